@@ -3,6 +3,8 @@
 #include "../../mem/kmalloc.h"
 #include "../../cmds/fat.h"
 #include "../../fs/fs.h"
+#include "../../fs/vfs/vfs.h"
+#include "../../fs/vfs/pcache.h"
 #include "../../string.h"
 #include "../../drivers/serial.h"
 #include <stddef.h>
@@ -149,18 +151,17 @@ static bool load_bmp_from_mem(const uint8_t* data, size_t size, icon_image_t* ou
     return true;
 }
 
+/* Decoded straight out of a page cache mapping: loading the same icon
+   again (or another window asking for it) does not touch the disk. */
 static bool load_bmp_from_fat(const char* path, icon_image_t* out) {
-    int32_t size = fat32_get_file_size(path);
-    if (size <= 0) return false;
-    uint8_t* data = (uint8_t*)kmalloc((size_t)size);
+    vnode_t* node = vfs_resolve(path);
+    if (!node) return false;
+    uint32_t size = 0;
+    const uint8_t* data = (const uint8_t*)vfs_mmap(node, 0, 0, &size);
+    vnode_put(node);
     if (!data) return false;
-    int rd = fat32_read_file(path, data, (uint32_t)size);
-    if (rd < size) {
-        kfree(data);
-        return false;
-    }
     bool ok = load_bmp_from_mem(data, (size_t)size, out);
-    kfree(data);
+    vfs_munmap((void*)data);
     return ok;
 }
 
@@ -4,11 +4,40 @@
 #include "../ui/flyui/theme.h"
 #include "app_manager.h"
 #include "../string.h"
+#include "../sched/pcb.h"
+#include "../sched/scheduler.h"
+#include "../time/timer.h"
 
 static window_t* task_win = NULL;
 
 static void draw_stats(surface_t* s);
 
+// Layout: apps list on top, scheduler tasks below
+#define APPS_LIST_BOTTOM 140
+#define TASKS_HEADER_Y 150
+#define TASKS_LIST_Y 168
+#define TASKS_ROW_H 16
+
+static const char* task_state_name(task_state_t st) {
+    switch (st) {
+        case TASK_READY: return "ready";
+        case TASK_RUNNING: return "run";
+        case TASK_SLEEPING: return "sleep";
+        case TASK_ZOMBIE: return "zombie";
+        default: return "?";
+    }
+}
+
+// n-th scheduler task in use (row order), NULL if none
+static pcb_t* task_row_pcb(int row) {
+    for (int tid = 0; tid < MAX_TASKS; tid++) {
+        pcb_t* p = pcb_get(tid);
+        if (!p || p->state == TASK_UNUSED) continue;
+        if (row-- == 0) return p;
+    }
+    return NULL;
+}
+
 static void task_close(window_t* win) {
     (void)win;
     if (task_win) {
@@ -85,7 +114,26 @@ static void draw_stats(surface_t* s) {
         
         y += 20;
         app = app->next;
-        if (y > (int)s->height - 60) break;
+        if (y > APPS_LIST_BOTTOM) break;
+    }
+
+    // Scheduler tasks: "#tid state prio P/B" (click a row to change base priority)
+    fly_draw_text(s, 10, TASKS_HEADER_Y, "Kernel Tasks (click: prio):", th->color_text);
+    y = TASKS_LIST_Y;
+    for (int row = 0; y <= h - 60 - TASKS_ROW_H; row++, y += TASKS_ROW_H) {
+        pcb_t* p = task_row_pcb(row);
+        if (!p) break;
+        char line[48];
+        char num[12];
+        strcpy(line, "#");
+        strcat(line, itoa_dec(num, (int32_t)p->tid));
+        strcat(line, " ");
+        strcat(line, task_state_name(p->state));
+        strcat(line, " prio ");
+        strcat(line, itoa_dec(num, p->prio));
+        strcat(line, "/");
+        strcat(line, itoa_dec(num, p->base_prio));
+        fly_draw_text(s, 14, y, line, th->color_text);
     }
     
     // "End Task" Button
@@ -120,8 +168,19 @@ bool task_manager_app_handle_event(input_event_t* ev) {
     if (ev->type == INPUT_MOUSE_CLICK && ev->pressed) {
         int lx = ev->mouse_x - task_win->x;
         int ly = ev->mouse_y - task_win->y;
+        // Kernel task row: cycle its base priority
+        if (ly >= TASKS_LIST_Y && ly < (int)task_win->surface->height - 60) {
+            pcb_t* p = task_row_pcb((ly - TASKS_LIST_Y) / TASKS_ROW_H);
+            if (p) {
+                scheduler_set_priority((int)p->tid, (p->base_prio + 1) % SCHED_PRIO_LEVELS);
+                draw_stats(task_win->surface);
+                wm_mark_dirty();
+            }
+            return true;
+        }
+
         // Select row
-        if (ly >= 28 && ly <= (int)task_win->surface->height - 60) {
+        if (ly >= 28 && ly <= APPS_LIST_BOTTOM + 16) {
             int idx = (ly - 30) / 20;
             int i = 0;
             app_info_t* app = app_get_list();
@@ -159,7 +218,14 @@ bool task_manager_app_handle_event(input_event_t* ev) {
 }
 
 void task_manager_app_update(void) {
-    /* No-op for now */
+    /* refresh task states/priorities twice a second */
+    static uint32_t last_ms = 0;
+    if (!task_win) return;
+    uint32_t now = timer_uptime_ms();
+    if (now - last_ms < 500) return;
+    last_ms = now;
+    draw_stats(task_win->surface);
+    wm_mark_dirty();
 }
 
 window_t* task_manager_app_get_window(void) {
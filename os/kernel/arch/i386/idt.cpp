@@ -26,6 +26,12 @@ void idt_set_gate(int num, uint32_t base, uint16_t sel, uint8_t flags)
     idt[num].flags     = flags;
 }
 
+/* AP-urile folosesc aceeași tabelă: doar lidt */
+extern "C" void idt_load(void)
+{
+    asm volatile("lidt %0" : : "m"(idtp));
+}
+
 /* IDT init + fallback stabil */
 extern "C" void idt_init()
 {
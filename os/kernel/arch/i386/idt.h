@@ -30,6 +30,9 @@ void idt_init(void);
 */
 void idt_set_gate(int num, uint32_t base, uint16_t sel, uint8_t flags);
 
+/* Încarcă IDT-ul comun pe CPU-ul curent (folosit de AP-uri) */
+void idt_load(void);
+
 #ifdef __cplusplus
 }
 #endif
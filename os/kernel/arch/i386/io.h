@@ -44,6 +44,15 @@ static inline uint32_t inl(uint16_t port) {
     return ret;
 }
 
+/* read/write count words from/to port into buf (rep insw / rep outsw) */
+static inline void insw(uint16_t port, void* buf, uint32_t count) {
+    asm volatile ("rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buf, uint32_t count) {
+    asm volatile ("rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
 /* legacy io wait (approx 400ns) — write to port 0x80 */
 static inline void io_wait(void) {
     asm volatile ("outb %%al, $0x80" : : "a"(0));
@@ -39,7 +39,7 @@ static int sys_write(int fd, const char *s, uint32_t size) {
   if (!f || !f->node || !f->node->ops || !f->node->ops->write)
     return -1;
 
-  int bytes = f->node->ops->write(f->node, f->offset, (const uint8_t *)s, size);
+  int bytes = vfs_write(f->node, f->offset, s, size);
   if (bytes > 0) {
     f->offset += bytes;
   }
@@ -52,24 +52,31 @@ static int sys_open(const char *path, int flags) {
     return -1;
 
   if (node->ops && node->ops->open) {
-    if (node->ops->open(node) < 0)
+    if (node->ops->open(node) < 0) {
+      vnode_put(node);
       return -1;
+    }
   }
 
   pcb_t *cur = pcb_get_current();
-  if (!cur)
+  if (!cur) {
+    vnode_put(node);
     return -1;
+  }
 
   for (int i = 0; i < MAX_FILES_PER_PROCESS; i++) {
     if (cur->files[i] == NULL) {
       file_t *f = (file_t *)kmalloc(sizeof(file_t));
-      f->node = node;
+      if (!f)
+        break;
+      f->node = node; /* keeps the reference from vfs_resolve */
       f->offset = 0;
       f->flags = flags;
       cur->files[i] = f;
       return i;
     }
   }
+  vnode_put(node);
   return -1;
 }
 
@@ -81,7 +88,7 @@ static int sys_read(int fd, void *buf, uint32_t size) {
   if (!f || !f->node || !f->node->ops || !f->node->ops->read)
     return -1;
 
-  int bytes = f->node->ops->read(f->node, f->offset, (uint8_t *)buf, size);
+  int bytes = vfs_read(f->node, f->offset, buf, size);
   if (bytes > 0) {
     f->offset += bytes;
   }
@@ -96,6 +103,7 @@ static int sys_close(int fd) {
   if (!f)
     return -1;
 
+  vnode_put(f->node);
   kfree(f);
   cur->files[fd] = NULL;
   return 0;
@@ -0,0 +1,51 @@
+// kernel/cmds/bcache.cpp
+// bcache [flush|reset|size <blocks>] : buffer cache statistics and control
+#include "bcache.h"
+#include "../terminal.h"
+#include "../string.h"
+#include "../storage/bcache.h"
+#include <stdint.h>
+
+extern "C" int cmd_bcache(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "flush") == 0) {
+        int r = bcache_flush(0);
+        terminal_printf("bcache: flush %s\n", r == 0 ? "done" : "failed");
+        return r;
+    }
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        bcache_reset_stats();
+        terminal_writestring("bcache: statistics reset\n");
+        return 0;
+    }
+    if (argc >= 3 && strcmp(argv[1], "size") == 0) {
+        int n = atoi(argv[2]);
+        if (n < 0) {
+            terminal_writestring("bcache: size must be >= 0 (0 disables the cache)\n");
+            return -1;
+        }
+        int r = bcache_init((uint32_t)n);
+        if (r != 0) terminal_writestring("bcache: not enough memory, cache disabled\n");
+        return r;
+    }
+    if (argc >= 2) {
+        terminal_writestring("usage: bcache [flush|reset|size <blocks>]\n");
+        return -1;
+    }
+
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    if (!bcache_enabled()) {
+        terminal_writestring("bcache: disabled\n");
+        return 0;
+    }
+    uint32_t lookups = st.hits + st.misses;
+    uint32_t pct = lookups ? (uint32_t)(((uint64_t)st.hits * 100) / lookups) : 0;
+    terminal_printf("blocks: %u (%u KB), used %u, dirty %u\n",
+                    st.nblocks, st.nblocks / 2, st.used, st.dirty);
+    terminal_printf("hits: %u  misses: %u  (%u%% hit)\n", st.hits, st.misses, pct);
+    terminal_printf("evictions: %u  writebacks: %u  bypass: %u\n",
+                    st.evictions, st.writebacks, st.bypass);
+    terminal_printf("read-ahead: %u sectors, %u used  write-behind: %u sectors\n",
+                    st.readahead, st.ra_hits, st.writebehind);
+    return 0;
+}
@@ -0,0 +1,334 @@
+// kernel/cmds/blkbench.cpp
+// blkbench [dev] [rw=..] [bs=4k] [iodepth=1] [size=64m] [offset=1m] [runtime=10]
+//          [cache=off|on] [pio] [force]
+// fio-style workloads against a block device: IOPS, bandwidth and
+// completion latency percentiles. cache=off goes through io_sched straight
+// to the driver (iodepth requests in flight), cache=on through the buffer
+// cache (synchronous, iodepth 1). pio keeps an ATA disk off bus-master DMA
+// for the run, so PIO, DMA and AHCI can be compared on one disk. Each run also logs one BLKBENCH line to
+// serial for tools/bench/blkbench.sh. The region starts 1 MB in by default:
+// sector 0 holds the MBR, which the drivers refuse to overwrite.
+#include "blkbench.h"
+#include "../terminal.h"
+#include "../string.h"
+#include "../mem/kmalloc.h"
+#include "../hardware/hpet.h"
+#include "../time/timer.h"
+#include "../storage/block.h"
+#include "../storage/bcache.h"
+#include "../storage/io_sched.h"
+#include "../storage/ata.h"
+#include <stdint.h>
+#include <stddef.h>
+
+extern "C" void serial(const char *fmt, ...);
+
+#define BB_MAX_DEPTH    32
+#define BB_MAX_SAMPLES  65536u    /* latencies kept; also the I/O cap per run */
+#define BB_MAX_BS       (1024u * 1024u)
+#define BB_GRACE_MS     30000u    /* past runtime: give up on lost completions */
+
+enum { BB_READ, BB_WRITE, BB_RANDREAD, BB_RANDWRITE, BB_NWORKLOADS, BB_ALL = BB_NWORKLOADS };
+static const char* const bb_names[BB_NWORKLOADS] = { "read", "write", "randread", "randwrite" };
+
+typedef struct {
+    block_device_t* dev;
+    uint32_t bs;           /* sectors per I/O */
+    uint32_t depth;
+    uint64_t start;        /* first sector of the region */
+    uint64_t sectors;      /* region length, a multiple of bs */
+    uint32_t runtime_ms;
+    int cache;
+    int pio;               /* ATA DMA switched off for the run */
+} bb_opts_t;
+
+typedef struct {
+    void* buf;
+    volatile int busy;
+    int status;
+    uint64_t t0;           /* 0: slot idle */
+    uint64_t t1;
+} bb_slot_t;
+
+static uint32_t bb_rng = 0x2545F491u;
+
+/* xorshift32: the same offsets on every run */
+static uint32_t bb_rand(void) {
+    bb_rng ^= bb_rng << 13;
+    bb_rng ^= bb_rng >> 17;
+    bb_rng ^= bb_rng << 5;
+    return bb_rng;
+}
+
+static uint64_t bb_now_ns(void) {
+    uint64_t ns = hpet_time_ns();
+    return ns ? ns : timer_now_ns();
+}
+
+/* "4096", "4k", "64m", "1g" -> bytes; 0 if malformed */
+static uint64_t bb_parse_size(const char* s) {
+    uint64_t v = 0;
+    if (*s < '0' || *s > '9') return 0;
+    while (*s >= '0' && *s <= '9') v = v * 10 + (uint64_t)(*s++ - '0');
+    switch (*s) {
+    case 'k': case 'K': v <<= 10; s++; break;
+    case 'm': case 'M': v <<= 20; s++; break;
+    case 'g': case 'G': v <<= 30; s++; break;
+    }
+    return *s ? 0 : v;
+}
+
+/* completion, possibly in IRQ context: stamp it and hand the slot back */
+static void bb_done(int status, void* ctx) {
+    bb_slot_t* s = (bb_slot_t*)ctx;
+    s->t1 = bb_now_ns();
+    s->status = status;
+    __atomic_store_n(&s->busy, 0, __ATOMIC_RELEASE);
+}
+
+static void bb_sort(uint32_t* a, uint32_t n) {
+    /* heapsort: no recursion, no extra memory */
+    for (uint32_t i = n / 2; i-- > 0;) {
+        for (uint32_t r = i, c; (c = 2 * r + 1) < n; r = c) {
+            if (c + 1 < n && a[c + 1] > a[c]) c++;
+            if (a[r] >= a[c]) break;
+            uint32_t t = a[r]; a[r] = a[c]; a[c] = t;
+        }
+    }
+    for (uint32_t end = n; end-- > 1;) {
+        uint32_t t = a[0]; a[0] = a[end]; a[end] = t;
+        for (uint32_t r = 0, c; (c = 2 * r + 1) < end; r = c) {
+            if (c + 1 < end && a[c + 1] > a[c]) c++;
+            if (a[r] >= a[c]) break;
+            t = a[r]; a[r] = a[c]; a[c] = t;
+        }
+    }
+}
+
+/* latency at a per-mille rank of the sorted samples */
+static uint32_t bb_pct(const uint32_t* lat, uint32_t n, uint32_t permille) {
+    return lat[(uint32_t)(((uint64_t)(n - 1) * permille) / 1000u)];
+}
+
+static void bb_report(const bb_opts_t* o, int wl, uint32_t ios, uint32_t errors,
+                      uint64_t ns, uint32_t* lat) {
+    if (ns == 0) ns = 1;
+    uint64_t kb = (uint64_t)ios * o->bs / 2;
+    uint32_t iops = (uint32_t)((uint64_t)ios * 1000000000ull / ns);
+    uint32_t kbps = (uint32_t)(kb * 1000000000ull / ns);
+    uint32_t ms = (uint32_t)(ns / 1000000u);
+
+    terminal_printf("%s: bs=%uk iodepth=%u cache=%s%s  ios=%u errors=%u time=%u ms\n",
+                    bb_names[wl], o->bs / 2, o->depth, o->cache ? "on" : "off",
+                    o->pio ? " pio" : "", ios, errors, ms);
+    terminal_printf("  iops=%u  bw=%u.%u MB/s\n", iops, kbps / 1024u, (kbps % 1024u) * 10u / 1024u);
+    if (ios == 0) return;
+
+    bb_sort(lat, ios);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < ios; i++) sum += lat[i];
+    uint32_t avg = (uint32_t)(sum / ios);
+    terminal_printf("  lat (us): min=%u avg=%u max=%u\n", lat[0], avg, lat[ios - 1]);
+    terminal_printf("  p50=%u p90=%u p99=%u p99.9=%u\n", bb_pct(lat, ios, 500),
+                    bb_pct(lat, ios, 900), bb_pct(lat, ios, 990), bb_pct(lat, ios, 999));
+
+    serial("BLKBENCH dev=%s rw=%s bs=%u qd=%u cache=%s pio=%s ios=%u err=%u ms=%u iops=%u "
+           "kbps=%u min=%u avg=%u p50=%u p90=%u p99=%u p999=%u max=%u\n",
+           o->dev->name, bb_names[wl], o->bs * 512u, o->depth, o->cache ? "on" : "off",
+           o->pio ? "on" : "off", ios, errors, ms, iops, kbps, lat[0], avg, bb_pct(lat, ios, 500),
+           bb_pct(lat, ios, 900), bb_pct(lat, ios, 990), bb_pct(lat, ios, 999), lat[ios - 1]);
+}
+
+/* One workload. -1 if completions stopped arriving: the slots are then
+   still owned by the driver and must not be freed. */
+static int bb_run(const bb_opts_t* o, int wl, bb_slot_t* slots, uint32_t* lat) {
+    int write = (wl == BB_WRITE || wl == BB_RANDWRITE);
+    int rnd = (wl == BB_RANDREAD || wl == BB_RANDWRITE);
+    uint64_t blocks = o->sectors / o->bs;
+    uint32_t max_ios = blocks < BB_MAX_SAMPLES ? (uint32_t)blocks : BB_MAX_SAMPLES;
+    uint64_t next = 0;
+    uint32_t issued = 0, ios = 0, errors = 0;
+    int stop = 0;
+
+    /* start cold, and keep cached copies from shadowing what we write */
+    bcache_invalidate(o->dev);
+
+    uint64_t t_start = bb_now_ns();
+    uint64_t deadline = t_start + (uint64_t)o->runtime_ms * 1000000u;
+    while (ios < issued || !stop) {
+        for (uint32_t i = 0; i < o->depth; i++) {
+            bb_slot_t* s = &slots[i];
+            if (__atomic_load_n(&s->busy, __ATOMIC_ACQUIRE)) continue;
+            if (s->t0) {
+                uint64_t us = (s->t1 - s->t0) / 1000u;
+                lat[ios++] = us > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)us;
+                if (s->status != 0) errors++;
+                s->t0 = 0;
+            }
+            if (stop || issued >= max_ios) continue;
+
+            uint64_t blk = rnd ? (((uint64_t)bb_rand() << 32) | bb_rand()) % blocks : next;
+            uint64_t lba = o->start + blk * o->bs;
+            s->t0 = bb_now_ns();
+            if (o->cache) {
+                int r = write ? block_write(o->dev, lba, o->bs, s->buf)
+                              : block_read(o->dev, lba, o->bs, s->buf);
+                bb_done(r, s);
+            } else {
+                s->busy = 1;
+                if (io_sched_submit_dev(o->dev, write ? IO_OP_WRITE : IO_OP_READ, lba, o->bs,
+                                        s->buf, bb_done, s) != 0) {
+                    /* request pool exhausted: retry once completions free some */
+                    s->busy = 0;
+                    s->t0 = 0;
+                    break;
+                }
+            }
+            issued++;
+            next++;
+        }
+        uint64_t now = bb_now_ns();
+        if (issued >= max_ios || now >= deadline) stop = 1;
+        if (now >= deadline + (uint64_t)BB_GRACE_MS * 1000000u) {
+            terminal_printf("blkbench: %u I/O(s) never completed, giving up\n", issued - ios);
+            return -1;
+        }
+        io_sched_poll();
+    }
+    /* written data counts once it is on the disk */
+    if (write && o->cache && bcache_flush(o->dev) != 0) errors++;
+    uint64_t ns = bb_now_ns() - t_start;
+    if (write && !o->cache) bcache_invalidate(o->dev);
+
+    bb_report(o, wl, ios, errors, ns, lat);
+    return 0;
+}
+
+static void bb_usage(void) {
+    terminal_writestring("usage: blkbench [dev] [rw=read|write|randread|randwrite|all] [bs=4k]\n"
+                         "                [iodepth=1] [size=64m] [offset=1m] [runtime=10]\n"
+                         "                [cache=off|on] [pio] [force]\n"
+                         "  pio: ATA disks only, bypass bus-master DMA for the run\n"
+                         "  write workloads destroy data in the region and need 'force';\n"
+                         "  they cannot include sector 0 (MBR)\n");
+}
+
+extern "C" int cmd_blkbench(int argc, char** argv) {
+    const char* name = 0;
+    int wl = BB_RANDREAD, force = 0, cache = 0, pio = 0;
+    uint64_t bs = 4096, size = 64u << 20, offset = 1u << 20;
+    uint32_t depth = 1, runtime = 10;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (strncmp(a, "rw=", 3) == 0) {
+            wl = -1;
+            if (strcmp(a + 3, "all") == 0) wl = BB_ALL;
+            for (int k = 0; k < BB_NWORKLOADS; k++)
+                if (strcmp(a + 3, bb_names[k]) == 0) wl = k;
+            if (wl < 0) { bb_usage(); return -1; }
+        } else if (strncmp(a, "bs=", 3) == 0) {
+            bs = bb_parse_size(a + 3);
+        } else if (strncmp(a, "size=", 5) == 0) {
+            size = bb_parse_size(a + 5);
+        } else if (strncmp(a, "offset=", 7) == 0) {
+            offset = bb_parse_size(a + 7);
+            if (offset == 0 && strcmp(a + 7, "0") != 0) { bb_usage(); return -1; }
+        } else if (strncmp(a, "iodepth=", 8) == 0) {
+            depth = (uint32_t)atoi(a + 8);
+        } else if (strncmp(a, "runtime=", 8) == 0) {
+            runtime = (uint32_t)atoi(a + 8);
+        } else if (strcmp(a, "cache=on") == 0) {
+            cache = 1;
+        } else if (strcmp(a, "cache=off") == 0) {
+            cache = 0;
+        } else if (strcmp(a, "pio") == 0) {
+            pio = 1;
+        } else if (strcmp(a, "force") == 0) {
+            force = 1;
+        } else if (!name && !strchr(a, '=')) {
+            name = a;
+        } else {
+            bb_usage();
+            return -1;
+        }
+    }
+
+    if (bs == 0 || bs % 512 || bs > BB_MAX_BS || size == 0 || offset % 512 ||
+        depth == 0 || depth > BB_MAX_DEPTH || runtime == 0) {
+        terminal_printf("blkbench: bs must be a multiple of 512 up to 1m, iodepth 1..%u\n",
+                        BB_MAX_DEPTH);
+        return -1;
+    }
+
+    bb_opts_t o;
+    o.dev = name ? block_get(name) : block_get("ahci0");
+    if (!o.dev && !name) o.dev = block_get("ata0");
+    if (!o.dev) {
+        terminal_printf("blkbench: no block device %s\n", name ? name : "(ahci0/ata0)");
+        return -1;
+    }
+    o.bs = (uint32_t)(bs / 512);
+    o.depth = cache ? 1 : depth;
+    o.start = offset / 512;
+    o.runtime_ms = runtime * 1000u;
+    o.cache = cache;
+    o.pio = pio;
+    if (o.start >= o.dev->sector_count) {
+        terminal_writestring("blkbench: offset past the end of the device\n");
+        return -1;
+    }
+    o.sectors = size / 512;
+    if (o.sectors > o.dev->sector_count - o.start) o.sectors = o.dev->sector_count - o.start;
+    o.sectors -= o.sectors % o.bs;
+    if (o.sectors == 0) {
+        terminal_writestring("blkbench: region smaller than one block\n");
+        return -1;
+    }
+    int writes = (wl == BB_ALL || wl == BB_WRITE || wl == BB_RANDWRITE);
+    if (writes && o.start == 0) {
+        terminal_writestring("blkbench: write workloads cannot start at sector 0 (MBR), use offset=\n");
+        return -1;
+    }
+    if (writes && !force) {
+        terminal_printf("blkbench: write workloads overwrite %s sectors %u..%u; add 'force'\n",
+                        o.dev->name, (uint32_t)o.start, (uint32_t)(o.start + o.sectors - 1));
+        return -1;
+    }
+    if (cache && depth > 1)
+        terminal_writestring("blkbench: cache=on is synchronous, running at iodepth=1\n");
+    if (pio && ata_set_pio(o.dev, 1) != 0) {
+        terminal_printf("blkbench: pio needs an ATA disk, %s is not one\n", o.dev->name);
+        return -1;
+    }
+
+    bb_slot_t slots[BB_MAX_DEPTH];
+    uint32_t* lat = (uint32_t*)kmalloc(BB_MAX_SAMPLES * sizeof(uint32_t));
+    int ok = lat != 0;
+    for (uint32_t i = 0; i < o.depth; i++) {
+        slots[i].busy = 0;
+        slots[i].t0 = 0;
+        slots[i].buf = ok ? kmalloc_aligned(o.bs * 512u, 4096) : 0;
+        if (!slots[i].buf) ok = 0;
+        else memset(slots[i].buf, 0xA5 ^ (int)i, o.bs * 512u);
+    }
+    if (!ok) {
+        terminal_writestring("blkbench: out of memory\n");
+    } else {
+        terminal_printf("blkbench: %s, sectors %u..%u (%u MB), timer=%s\n", o.dev->name,
+                        (uint32_t)o.start, (uint32_t)(o.start + o.sectors - 1),
+                        (uint32_t)(o.sectors / 2048), hpet_is_active() ? "hpet" : "pit");
+        for (int k = (wl == BB_ALL ? 0 : wl); k <= (wl == BB_ALL ? BB_NWORKLOADS - 1 : wl); k++) {
+            if (bb_run(&o, k, slots, lat) != 0) {
+                if (pio) ata_set_pio(o.dev, 0);
+                return -1; /* buffers still in flight */
+            }
+        }
+    }
+    if (pio) ata_set_pio(o.dev, 0);
+
+    for (uint32_t i = 0; i < o.depth; i++)
+        if (slots[i].buf) kfree(slots[i].buf);
+    if (lat) kfree(lat);
+    return ok ? 0 : -1;
+}
@@ -5,9 +5,7 @@
 #include "../mem/kmalloc.h"
 #include "fat.h"
 #include "pathutil.h"
-
-/* FAT32 Driver API */
-extern "C" int fat32_read_file(const char* path, void* buf, uint32_t max_size);
+#include "../fs/vfs/vfs.h"
 
 extern "C" void cmd_cat(int argc, char** argv) {
     if (argc < 2) {
@@ -17,21 +15,31 @@ extern "C" void cmd_cat(int argc, char** argv) {
     char path[256];
     cmd_resolve_path(argv[1], path, sizeof(path));
 
-    /* Try Disk (FAT32) first */
+    /* Try Disk (FAT32) first, through the VFS page cache: the file is
+       printed 4 KB at a time and a second cat of it stays in RAM */
     fat_automount();
 
-    char *buf = (char*)kmalloc(4096);
-    if (buf) {
-        int bytes = fat32_read_file(path, buf, 4095);
-        if (bytes >= 0) {
-            buf[bytes] = 0;
-            terminal_writestring(buf);
-            terminal_writestring("\n");
+    vnode_t *vn = vfs_resolve(path);
+    if (vn && vn->type == VNODE_FILE) {
+        char *buf = (char*)kmalloc(4096);
+        if (buf) {
+            uint32_t off = 0;
+            int bytes;
+            while ((bytes = vfs_read(vn, off, buf, 4095)) > 0) {
+                buf[bytes] = 0;
+                terminal_writestring(buf);
+                off += bytes;
+            }
             kfree(buf);
-            return;
+            vnode_put(vn);
+            if (bytes == 0 || off > 0) {
+                terminal_writestring("\n");
+                return;
+            }
+            vn = nullptr;
         }
-        kfree(buf);
     }
+    vnode_put(vn);
 
     /* Fallback to RAMFS */
     const FSNode* node = fs_find(path);
@@ -64,25 +64,25 @@ static const char* get_part_type_name(uint8_t type) {
 
 int disk_read_sector(uint32_t lba, uint8_t* buf) {
     block_device_t* bd = get_main_disk();
-    if (bd) return bd->read(bd, lba, 1, buf);
+    if (bd) return block_read(bd, lba, 1, buf);
     return -1;
 }
 
 int disk_write_sector(uint32_t lba, const uint8_t* buf) {
     block_device_t* bd = get_main_disk();
-    if (bd) return bd->write(bd, lba, 1, buf);
+    if (bd) return block_write(bd, lba, 1, buf);
     return -1;
 }
 
 int disk_read_sectors(uint32_t lba, uint32_t count, uint8_t* buf) {
     block_device_t* bd = get_main_disk();
-    if (bd) return bd->read(bd, lba, count, buf);
+    if (bd) return block_read(bd, lba, count, buf);
     return -1;
 }
 
 int disk_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buf) {
     block_device_t* bd = get_main_disk();
-    if (bd) return bd->write(bd, lba, count, buf);
+    if (bd) return block_write(bd, lba, count, buf);
     return -1;
 }
 
@@ -112,11 +112,18 @@ static void cmd_lsblk(void) {
         }
     }
 
-    block_device_t* ata = block_get("ata0");
-    if (ata) {
-        terminal_printf("%s     3:0    0  ", ata->name);
-        print_size(ata->sector_count);
-        terminal_writestring("  0 disk \n");
+    /* legacy IDE: hda/hdb on major 3, hdc/hdd on major 22 */
+    static const char* ata_majmin[4] = { " 3:0 ", " 3:64", "22:0 ", "22:64" };
+    for (int i = 0; i < 4; i++) {
+        name[0]='a'; name[1]='t'; name[2]='a';
+        name[3]='0'+i; name[4]=0;
+
+        block_device_t* ata = block_get(name);
+        if (ata) {
+            terminal_printf("%s     %s   0  ", ata->name, ata_majmin[i]);
+            print_size(ata->sector_count);
+            terminal_writestring("  0 disk \n");
+        }
     }
 }
 
@@ -137,7 +144,7 @@ static void cmd_fdisk_list(void) {
     terminal_writestring("Disklabel type: dos\n\n");
 
     uint8_t* mbr = (uint8_t*)kmalloc(512);
-    if (!mbr || bd->read(bd, 0, 1, mbr) != 0) {
+    if (!mbr || block_read(bd, 0, 1, mbr) != 0) {
         terminal_writestring("fdisk: unable to read MBR\n");
         if(mbr) kfree(mbr);
         return;
@@ -175,7 +182,7 @@ void disk_probe_partitions(void) {
     if (!bd) return;
 
     uint8_t* mbr = (uint8_t*)kmalloc(512);
-    if (!mbr || bd->read(bd, 0, 1, mbr) != 0) {
+    if (!mbr || block_read(bd, 0, 1, mbr) != 0) {
         if(mbr) kfree(mbr);
         return;
     }
@@ -215,14 +222,16 @@ void disk_probe_partitions(void) {
     terminal_printf("Probed %d partitions. Use 'disk list' to see details.\n", found);
 }
 
-/* Helper to zero sectors */
+/* Helper to zero sectors (through the buffer cache, so no stale cached
+   copy survives the wipe; written back before returning) */
 static void disk_zero_sectors(block_device_t* bd, uint32_t start_lba, uint32_t count) {
     uint8_t* zero_buf = (uint8_t*)kmalloc(512);
     if (!zero_buf) return;
     memset(zero_buf, 0, 512);
     for (uint32_t i = 0; i < count; i++) {
-        bd->write(bd, start_lba + i, 1, zero_buf);
+        block_write(bd, start_lba + i, 1, zero_buf);
     }
+    block_sync(bd);
     kfree(zero_buf);
 }
 
@@ -251,8 +260,10 @@ static void cmd_mklabel(void) {
     mbr[510] = 0x55;
     mbr[511] = 0xAA;
 
+    /* write back while the MBR guard is lifted */
     ata_set_allow_mbr_write(1);
-    int r = bd->write(bd, 0, 1, mbr);
+    int r = block_write(bd, 0, 1, mbr);
+    if (r == 0) r = block_sync(bd);
     ata_set_allow_mbr_write(0);
 
     if (r == 0) {
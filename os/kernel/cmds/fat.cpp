@@ -5,6 +5,9 @@
 #include "../string.h"
 #include "../terminal.h"
 #include "disk.h" // Acces la g_assigns
+#include "../debug/trace.h"
+#include "../fs/fat/fat_vfs.h"
+#include "../fs/vfs/mount.h"
 
 extern void terminal_printf(const char *fmt, ...);
 extern "C" void serial(const char *fmt, ...);
@@ -12,11 +15,32 @@ extern "C" void serial(const char *fmt, ...);
 static bool is_fat_initialized = false;
 static uint32_t current_lba = 0;
 static char current_letter = 0;
-
+/* bumped by everything that changes the mount, a FAT or a directory:
+   open handles and the cached geometry compare it before trusting
+   what they remember */
+static uint32_t fat_gen = 1;
+
+static void fat_changed(void) { fat_gen++; }
+
+static void fat_space_drop(void);
+static void fat_dcache_drop(void);
+
+/* The mounted volume becomes the VFS root on purpose: shell paths (cwd,
+   cmd_resolve_path) are FAT volume paths, and the VFS users (exec, cat,
+   gcc, sys_open, icons) resolve those same paths. The ramfs root it
+   replaces is an empty placeholder with no lookup or entries; boot
+   modules are read through ramfs_read_file(), not the VFS, and stay
+   available. */
 extern "C" void fat32_set_mounted(uint32_t lba, char letter) {
+  fat_changed();
+  fat_space_drop();
+  fat_dcache_drop();
+  fat_vfs_changed_all();
   is_fat_initialized = true;
   current_lba = lba;
   current_letter = letter;
+  vfs_mount("/", fat_vfs_root());
+  serial("[FAT] partition %c is now the VFS root\n", letter);
 }
 
 /* --- FAT32 Structures & Helpers (Local Implementation) --- */
@@ -350,14 +374,111 @@ static void to_dos_name_component(const char *name, int len, char *dst) {
   }
 }
 
-/* Helper to find an entry in a directory cluster */
-static int find_in_cluster(uint32_t dir_cluster, const char *name, int name_len,
-                           uint32_t data_start, uint32_t fat_start,
-                           uint32_t spc, uint32_t bps, uint32_t *out_cluster,
-                           uint32_t *out_size, uint32_t *out_sector,
-                           uint32_t *out_offset, bool *out_is_dir) {
-  if (name_len <= 0 || name_len > 255)
-    return -1;
+static uint32_t fat_get_next_cluster(uint32_t cluster, uint32_t fat_start,
+                                     uint16_t bps);
+static int fat_read_next_cluster(uint32_t cluster, uint32_t fat_start,
+                                 uint16_t bps, uint32_t *next);
+
+/* --- Dentry cache ---
+   Remembers what find_in_cluster() found for (directory cluster, name),
+   name case-folded, including "no such entry", so the components of hot
+   paths resolve with a hash probe instead of a directory scan. Any change
+   to a directory drops everything cached for it (a new entry can answer
+   to more than one spelling through its short alias), mkdir also drops
+   its new cluster, and mount and format drop the lot. Names longer than
+   DCACHE_NAME - 1 are not cached. */
+
+#define DCACHE_SETS 128 /* power of two */
+#define DCACHE_WAYS 4
+#define DCACHE_NAME 64
+
+struct fat_dentry {
+  uint32_t parent;
+  uint32_t hash;
+  uint32_t cluster;
+  uint32_t size;
+  uint32_t sector; /* LBA and index of the short entry */
+  uint32_t offset;
+  uint8_t valid;
+  uint8_t negative;
+  uint8_t attr;
+  uint8_t len;
+  char name[DCACHE_NAME]; /* case-folded */
+};
+
+static struct fat_dentry g_dcache[DCACHE_SETS][DCACHE_WAYS];
+static uint8_t g_dcache_victim[DCACHE_SETS];
+static uint32_t g_dcache_hits, g_dcache_misses;
+
+static inline char fold_char(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+}
+
+static uint32_t dcache_hash(uint32_t parent, const char *name, int len) {
+  uint32_t h = 2166136261u ^ parent;
+  for (int i = 0; i < len; i++)
+    h = (h ^ (uint8_t)fold_char(name[i])) * 16777619u;
+  return h;
+}
+
+static bool dcache_match(const struct fat_dentry *d, uint32_t parent,
+                         uint32_t hash, const char *name, int len) {
+  if (!d->valid || d->parent != parent || d->hash != hash || d->len != len)
+    return false;
+  for (int i = 0; i < len; i++)
+    if (d->name[i] != fold_char(name[i]))
+      return false;
+  return true;
+}
+
+static struct fat_dentry *dcache_lookup(uint32_t parent, const char *name,
+                                        int len, uint32_t hash) {
+  struct fat_dentry *set = g_dcache[hash & (DCACHE_SETS - 1)];
+  for (int w = 0; w < DCACHE_WAYS; w++)
+    if (dcache_match(&set[w], parent, hash, name, len))
+      return &set[w];
+  return NULL;
+}
+
+static struct fat_dentry *dcache_insert(uint32_t parent, const char *name,
+                                        int len, uint32_t hash) {
+  uint32_t s = hash & (DCACHE_SETS - 1);
+  struct fat_dentry *d = NULL;
+  for (int w = 0; w < DCACHE_WAYS && !d; w++)
+    if (!g_dcache[s][w].valid)
+      d = &g_dcache[s][w];
+  if (!d)
+    d = &g_dcache[s][g_dcache_victim[s]++ % DCACHE_WAYS];
+  memset(d, 0, sizeof(*d));
+  d->parent = parent;
+  d->hash = hash;
+  d->len = (uint8_t)len;
+  for (int i = 0; i < len; i++)
+    d->name[i] = fold_char(name[i]);
+  d->valid = 1;
+  return d;
+}
+
+/* forget everything cached under directory cluster dir */
+static void fat_dcache_purge_dir(uint32_t dir) {
+  for (int s = 0; s < DCACHE_SETS; s++)
+    for (int w = 0; w < DCACHE_WAYS; w++)
+      if (g_dcache[s][w].parent == dir)
+        g_dcache[s][w].valid = 0;
+}
+
+static void fat_dcache_drop(void) {
+  memset(g_dcache, 0, sizeof(g_dcache));
+}
+
+/* Scan a directory for an entry: 0 found, -1 not there, -2 no memory,
+   -3 read error (directory or FAT sector) */
+static int find_in_cluster_scan(uint32_t dir_cluster, const char *name,
+                                int name_len, uint32_t data_start,
+                                uint32_t fat_start, uint32_t spc, uint32_t bps,
+                                uint32_t *out_cluster, uint32_t *out_size,
+                                uint32_t *out_sector, uint32_t *out_offset,
+                                uint8_t *out_attr) {
   char name_buf[256];
   copy_component(name_buf, sizeof(name_buf), name, name_len);
 
@@ -370,13 +491,16 @@ static int find_in_cluster(uint32_t dir_cluster, const char *name, int name_len,
 
   uint8_t *sector = (uint8_t *)kmalloc(512);
   if (!sector)
-    return -1;
+    return -2;
 
   uint32_t current_cluster = dir_cluster;
   while (current_cluster < 0x0FFFFFF8) {
     uint32_t cluster_lba = data_start + (current_cluster - 2) * spc;
     for (int i = 0; i < (int)spc; i++) {
-      disk_read_sector(cluster_lba + i, sector);
+      if (disk_read_sector(cluster_lba + i, sector) != 0) {
+        kfree(sector);
+        return -3;
+      }
       struct fat_dir_entry *entries = (struct fat_dir_entry *)sector;
       for (int j = 0; j < 512 / 32; j++) {
         if (entries[j].name[0] == 0) {
@@ -415,8 +539,8 @@ static int find_in_cluster(uint32_t dir_cluster, const char *name, int name_len,
               *out_sector = cluster_lba + i;
             if (out_offset)
               *out_offset = j;
-            if (out_is_dir)
-              *out_is_dir = (entries[j].attr & 0x10) ? true : false;
+            if (out_attr)
+              *out_attr = entries[j].attr;
             kfree(sector);
             return 0;
           }
@@ -436,8 +560,8 @@ static int find_in_cluster(uint32_t dir_cluster, const char *name, int name_len,
             *out_sector = cluster_lba + i;
           if (out_offset)
             *out_offset = j;
-          if (out_is_dir)
-            *out_is_dir = (entries[j].attr & 0x10) ? true : false;
+          if (out_attr)
+            *out_attr = entries[j].attr;
           kfree(sector);
           return 0;
         }
@@ -445,15 +569,72 @@ static int find_in_cluster(uint32_t dir_cluster, const char *name, int name_len,
     }
 
     /* Next cluster */
-    uint32_t fat_sector = fat_start + (current_cluster * 4) / bps;
-    uint32_t fat_offset = (current_cluster * 4) % bps;
-    disk_read_sector(fat_sector, sector);
-    current_cluster = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
+    if (fat_read_next_cluster(current_cluster, fat_start, (uint16_t)bps,
+                              &current_cluster) != 0) {
+      kfree(sector);
+      return -3;
+    }
   }
   kfree(sector);
   return -1;
 }
 
+static int find_in_cluster(uint32_t dir_cluster, const char *name, int name_len,
+                           uint32_t data_start, uint32_t fat_start,
+                           uint32_t spc, uint32_t bps, uint32_t *out_cluster,
+                           uint32_t *out_size, uint32_t *out_sector,
+                           uint32_t *out_offset, bool *out_is_dir) {
+  if (name_len <= 0 || name_len > 255)
+    return -1;
+  uint32_t cluster = 0, size = 0, sector = 0, offset = 0;
+  uint8_t attr = 0;
+  uint32_t hash = 0;
+  struct fat_dentry *d = NULL;
+  if (name_len < DCACHE_NAME) {
+    hash = dcache_hash(dir_cluster, name, name_len);
+    d = dcache_lookup(dir_cluster, name, name_len, hash);
+  }
+  if (d) {
+    g_dcache_hits++;
+    if (d->negative)
+      return -1;
+    cluster = d->cluster;
+    size = d->size;
+    sector = d->sector;
+    offset = d->offset;
+    attr = d->attr;
+  } else {
+    g_dcache_misses++;
+    int rc = find_in_cluster_scan(dir_cluster, name, name_len, data_start,
+                                  fat_start, spc, bps, &cluster, &size, &sector,
+                                  &offset, &attr);
+    if (rc == -2 || rc == -3)
+      return -1; /* no memory or I/O error: nothing learnt */
+    if (name_len < DCACHE_NAME) {
+      d = dcache_insert(dir_cluster, name, name_len, hash);
+      d->negative = rc != 0;
+      d->cluster = cluster;
+      d->size = size;
+      d->sector = sector;
+      d->offset = offset;
+      d->attr = attr;
+    }
+    if (rc != 0)
+      return -1;
+  }
+  if (out_cluster)
+    *out_cluster = cluster;
+  if (out_size)
+    *out_size = size;
+  if (out_sector)
+    *out_sector = sector;
+  if (out_offset)
+    *out_offset = offset;
+  if (out_is_dir)
+    *out_is_dir = (attr & 0x10) ? true : false;
+  return 0;
+}
+
 static bool short_name_exists(const uint8_t *dirbuf, int total_entries,
                               const char short_name[11]) {
   const struct fat_dir_entry *entries = (const struct fat_dir_entry *)dirbuf;
@@ -470,9 +651,6 @@ static bool short_name_exists(const uint8_t *dirbuf, int total_entries,
   return false;
 }
 
-static uint32_t fat_get_next_cluster(uint32_t cluster, uint32_t fat_start,
-                                     uint16_t bps, uint8_t *sector);
-
 static bool short_name_exists_in_dir(uint32_t dir_cluster, uint32_t data_start,
                                      uint32_t fat_start, uint8_t spc,
                                      uint16_t bps, const char short_name[11]) {
@@ -491,101 +669,383 @@ static bool short_name_exists_in_dir(uint32_t dir_cluster, uint32_t data_start,
       }
     }
     current_cluster =
-        fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+        fat_get_next_cluster(current_cluster, fat_start, bps);
   }
   kfree(sector);
   return false;
 }
 
-static uint32_t fat_get_next_cluster(uint32_t cluster, uint32_t fat_start,
-                                     uint16_t bps, uint8_t *sector) {
+/* --- FAT table access ---
+   FAT sectors are read and written through a small write-back cache, so
+   walking or building a chain touches each FAT sector once and writes it
+   back once, at fat_flush() (or when the slot is reused). Every public
+   call that changes the FAT flushes before it returns, so code that reads
+   FAT sectors straight from the disk still sees the current table. */
+
+#define FAT_WB_SLOTS 16
+
+struct fat_wb_slot {
+  uint32_t lba;
+  uint8_t valid;
+  uint8_t dirty;
+  uint8_t data[512];
+};
+
+static struct fat_wb_slot g_fat_wb[FAT_WB_SLOTS];
+static uint32_t g_fat_wb_next; /* round-robin victim */
+
+static int fat_wb_write(struct fat_wb_slot *s) {
+  if (!s->dirty)
+    return 0;
+  if (disk_write_sector(s->lba, s->data) != 0) {
+    serial("[FAT] fat_wb: write failed LBA %d\n", (int)s->lba);
+    return -1;
+  }
+  s->dirty = 0;
+  return 0;
+}
+
+/* cached copy of FAT sector lba, NULL if it cannot be read */
+static uint8_t *fat_wb_get(uint32_t lba, int dirty) {
+  for (int i = 0; i < FAT_WB_SLOTS; i++) {
+    struct fat_wb_slot *s = &g_fat_wb[i];
+    if (s->valid && s->lba == lba) {
+      s->dirty |= dirty;
+      return s->data;
+    }
+  }
+  struct fat_wb_slot *s = &g_fat_wb[g_fat_wb_next++ % FAT_WB_SLOTS];
+  if (s->valid && fat_wb_write(s) != 0)
+    return NULL;
+  s->valid = 0;
+  if (disk_read_sector(lba, s->data) != 0)
+    return NULL;
+  s->lba = lba;
+  s->valid = 1;
+  s->dirty = (uint8_t)dirty;
+  return s->data;
+}
+
+/* write the dirty FAT sectors back, lowest LBA first */
+static int fat_wb_flush(void) {
+  int rc = 0;
+  for (;;) {
+    struct fat_wb_slot *low = NULL;
+    for (int i = 0; i < FAT_WB_SLOTS; i++) {
+      struct fat_wb_slot *s = &g_fat_wb[i];
+      if (s->valid && s->dirty && (!low || s->lba < low->lba))
+        low = s;
+    }
+    if (!low)
+      return rc;
+    if (fat_wb_write(low) != 0) {
+      low->valid = 0;
+      rc = -1;
+    }
+  }
+}
+
+/* FAT entry of cluster into *next: 0, or -1 if the FAT sector cannot be read */
+static int fat_read_next_cluster(uint32_t cluster, uint32_t fat_start,
+                                 uint16_t bps, uint32_t *next) {
   uint32_t fat_sector = fat_start + (cluster * 4) / bps;
   uint32_t fat_offset = (cluster * 4) % bps;
-  if (disk_read_sector(fat_sector, sector) != 0) {
+  uint8_t *sector = fat_wb_get(fat_sector, 0);
+  if (!sector) {
     serial("[FAT] fat_get_next_cluster: read failed LBA %d\n", (int)fat_sector);
-    return 0x0FFFFFFF;
+    return -1;
   }
-  return (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
+  *next = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
+  return 0;
 }
 
-static void fat_set_next_cluster(uint32_t cluster, uint32_t value,
-                                 uint32_t fat_start, uint16_t bps,
-                                 uint8_t *sector) {
-  uint32_t fat_sector = fat_start + (cluster * 4) / bps;
-  uint32_t fat_offset = (cluster * 4) % bps;
-  if (disk_read_sector(fat_sector, sector) != 0) {
-    serial("[FAT] fat_set_next_cluster: read failed LBA %d\n", (int)fat_sector);
+/* read failures end the chain (EOC) */
+static uint32_t fat_get_next_cluster(uint32_t cluster, uint32_t fat_start,
+                                     uint16_t bps) {
+  uint32_t next;
+  if (fat_read_next_cluster(cluster, fat_start, bps, &next) != 0)
+    return 0x0FFFFFFF;
+  return next;
+}
+
+/* --- Free space ---
+   One bit per cluster (set = in use), built from the FAT in a single
+   streaming pass the first time the mounted volume allocates, and kept in
+   step by fat_set_next_cluster(). Allocation looks for a free run as long
+   as the request starting at the FSInfo next-free hint, so big files come
+   out in one or a few extents instead of one cluster per FAT scan. */
+
+struct fat_space {
+  uint32_t lba;        /* volume the map describes, 0 = not built */
+  uint32_t clusters;   /* FAT entries covered: 2 .. clusters - 1 are data */
+  uint32_t *map;
+  uint32_t free;
+  uint32_t next;       /* next-free hint */
+  uint32_t fsinfo_lba; /* 0 if the volume has no valid FSInfo */
+  int fsinfo_dirty;
+};
+
+static struct fat_space g_space;
+
+static void fat_space_drop(void) {
+  if (g_space.map)
+    kfree(g_space.map);
+  memset(&g_space, 0, sizeof(g_space));
+  memset(g_fat_wb, 0, sizeof(g_fat_wb));
+}
+
+static inline bool fat_space_used(uint32_t c) {
+  return (g_space.map[c / 32] >> (c % 32)) & 1;
+}
+
+static void fat_space_mark(uint32_t c, bool used) {
+  if (!g_space.map || c < 2 || c >= g_space.clusters)
     return;
+  if (fat_space_used(c) == used)
+    return;
+  if (used) {
+    g_space.map[c / 32] |= 1U << (c % 32);
+    g_space.free--;
+  } else {
+    g_space.map[c / 32] &= ~(1U << (c % 32));
+    g_space.free++;
   }
-  *(uint32_t *)(sector + fat_offset) = value;
-  if (disk_write_sector(fat_sector, sector) != 0) {
-    serial("[FAT] fat_set_next_cluster: write failed LBA %d\n",
-           (int)fat_sector);
-  }
+  g_space.fsinfo_dirty = 1;
 }
 
-static uint32_t fat_alloc_cluster(uint32_t fat_start, uint32_t sectors_per_fat,
-                                  uint8_t *sector) {
-  for (uint32_t s = 0; s < sectors_per_fat; s++) {
-    if (disk_read_sector(fat_start + s, sector) != 0) {
-      serial("[FAT] fat_alloc_cluster: read failed LBA %d\n",
-             (int)(fat_start + s));
-      continue;
+static int fat_space_load(void) {
+  if (g_space.map && g_space.lba == current_lba)
+    return 0;
+  fat_wb_flush();
+  fat_space_drop();
+
+  uint8_t *sector = (uint8_t *)kmalloc(512);
+  if (!sector)
+    return -1;
+  if (disk_read_sector(current_lba, sector) != 0) {
+    kfree(sector);
+    return -1;
+  }
+  struct fat_bpb *bpb = (struct fat_bpb *)sector;
+  if (bpb->bytes_per_sector != 512 || bpb->sectors_per_cluster == 0) {
+    kfree(sector);
+    return -1;
+  }
+  uint32_t fat_start = current_lba + bpb->reserved_sectors;
+  uint32_t spf = bpb->sectors_per_fat_32;
+  uint32_t data_rel = bpb->reserved_sectors + bpb->fats_count * spf;
+  uint32_t clusters = spf * 128;
+  if (bpb->total_sectors_32 > data_rel &&
+      (bpb->total_sectors_32 - data_rel) / bpb->sectors_per_cluster + 2 <
+          clusters)
+    clusters = (bpb->total_sectors_32 - data_rel) / bpb->sectors_per_cluster + 2;
+  uint32_t fsinfo = bpb->fs_info;
+  uint32_t reserved = bpb->reserved_sectors;
+
+  uint32_t hint = 2;
+  if (fsinfo != 0 && fsinfo < reserved &&
+      disk_read_sector(current_lba + fsinfo, sector) == 0) {
+    struct fat_fsinfo *fi = (struct fat_fsinfo *)sector;
+    if (fi->lead_sig == 0x41615252 && fi->struc_sig == 0x61417272) {
+      g_space.fsinfo_lba = current_lba + fsinfo;
+      if (fi->next_free >= 2 && fi->next_free < clusters)
+        hint = fi->next_free;
     }
-    uint32_t *table = (uint32_t *)sector;
-    for (int k = 0; k < 128; k++) {
-      if ((table[k] & 0x0FFFFFFF) == 0) {
-        uint32_t cluster = s * 128 + k;
-        if (cluster < 2)
-          continue;
-        table[k] = 0x0FFFFFFF;
-        if (disk_write_sector(fat_start + s, sector) != 0) {
-          serial("[FAT] fat_alloc_cluster: write failed LBA %d\n",
-                 (int)(fat_start + s));
-          return 0;
-        }
-        return cluster;
+  }
+  kfree(sector);
+
+  uint32_t words = (clusters + 31) / 32;
+  uint32_t *map = (uint32_t *)kmalloc(words * 4);
+  if (!map)
+    return -1;
+  memset(map, 0xFF, words * 4); /* bits past the end stay "used" */
+
+  /* stream the FAT, batch sectors per read */
+  const uint32_t batch = 16;
+  uint8_t *buf = (uint8_t *)kmalloc(batch * 512);
+  if (!buf) {
+    kfree(map);
+    return -1;
+  }
+  uint32_t free_count = 0;
+  uint32_t fat_sectors = (clusters + 127) / 128;
+  for (uint32_t s = 0; s < fat_sectors; s += batch) {
+    uint32_t n = fat_sectors - s < batch ? fat_sectors - s : batch;
+    if (disk_read_sectors(fat_start + s, n, buf) != 0) {
+      serial("[FAT] free map: FAT read failed LBA %d\n", (int)(fat_start + s));
+      kfree(buf);
+      kfree(map);
+      return -1;
+    }
+    const uint32_t *table = (const uint32_t *)buf;
+    for (uint32_t k = 0; k < n * 128; k++) {
+      uint32_t c = s * 128 + k;
+      if (c >= clusters)
+        break;
+      if (c >= 2 && (table[k] & 0x0FFFFFFF) == 0) {
+        map[c / 32] &= ~(1U << (c % 32));
+        free_count++;
       }
     }
   }
+  kfree(buf);
+
+  g_space.lba = current_lba;
+  g_space.clusters = clusters;
+  g_space.map = map;
+  g_space.free = free_count;
+  g_space.next = hint;
+  serial("[FAT] free map: %u of %u clusters free, next %u\n", free_count,
+         clusters - 2, hint);
   return 0;
 }
 
-static uint32_t fat_alloc_cluster_from(uint32_t fat_start,
-                                       uint32_t sectors_per_fat,
-                                       uint8_t *sector,
-                                       uint32_t *hint_cluster) {
-  uint32_t start = (hint_cluster && *hint_cluster >= 2) ? *hint_cluster : 2;
-  uint32_t total_entries = sectors_per_fat * 128;
-  if (start >= total_entries)
-    start = 2;
-
-  for (int pass = 0; pass < 2; pass++) {
-    uint32_t first = (pass == 0) ? start : 2;
-    uint32_t last = (pass == 0) ? total_entries : start;
-    for (uint32_t cluster = first; cluster < last; cluster++) {
-      uint32_t s = cluster / 128;
-      uint32_t k = cluster % 128;
-      if (disk_read_sector(fat_start + s, sector) != 0) {
-        serial("[FAT] fat_alloc_cluster_from: read failed LBA %d\n",
-               (int)(fat_start + s));
+/* Look at clusters from .. to - 1 for a free run; a run may carry on past
+   to. Keeps the longest run in *best / *best_len, true once one reaches
+   want. */
+static bool fat_space_scan(uint32_t from, uint32_t to, uint32_t want,
+                           uint32_t *best, uint32_t *best_len) {
+  const uint32_t *map = g_space.map;
+  uint32_t end = g_space.clusters;
+  uint32_t c = from;
+  while (c < to) {
+    if ((c % 32) == 0 && map[c / 32] == 0xFFFFFFFF) {
+      c += 32;
+      continue;
+    }
+    if (fat_space_used(c)) {
+      c++;
+      continue;
+    }
+    uint32_t s = c;
+    while (c < end && c - s < want) {
+      if ((c % 32) == 0 && map[c / 32] == 0 && c + 32 <= end &&
+          c - s + 32 <= want) {
+        c += 32;
         continue;
       }
-      uint32_t *table = (uint32_t *)sector;
-      if ((table[k] & 0x0FFFFFFF) == 0) {
-        table[k] = 0x0FFFFFFF;
-        if (disk_write_sector(fat_start + s, sector) != 0) {
-          serial("[FAT] fat_alloc_cluster_from: write failed LBA %d\n",
-                 (int)(fat_start + s));
-          return 0;
-        }
-        if (hint_cluster)
-          *hint_cluster = cluster + 1;
-        return cluster;
-      }
+      if (fat_space_used(c))
+        break;
+      c++;
+    }
+    if (c - s > *best_len) {
+      *best = s;
+      *best_len = c - s;
     }
+    if (*best_len >= want)
+      return true;
   }
-  return 0;
+  return false;
+}
+
+/* First free run of want clusters at or after the hint (wrapping round),
+   else the longest free run. Returns its first cluster, 0 if the volume is
+   full. */
+static uint32_t fat_space_find(uint32_t want, uint32_t *got) {
+  uint32_t best = 0, best_len = 0;
+  uint32_t hint = g_space.next;
+  if (hint < 2 || hint >= g_space.clusters)
+    hint = 2;
+  if (!fat_space_scan(hint, g_space.clusters, want, &best, &best_len))
+    fat_space_scan(2, hint, want, &best, &best_len);
+  *got = best_len < want ? best_len : want;
+  return best_len ? best : 0;
+}
+
+static void fat_set_next_cluster(uint32_t cluster, uint32_t value,
+                                 uint32_t fat_start, uint16_t bps) {
+  uint32_t fat_sector = fat_start + (cluster * 4) / bps;
+  uint32_t fat_offset = (cluster * 4) % bps;
+  uint8_t *sector = fat_wb_get(fat_sector, 1);
+  if (!sector) {
+    serial("[FAT] fat_set_next_cluster: read failed LBA %d\n", (int)fat_sector);
+    return;
+  }
+  uint32_t *entry = (uint32_t *)(sector + fat_offset);
+  *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
+  fat_space_mark(cluster, (value & 0x0FFFFFFF) != 0);
+}
+
+/* Mark every cluster of the chain at first free */
+static void fat_free_chain(uint32_t first, uint32_t fat_start, uint16_t bps) {
+  uint32_t current = first;
+  while (current >= 2 && current < 0x0FFFFFF8) {
+    uint32_t next = fat_get_next_cluster(current, fat_start, bps);
+    fat_set_next_cluster(current, 0, fat_start, bps);
+    current = next;
+  }
+}
+
+/* Allocate a chain of want clusters in as few contiguous extents as the
+   free space allows, link it after prev (if not 0) and end it with EOC.
+   Returns the first cluster, or 0 with nothing allocated. */
+static uint32_t fat_alloc_chain(uint32_t want, uint32_t prev,
+                                uint32_t fat_start, uint16_t bps) {
+  if (want == 0 || fat_space_load() != 0)
+    return 0;
+  if (want > g_space.free) {
+    serial("[FAT] alloc: %u clusters wanted, %u free\n", want, g_space.free);
+    return 0;
+  }
+  uint32_t first = 0;
+  uint32_t last = prev;
+  uint32_t left = want;
+  while (left > 0) {
+    uint32_t got;
+    uint32_t c = fat_space_find(left, &got);
+    if (c == 0)
+      break;
+    TRACE(TR_FAT_ALLOC, left, got, c, 0);
+    if (last)
+      fat_set_next_cluster(last, c, fat_start, bps);
+    for (uint32_t i = 0; i + 1 < got; i++)
+      fat_set_next_cluster(c + i, c + i + 1, fat_start, bps);
+    fat_set_next_cluster(c + got - 1, 0x0FFFFFFF, fat_start, bps);
+    if (!first)
+      first = c;
+    last = c + got - 1;
+    left -= got;
+    g_space.next = c + got < g_space.clusters ? c + got : 2;
+  }
+  if (left > 0) {
+    fat_free_chain(first, fat_start, bps);
+    if (prev)
+      fat_set_next_cluster(prev, 0x0FFFFFFF, fat_start, bps);
+    return 0;
+  }
+  return first;
+}
+
+static uint32_t fat_alloc_cluster(uint32_t fat_start, uint16_t bps) {
+  return fat_alloc_chain(1, 0, fat_start, bps);
+}
+
+/* Write back the FAT sectors a call dirtied and the FSInfo counters */
+static int fat_flush(void) {
+  int rc = fat_wb_flush();
+  if (!g_space.map || !g_space.fsinfo_dirty || !g_space.fsinfo_lba)
+    return rc;
+  uint8_t *sector = (uint8_t *)kmalloc(512);
+  if (!sector)
+    return -1;
+  if (disk_read_sector(g_space.fsinfo_lba, sector) == 0) {
+    struct fat_fsinfo *fi = (struct fat_fsinfo *)sector;
+    fi->free_count = g_space.free;
+    fi->next_free = g_space.next;
+    if (disk_write_sector(g_space.fsinfo_lba, sector) == 0)
+      g_space.fsinfo_dirty = 0;
+    else
+      rc = -1;
+  }
+  kfree(sector);
+  return rc;
+}
+
+/* end of a public call that changed the FAT: flush, report a failed flush */
+static int fat_commit(int rc) {
+  if (fat_flush() != 0 && rc == 0)
+    return -1;
+  return rc;
 }
 
 static int fat_set_next_cluster_checked(uint32_t cluster, uint32_t value,
@@ -593,32 +1053,19 @@ static int fat_set_next_cluster_checked(uint32_t cluster, uint32_t value,
                                         uint8_t *sector, int verify) {
   uint32_t fat_sector = fat_start + (cluster * 4) / bps;
   uint32_t fat_offset = (cluster * 4) % bps;
-  if (disk_read_sector(fat_sector, sector) != 0) {
-    serial("[FAT] fat_set_next_cluster_checked: read failed LBA %d\n",
-           (int)fat_sector);
-    return -1;
-  }
-  *(uint32_t *)(sector + fat_offset) = value;
-  if (disk_write_sector(fat_sector, sector) != 0) {
+  fat_set_next_cluster(cluster, value, fat_start, bps);
+  if (fat_wb_flush() != 0) {
     serial("[FAT] fat_set_next_cluster_checked: write failed LBA %d\n",
            (int)fat_sector);
     return -1;
   }
   if (verify) {
-    uint8_t *verify_buf = (uint8_t *)kmalloc(512);
-    if (!verify_buf) {
-      serial(
-          "[FAT] fat_set_next_cluster_checked: no verify buffer, skipping\n");
-      return 0;
-    }
-    if (disk_read_sector(fat_sector, verify_buf) != 0) {
+    if (disk_read_sector(fat_sector, sector) != 0) {
       serial("[FAT] fat_set_next_cluster_checked: verify read failed LBA %d\n",
              (int)fat_sector);
-      kfree(verify_buf);
       return -1;
     }
-    uint32_t v = (*(uint32_t *)(verify_buf + fat_offset)) & 0x0FFFFFFF;
-    kfree(verify_buf);
+    uint32_t v = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
     if (v != (value & 0x0FFFFFFF)) {
       serial("[FAT] fat_set_next_cluster_checked: verify mismatch LBA %d\n",
              (int)fat_sector);
@@ -645,7 +1092,7 @@ static bool dir_locate_entry(uint32_t dir_cluster, uint32_t entry_idx,
 
   uint32_t cluster = dir_cluster;
   for (uint32_t i = 0; i < cluster_steps; i++) {
-    cluster = fat_get_next_cluster(cluster, fat_start, bps, sector);
+    cluster = fat_get_next_cluster(cluster, fat_start, bps);
     if (cluster >= 0x0FFFFFF8) {
       kfree(sector);
       return false;
@@ -679,7 +1126,7 @@ static int dir_calc_entry_index(uint32_t dir_cluster, uint32_t target_sector,
       index += entries_per_sector;
     }
     current_cluster =
-        fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+        fat_get_next_cluster(current_cluster, fat_start, bps);
   }
   kfree(sector);
   return -1;
@@ -729,7 +1176,7 @@ static bool dir_find_free_run(uint32_t dir_cluster, uint32_t data_start,
       }
     }
     current_cluster =
-        fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+        fat_get_next_cluster(current_cluster, fat_start, bps);
   }
 
   kfree(sector);
@@ -768,8 +1215,7 @@ static int dir_create_entry_with_cluster(uint32_t parent_cluster,
                                          uint32_t cluster, uint32_t size,
                                          uint8_t attr, uint32_t data_start,
                                          uint32_t fat_start, uint8_t spc,
-                                         uint16_t bps, uint32_t sectors_per_fat,
-                                         int verify) {
+                                         uint16_t bps, int verify) {
   uint8_t *sector = (uint8_t *)kmalloc(512);
   if (!sector) {
     serial("[FAT] mkdir: no memory for sector buffer\n");
@@ -797,34 +1243,22 @@ static int dir_create_entry_with_cluster(uint32_t parent_cluster,
                          need_entries, &entry_sector_lba, &entry_offset,
                          &free_run_start)) {
     /* Extend directory by one cluster and retry */
-    uint8_t *fatbuf = (uint8_t *)kmalloc(512);
-    if (!fatbuf) {
-      serial("[FAT] mkdir: no memory for fatbuf\n");
-      if (verify_buf)
-        kfree(verify_buf);
-      kfree(sector);
-      return -20;
-    }
     uint32_t current = parent_cluster;
     int cluster_index = 0;
     while (true) {
-      uint32_t next = fat_get_next_cluster(current, fat_start, bps, fatbuf);
+      uint32_t next = fat_get_next_cluster(current, fat_start, bps);
       if (next >= 0x0FFFFFF8)
         break;
       current = next;
       cluster_index++;
     }
-    uint32_t new_cluster =
-        fat_alloc_cluster(fat_start, sectors_per_fat, fatbuf);
+    uint32_t new_cluster = fat_alloc_chain(1, current, fat_start, bps);
     if (new_cluster == 0) {
-      kfree(fatbuf);
       if (verify_buf)
         kfree(verify_buf);
       kfree(sector);
       return -24;
     }
-    fat_set_next_cluster(current, new_cluster, fat_start, bps, fatbuf);
-    fat_set_next_cluster(new_cluster, 0x0FFFFFFF, fat_start, bps, fatbuf);
 
     memset(sector, 0, 512);
     uint32_t new_lba = data_start + (new_cluster - 2) * spc;
@@ -832,14 +1266,12 @@ static int dir_create_entry_with_cluster(uint32_t parent_cluster,
       if (write_sector_verified(new_lba + i, sector, verify) != 0) {
         serial("[FAT] mkdir: extend dir write failed LBA %d\n",
                (int)(new_lba + i));
-        kfree(fatbuf);
         if (verify_buf)
           kfree(verify_buf);
         kfree(sector);
         return -24;
       }
     }
-    kfree(fatbuf);
 
     int entries_per_sector = 512 / 32;
     int entries_per_cluster = spc * entries_per_sector;
@@ -880,6 +1312,7 @@ static int dir_create_entry_with_cluster(uint32_t parent_cluster,
     }
   }
 
+  fat_dcache_purge_dir(parent_cluster);
   if (need_lfn) {
     uint8_t checksum = lfn_checksum(short_name);
     for (int i = 0; i < lfn_entries; i++) {
@@ -995,6 +1428,37 @@ static int resolve_parent(const char *path, uint32_t root_cluster,
 
 /* --- FAT32 File Operations --- */
 
+/* Copy len bytes from byte off of a cluster into out. Whole sectors go
+   straight into the caller's buffer as one request, so the block layer
+   sees one sequential stream per file and reads ahead of it; only the
+   partial head/tail sector goes through the bounce sector. */
+static int cluster_read(uint32_t cluster_lba, uint32_t off, uint32_t len,
+                        uint8_t *out, uint8_t *sector) {
+  while (len > 0) {
+    uint32_t sec = off / 512;
+    uint32_t in = off % 512;
+    if (in == 0 && len >= 512) {
+      uint32_t n = len / 512;
+      if (disk_read_sectors(cluster_lba + sec, n, out) != 0)
+        return -1;
+      out += n * 512;
+      off += n * 512;
+      len -= n * 512;
+      continue;
+    }
+    if (disk_read_sector(cluster_lba + sec, sector) != 0)
+      return -1;
+    uint32_t chunk = 512 - in;
+    if (chunk > len)
+      chunk = len;
+    memcpy(out, sector + in, chunk);
+    out += chunk;
+    off += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
+
 extern "C" int fat32_read_file(const char *path, void *buf, uint32_t max_size) {
   if (!is_fat_initialized)
     return -1;
@@ -1049,34 +1513,27 @@ extern "C" int fat32_read_file(const char *path, void *buf, uint32_t max_size) {
     return -1;
   }
 
-  /* 3. Read File Data */
+  /* 3. Read File Data, a cluster per request */
   uint32_t bytes_read = 0;
   uint8_t *out = (uint8_t *)buf;
   uint32_t current_cluster = file_cluster;
+  uint32_t cluster_bytes = spc * bps;
+  uint32_t limit = (file_size < max_size) ? file_size : max_size;
 
-  while (bytes_read < file_size && bytes_read < max_size) {
+  while (bytes_read < limit) {
     uint32_t cluster_lba = data_start + (current_cluster - 2) * spc;
-
-    for (int i = 0; i < spc; i++) {
-      disk_read_sector(cluster_lba + i, sector);
-      uint32_t chunk =
-          (file_size - bytes_read > 512) ? 512 : (file_size - bytes_read);
-      if (bytes_read + chunk > max_size)
-        chunk = max_size - bytes_read;
-
-      memcpy(out + bytes_read, sector, chunk);
-      bytes_read += chunk;
-      if (bytes_read >= file_size || bytes_read >= max_size)
-        break;
-    }
+    uint32_t chunk = limit - bytes_read;
+    if (chunk > cluster_bytes)
+      chunk = cluster_bytes;
+    if (cluster_read(cluster_lba, 0, chunk, out + bytes_read, sector) != 0)
+      break;
+    bytes_read += chunk;
+    if (bytes_read >= limit)
+      break;
 
     /* Get next cluster from FAT */
-    uint32_t fat_sector = fat_start + (current_cluster * 4) / bps;
-    uint32_t fat_offset = (current_cluster * 4) % bps;
-
-    disk_read_sector(fat_sector, sector);
-    current_cluster = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
-
+    current_cluster =
+        fat_get_next_cluster(current_cluster, fat_start, bps);
     if (current_cluster >= 0x0FFFFFF8)
       break; /* EOC */
   }
@@ -1085,114 +1542,253 @@ extern "C" int fat32_read_file(const char *path, void *buf, uint32_t max_size) {
   return bytes_read;
 }
 
-extern "C" int fat32_read_file_offset(const char *path, void *buf,
-                                      uint32_t size, uint32_t offset) {
-  if (!is_fat_initialized)
-    return -1;
-
-  uint8_t *sector = (uint8_t *)kmalloc(512);
-  if (!sector)
-    return -1;
+/* --- Open-file handles --- */
 
-  /* 1. Read BPB */
-  if (disk_read_sector(current_lba, sector) != 0) {
-    kfree(sector);
-    return -1;
-  }
+/* Mounted volume geometry from the BPB, read once per fat_gen */
+struct fat_geom {
+  uint32_t gen;
+  uint32_t fat_start;
+  uint32_t data_start;
+  uint32_t root_cluster;
+  uint32_t spc;
+  uint32_t bps;
+  uint32_t cluster_bytes;
+};
+
+static struct fat_geom g_geom;
+
+static const struct fat_geom *fat_geom_get(uint8_t *sector) {
+  if (g_geom.gen == fat_gen)
+    return &g_geom;
+  if (disk_read_sector(current_lba, sector) != 0)
+    return NULL;
   struct fat_bpb *bpb = (struct fat_bpb *)sector;
+  if (bpb->bytes_per_sector != 512 || bpb->sectors_per_cluster == 0)
+    return NULL;
+  g_geom.fat_start = current_lba + bpb->reserved_sectors;
+  g_geom.data_start =
+      g_geom.fat_start + (bpb->fats_count * bpb->sectors_per_fat_32);
+  g_geom.root_cluster = bpb->root_cluster;
+  g_geom.spc = bpb->sectors_per_cluster;
+  g_geom.bps = bpb->bytes_per_sector;
+  g_geom.cluster_bytes = g_geom.spc * g_geom.bps;
+  g_geom.gen = fat_gen;
+  return &g_geom;
+}
 
-  if (bpb->bytes_per_sector == 0) {
-    kfree(sector);
-    return -1;
-  }
+/* clusters first .. first + count - 1 hold file clusters fcluster .. */
+struct fat_extent {
+  uint32_t fcluster;
+  uint32_t cluster;
+  uint32_t count;
+};
 
-  uint32_t fat_start = current_lba + bpb->reserved_sectors;
-  uint32_t data_start = fat_start + (bpb->fats_count * bpb->sectors_per_fat_32);
-  uint32_t root_cluster = bpb->root_cluster;
-  uint8_t spc = bpb->sectors_per_cluster;
-  uint16_t bps = bpb->bytes_per_sector;
-  uint32_t cluster_bytes = spc * bps;
+struct fat_file {
+  uint32_t gen;               /* fat_gen the fields below were read at */
+  uint32_t size;
+  uint32_t first_cluster;
+  uint32_t dirent_sector;     /* directory entry, for later writers */
+  uint32_t dirent_index;
+  struct fat_geom geom;
+  struct fat_extent *ext;     /* cluster chain, run-length encoded */
+  uint32_t n_ext;             /* extents used */
+  uint32_t cap;
+  char path[256];
+};
+
+/* (Re)read the directory entry and the cluster chain of f->path */
+static int fat_file_load(fat_file_t *f, uint8_t *sector) {
+  const struct fat_geom *g = fat_geom_get(sector);
+  if (!g)
+    return -1;
+  f->geom = *g;
 
-  /* 2. Resolve Path */
-  uint32_t file_cluster = 0;
-  uint32_t file_size = 0;
-  uint32_t parent_cluster;
+  uint32_t parent;
   const char *fname;
   int fname_len;
-
-  if (resolve_parent(path, root_cluster, data_start, fat_start, spc, bps,
-                     &parent_cluster, &fname, &fname_len) != 0) {
-    kfree(sector);
-    return -1;
-  }
-
   bool is_dir;
-  if (find_in_cluster(parent_cluster, fname, fname_len, data_start, fat_start,
-                      spc, bps, &file_cluster, &file_size, NULL, NULL,
-                      &is_dir) != 0) {
-    kfree(sector);
+  if (resolve_parent(f->path, g->root_cluster, g->data_start, g->fat_start,
+                     g->spc, g->bps, &parent, &fname, &fname_len) != 0 ||
+      find_in_cluster(parent, fname, fname_len, g->data_start, g->fat_start,
+                      g->spc, g->bps, &f->first_cluster, &f->size,
+                      &f->dirent_sector, &f->dirent_index, &is_dir) != 0 ||
+      is_dir)
     return -1;
+
+  /* walk the chain once, only as far as the size needs (a looping chain
+     cannot run away), merging physically consecutive clusters */
+  f->n_ext = 0;
+  uint32_t need = (f->size + g->cluster_bytes - 1) / g->cluster_bytes;
+  uint32_t cluster = f->first_cluster;
+  uint32_t cached_fat = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < need; i++) {
+    if (cluster < 2 || cluster >= 0x0FFFFFF7) {
+      serial("[FAT] %s: chain ends after %u of %u clusters\n", f->path, i,
+             need);
+      f->size = i * g->cluster_bytes;
+      break;
+    }
+    struct fat_extent *last = f->n_ext ? &f->ext[f->n_ext - 1] : NULL;
+    if (last && last->cluster + last->count == cluster) {
+      last->count++;
+    } else {
+      if (f->n_ext == f->cap) {
+        uint32_t cap = f->cap ? f->cap * 2 : 8;
+        struct fat_extent *n =
+            (struct fat_extent *)kmalloc(cap * sizeof(struct fat_extent));
+        if (!n)
+          return -1;
+        if (f->ext) {
+          memcpy(n, f->ext, f->n_ext * sizeof(struct fat_extent));
+          kfree(f->ext);
+        }
+        f->ext = n;
+        f->cap = cap;
+      }
+      f->ext[f->n_ext].fcluster = i;
+      f->ext[f->n_ext].cluster = cluster;
+      f->ext[f->n_ext].count = 1;
+      f->n_ext++;
+    }
+    if (i + 1 == need)
+      break;
+    uint32_t fat_sector = g->fat_start + (cluster * 4) / g->bps;
+    if (fat_sector != cached_fat) {
+      if (disk_read_sector(fat_sector, sector) != 0)
+        return -1;
+      cached_fat = fat_sector;
+    }
+    cluster = (*(uint32_t *)(sector + (cluster * 4) % g->bps)) & 0x0FFFFFFF;
   }
+  f->gen = fat_gen;
+  return 0;
+}
 
-  if (offset >= file_size) {
+extern "C" fat_file_t *fat32_open(const char *path) {
+  if (!is_fat_initialized || !path || strlen(path) >= sizeof(((fat_file_t *)0)->path))
+    return NULL;
+  uint8_t *sector = (uint8_t *)kmalloc(512);
+  fat_file_t *f = (fat_file_t *)kmalloc(sizeof(fat_file_t));
+  if (!sector || !f) {
+    if (sector)
+      kfree(sector);
+    if (f)
+      kfree(f);
+    return NULL;
+  }
+  memset(f, 0, sizeof(*f));
+  strcpy(f->path, path);
+  if (fat_file_load(f, sector) != 0) {
     kfree(sector);
-    return 0;
+    fat32_close(f);
+    return NULL;
   }
-  if (offset + size > file_size)
-    size = file_size - offset;
+  kfree(sector);
+  return f;
+}
 
-  /* 3. Seek to cluster */
-  uint32_t current_cluster = file_cluster;
-  uint32_t clusters_to_skip = offset / cluster_bytes;
-  uint32_t offset_in_cluster = offset % cluster_bytes;
+extern "C" void fat32_close(fat_file_t *f) {
+  if (!f)
+    return;
+  if (f->ext)
+    kfree(f->ext);
+  kfree(f);
+}
 
-  for (uint32_t i = 0; i < clusters_to_skip; i++) {
-    uint32_t fat_sector = fat_start + (current_cluster * 4) / bps;
-    uint32_t fat_offset = (current_cluster * 4) % bps;
-    disk_read_sector(fat_sector, sector);
-    current_cluster = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
-    if (current_cluster >= 0x0FFFFFF8) {
+/* size at the last (re)load; -1 if the file went away */
+extern "C" int32_t fat32_fsize(fat_file_t *f) {
+  if (!f)
+    return -1;
+  if (f->gen != fat_gen) {
+    uint8_t *sector = (uint8_t *)kmalloc(512);
+    int r = sector ? fat_file_load(f, sector) : -1;
+    if (sector)
       kfree(sector);
+    if (r != 0)
       return -1;
-    }
   }
+  return (int32_t)f->size;
+}
 
-  /* 4. Read Data */
-  uint32_t bytes_read = 0;
-  uint8_t *out = (uint8_t *)buf;
+/* extent holding file cluster ci (binary search; ci < clusters in map) */
+static const struct fat_extent *fat_file_extent(const fat_file_t *f,
+                                                uint32_t ci) {
+  uint32_t lo = 0, hi = f->n_ext;
+  while (hi - lo > 1) {
+    uint32_t mid = (lo + hi) / 2;
+    if (f->ext[mid].fcluster <= ci)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return &f->ext[lo];
+}
 
-  while (bytes_read < size) {
-    uint32_t cluster_lba = data_start + (current_cluster - 2) * spc;
-    uint32_t cluster_offset = (bytes_read == 0) ? offset_in_cluster : 0;
-    uint32_t start_sector = cluster_offset / bps;
-    uint32_t sector_offset = cluster_offset % bps;
+extern "C" int fat32_pread(fat_file_t *f, void *buf, uint32_t size,
+                           uint32_t offset) {
+  if (!f || !buf)
+    return -1;
+  uint8_t *sector = (uint8_t *)kmalloc(512);
+  if (!sector)
+    return -1;
+  /* the volume changed since the handle was filled: look again */
+  if (f->gen != fat_gen && fat_file_load(f, sector) != 0) {
+    kfree(sector);
+    return -1;
+  }
+  if (offset >= f->size) {
+    kfree(sector);
+    return 0;
+  }
+  if (size > f->size - offset)
+    size = f->size - offset;
 
-    for (int i = start_sector; i < spc && bytes_read < size; i++) {
-      disk_read_sector(cluster_lba + i, sector);
-      uint32_t available = bps - sector_offset;
-      uint32_t to_copy =
-          (size - bytes_read > available) ? available : (size - bytes_read);
-      memcpy(out + bytes_read, sector + sector_offset, to_copy);
-      bytes_read += to_copy;
-      sector_offset = 0;
-    }
-
-    uint32_t fat_sector = fat_start + (current_cluster * 4) / bps;
-    uint32_t fat_offset = (current_cluster * 4) % bps;
-    disk_read_sector(fat_sector, sector);
-    current_cluster = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
-    if (current_cluster >= 0x0FFFFFF8)
+  /* one request per run of consecutive clusters */
+  const struct fat_geom *g = &f->geom;
+  uint8_t *out = (uint8_t *)buf;
+  uint32_t done = 0;
+  while (done < size) {
+    uint32_t pos = offset + done;
+    uint32_t ci = pos / g->cluster_bytes;
+    const struct fat_extent *e = fat_file_extent(f, ci);
+    uint32_t in_run = (ci - e->fcluster) * g->cluster_bytes + pos % g->cluster_bytes;
+    uint32_t chunk = e->count * g->cluster_bytes - in_run;
+    if (chunk > size - done)
+      chunk = size - done;
+    uint32_t run_lba = g->data_start + (e->cluster - 2) * g->spc;
+    if (cluster_read(run_lba, in_run, chunk, out + done, sector) != 0)
       break;
+    done += chunk;
   }
-
   kfree(sector);
-  return bytes_read;
+  return (int)done;
+}
+
+/* Path-based reads keep the last file open: callers that walk a file in
+   chunks pay for the path and the chain once, not per call. */
+static fat_file_t *g_last_file;
+
+extern "C" int fat32_read_file_offset(const char *path, void *buf,
+                                      uint32_t size, uint32_t offset) {
+  if (!is_fat_initialized || !path)
+    return -1;
+  if (g_last_file &&
+      (g_last_file->gen != fat_gen || strcmp(g_last_file->path, path) != 0)) {
+    fat32_close(g_last_file);
+    g_last_file = NULL;
+  }
+  if (!g_last_file)
+    g_last_file = fat32_open(path);
+  if (!g_last_file)
+    return -1;
+  return fat32_pread(g_last_file, buf, size, offset);
 }
 
 static int fat32_create_file_impl(const char *path, const void *data,
                                   uint32_t size, int verify, int skip_write) {
   if (!is_fat_initialized)
     return -1;
+  fat_changed();
 
   uint8_t *sector = (uint8_t *)kmalloc(512);
   if (!sector)
@@ -1220,7 +1816,6 @@ static int fat32_create_file_impl(const char *path, const void *data,
   uint32_t data_start = fat_start + (b_fats * b_spf);
   uint32_t root_cluster = b_root;
   uint8_t spc = b_spc;
-  uint32_t sectors_per_fat = b_spf;
   uint16_t bps = b_bps;
 
   /* 2. Resolve Parent Directory */
@@ -1273,29 +1868,21 @@ static int fat32_create_file_impl(const char *path, const void *data,
                            &free_run_start)) {
       /* Extend directory by one cluster and retry */
       uint32_t new_cluster = 0;
-      uint8_t *fatbuf = (uint8_t *)kmalloc(512);
-      if (!fatbuf) {
-        kfree(sector);
-        return -1;
-      }
       uint32_t current = parent_cluster;
       int cluster_index = 0;
       while (true) {
-        uint32_t next = fat_get_next_cluster(current, fat_start, bps, fatbuf);
+        uint32_t next = fat_get_next_cluster(current, fat_start, bps);
         if (next >= 0x0FFFFFF8)
           break;
         current = next;
         cluster_index++;
       }
-      new_cluster = fat_alloc_cluster(fat_start, sectors_per_fat, fatbuf);
+      new_cluster = fat_alloc_chain(1, current, fat_start, bps);
       if (new_cluster == 0) {
         serial("[FAT] create_file: no space to extend directory\n");
-        kfree(fatbuf);
         kfree(sector);
         return -1;
       }
-      fat_set_next_cluster(current, new_cluster, fat_start, bps, fatbuf);
-      fat_set_next_cluster(new_cluster, 0x0FFFFFFF, fat_start, bps, fatbuf);
 
       /* zero new dir cluster */
       memset(sector, 0, 512);
@@ -1303,7 +1890,6 @@ static int fat32_create_file_impl(const char *path, const void *data,
       for (int i = 0; i < spc; i++) {
         disk_write_sector(new_lba + i, sector);
       }
-      kfree(fatbuf);
 
       int entries_per_sector = 512 / 32;
       int entries_per_cluster = spc * entries_per_sector;
@@ -1321,12 +1907,7 @@ static int fat32_create_file_impl(const char *path, const void *data,
   /* 3. Allocate Cluster Chain */
   /* If file exists, free its cluster chain first. */
   if (found_existing && file_cluster != 0) {
-    uint32_t current = file_cluster;
-    while (current < 0x0FFFFFF8 && current != 0) {
-      uint32_t next = fat_get_next_cluster(current, fat_start, bps, sector);
-      fat_set_next_cluster(current, 0, fat_start, bps, sector);
-      current = next;
-    }
+    fat_free_chain(file_cluster, fat_start, bps);
     file_cluster = 0;
   }
 
@@ -1335,43 +1916,13 @@ static int fat32_create_file_impl(const char *path, const void *data,
   if (need_clusters == 0)
     need_clusters = 1;
 
-  uint32_t alloc_hint = 2;
-  file_cluster =
-      fat_alloc_cluster_from(fat_start, sectors_per_fat, sector, &alloc_hint);
+  file_cluster = fat_alloc_chain(need_clusters, 0, fat_start, bps);
   if (file_cluster == 0) {
-    serial("[FAT] create_file: no free clusters\n");
+    serial("[FAT] create_file: no free clusters for %u\n", need_clusters);
     kfree(sector);
     return -2;
   }
 
-  uint32_t current_cluster = file_cluster;
-  if (need_clusters > 256) {
-    serial("[FAT] create_file: allocating %d clusters\n", (int)need_clusters);
-  }
-  for (uint32_t i = 1; i < need_clusters; i++) {
-    uint32_t next_cluster =
-        fat_alloc_cluster_from(fat_start, sectors_per_fat, sector, &alloc_hint);
-    if (next_cluster == 0) {
-      serial("[FAT] create_file: no free clusters for chain\n");
-      /* free allocated chain */
-      uint32_t cur = file_cluster;
-      while (cur < 0x0FFFFFF8 && cur != 0) {
-        uint32_t nxt = fat_get_next_cluster(cur, fat_start, bps, sector);
-        fat_set_next_cluster(cur, 0, fat_start, bps, sector);
-        cur = nxt;
-      }
-      kfree(sector);
-      return -2;
-    }
-    fat_set_next_cluster(current_cluster, next_cluster, fat_start, bps, sector);
-    current_cluster = next_cluster;
-    if ((i % 512) == 0) {
-      serial("[FAT] create_file: allocated %d/%d clusters\n", (int)i,
-             (int)need_clusters);
-    }
-  }
-  fat_set_next_cluster(current_cluster, 0x0FFFFFFF, fat_start, bps, sector);
-
   /* Prepare short name */
   if (found_existing) {
     disk_read_sector(entry_sector_lba, sector);
@@ -1404,10 +1955,6 @@ static int fat32_create_file_impl(const char *path, const void *data,
   uint32_t clusters_written = 0;
   uint32_t total_sectors = (size + 511) / 512;
   uint32_t sectors_done = 0;
-  if (!skip_write) {
-    serial("[FAT] create_file: writing %d bytes (%d sectors)\n", (int)size,
-           (int)total_sectors);
-  }
   uint8_t *verify_buf = 0;
   if (verify && !skip_write)
     verify_buf = (uint8_t *)kmalloc(512);
@@ -1421,16 +1968,14 @@ static int fat32_create_file_impl(const char *path, const void *data,
     }
     uint32_t cluster_lba = data_start + (data_cluster - 2) * spc;
     if (sectors_done == 0) {
-      serial("[FAT] create_file: first cluster LBA %d\n", (int)cluster_lba);
+      TRACE(TR_FAT_CREATE, size, total_sectors, cluster_lba, 0);
     }
     for (int i = 0; i < spc; i++) {
       memset(sector, 0, 512);
       uint32_t chunk = (size - written > 512) ? 512 : (size - written);
       if (chunk > 0)
         memcpy(sector, data_ptr + written, chunk);
-      if (sectors_done == 0) {
-        serial("[FAT] create_file: write LBA %d\n", (int)(cluster_lba + i));
-      }
+      TRACE(TR_FAT_WRITE, cluster_lba + i, 1, total_sectors, 0);
       int retries = verify ? 3 : 1;
       int ok = 0;
       for (int r = 0; r < retries; r++) {
@@ -1458,16 +2003,12 @@ static int fat32_create_file_impl(const char *path, const void *data,
       }
       written += chunk;
       sectors_done++;
-      if ((sectors_done % 64) == 0) {
-        serial("[FAT] create_file: wrote %d/%d sectors\n", (int)sectors_done,
-               (int)total_sectors);
-      }
       if (written >= size)
         break;
     }
     if (written >= size)
       break;
-    data_cluster = fat_get_next_cluster(data_cluster, fat_start, bps, sector);
+    data_cluster = fat_get_next_cluster(data_cluster, fat_start, bps);
     clusters_written++;
     if (clusters_written > need_clusters + 2) {
       serial("[FAT] create_file: cluster chain too long\n");
@@ -1486,12 +2027,13 @@ static int fat32_create_file_impl(const char *path, const void *data,
     return -10;
   }
   if (!skip_write) {
-    serial("[FAT] create_file: write done (%d bytes)\n", (int)written);
+    TRACE(TR_FAT_DONE, written, size, 0, 0);
     if (verify_buf)
       kfree(verify_buf);
   }
 
   /* 5. Update Directory Entry (and LFN if needed) */
+  fat_dcache_purge_dir(parent_cluster);
   if (!found_existing && need_lfn) {
     uint8_t checksum = lfn_checksum(short_name);
     for (int i = 0; i < lfn_entries; i++) {
@@ -1546,25 +2088,32 @@ static int fat32_create_file_impl(const char *path, const void *data,
 
 extern "C" int fat32_create_file(const char *path, const void *data,
                                  uint32_t size) {
-  return fat32_create_file_impl(path, data, size, 0, 0);
+  int rc = fat_commit(fat32_create_file_impl(path, data, size, 0, 0));
+  fat_vfs_changed(path);
+  return rc;
 }
 
 extern "C" int fat32_create_file_verified(const char *path, const void *data,
                                           uint32_t size, int verify) {
-  return fat32_create_file_impl(path, data, size, verify ? 1 : 0, 0);
+  int rc = fat_commit(fat32_create_file_impl(path, data, size, verify ? 1 : 0, 0));
+  fat_vfs_changed(path);
+  return rc;
 }
 
 extern "C" int fat32_create_file_alloc(const char *path, uint32_t size) {
-  return fat32_create_file_impl(path, NULL, size, 0, 1);
+  int rc = fat_commit(fat32_create_file_impl(path, NULL, size, 0, 1));
+  fat_vfs_changed(path);
+  return rc;
 }
 
-extern "C" int fat32_write_file_offset(const char *path, const void *data,
-                                       uint32_t size, uint32_t offset,
-                                       int verify) {
+static int fat32_write_file_offset_impl(const char *path, const void *data,
+                                        uint32_t size, uint32_t offset,
+                                        int verify) {
   if (!is_fat_initialized)
     return -1;
   if (!path || !data || size == 0)
     return -1;
+  fat_changed();
 
   uint8_t *sector = (uint8_t *)kmalloc(512);
   if (!sector)
@@ -1621,23 +2170,24 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
   uint32_t skip_clusters = offset / cluster_bytes;
   uint32_t offset_in_cluster = offset % cluster_bytes;
 
-  uint32_t alloc_hint = 2;
   uint32_t current_cluster = file_cluster;
   uint32_t prev_cluster = 0;
   for (uint32_t i = 0; i < skip_clusters; i++) {
     prev_cluster = current_cluster;
     current_cluster =
-        fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+        fat_get_next_cluster(current_cluster, fat_start, bps);
     if (current_cluster >= 0x0FFFFFF8) {
-      uint32_t newc = fat_alloc_cluster_from(fat_start, bpb->sectors_per_fat_32,
-                                             sector, &alloc_hint);
+      /* past the end: allocate the gap and the data in one go */
+      uint32_t want = skip_clusters - i - 1 +
+                      (offset_in_cluster + size + cluster_bytes - 1) /
+                          cluster_bytes;
+      uint32_t newc = fat_alloc_chain(want, prev_cluster, fat_start, bps);
       if (newc == 0) {
         serial("[FAT] write_file_offset: alloc failed (skip) off=%d\n",
                (int)offset);
         kfree(sector);
         return -8;
       }
-      fat_set_next_cluster(prev_cluster, newc, fat_start, bps, sector);
       current_cluster = newc;
     }
   }
@@ -1645,7 +2195,6 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
   const uint8_t *p = (const uint8_t *)data;
   uint32_t remaining = size;
   uint32_t total_sectors = (size + 511) / 512;
-  uint32_t sectors_done = 0;
   uint8_t *buf = (uint8_t *)kmalloc(512);
   uint8_t *vbuf = verify ? (uint8_t *)kmalloc(512) : NULL;
   if (!buf) {
@@ -1669,6 +2218,7 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
         } else {
           if (run > full)
             run = full;
+          TRACE(TR_FAT_WRITE, cluster_lba + sector_idx, run, total_sectors, 0);
           if (disk_write_sectors(cluster_lba + sector_idx, run, p) != 0) {
             kfree(sector);
             kfree(buf);
@@ -1678,11 +2228,6 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
           }
           p += run * 512;
           remaining -= run * 512;
-          sectors_done += run;
-          if (total_sectors > 2048 && (sectors_done % 256) == 0) {
-            serial("[FAT] write_file_offset: wrote %d/%d sectors\n",
-                   (int)sectors_done, (int)total_sectors);
-          }
           sector_idx += (run - 1);
           continue;
         }
@@ -1701,6 +2246,7 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
       if (copy > remaining)
         copy = remaining;
       memcpy(buf + sector_off, p, copy);
+      TRACE(TR_FAT_WRITE, cluster_lba + sector_idx, 1, total_sectors, 0);
       int retries = verify ? 3 : 1;
       int ok = 0;
       for (int r = 0; r < retries; r++) {
@@ -1725,20 +2271,16 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
       }
       p += copy;
       remaining -= copy;
-      sectors_done++;
-      if (total_sectors > 2048 && (sectors_done % 256) == 0) {
-        serial("[FAT] write_file_offset: wrote %d/%d sectors\n",
-               (int)sectors_done, (int)total_sectors);
-      }
       offset_in_cluster = 0;
       sector_off = 0;
     }
     if (remaining > 0) {
       uint32_t next =
-          fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+          fat_get_next_cluster(current_cluster, fat_start, bps);
       if (next >= 0x0FFFFFF8) {
-        uint32_t newc = fat_alloc_cluster_from(
-            fat_start, bpb->sectors_per_fat_32, sector, &alloc_hint);
+        uint32_t newc = fat_alloc_chain(
+            (remaining + cluster_bytes - 1) / cluster_bytes, current_cluster,
+            fat_start, bps);
         if (newc == 0) {
           serial("[FAT] write_file_offset: alloc failed (extend) off=%d\n",
                  (int)(offset + (size - remaining)));
@@ -1748,7 +2290,6 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
             kfree(vbuf);
           return -8;
         }
-        fat_set_next_cluster(current_cluster, newc, fat_start, bps, sector);
         next = newc;
       }
       current_cluster = next;
@@ -1773,6 +2314,7 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
     }
     struct fat_dir_entry *ent = (struct fat_dir_entry *)sector;
     ent[entry_offset].size = new_size;
+    fat_dcache_purge_dir(parent_cluster);
     if (disk_write_sector(entry_sector, sector) != 0) {
       kfree(sector);
       kfree(buf);
@@ -1788,6 +2330,15 @@ extern "C" int fat32_write_file_offset(const char *path, const void *data,
   return 0;
 }
 
+extern "C" int fat32_write_file_offset(const char *path, const void *data,
+                                       uint32_t size, uint32_t offset,
+                                       int verify) {
+  int rc = fat_commit(
+      fat32_write_file_offset_impl(path, data, size, offset, verify));
+  fat_vfs_changed(path);
+  return rc;
+}
+
 extern "C" void fat32_list_directory(const char *path) {
   if (!is_fat_initialized) {
     terminal_writestring("FAT not mounted.\n");
@@ -1923,7 +2474,7 @@ extern "C" void fat32_list_directory(const char *path) {
 
     /* Next cluster */
     current_cluster =
-        fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+        fat_get_next_cluster(current_cluster, fat_start, bps);
     if (current_cluster >= 0x0FFFFFF8)
       break;
   }
@@ -2049,7 +2600,7 @@ extern "C" int fat32_read_directory(const char *path, fat_file_info_t *out,
     }
 
     current_cluster =
-        fat_get_next_cluster(current_cluster, fat_start, bps, sector);
+        fat_get_next_cluster(current_cluster, fat_start, bps);
     if (current_cluster >= 0x0FFFFFF8)
       break;
   }
@@ -2058,9 +2609,10 @@ done_reading:
   return count;
 }
 
-extern "C" int fat32_delete_file(const char *path) {
+static int fat32_delete_file_impl(const char *path) {
   if (!is_fat_initialized)
     return -1;
+  fat_changed();
 
   uint8_t *sector = (uint8_t *)kmalloc(512);
   if (!sector)
@@ -2102,6 +2654,9 @@ extern "C" int fat32_delete_file(const char *path) {
   }
 
   /* Mark deleted in directory entry */
+  fat_dcache_purge_dir(parent_cluster);
+  if (is_dir && file_cluster != 0)
+    fat_dcache_purge_dir(file_cluster);
   disk_read_sector(entry_sector, sector);
   ((struct fat_dir_entry *)sector)[entry_offset].name[0] = 0xE5;
   disk_write_sector(entry_sector, sector);
@@ -2114,27 +2669,20 @@ extern "C" int fat32_delete_file(const char *path) {
                        bps);
 
   /* Free cluster chain */
-  if (file_cluster != 0) {
-    uint32_t current = file_cluster;
-    while (current < 0x0FFFFFF8 && current != 0) {
-      uint32_t fat_sector = fat_start + (current * 4) / bps;
-      uint32_t fat_offset = (current * 4) % bps;
-
-      disk_read_sector(fat_sector, sector);
-      uint32_t next = (*(uint32_t *)(sector + fat_offset)) & 0x0FFFFFFF;
-
-      /* Mark free */
-      *(uint32_t *)(sector + fat_offset) = 0;
-      disk_write_sector(fat_sector, sector);
-
-      current = next;
-    }
-  }
+  if (file_cluster != 0)
+    fat_free_chain(file_cluster, fat_start, bps);
 
   kfree(sector);
   return 0;
 }
 
+extern "C" int fat32_delete_file(const char *path) {
+  int rc = fat_commit(fat32_delete_file_impl(path));
+  fat_vfs_changed(path);
+  vnode_cache_flush(); /* names may have gone */
+  return rc;
+}
+
 static int write_sector_verified(uint32_t lba, const uint8_t *buf, int verify) {
   int local_verify = verify;
   uint8_t *verify_buf = 0;
@@ -2169,6 +2717,7 @@ static int write_sector_verified(uint32_t lba, const uint8_t *buf, int verify) {
 }
 
 static int fat32_create_directory_impl(const char *path, int verify) {
+  fat_changed();
   if (!path) {
     serial("[FAT] mkdir: invalid path (null)\n");
     return -101;
@@ -2210,7 +2759,6 @@ static int fat32_create_directory_impl(const char *path, int verify) {
   uint32_t root_cluster = bpb->root_cluster;
   uint8_t spc = bpb->sectors_per_cluster;
   uint16_t bps = bpb->bytes_per_sector;
-  uint32_t sectors_per_fat = bpb->sectors_per_fat_32;
 
   uint32_t parent_cluster = 0;
   const char *fname = 0;
@@ -2237,7 +2785,7 @@ static int fat32_create_directory_impl(const char *path, int verify) {
   }
 
   /* allocate cluster */
-  uint32_t dir_cluster = fat_alloc_cluster(fat_start, sectors_per_fat, sector);
+  uint32_t dir_cluster = fat_alloc_cluster(fat_start, bps);
   if (dir_cluster == 0) {
     serial("[FAT] mkdir: alloc cluster failed for %s\n", path);
     kfree(sector);
@@ -2250,13 +2798,15 @@ static int fat32_create_directory_impl(const char *path, int verify) {
     kfree(sector);
     return -108;
   }
+  /* the cluster may have held a directory before */
+  fat_dcache_purge_dir(dir_cluster);
 
   /* create directory entry in parent */
   char name_buf[256];
   copy_component(name_buf, sizeof(name_buf), fname, fname_len);
   int dc = dir_create_entry_with_cluster(
       parent_cluster, name_buf, fname_len, dir_cluster, 0, 0x10, data_start,
-      fat_start, spc, bps, sectors_per_fat, verify);
+      fat_start, spc, bps, verify);
   if (dc != 0) {
     serial("[FAT] mkdir: entry creation failed (code=%d)\n", dc);
     if (fat_set_next_cluster_checked(dir_cluster, 0, fat_start, bps, sector,
@@ -2308,11 +2858,11 @@ static int fat32_create_directory_impl(const char *path, int verify) {
 }
 
 extern "C" int fat32_create_directory(const char *path) {
-  return fat32_create_directory_impl(path, 0);
+  return fat_commit(fat32_create_directory_impl(path, 0));
 }
 
 extern "C" int fat32_create_directory_verified(const char *path, int verify) {
-  return fat32_create_directory_impl(path, verify ? 1 : 0);
+  return fat_commit(fat32_create_directory_impl(path, verify ? 1 : 0));
 }
 
 extern "C" int fat32_directory_exists(const char *path) {
@@ -2360,9 +2910,10 @@ extern "C" int fat32_directory_exists(const char *path) {
   return (res == 0 && is_dir) ? 1 : 0;
 }
 
-extern "C" int fat32_rename(const char *src, const char *dst) {
+static int fat32_rename_impl(const char *src, const char *dst) {
   if (!is_fat_initialized)
     return -1;
+  fat_changed();
 
   uint8_t *sector = (uint8_t *)kmalloc(512);
   if (!sector)
@@ -2380,7 +2931,6 @@ extern "C" int fat32_rename(const char *src, const char *dst) {
   uint32_t root_cluster = bpb->root_cluster;
   uint8_t spc = bpb->sectors_per_cluster;
   uint16_t bps = bpb->bytes_per_sector;
-  uint32_t sectors_per_fat = bpb->sectors_per_fat_32;
 
   uint32_t src_parent;
   const char *src_name;
@@ -2429,13 +2979,14 @@ extern "C" int fat32_rename(const char *src, const char *dst) {
 
   if (dir_create_entry_with_cluster(dst_parent, dst_buf, dst_len, src_cluster,
                                     src_size, attr, data_start, fat_start, spc,
-                                    bps, sectors_per_fat, 0) != 0) {
+                                    bps, 0) != 0) {
     kfree(sector);
     return -1;
   }
 
   /* If directory moved, update .. entry to new parent */
   if (is_dir && src_cluster != 0) {
+    fat_dcache_purge_dir(src_cluster);
     uint32_t dir_lba = data_start + (src_cluster - 2) * spc;
     disk_read_sector(dir_lba, sector);
     struct fat_dir_entry *entries = (struct fat_dir_entry *)sector;
@@ -2450,6 +3001,7 @@ extern "C" int fat32_rename(const char *src, const char *dst) {
   }
 
   /* delete old entry + LFN, but keep clusters */
+  fat_dcache_purge_dir(src_parent);
   disk_read_sector(src_sector, sector);
   ((struct fat_dir_entry *)sector)[src_offset].name[0] = 0xE5;
   disk_write_sector(src_sector, sector);
@@ -2462,8 +3014,20 @@ extern "C" int fat32_rename(const char *src, const char *dst) {
   return 0;
 }
 
+extern "C" int fat32_rename(const char *src, const char *dst) {
+  int rc = fat_commit(fat32_rename_impl(src, dst));
+  fat_vfs_changed(src);
+  fat_vfs_changed(dst);
+  vnode_cache_flush();
+  return rc;
+}
+
 extern "C" int fat32_format(uint32_t lba, uint32_t sector_count,
                             const char *label) {
+  fat_changed();
+  fat_space_drop();
+  fat_dcache_drop();
+  fat_vfs_changed_all();
   if (sector_count < 65536) {
     terminal_writestring(
         "Error: Partition too small for FAT32 (need > 32MB approx)\n");
@@ -2643,6 +3207,46 @@ extern "C" int32_t fat32_get_file_size(const char *path) {
   return (res == 0 && !is_dir) ? (int32_t)file_size : -1;
 }
 
+extern "C" int fat32_stat(const char *path, uint32_t *size, int *is_dir) {
+  if (!is_fat_initialized || !path)
+    return -1;
+  if (strcmp(path, "/") == 0 || strcmp(path, "") == 0) {
+    if (size)
+      *size = 0;
+    if (is_dir)
+      *is_dir = 1;
+    return 0;
+  }
+
+  uint8_t *sector = (uint8_t *)kmalloc(512);
+  if (!sector)
+    return -1;
+  const struct fat_geom *g = fat_geom_get(sector);
+  kfree(sector);
+  if (!g)
+    return -1;
+
+  uint32_t parent_cluster;
+  const char *fname;
+  int fname_len;
+  if (resolve_parent(path, g->root_cluster, g->data_start, g->fat_start,
+                     g->spc, g->bps, &parent_cluster, &fname,
+                     &fname_len) != 0)
+    return -1;
+
+  uint32_t file_size = 0;
+  bool dir = false;
+  if (find_in_cluster(parent_cluster, fname, fname_len, g->data_start,
+                      g->fat_start, g->spc, g->bps, NULL, &file_size, NULL,
+                      NULL, &dir) != 0)
+    return -1;
+  if (size)
+    *size = dir ? 0 : file_size;
+  if (is_dir)
+    *is_dir = dir ? 1 : 0;
+  return 0;
+}
+
 /* Încearcă să monteze automat prima partiție FAT găsită */
 void fat_automount(void) {
   if (is_fat_initialized)
@@ -2682,9 +3286,7 @@ void fat_automount(void) {
             "[AutoMount] Mounting FAT32 on partition %c (LBA %u)...\n",
             g_assigns[i].letter, g_assigns[i].lba);
         if (fat32_init(0, g_assigns[i].lba) == 0) {
-          is_fat_initialized = true;
-          current_lba = g_assigns[i].lba;
-          current_letter = g_assigns[i].letter;
+          fat32_set_mounted(g_assigns[i].lba, g_assigns[i].letter);
           return;
         }
       }
@@ -2726,6 +3328,8 @@ extern "C" int cmd_fat(int argc, char **argv) {
       terminal_printf("  Partition: %c\n",
                       current_letter ? current_letter : '?');
       terminal_printf("  LBA Start: %u\n", current_lba);
+      terminal_printf("  Dentry cache: %u hits, %u misses\n", g_dcache_hits,
+                      g_dcache_misses);
     } else
       terminal_writestring("FAT not mounted.\n");
     return 0;
@@ -2760,9 +3364,7 @@ extern "C" int cmd_fat(int argc, char **argv) {
     // 0 = device ID (ignorat dacă fat.c folosește disk_read_sector global)
     if (fat32_init(0, lba) == 0) {
       terminal_writestring("Mount successful.\n");
-      is_fat_initialized = true;
-      current_lba = lba;
-      current_letter = letter;
+      fat32_set_mounted(lba, letter);
     } else {
       terminal_writestring("Mount failed.\n");
       is_fat_initialized = false;
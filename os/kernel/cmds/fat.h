@@ -29,9 +29,23 @@ int fat32_read_directory(const char* path, fat_file_info_t* out, int max_entries
 /* Citește un fișier complet (limitat la max_size) */
 int fat32_read_file(const char* path, void* buf, uint32_t max_size);
 
-/* Citește dintr-un fișier de la un offset specificat (pentru fișiere mari) */
+/* Citește dintr-un fișier de la un offset specificat (pentru fișiere mari).
+ * Ultimul fișier citit rămâne deschis, deci citirile pe bucăți ale
+ * aceluiași fișier nu mai rezolvă calea și lanțul FAT la fiecare apel. */
 int fat32_read_file_offset(const char* path, void* buf, uint32_t size, uint32_t offset);
 
+/* Fișier deschis: intrarea din director, geometria volumului și lanțul de
+ * clustere (ca extent-uri contigue) sunt citite o singură dată, la open.
+ * fat32_pread caută extent-ul offset-ului binar și citește fiecare extent
+ * dintr-o singură cerere. Dacă volumul se schimbă între timp (scriere,
+ * ștergere, remontare), handle-ul se reîncarcă singur după cale. */
+typedef struct fat_file fat_file_t;
+
+fat_file_t* fat32_open(const char* path);           /* NULL: negăsit / director */
+int fat32_pread(fat_file_t* f, void* buf, uint32_t size, uint32_t offset); /* bytes citiți */
+int32_t fat32_fsize(fat_file_t* f);                 /* -1 dacă fișierul a dispărut */
+void fat32_close(fat_file_t* f);
+
 /* Creează un fișier (sau suprascrie) */
 int fat32_create_file(const char* path, const void* data, uint32_t size);
 
@@ -84,6 +98,9 @@ int fat32_format(uint32_t lba, uint32_t sector_count, const char* label);
 /* Get file size (returns -1 if not found) */
 int32_t fat32_get_file_size(const char* path);
 
+/* Size and kind of a file or directory in one lookup (-1 if not found) */
+int fat32_stat(const char* path, uint32_t* size, int* is_dir);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,9 +16,10 @@ int cmd_gcc(int argc, char **argv) {
   // 1. Check if it's a file first (only if 1 argument is provided)
   if (argc == 2) {
     vnode_t *node = vfs_resolve(argv[1]);
-    if (node) {
+    if (node && node->type == VNODE_FILE && node->ops && node->ops->read) {
       char *buf = (char *)kmalloc(4096);
       int bytes = node->ops->read(node, 0, (uint8_t *)buf, 4095);
+      vnode_put(node);
       if (bytes > 0) {
         buf[bytes] = '\0';
         toolchain_compile_and_run(buf);
@@ -27,6 +28,7 @@ int cmd_gcc(int argc, char **argv) {
       kfree(buf);
       return 0;
     }
+    vnode_put(node);
   }
 
   // 2. It's a string (potentially split into multiple argv parts if not quoted)
@@ -51,7 +51,7 @@ static const help_entry_t help_entries[] = {
     { "ticks", "ticks", "Show PIT ticks" },
     { "touch", "touch <file>", "Create empty file" },
     { "uptime", "uptime", "Show uptime" },
-    { "vfs", "vfs", "VFS info" },
+    { "vfs", "vfs [path] | vfs mount <dev> <path>", "VFS mounts, vnode/page cache, resolve a path; mount ChrysFS" },
     { "write", "write <file>", "Interactive line editor" },
     { "win", "win <app>", "Launch GUI app" },
     { "vt", "vt <cmd>", "Virtual terminal control" },
@@ -67,6 +67,11 @@ static const help_entry_t help_entries[] = {
     { "tee", "tee <file>", "Write stdin to file and stdout" },
     { "sha256", "sha256 [file]", "Compute SHA-256 hash" },
     { "sleep", "sleep <ms|Ns|Nms>", "Sleep for a duration" },
+    { "bench", "bench mem", "memcpy/memset/memmove throughput" },
+    { "locks", "locks [reset]", "Lock contention stats (SYNC_DEBUG)" },
+    { "bcache", "bcache [flush|reset|size <blocks>]", "Block cache stats and control" },
+    { "trace", "trace [on|off <subsys|all>] [dump|raw [n]] [clear]", "Storage trace ring" },
+    { "blkbench", "blkbench [dev] [rw=..] [bs=4k] [iodepth=N] [size=..] [cache=on|off]", "Block device benchmark" },
     { "which", "which <command>", "Locate a command" },
     { "size", "size <file>", "Show file size" },
 };
@@ -0,0 +1,32 @@
+// kernel/cmds/locks.cpp
+// locks [reset] : per-lock statistics (needs a -DSYNC_DEBUG build)
+#include "locks.h"
+#include "../terminal.h"
+#include "../string.h"
+#include "../sync/spinlock.h"
+#include <stdint.h>
+
+extern "C" int cmd_locks(int argc, char** argv) {
+    if (!sync_debug_enabled()) {
+        terminal_writestring("locks: statistics need a SYNC_DEBUG build (see Makefile)\n");
+        return -1;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        sync_reset_stats();
+        terminal_writestring("locks: statistics reset\n");
+        return 0;
+    }
+
+    lock_stats_t st;
+    int n = 0;
+    terminal_writestring("name: acquires contended spins max_hold(cycles)\n");
+    while (sync_get_stats(n, &st) == 0) {
+        uint32_t hold = st.max_hold > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)st.max_hold;
+        terminal_printf("%s: acq=%u cont=%u spins=%u hold=%u\n",
+                        st.name, st.acquires, st.contended, st.spins, hold);
+        n++;
+    }
+    if (n == 0) terminal_writestring("(no locks used yet)\n");
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include "../terminal.h"
 #include "../mem/kmalloc.h"
 #include "../mem/slab.h"
+#include "../mem/magazine.h"
 #include "../mem/buddy.h"
 
 #include <stdint.h>
@@ -82,8 +83,9 @@ static void print_help(void) {
         "mem - memory tests and info\n"
         "usage:\n"
         "  mem help              : show this help\n"
-        "  mem status            : show heap range\n"
+        "  mem status            : show heap range and allocator stats\n"
         "  mem slab              : quick slab allocator smoke test\n"
+        "  mem caches            : list slab caches and per-cpu magazine stats\n"
         "  mem buddy             : quick buddy allocator smoke test\n"
         "  mem kmalloc <bytes>   : allocate and free <bytes> using kmalloc/kfree\n"
     );
@@ -95,6 +97,15 @@ static void cmd_mem_status(void) {
     uintptr_t end   = (uintptr_t)&__heap_end;
     unsigned size = (unsigned)(end - start);
     terminal_printf("heap: %p - %p  (%u bytes)\n", (void*)start, (void*)end, size);
+
+    kmalloc_stats_t st;
+    kmalloc_get_stats(&st);
+    terminal_printf("  free: %u bytes in %u blocks (largest %u)\n",
+        (unsigned)st.free_bytes, st.free_blocks, (unsigned)st.largest_free);
+    terminal_printf("  bins: %u bytes cached, %u allocs, %u frees, %u refills\n",
+        (unsigned)st.bin_bytes, st.small_allocs, st.small_frees, st.small_refills);
+    terminal_printf("  large: %u allocs, %u frees, %u failures\n",
+        st.large_allocs, st.large_frees, st.failures);
 }
 
 static void cmd_mem_slab(const char* /*rest*/) {
@@ -117,9 +128,29 @@ static void cmd_mem_slab(const char* /*rest*/) {
     if (a) slab_free(cache, a);
     if (cobj) slab_free(cache, cobj);
     if (d) slab_free(cache, d);
+    slab_destroy(cache);
     terminal_writestring("slab test done\n");
 }
 
+static void cmd_mem_caches(void) {
+    slab_stats_t st;
+    int i;
+    for (i = 0; slab_get_stats(i, &st); ++i) {
+        terminal_printf("%s: size=%u per-slab=%u inuse=%u\n",
+            st.name ? st.name : "?", (unsigned)st.obj_size, st.objs_per_slab, st.objs_inuse);
+        terminal_printf("  slabs partial=%u full=%u empty=%u, pages released=%u\n",
+            st.slabs_partial, st.slabs_full, st.slabs_empty, st.pages_released);
+    }
+    if (i == 0) terminal_writestring("no slab caches\n");
+
+    mag_stats_t ms;
+    for (i = 0; mag_get_stats(i, &ms); ++i) {
+        terminal_printf("%s (per-cpu): hits=%u depot-swaps=%u misses=%u\n",
+            ms.name ? ms.name : "?", ms.hits, ms.depot_swaps, ms.misses);
+        terminal_printf("  depot full=%u empty=%u\n", ms.depot_full, ms.depot_empty);
+    }
+}
+
 static void cmd_mem_buddy(const char* /*rest*/) {
     terminal_writestring("buddy test: allocating pages (order 0 = 4KB, order 1 = 8KB)...\n");
     void* p4k = buddy_alloc_page(0);
@@ -130,6 +161,14 @@ static void cmd_mem_buddy(const char* /*rest*/) {
     else terminal_writestring("  note: buddy_alloc_page(order=0) returned NULL\n");
     if (p8k) { buddy_free_page(p8k, 1); terminal_printf("  freed %p (order 1)\n", p8k); }
     else terminal_writestring("  note: buddy_alloc_page(order=1) returned NULL\n");
+
+    buddy_stats_t st;
+    buddy_get_stats(&st);
+    terminal_printf("  free %u / %u pages, largest order %d, fragmentation %u%%\n",
+        st.free_pages, st.total_pages, st.largest_order, st.frag_percent);
+    for (int o = 0; o <= BUDDY_MAX_ORDER; ++o) {
+        if (st.free_blocks[o]) terminal_printf("    order %d: %u free\n", o, st.free_blocks[o]);
+    }
     terminal_writestring("buddy test done\n");
 }
 
@@ -212,6 +251,7 @@ extern "C" void cmd_mem(int argc, char* argv[])
     if (strcmp(token, "status") == 0) { cmd_mem_status(); return; }
     if (strcmp(token, "slab") == 0) { cmd_mem_slab(p); return; }
     if (strcmp(token, "buddy") == 0) { cmd_mem_buddy(p); return; }
+    if (strcmp(token, "caches") == 0) { cmd_mem_caches(); return; }
     if (strcmp(token, "kmalloc") == 0) { cmd_mem_kmalloc(p); return; }
 
     /* fallback scanning the whole args string */
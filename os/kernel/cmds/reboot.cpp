@@ -1,4 +1,5 @@
 #include "reboot.h"
+#include "../storage/bcache.h"
 
 static inline void outb(unsigned short port, unsigned char val) {
     asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
@@ -11,6 +12,8 @@ static inline unsigned char inb(unsigned short port) {
 }
 
 extern "C" void cmd_reboot(const char*) {
+    bcache_flush(0); /* dirty sectors would be lost */
+
     // Disable interrupts
     asm volatile("cli");
 
@@ -47,6 +47,11 @@
 #include "shutdown.h"
 #include "size.h"
 #include "sleep.h"
+#include "bench.h"
+#include "locks.h"
+#include "bcache.h"
+#include "trace.h"
+#include "blkbench.h"
 #include "sysfetch.h"
 #include "tail.h"
 #include "tee.h"
@@ -287,6 +292,21 @@ static int wrap_cmd_sha256(int argc, char **argv) {
 static int wrap_cmd_sleep(int argc, char **argv) {
   return wrap_new_int(cmd_sleep, argc, argv);
 } /* int cmd_sleep(int,char**) */
+static int wrap_cmd_bench(int argc, char **argv) {
+  return wrap_new_int(cmd_bench, argc, argv);
+} /* int cmd_bench(int,char**) */
+static int wrap_cmd_locks(int argc, char **argv) {
+  return wrap_new_int(cmd_locks, argc, argv);
+} /* int cmd_locks(int,char**) */
+static int wrap_cmd_bcache(int argc, char **argv) {
+  return wrap_new_int(cmd_bcache, argc, argv);
+} /* int cmd_bcache(int,char**) */
+static int wrap_cmd_trace(int argc, char **argv) {
+  return wrap_new_int(cmd_trace, argc, argv);
+} /* int cmd_trace(int,char**) */
+static int wrap_cmd_blkbench(int argc, char **argv) {
+  return wrap_new_int(cmd_blkbench, argc, argv);
+} /* int cmd_blkbench(int,char**) */
 static int wrap_cmd_which(int argc, char **argv) {
   return wrap_new_int(cmd_which, argc, argv);
 } /* int cmd_which(int,char**) */
@@ -345,6 +365,11 @@ Command command_table[] = {
     {"rm", wrap_cmd_rm},
     {"size", wrap_cmd_size},
     {"sleep", wrap_cmd_sleep},
+    {"bench", wrap_cmd_bench},
+    {"locks", wrap_cmd_locks},
+    {"bcache", wrap_cmd_bcache},
+    {"trace", wrap_cmd_trace},
+    {"blkbench", wrap_cmd_blkbench},
     {"sha256", wrap_cmd_sha256},
     {"shutdown", wrap_cmd_shutdown},
     {"sysfetch", wrap_cmd_sysfetch},
@@ -1,4 +1,5 @@
 #include "shutdown.h"
+#include "../storage/bcache.h"
 
 static inline void outw(unsigned short port, unsigned short val) {
     asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
@@ -9,6 +10,8 @@ static inline void outb(unsigned short port, unsigned char val) {
 }
 
 extern "C" void cmd_shutdown(const char*) {
+    bcache_flush(0); /* dirty sectors would be lost */
+
     asm volatile("cli");
 
     // QEMU / Bochs / modern emulators
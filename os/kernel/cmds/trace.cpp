@@ -0,0 +1,81 @@
+// kernel/cmds/trace.cpp
+// trace [on|off <subsys|all>] [dump|raw [n]] [clear] : in-memory trace ring
+#include "trace.h"
+#include "../terminal.h"
+#include "../string.h"
+#include "../debug/trace.h"
+#include <stdint.h>
+
+static void set_subsys(const char* name, int on) {
+    if (strcmp(name, "all") == 0) {
+        for (int i = 0; i < TRACE_NSUBSYS; i++) trace_enable(i, on);
+        return;
+    }
+    int sub = trace_subsys_find(name);
+    if (sub < 0) terminal_printf("trace: unknown subsystem '%s'\n", name);
+    else trace_enable(sub, on);
+}
+
+/* last n records, oldest first; raw skips the decoding. A record that
+   cannot be read was either overwritten by writers or dropped by a
+   trace clear meanwhile; trace_base() tells the two apart. */
+static void dump(uint32_t n, int raw) {
+    uint32_t base = trace_base();    /* before head: never past it */
+    uint32_t end = trace_head();
+    uint32_t avail = end - base;
+    uint32_t start = end - (n < avail ? n : avail);
+    uint64_t t0 = 0;
+    uint32_t shown = 0, lost = 0, cleared = 0;
+    for (uint32_t i = start; i != end; i++) {
+        trace_rec_t r;
+        if (!trace_read(i, &r)) {
+            if ((int32_t)(i - trace_base()) < 0) cleared++;
+            else lost++;
+            continue;
+        }
+        if (!shown++) t0 = r.ns;
+        uint32_t us = (uint32_t)((r.ns - t0) / 1000);
+        const trace_desc_t* d = raw ? 0 : trace_desc(r.id);
+        terminal_printf("%u +%u.%03u ms cpu%u ", i, us / 1000, us % 1000, r.cpu);
+        if (d) {
+            terminal_printf("%s: ", d->name);
+            terminal_printf(d->fmt, r.arg[0], r.arg[1], r.arg[2], r.arg[3]);
+            terminal_writestring("\n");
+        } else {
+            terminal_printf("id 0x%x: %x %x %x %x\n", r.id, r.arg[0], r.arg[1], r.arg[2], r.arg[3]);
+        }
+    }
+    if (!shown) terminal_writestring("trace: ring empty\n");
+    if (lost) terminal_printf("(%u records overwritten while reading)\n", lost);
+    if (cleared) terminal_printf("(%u records cleared while reading)\n", cleared);
+}
+
+extern "C" int cmd_trace(int argc, char** argv) {
+    if (argc >= 3 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)) {
+        int on = strcmp(argv[1], "on") == 0;
+        for (int i = 2; i < argc; i++) set_subsys(argv[i], on);
+        return 0;
+    }
+    if (argc >= 2 && (strcmp(argv[1], "dump") == 0 || strcmp(argv[1], "raw") == 0)) {
+        int n = argc >= 3 ? atoi(argv[2]) : 32;
+        if (n <= 0 || n > TRACE_RING) n = TRACE_RING;
+        dump((uint32_t)n, argv[1][0] == 'r');
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "clear") == 0) {
+        trace_clear();
+        terminal_writestring("trace: ring cleared\n");
+        return 0;
+    }
+    if (argc >= 2) {
+        terminal_writestring("usage: trace [on|off <subsys|all>] [dump|raw [n]] [clear]\n");
+        return -1;
+    }
+
+    terminal_printf("records: %u (ring holds %u)\n", trace_head(), TRACE_RING);
+    for (int i = 0; i < TRACE_NSUBSYS; i++) {
+        terminal_printf("  %s: %s\n", trace_subsys_name(i),
+                        (trace_mask & (1U << i)) ? "on" : "off");
+    }
+    return 0;
+}
@@ -5,22 +5,66 @@
 
 #include "../fs/vfs/mount.h"
 #include "../fs/vfs/vnode.h"
+#include "../fs/vfs/pcache.h"
+#include "../fs/chrysfs/chrysfs.h"
+#include "../storage/block.h"
 
+/* vfs mount <dev> <path>: mount the ChrysFS volume on a block device */
+static void vfs_mount_chrysfs(int argc, char** argv)
+{
+    if (argc < 4) {
+        terminal_writestring("Usage: vfs mount <dev> <path>\n");
+        return;
+    }
+    block_device_t* dev = block_get(argv[2]);
+    if (!dev) {
+        terminal_printf("vfs: no block device %s\n", argv[2]);
+        return;
+    }
+    if (chrysfs_mount(dev, argv[3]) != 0) {
+        terminal_printf("vfs: %s: not a ChrysFS volume\n", argv[2]);
+        return;
+    }
+    terminal_printf("ChrysFS on %s mounted at %s\n", argv[2], argv[3]);
+}
+
+/* vfs [path]: mount table, vnode and page cache counters, and what path
+   (default "/") resolves to */
 void cmd_vfs(int argc, char** argv)
 {
-    (void)argc;
-    (void)argv;
+    if (argc > 1 && strcmp(argv[1], "mount") == 0) {
+        vfs_mount_chrysfs(argc, argv);
+        return;
+    }
+
+    const char* path = argc > 1 ? argv[1] : "/";
 
-    terminal_writestring("VFS test:\n");
+    terminal_writestring("VFS mounts:\n");
+    const char* mp;
+    vnode_t* mroot;
+    for (int i = 0; vfs_mount_at(i, &mp, &mroot); i++)
+        terminal_printf("  %s\n", mp);
 
-    vnode_t* root = vfs_resolve("/");
+    vnode_cache_stats_t st;
+    vnode_cache_stats(&st);
+    terminal_printf("vnode cache: %u cached, %u hits, %u misses\n",
+                    st.cached, st.hits, st.misses);
+
+    pcache_stats_t pc;
+    pcache_get_stats(&pc);
+    terminal_printf("page cache: %u pages (%u KB), %u mapped, %u hits, %u misses, "
+                    "%u evicted, %u reclaimed\n",
+                    pc.pages, pc.pages * (PCACHE_PAGE / 1024), pc.mapped, pc.hits,
+                    pc.misses, pc.evictions, pc.reclaimed);
+
+    vnode_t* root = vfs_resolve(path);
 
     if (!root) {
-        terminal_writestring("  root = NULL (not mounted)\n");
+        terminal_printf("  %s: not found\n", path);
         return;
     }
 
-    terminal_writestring("  root mounted OK\n");
+    terminal_printf("  %s: resolved OK\n", path);
 
     terminal_writestring("  name: ");
     terminal_writestring(root->name ? root->name : "(null)");
@@ -47,4 +91,6 @@ void cmd_vfs(int argc, char** argv)
         terminal_writestring("present\n");
     else
         terminal_writestring("NULL\n");
+
+    vnode_put(root);
 }
@@ -8,6 +8,7 @@
 #include "../hardware/apic.h"
 #include "../input/input.h"
 #include "../shell/shell.h"
+#include "../storage/bcache.h"
 #include "../storage/io_sched.h"
 #include "../string.h"
 #include "../terminal.h"
@@ -996,6 +997,7 @@ extern "C" int cmd_launch(int argc, char **argv) {
     /* Update Subsystems (Missing Pollers) */
     usb_poll();
     io_sched_poll();
+    bcache_periodic();
     net_poll();
     ps2_controller_watchdog();
 
@@ -1355,7 +1357,9 @@ extern "C" int cmd_launch(int argc, char **argv) {
       wm_render();
     }
 
-    asm volatile("hlt");
+    /* sleep until input (boosted wake-up when run as a task), at most
+       10 ms to keep the USB/net poll cadence */
+    input_wait(10);
   }
 
   /* 5. Cleanup & Return to Text Mode */
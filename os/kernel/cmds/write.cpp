@@ -129,8 +129,8 @@ extern "C" int cmd_write(int argc, char** argv) {
                 wm_render();
             }
         } else {
-            /* Wait for interrupt to avoid burning CPU */
-            asm volatile("hlt");
+            /* Sleep until the next key instead of burning CPU */
+            input_wait(0);
         }
     }
 
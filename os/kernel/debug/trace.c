@@ -0,0 +1,105 @@
+/* kernel/debug/trace.c
+   Lock-free trace ring (see trace.h). head counts every record ever
+   claimed; record i lives in ring[i % TRACE_RING] and carries seq = i + 1
+   once it is fully written, so a reader can tell a finished record from
+   one being written or already overwritten. */
+
+#include "trace.h"
+#include "../hardware/hpet.h"
+#include "../time/timer.h"
+#include "../smp/smp.h"
+#include "../string.h"
+
+volatile uint32_t trace_mask = 0;
+
+static trace_rec_t ring[TRACE_RING];
+static volatile uint32_t head = 0;
+static volatile uint32_t base = 0;   /* records before this were cleared */
+
+static const char *subsys_names[TRACE_NSUBSYS] = {
+    "ahci", "iosched", "bcache", "fat", "ata"
+};
+
+/* lba arguments are the low 32 bits of the sector number */
+static const trace_desc_t descs[] = {
+    { TR_AHCI_SUBMIT,    "ahci.submit",    "port %u slot %u lba %u count/w 0x%x" },
+    { TR_AHCI_DONE,      "ahci.done",      "port %u slots 0x%x status %d" },
+    { TR_AHCI_ERROR,     "ahci.error",     "port %u is 0x%x tfd 0x%x serr 0x%x" },
+    { TR_IOS_QUEUE,      "ios.queue",      "op %u lba %u count %u inflight %u" },
+    { TR_IOS_DISPATCH,   "ios.dispatch",   "op %u lba %u count %u merged %u" },
+    { TR_IOS_DONE,       "ios.done",       "op %u lba %u count %u status %d" },
+    { TR_BC_MISS,        "bc.miss",        "lba %u count %u" },
+    { TR_BC_READAHEAD,   "bc.readahead",   "lba %u count %u window %u" },
+    { TR_BC_WRITEBEHIND, "bc.writebehind", "lba %u count %u window %u" },
+    { TR_BC_FLUSH,       "bc.flush",       "sectors %u status %d" },
+    { TR_FAT_ALLOC,      "fat.alloc",      "want %u got %u first %u" },
+    { TR_FAT_WRITE,      "fat.write",      "lba %u sectors %u of %u" },
+    { TR_FAT_CREATE,     "fat.create",     "bytes %u sectors %u lba %u" },
+    { TR_FAT_DONE,       "fat.done",       "wrote %u of %u bytes" },
+    { TR_ATA_CMD,        "ata.cmd",        "ata%u cmd 0x%x lba %u count %u" },
+    { TR_ATA_DONE,       "ata.done",       "ata%u status 0x%x" },
+    { TR_ATA_ERROR,      "ata.error",      "ata%u status 0x%x err 0x%x" },
+};
+
+void trace_emit(uint16_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    uint64_t ns = hpet_time_ns();
+    if (!ns) ns = timer_now_ns();
+    uint32_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    trace_rec_t *r = &ring[idx & (TRACE_RING - 1)];
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->id = id;
+    r->cpu = (uint8_t)smp_current_cpu();
+    r->ns = ns;
+    r->arg[0] = a0;
+    r->arg[1] = a1;
+    r->arg[2] = a2;
+    r->arg[3] = a3;
+    __atomic_store_n(&r->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t trace_head(void) {
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+}
+
+uint32_t trace_base(void) {
+    return __atomic_load_n(&base, __ATOMIC_ACQUIRE);
+}
+
+int trace_read(uint32_t idx, trace_rec_t *out) {
+    if ((int32_t)(idx - trace_base()) < 0) return 0;
+    const trace_rec_t *r = &ring[idx & (TRACE_RING - 1)];
+    uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (seq != idx + 1) return 0;
+    *out = *r;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq;
+}
+
+void trace_clear(void) {
+    __atomic_store_n(&base, trace_head(), __ATOMIC_RELEASE);
+}
+
+const char *trace_subsys_name(int sub) {
+    return (sub >= 0 && sub < TRACE_NSUBSYS) ? subsys_names[sub] : "?";
+}
+
+int trace_subsys_find(const char *name) {
+    for (int i = 0; i < TRACE_NSUBSYS; i++) {
+        if (strcmp(subsys_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+void trace_enable(int sub, int on) {
+    if (sub < 0 || sub >= TRACE_NSUBSYS) return;
+    if (on) __atomic_fetch_or(&trace_mask, 1U << sub, __ATOMIC_RELAXED);
+    else __atomic_fetch_and(&trace_mask, ~(1U << sub), __ATOMIC_RELAXED);
+}
+
+const trace_desc_t *trace_desc(uint16_t id) {
+    for (uint32_t i = 0; i < sizeof(descs) / sizeof(descs[0]); i++) {
+        if (descs[i].id == id) return &descs[i];
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kernel/debug/trace.h
+   In-memory trace ring for hot paths that used to print to serial.
+   A tracepoint costs a mask test when its subsystem is off, and a
+   timestamp plus a 32-byte store when it is on. Writers never lock: each
+   claims a slot with one atomic increment, so IRQ handlers and other
+   CPUs can trace concurrently. The oldest records are overwritten.
+   Shell: trace [on|off <subsys|all>] [dump|raw [n]] [clear] */
+
+/* subsystems, switched on and off at runtime with trace_enable() */
+enum {
+    TRACE_AHCI = 0,
+    TRACE_IOSCHED,
+    TRACE_BCACHE,
+    TRACE_FAT,
+    TRACE_ATA,
+    TRACE_NSUBSYS
+};
+
+/* event id: subsystem in the high byte */
+#define TRACE_EV(sub, n)   (((sub) << 8) | (n))
+#define TRACE_SUB(ev)      ((ev) >> 8)
+
+enum {
+    TR_AHCI_SUBMIT    = TRACE_EV(TRACE_AHCI, 0),    /* port, slot, lba, count | write << 31 */
+    TR_AHCI_DONE      = TRACE_EV(TRACE_AHCI, 1),    /* port, slot mask, status */
+    TR_AHCI_ERROR     = TRACE_EV(TRACE_AHCI, 2),    /* port, is, tfd, serr */
+    TR_IOS_QUEUE      = TRACE_EV(TRACE_IOSCHED, 0), /* op, lba, count, in flight */
+    TR_IOS_DISPATCH   = TRACE_EV(TRACE_IOSCHED, 1), /* op, lba, count, requests merged */
+    TR_IOS_DONE       = TRACE_EV(TRACE_IOSCHED, 2), /* op, lba, count, status */
+    TR_BC_MISS        = TRACE_EV(TRACE_BCACHE, 0),  /* lba, count */
+    TR_BC_READAHEAD   = TRACE_EV(TRACE_BCACHE, 1),  /* lba, count, window */
+    TR_BC_WRITEBEHIND = TRACE_EV(TRACE_BCACHE, 2),  /* lba, count, window */
+    TR_BC_FLUSH       = TRACE_EV(TRACE_BCACHE, 3),  /* sectors written, status */
+    TR_FAT_ALLOC      = TRACE_EV(TRACE_FAT, 0),     /* clusters wanted, clusters got, first */
+    TR_FAT_WRITE      = TRACE_EV(TRACE_FAT, 1),     /* lba, sectors, of total */
+    TR_FAT_CREATE     = TRACE_EV(TRACE_FAT, 2),     /* bytes, sectors, first cluster lba */
+    TR_FAT_DONE       = TRACE_EV(TRACE_FAT, 3),     /* bytes written, of size */
+    TR_ATA_CMD        = TRACE_EV(TRACE_ATA, 0),     /* disk, command, lba, count */
+    TR_ATA_DONE       = TRACE_EV(TRACE_ATA, 1),     /* disk, status */
+    TR_ATA_ERROR      = TRACE_EV(TRACE_ATA, 2),     /* disk, status, error register */
+};
+
+typedef struct {
+    uint32_t seq;        /* index + 1 once the record is complete */
+    uint16_t id;
+    uint8_t  cpu;
+    uint8_t  rsv;
+    uint64_t ns;
+    uint32_t arg[4];
+} trace_rec_t;
+
+typedef struct {
+    uint16_t id;
+    const char *name;
+    const char *fmt;     /* terminal_printf format for arg[0..3] */
+} trace_desc_t;
+
+#define TRACE_RING 2048  /* records (64 KB), power of two */
+
+extern volatile uint32_t trace_mask;
+
+void trace_emit(uint16_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+#define TRACE(id, a0, a1, a2, a3) do { \
+    if (trace_mask & (1U << TRACE_SUB(id))) \
+        trace_emit((id), (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3)); \
+} while (0)
+
+/* name of a subsystem / its index (-1 if unknown) */
+const char *trace_subsys_name(int sub);
+int trace_subsys_find(const char *name);
+void trace_enable(int sub, int on);
+
+/* Copy the record with sequence index idx; 0 if it was overwritten, is
+   still being written, or lies before trace_base(). trace_head() is the
+   index of the next record, trace_base() the first one trace_clear() kept. */
+uint32_t trace_head(void);
+uint32_t trace_base(void);
+int trace_read(uint32_t idx, trace_rec_t *out);
+void trace_clear(void);
+const trace_desc_t *trace_desc(uint16_t id);
+
+#ifdef __cplusplus
+}
+#endif
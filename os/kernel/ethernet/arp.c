@@ -1,6 +1,7 @@
 #include "arp.h"
 #include "../string.h"
 #include "../terminal.h"
+#include "../sync/spinlock.h"
 
 extern void serial(const char *fmt, ...);
 
@@ -16,6 +17,8 @@ typedef struct {
 
 static arp_entry_t arp_cache[8];
 static int arp_victim_idx = 0;
+/* RX path updates the cache, IP output and `arp` read it */
+static rwlock_t arp_lock = RWLOCK_INIT("arp_cache");
 
 void arp_handle_packet(net_device_t* dev, const void* data, size_t len) {
     if (len < sizeof(arp_packet_t)) return;
@@ -25,6 +28,7 @@ void arp_handle_packet(net_device_t* dev, const void* data, size_t len) {
     uint32_t src_ip = pkt->src_ip; // Already Network Byte Order
 
     /* Update Cache */
+    uint32_t flags = write_lock_irqsave(&arp_lock);
     int slot = -1;
     for (int i = 0; i < 8; i++) {
         if (arp_cache[i].valid && arp_cache[i].ip == src_ip) {
@@ -44,6 +48,7 @@ void arp_handle_packet(net_device_t* dev, const void* data, size_t len) {
         memcpy(arp_cache[slot].mac, pkt->src_mac, 6);
         arp_cache[slot].valid = 1;
     }
+    write_unlock_irqrestore(&arp_lock, flags);
 
     if (op == ARP_OP_REQUEST) {
         /* Check if it's for us */
@@ -91,21 +96,28 @@ void arp_send_request(net_device_t* dev, uint32_t ip) {
 }
 
 int arp_lookup(uint32_t ip, uint8_t* mac_out) {
+    uint32_t flags = read_lock_irqsave(&arp_lock);
     for (int i = 0; i < 8; i++) {
         if (arp_cache[i].valid && arp_cache[i].ip == ip) {
             memcpy(mac_out, arp_cache[i].mac, 6);
+            read_unlock_irqrestore(&arp_lock, flags);
             return 1;
         }
     }
+    read_unlock_irqrestore(&arp_lock, flags);
     return 0;
 }
 
 void arp_print_cache(void) {
     terminal_writestring("ARP Cache:\n");
     for (int i = 0; i < 8; i++) {
-        if (arp_cache[i].valid) {
-            uint32_t ip = arp_cache[i].ip;
-            uint8_t* m = arp_cache[i].mac;
+        /* copy the entry under the lock, print outside it */
+        uint32_t flags = read_lock_irqsave(&arp_lock);
+        arp_entry_t e = arp_cache[i];
+        read_unlock_irqrestore(&arp_lock, flags);
+        if (e.valid) {
+            uint32_t ip = e.ip;
+            uint8_t* m = e.mac;
             terminal_printf("  %d.%d.%d.%d  ->  %02x:%02x:%02x:%02x:%02x:%02x\n",
                 ip&0xFF, (ip>>8)&0xFF, (ip>>16)&0xFF, (ip>>24)&0xFF,
                 m[0], m[1], m[2], m[3], m[4], m[5]);
@@ -1,15 +1,20 @@
 #include "event_queue.h"
+#include "../sync/spinlock.h"
 
 #define EVENT_QUEUE_SIZE 64
 
 static event_t queue[EVENT_QUEUE_SIZE];
 static volatile int head = 0;
 static volatile int tail = 0;
+/* producers run in IRQ context, consumers in the main loop (or an AP) */
+static spinlock_t queue_lock = SPINLOCK_INIT("event_queue");
 
 void event_queue_init(void)
 {
+    uint32_t flags = spin_lock_irqsave(&queue_lock);
     head = 0;
     tail = 0;
+    spin_unlock_irqrestore(&queue_lock, flags);
 }
 
 static int next_index(int i)
@@ -24,24 +29,31 @@ int event_queue_is_empty(void)
 
 int event_push(const event_t* ev)
 {
+    uint32_t flags = spin_lock_irqsave(&queue_lock);
     int next = next_index(head);
 
     if (next == tail) {
         // queue full → drop event
+        spin_unlock_irqrestore(&queue_lock, flags);
         return -1;
     }
 
     queue[head] = *ev;
     head = next;
+    spin_unlock_irqrestore(&queue_lock, flags);
     return 0;
 }
 
 int event_pop(event_t* out)
 {
-    if (head == tail)
+    uint32_t flags = spin_lock_irqsave(&queue_lock);
+    if (head == tail) {
+        spin_unlock_irqrestore(&queue_lock, flags);
         return -1;
+    }
 
     *out = queue[tail];
     tail = next_index(tail);
+    spin_unlock_irqrestore(&queue_lock, flags);
     return 0;
 }
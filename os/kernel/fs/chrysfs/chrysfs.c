@@ -1,4 +1,7 @@
 #include "chrysfs.h"
+#include "../vfs/fs_ops.h"
+#include "../vfs/mount.h"
+#include "../vfs/vnode.h"
 #include "../../string.h"
 #include "../../mem/kmalloc.h"
 
@@ -40,6 +43,8 @@ typedef struct {
 } __attribute__((packed)) chrysfs_inode_t;
 
 #define INODE_MAGIC 0xCAFEBABE
+/* direct pointers per inode, i.e. the largest file in blocks */
+#define CHRYSFS_MAX_BLOCKS (sizeof(((chrysfs_inode_t*)0)->blocks) / sizeof(uint32_t))
 
 static block_device_t *mounted_dev = 0;
 static uint32_t fs_data_start = LBA_DATA;
@@ -65,13 +70,13 @@ static int alloc_block(block_device_t *dev) {
     uint8_t *bmp = (uint8_t*)kmalloc(BLOCK_SIZE);
     if (!bmp) return 0;
     
-    dev->read(dev, LBA_BITMAP, 1, bmp);
+    block_read(dev, LBA_BITMAP, 1, bmp);
     
     for (int i = 0; i < BLOCK_SIZE * 8; i++) {
         if (!((bmp[i/8] >> (i%8)) & 1)) {
             // Found free
             bmp[i/8] |= (1 << (i%8));
-            dev->write(dev, LBA_BITMAP, 1, bmp);
+            block_write(dev, LBA_BITMAP, 1, bmp);
             kfree(bmp);
             return fs_data_start + i;
         }
@@ -88,7 +93,7 @@ static int find_inode(block_device_t *dev, const char* name, chrysfs_inode_t* ou
 
     for (int i = 0; i < MAX_INODES; i++) {
         uint32_t lba = LBA_INODES + i;
-        dev->read(dev, lba, 1, (uint8_t*)node);
+        block_read(dev, lba, 1, (uint8_t*)node);
         
         if (node->magic == INODE_MAGIC && strcmp(node->name, name) == 0) {
             if (out_inode) memcpy(out_inode, node, sizeof(chrysfs_inode_t));
@@ -116,15 +121,15 @@ int chrysfs_format(block_device_t *dev) {
     sb->block_size = BLOCK_SIZE;
     sb->num_inodes = MAX_INODES;
     sb->data_start = LBA_DATA;
-    dev->write(dev, LBA_SUPERBLOCK, 1, buf);
+    block_write(dev, LBA_SUPERBLOCK, 1, buf);
 
     // 2. Clear Bitmap
     memset(buf, 0, BLOCK_SIZE);
-    dev->write(dev, LBA_BITMAP, 1, buf);
+    block_write(dev, LBA_BITMAP, 1, buf);
 
     // 3. Clear Inodes
     for (int i = 0; i < MAX_INODES; i++) {
-        dev->write(dev, LBA_INODES + i, 1, buf);
+        block_write(dev, LBA_INODES + i, 1, buf);
     }
 
     serial("[FS] Format complete.\n");
@@ -138,7 +143,7 @@ int chrysfs_mount(block_device_t *dev, const char *mountpoint) {
     uint8_t *buf = (uint8_t*)kmalloc(BLOCK_SIZE);
     if (!buf) return -1;
     
-    dev->read(dev, LBA_SUPERBLOCK, 1, buf);
+    block_read(dev, LBA_SUPERBLOCK, 1, buf);
     
     chrysfs_superblock_t *sb = (chrysfs_superblock_t*)buf;
     if (sb->magic != CHRYSFS_MAGIC) {
@@ -147,11 +152,16 @@ int chrysfs_mount(block_device_t *dev, const char *mountpoint) {
         return -1;
     }
     
+    /* cached vnodes hold inode LBAs of the volume mounted before */
+    if (mounted_dev)
+        vnode_cache_flush();
     fs_data_start = sb->data_start;
     mounted_dev = dev;
     
     serial("[FS] Mounted CHRYS_FS from %s at %s\n", dev->name, mountpoint);
     kfree(buf);
+    if (mountpoint)
+        vfs_mount(mountpoint, chrysfs_vfs_root());
     return 0;
 }
 
@@ -165,7 +175,7 @@ int chrysfs_ls(const char *path) {
     terminal_printf("Listing files on %s:\n", mounted_dev->name);
     int count = 0;
     for (int i = 0; i < MAX_INODES; i++) {
-        mounted_dev->read(mounted_dev, LBA_INODES + i, 1, (uint8_t*)node);
+        block_read(mounted_dev, LBA_INODES + i, 1, (uint8_t*)node);
         if (node->magic == INODE_MAGIC) {
             terminal_printf("  [FILE] %s (%u bytes)\n", node->name, node->size);
             count++;
@@ -194,7 +204,7 @@ int chrysfs_create_file(const char *path, const void *data, uint32_t size) {
     
     int inode_lba = -1;
     for (int i = 0; i < MAX_INODES; i++) {
-        mounted_dev->read(mounted_dev, LBA_INODES + i, 1, (uint8_t*)node);
+        block_read(mounted_dev, LBA_INODES + i, 1, (uint8_t*)node);
         if (node->magic != INODE_MAGIC) {
             inode_lba = LBA_INODES + i;
             break;
@@ -219,7 +229,7 @@ int chrysfs_create_file(const char *path, const void *data, uint32_t size) {
     int block_idx = 0;
     const uint8_t* ptr = (const uint8_t*)data;
 
-    while (bytes_written < size && block_idx < 100) {
+    while (bytes_written < size && block_idx < (int)CHRYSFS_MAX_BLOCKS) {
         uint32_t blk = alloc_block(mounted_dev);
         if (blk == 0) {
             serial("[FS] Disk full.\n");
@@ -235,14 +245,14 @@ int chrysfs_create_file(const char *path, const void *data, uint32_t size) {
         uint8_t* sector = (uint8_t*)kmalloc(BLOCK_SIZE);
         memset(sector, 0, BLOCK_SIZE);
         memcpy(sector, ptr + bytes_written, chunk);
-        mounted_dev->write(mounted_dev, blk, 1, sector);
+        block_write(mounted_dev, blk, 1, sector);
         kfree(sector);
         
         bytes_written += chunk;
     }
 
     // Save inode
-    mounted_dev->write(mounted_dev, inode_lba, 1, (uint8_t*)node);
+    block_write(mounted_dev, inode_lba, 1, (uint8_t*)node);
     
     kfree(node);
     serial("[FS] Created file %s (%u bytes)\n", fname, bytes_written);
@@ -271,11 +281,11 @@ int chrysfs_read_file(const char *path, void *buf, uint32_t max_size) {
     
     uint8_t* sector = (uint8_t*)kmalloc(BLOCK_SIZE);
     
-    while (bytes_read < to_read && block_idx < 100) {
+    while (bytes_read < to_read && block_idx < (int)CHRYSFS_MAX_BLOCKS) {
         uint32_t blk = node->blocks[block_idx++];
         if (blk == 0) break;
         
-        mounted_dev->read(mounted_dev, blk, 1, sector);
+        block_read(mounted_dev, blk, 1, sector);
         
         uint32_t chunk = to_read - bytes_read;
         if (chunk > BLOCK_SIZE) chunk = BLOCK_SIZE;
@@ -287,4 +297,144 @@ int chrysfs_read_file(const char *path, void *buf, uint32_t max_size) {
     kfree(sector);
     kfree(node);
     return bytes_read;
-}
\ No newline at end of file
+}
+
+/* --- VFS backend ---
+   Flat: the root is the only directory and a file vnode's internal data
+   is the LBA of its inode. Reads and writes go block by block through
+   the inode's direct pointers; writes allocate blocks as the file grows. */
+
+static fs_ops_t chrysfs_ops;
+
+static int chrysfs_vfs_open(struct vnode* node)
+{
+    (void)node;
+    return mounted_dev ? 0 : -1;
+}
+
+static int chrysfs_vfs_lookup(struct vnode* dir, const char* name, struct vnode* child)
+{
+    if (!mounted_dev || dir->internal)
+        return -1; /* only the root has children */
+    uint32_t lba;
+    if (find_inode(mounted_dev, name, 0, &lba) != 0)
+        return -1;
+    child->type = VNODE_FILE;
+    child->ops = &chrysfs_ops;
+    child->internal = (void*)(uintptr_t)lba;
+    return 0;
+}
+
+static int chrysfs_vfs_read(struct vnode* node, uint32_t off, uint8_t* buf, uint32_t size)
+{
+    uint32_t lba = (uint32_t)(uintptr_t)node->internal;
+    if (!mounted_dev || !lba)
+        return -1;
+    chrysfs_inode_t *ino = (chrysfs_inode_t*)kmalloc(BLOCK_SIZE);
+    uint8_t *sector = (uint8_t*)kmalloc(BLOCK_SIZE);
+    if (!ino || !sector) {
+        if (ino) kfree(ino);
+        if (sector) kfree(sector);
+        return -1;
+    }
+    int ret = -1;
+    if (block_read(mounted_dev, lba, 1, (uint8_t*)ino) != 0 || ino->magic != INODE_MAGIC)
+        goto out;
+
+    if (off >= ino->size) {
+        ret = 0;
+        goto out;
+    }
+    if (size > ino->size - off)
+        size = ino->size - off;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = off + done;
+        if (pos / BLOCK_SIZE >= CHRYSFS_MAX_BLOCKS)
+            break; /* size field past the direct pointers (corrupt inode) */
+        uint32_t blk = ino->blocks[pos / BLOCK_SIZE];
+        uint32_t in = pos % BLOCK_SIZE;
+        uint32_t chunk = BLOCK_SIZE - in;
+        if (chunk > size - done) chunk = size - done;
+        if (blk == 0 || block_read(mounted_dev, blk, 1, sector) != 0)
+            break;
+        memcpy(buf + done, sector + in, chunk);
+        done += chunk;
+    }
+    ret = (int)done;
+out:
+    kfree(sector);
+    kfree(ino);
+    return ret;
+}
+
+static int chrysfs_vfs_write(struct vnode* node, uint32_t off, const uint8_t* buf, uint32_t size)
+{
+    uint32_t lba = (uint32_t)(uintptr_t)node->internal;
+    if (!mounted_dev || !lba)
+        return -1;
+    if (off + size > CHRYSFS_MAX_BLOCKS * BLOCK_SIZE || off + size < off)
+        return -1;
+    chrysfs_inode_t *ino = (chrysfs_inode_t*)kmalloc(BLOCK_SIZE);
+    uint8_t *sector = (uint8_t*)kmalloc(BLOCK_SIZE);
+    if (!ino || !sector) {
+        if (ino) kfree(ino);
+        if (sector) kfree(sector);
+        return -1;
+    }
+    int ret = -1;
+    if (block_read(mounted_dev, lba, 1, (uint8_t*)ino) != 0 || ino->magic != INODE_MAGIC)
+        goto out;
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = off + done;
+        uint32_t bi = pos / BLOCK_SIZE;
+        uint32_t in = pos % BLOCK_SIZE;
+        uint32_t chunk = BLOCK_SIZE - in;
+        if (chunk > size - done) chunk = size - done;
+        if (ino->blocks[bi] == 0) {
+            ino->blocks[bi] = alloc_block(mounted_dev);
+            if (ino->blocks[bi] == 0)
+                break;
+            memset(sector, 0, BLOCK_SIZE);
+        } else if (chunk < BLOCK_SIZE &&
+                   block_read(mounted_dev, ino->blocks[bi], 1, sector) != 0) {
+            break;
+        }
+        memcpy(sector + in, buf + done, chunk);
+        if (block_write(mounted_dev, ino->blocks[bi], 1, sector) != 0)
+            break;
+        done += chunk;
+    }
+    if (off + done > ino->size)
+        ino->size = off + done;
+    if (block_write(mounted_dev, lba, 1, (uint8_t*)ino) == 0)
+        ret = (int)done;
+out:
+    kfree(sector);
+    kfree(ino);
+    return ret;
+}
+
+static fs_ops_t chrysfs_ops = {
+    .open = chrysfs_vfs_open,
+    .read = chrysfs_vfs_read,
+    .write = chrysfs_vfs_write,
+    .readdir = 0,
+    .lookup = chrysfs_vfs_lookup,
+    .release = 0
+};
+
+static vnode_t chrysfs_root_node = {
+    .name = "/",
+    .type = VNODE_DIR,
+    .ops = &chrysfs_ops,
+    .internal = 0,
+    .parent = 0
+};
+
+vnode_t* chrysfs_vfs_root(void)
+{
+    return &chrysfs_root_node;
+}
@@ -14,6 +14,9 @@ int chrysfs_ls(const char *path);
 int chrysfs_create_file(const char *path, const void *data, uint32_t size);
 int chrysfs_read_file(const char *path, void *buf, uint32_t max_size);
 
+// VFS root (flat: files only); chrysfs_mount() mounts it at mountpoint
+struct vnode *chrysfs_vfs_root(void);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
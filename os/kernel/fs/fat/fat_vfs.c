@@ -0,0 +1,165 @@
+/* kernel/fs/fat/fat_vfs.c
+   FAT32 backend for the VFS, on top of the fat32_* API in cmds/fat.cpp.
+   A vnode's internal data is its path on the volume; lookup is one
+   fat32_stat (served by the FAT dentry cache when hot). Files keep an
+   open fat_file_t, so sequential reads do not resolve the path or walk
+   the cluster chain again. File data is cached above this in the page
+   cache; fat32_* calls that change a file report it through
+   fat_vfs_changed(). */
+
+#include "fat_vfs.h"
+#include "../vfs/fs_ops.h"
+#include "../vfs/mount.h"
+#include "../vfs/pcache.h"
+#include "../../cmds/fat.h"
+#include "../../mem/kmalloc.h"
+#include "../../string.h"
+
+typedef struct {
+    fat_file_t* fh;     /* opened on first read */
+    char path[];        /* "/dir/file" on the volume */
+} fat_vnode_t;
+
+static fs_ops_t fat_ops;
+
+static int fat_vfs_open(vnode_t* node)
+{
+    (void)node;
+    return 0;
+}
+
+static int fat_vfs_read(vnode_t* node, uint32_t off, uint8_t* buf, uint32_t size)
+{
+    fat_vnode_t* fv = (fat_vnode_t*)node->internal;
+    if (!fv || node->type != VNODE_FILE)
+        return -1;
+    if (!fv->fh) {
+        fv->fh = fat32_open(fv->path);
+        if (!fv->fh)
+            return -1;
+    }
+    return fat32_pread(fv->fh, buf, size, off);
+}
+
+static int fat_vfs_write(vnode_t* node, uint32_t off, const uint8_t* buf, uint32_t size)
+{
+    fat_vnode_t* fv = (fat_vnode_t*)node->internal;
+    if (!fv || node->type != VNODE_FILE || size == 0)
+        return fv ? 0 : -1;
+    if (fat32_write_file_offset(fv->path, buf, size, off, 0) != 0)
+        return -1;
+    return (int)size;
+}
+
+static int fat_vfs_lookup(vnode_t* dir, const char* name, vnode_t* child)
+{
+    const fat_vnode_t* dv = (const fat_vnode_t*)dir->internal;
+    const char* dpath = dv ? dv->path : "";   /* root has no internal */
+    int dl = strlen(dpath);
+    int nl = strlen(name);
+    if (dl + 1 + nl >= VFS_PATH_MAX)
+        return -1;
+
+    fat_vnode_t* fv = (fat_vnode_t*)kmalloc(sizeof(fat_vnode_t) + dl + nl + 2);
+    if (!fv)
+        return -1;
+    fv->fh = 0;
+    memcpy(fv->path, dpath, dl);
+    fv->path[dl] = '/';
+    memcpy(fv->path + dl + 1, name, nl + 1);
+
+    uint32_t size;
+    int is_dir;
+    if (fat32_stat(fv->path, &size, &is_dir) != 0) {
+        kfree(fv);
+        return -1;
+    }
+    child->type = is_dir ? VNODE_DIR : VNODE_FILE;
+    child->ops = &fat_ops;
+    child->internal = fv;
+    return 0;
+}
+
+static void fat_vfs_release(vnode_t* node)
+{
+    fat_vnode_t* fv = (fat_vnode_t*)node->internal;
+    if (!fv)
+        return;
+    if (fv->fh)
+        fat32_close(fv->fh);
+    kfree(fv);
+    node->internal = 0;
+}
+
+static fs_ops_t fat_ops = {
+    .open = fat_vfs_open,
+    .read = fat_vfs_read,
+    .write = fat_vfs_write,
+    .readdir = 0,
+    .lookup = fat_vfs_lookup,
+    .release = fat_vfs_release,
+    .flags = FS_NOCASE
+};
+
+static vnode_t fat_root_node = {
+    .name = "/",
+    .type = VNODE_DIR,
+    .ops = &fat_ops,
+    .internal = 0,
+    .parent = 0
+};
+
+vnode_t* fat_vfs_root(void)
+{
+    return &fat_root_node;
+}
+
+/* vn is the FAT file at path; FAT names compare without case */
+static int fat_vfs_match(vnode_t* vn, const void* arg)
+{
+    if (vn->ops != &fat_ops || !vn->internal)
+        return 0;
+    const char* a = ((const fat_vnode_t*)vn->internal)->path;
+    const char* b = (const char*)arg;
+    for (; *a && *b; a++, b++) {
+        char ca = (*a >= 'a' && *a <= 'z') ? *a - 32 : *a;
+        char cb = (*b >= 'a' && *b <= 'z') ? *b - 32 : *b;
+        if (ca != cb)
+            return 0;
+    }
+    return *a == *b;
+}
+
+static int fat_vfs_match_all(vnode_t* vn, const void* arg)
+{
+    (void)arg;
+    return vn->ops == &fat_ops;
+}
+
+void fat_vfs_changed(const char* path)
+{
+    if (!path)
+        return;
+    /* fat32_* take paths relative to the volume root, with or without the
+       leading '/' and unfolded; vnodes keep them canonical */
+    char abs[VFS_PATH_MAX];
+    char cpath[VFS_PATH_MAX];
+    int n = strlen(path);
+    if (n + 2 > VFS_PATH_MAX) {
+        pcache_invalidate_if(fat_vfs_match_all, 0); /* cannot tell which */
+        return;
+    }
+    abs[0] = '/';
+    memcpy(abs + 1, path, n + 1);
+    if (vfs_canonicalize(abs, cpath) < 0) {
+        pcache_invalidate_if(fat_vfs_match_all, 0);
+        return;
+    }
+    pcache_invalidate_if(fat_vfs_match, cpath);
+}
+
+void fat_vfs_changed_all(void)
+{
+    pcache_invalidate_if(fat_vfs_match_all, 0);
+    vnode_cache_flush();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "../vfs/vnode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Rădăcina volumului FAT32 montat (cmds/fat.cpp), ca vnode VFS.
+ * Nodurile găsite prin lookup țin calea lor pe volum; fișierele deschid
+ * un fat_file_t la prima citire și îl păstrează cât vnode-ul e în cache. */
+vnode_t* fat_vfs_root(void);
+
+/* Fișierul de la path s-a schimbat prin fat32_* (scriere, ștergere,
+ * redenumire): paginile lui din page cache nu mai sunt valabile. path e
+ * relativ la rădăcina volumului, ca la fat32_*: cu sau fără '/' inițial,
+ * "." și ".." se rezolvă înainte de comparare. */
+void fat_vfs_changed(const char* path);
+
+/* Tot volumul s-a schimbat (format, montare): paginile tuturor fișierelor
+ * FAT și vnode-urile nereferite din cache nu mai sunt valabile. */
+void fat_vfs_changed_all(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,8 +17,22 @@ typedef struct fs_ops {
     /* readdir: for directory nodes; index starts at 0. If no more entries return 0 and set *out = NULL.
        On success return 1 and set *out to the vnode pointer (owned by FS). */
     int (*readdir)(struct vnode* dir, uint32_t index, struct vnode** out);
+
+    /* lookup: find child `name` (NUL-terminated, no '/') of directory dir.
+       On success fill child->type, ops and internal and return 0; the VFS
+       has already set child->name and child->parent. Negative if absent. */
+    int (*lookup)(struct vnode* dir, const char* name, struct vnode* child);
+
+    /* release: the VFS is freeing a vnode filled in by lookup */
+    void (*release)(struct vnode* node);
+
+    uint32_t flags;     /* FS_* */
 } fs_ops_t;
 
+/* names that differ only in ASCII case are the same entry (FAT): the vnode
+   cache folds case when keying children of this FS's directories */
+#define FS_NOCASE 0x1
+
 #ifdef __cplusplus
 }
 #endif
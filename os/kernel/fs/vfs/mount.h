@@ -6,13 +6,28 @@
 extern "C" {
 #endif
 
-/* mount a filesystem root at path (string pointer must remain valid) */
+#define MAX_MOUNTS 8
+#define VFS_PATH_MAX 256
+
+/* mount a filesystem root at path (copied; an existing mount at the same
+   path is replaced) */
 void vfs_mount(const char* path, vnode_t* root);
 
-/* resolve a path to a vnode. Minimal resolver: matches mount points exactly.
-   Returns vnode pointer or NULL if not found. */
+/* Resolve an absolute path: ".", ".." and repeated '/' are folded first,
+   the longest mount point that is a whole-component prefix of the result
+   picks the filesystem, and the rest is walked one lookup per component
+   through the vnode cache. Returns a referenced vnode (vnode_put() it) or
+   NULL if not found. */
 vnode_t* vfs_resolve(const char* path);
 
+/* Fold an absolute path into out (VFS_PATH_MAX bytes) as "/a/b": no ".",
+   "..", empty components or trailing '/'. Length, -1 if path is relative
+   or too long. */
+int vfs_canonicalize(const char* path, char* out);
+
+/* mount table, for listing: 0 past the last entry */
+int vfs_mount_at(int index, const char** path, vnode_t** root);
+
 #ifdef __cplusplus
 }
 #endif
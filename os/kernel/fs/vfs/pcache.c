@@ -0,0 +1,495 @@
+/* kernel/fs/vfs/pcache.c
+   Page cache (see pcache.h).
+   - a page is one PMM frame, used through the KERNEL_BASE alias of low
+     physical memory (page_data(): the identity range below it can be
+     remapped, e.g. by exec), plus a descriptor hashed on (vnode, index)
+     and chained on its vnode
+   - every page sits on one LRU list (head = most recently used)
+   - a miss inserts the page marked PC_FILLING and reads it with pc_lock
+     dropped; anyone else who wants it waits for the flag to drop
+   - pins (a reader copying out, a vfs_mmap() mapping) keep a page from
+     being recycled; invalidating a pinned page only detaches it from its
+     vnode and the last unpin frees it
+*/
+
+#include "pcache.h"
+#include "fs_ops.h"
+#include "../../memory/pmm.h"
+#include "../../mm/vmm.h"
+#include "../../mem/kmalloc.h"
+#include "../../string.h"
+#include "../../sync/spinlock.h"
+
+#define PC_BUCKETS  1024   /* power of two */
+
+#define PC_FILLING  0x1
+#define PC_DETACHED 0x2
+
+typedef struct pc_page {
+    vnode_t* vn;
+    uint32_t index;          /* file offset / PCACHE_PAGE */
+    uint32_t phys;
+    uint32_t valid;          /* bytes of file data; < PCACHE_PAGE only at EOF */
+    uint32_t pins;
+    uint32_t flags;
+    struct pc_page* hnext;
+    struct pc_page* vnext;   /* vn->pages */
+    struct pc_page* lru_prev;
+    struct pc_page* lru_next;
+} pc_page_t;
+
+typedef struct {
+    uint32_t first;          /* window slot; count 0 = free entry */
+    uint32_t count;
+    vnode_t* vn;
+} pc_map_t;
+
+static pc_page_t* buckets[PC_BUCKETS];
+static pc_page_t* lru_head;
+static pc_page_t* lru_tail;
+static pc_page_t* win[PCACHE_MAP_PAGES];   /* page behind each window slot */
+static pc_map_t maps[PCACHE_MAPS];
+static spinlock_t pc_lock = SPINLOCK_INIT("pcache");
+static pcache_stats_t st;
+
+/* ---- lists (pc_lock held) ---- */
+
+static uint32_t pc_hash(const vnode_t* vn, uint32_t index)
+{
+    return (((uint32_t)(uintptr_t)vn >> 4) ^ (index * 2654435761u)) & (PC_BUCKETS - 1);
+}
+
+static pc_page_t* lookup(const vnode_t* vn, uint32_t index)
+{
+    for (pc_page_t* p = buckets[pc_hash(vn, index)]; p; p = p->hnext) {
+        if (p->vn == vn && p->index == index)
+            return p;
+    }
+    return 0;
+}
+
+static void lru_unlink(pc_page_t* p)
+{
+    if (p->lru_prev) p->lru_prev->lru_next = p->lru_next;
+    else lru_head = p->lru_next;
+    if (p->lru_next) p->lru_next->lru_prev = p->lru_prev;
+    else lru_tail = p->lru_prev;
+    p->lru_prev = p->lru_next = 0;
+}
+
+static void lru_push(pc_page_t* p)
+{
+    p->lru_prev = 0;
+    p->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = p;
+    lru_head = p;
+    if (!lru_tail) lru_tail = p;
+}
+
+static void insert(pc_page_t* p)
+{
+    uint32_t h = pc_hash(p->vn, p->index);
+    p->hnext = buckets[h];
+    buckets[h] = p;
+    p->vnext = p->vn->pages;
+    p->vn->pages = p;
+    lru_push(p);
+    st.pages++;
+}
+
+/* out of the hash, the vnode and the LRU; the caller frees it if unpinned */
+static void detach(pc_page_t* p)
+{
+    pc_page_t** pp = &buckets[pc_hash(p->vn, p->index)];
+    while (*pp && *pp != p)
+        pp = &(*pp)->hnext;
+    if (*pp)
+        *pp = p->hnext;
+
+    pp = &p->vn->pages;
+    while (*pp && *pp != p)
+        pp = &(*pp)->vnext;
+    if (*pp)
+        *pp = p->vnext;
+
+    lru_unlink(p);
+    p->hnext = p->vnext = 0;
+    p->vn = 0;
+    p->flags |= PC_DETACHED;
+    st.pages--;
+}
+
+/* least recently used page nobody holds, detached; NULL if all are pinned */
+static pc_page_t* take_victim(void)
+{
+    pc_page_t* p = lru_tail;
+    while (p && (p->pins || (p->flags & PC_FILLING)))
+        p = p->lru_prev;
+    if (p)
+        detach(p);
+    return p;
+}
+
+/* drop the lock while someone else fills a page */
+static void wait_fill(uint32_t* fl)
+{
+    spin_unlock_irqrestore(&pc_lock, *fl);
+    asm volatile("pause");
+    *fl = spin_lock_irqsave(&pc_lock);
+}
+
+/* ---- pages ---- */
+
+static void free_pages(pc_page_t* p)
+{
+    while (p) {
+        pc_page_t* next = p->hnext;
+        pmm_free_frame(p->phys);
+        kfree(p);
+        p = next;
+    }
+}
+
+static inline uint8_t* page_data(const pc_page_t* p)
+{
+    return (uint8_t*)(uintptr_t)(p->phys + KERNEL_BASE);
+}
+
+/* A page to fill: an evicted one while the cache is full or memory is
+   short, else a fresh frame. Frames outside the KERNEL_BASE alias are
+   given back. */
+static pc_page_t* new_page(void)
+{
+    pc_page_t* p = 0;
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    if (st.pages >= PCACHE_MAX_PAGES ||
+        pmm_total_frames() - pmm_used_frames() < PCACHE_MIN_FREE) {
+        p = take_victim();
+        if (p)
+            st.evictions++;
+    }
+    spin_unlock_irqrestore(&pc_lock, fl);
+
+    if (!p) {
+        p = (pc_page_t*)kmalloc(sizeof(pc_page_t));
+        if (!p)
+            return 0;
+        uint32_t phys = pmm_alloc_frame();
+        if (!phys || vmm_virt_to_phys((void*)(uintptr_t)(phys + KERNEL_BASE)) != phys) {
+            if (phys)
+                pmm_free_frame(phys);
+            kfree(p);
+            return 0;
+        }
+        p->phys = phys;
+    }
+    uint32_t phys = p->phys;
+    memset(p, 0, sizeof(pc_page_t));
+    p->phys = phys;
+    return p;
+}
+
+static void unpin(pc_page_t* p)
+{
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    p->pins--;
+    int dead = p->pins == 0 && (p->flags & PC_DETACHED);
+    spin_unlock_irqrestore(&pc_lock, fl);
+    if (dead) {
+        p->hnext = 0;
+        free_pages(p);
+    }
+}
+
+/* Page index of vn, filled and pinned (unpin() it); NULL on a read error
+   or when no memory can be found. */
+static pc_page_t* get_page(vnode_t* vn, uint32_t index)
+{
+    pc_page_t* fresh = 0;
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    for (;;) {
+        pc_page_t* p = lookup(vn, index);
+        if (p) {
+            if (p->flags & PC_FILLING) {
+                wait_fill(&fl);
+                continue;
+            }
+            p->pins++;
+            lru_unlink(p);
+            lru_push(p);
+            st.hits++;
+            spin_unlock_irqrestore(&pc_lock, fl);
+            free_pages(fresh);
+            return p;
+        }
+        if (fresh)
+            break;
+        spin_unlock_irqrestore(&pc_lock, fl);
+        fresh = new_page();
+        if (!fresh)
+            return 0;
+        fl = spin_lock_irqsave(&pc_lock);
+    }
+    fresh->vn = vn;
+    fresh->index = index;
+    fresh->flags = PC_FILLING;
+    fresh->pins = 1;
+    insert(fresh);
+    st.misses++;
+    spin_unlock_irqrestore(&pc_lock, fl);
+
+    uint8_t* data = page_data(fresh);
+    int r = vn->ops->read(vn, index * PCACHE_PAGE, data, PCACHE_PAGE);
+    if (r > PCACHE_PAGE)
+        r = PCACHE_PAGE;
+    if (r >= 0 && r < PCACHE_PAGE)
+        memset(data + r, 0, PCACHE_PAGE - r); /* mappings see zeros past EOF */
+
+    fl = spin_lock_irqsave(&pc_lock);
+    fresh->flags &= ~PC_FILLING;
+    if (r < 0) {
+        if (!(fresh->flags & PC_DETACHED))
+            detach(fresh);
+        fresh->pins--;
+        spin_unlock_irqrestore(&pc_lock, fl);
+        fresh->hnext = 0;
+        free_pages(fresh);
+        return 0;
+    }
+    fresh->valid = (uint32_t)r;
+    spin_unlock_irqrestore(&pc_lock, fl);
+    return fresh;
+}
+
+/* ---- interface ---- */
+
+void pcache_init(void)
+{
+    /* Create the window's page tables now, so page directories copied
+       from the kernel one later on see vfs_mmap() mappings too */
+    for (uint32_t va = PCACHE_MAP_BASE; va < PCACHE_MAP_BASE + PCACHE_MAP_PAGES * PCACHE_PAGE;
+         va += 1024 * PCACHE_PAGE) {
+        vmm_map_page(kernel_page_directory, va, 0, 0);
+        vmm_unmap_page(kernel_page_directory, va);
+    }
+    pmm_set_reclaim(pcache_shrink);
+}
+
+int pcache_read(vnode_t* vn, uint32_t off, void* buf, uint32_t size)
+{
+    if (!vn || !vn->ops || !vn->ops->read)
+        return -1;
+    if (vn->type != VNODE_FILE)
+        return vn->ops->read(vn, off, (uint8_t*)buf, size);
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = off + done;
+        uint32_t in = pos % PCACHE_PAGE;
+        pc_page_t* p = get_page(vn, pos / PCACHE_PAGE);
+        if (!p) {
+            /* no page to be had: read the rest uncached */
+            int r = vn->ops->read(vn, pos, (uint8_t*)buf + done, size - done);
+            if (r < 0)
+                return done ? (int)done : -1;
+            return (int)(done + (uint32_t)r);
+        }
+        uint32_t n = 0;
+        if (in < p->valid) {
+            n = p->valid - in;
+            if (n > size - done)
+                n = size - done;
+            memcpy((uint8_t*)buf + done, page_data(p) + in, n);
+        }
+        int eof = p->valid < PCACHE_PAGE;
+        unpin(p);
+        done += n;
+        if (eof || n == 0)
+            break;
+    }
+    return (int)done;
+}
+
+void pcache_invalidate(vnode_t* vn)
+{
+    if (!vn)
+        return;
+    pc_page_t* dead = 0;
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    while (vn->pages) {
+        pc_page_t* p = vn->pages;
+        detach(p);
+        if (p->pins == 0) {
+            p->hnext = dead;
+            dead = p;
+        }
+    }
+    spin_unlock_irqrestore(&pc_lock, fl);
+    free_pages(dead);
+}
+
+void pcache_invalidate_if(int (*match)(vnode_t* vn, const void* arg), const void* arg)
+{
+    pc_page_t* dead = 0;
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    for (int b = 0; b < PC_BUCKETS; b++) {
+        pc_page_t* p = buckets[b];
+        while (p) {
+            pc_page_t* next = p->hnext;
+            if (match(p->vn, arg)) {
+                detach(p);
+                if (p->pins == 0) {
+                    p->hnext = dead;
+                    dead = p;
+                }
+            }
+            p = next;
+        }
+    }
+    spin_unlock_irqrestore(&pc_lock, fl);
+    free_pages(dead);
+}
+
+uint32_t pcache_shrink(uint32_t want)
+{
+    pc_page_t* dead = 0;
+    uint32_t n = 0;
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    while (n < want) {
+        pc_page_t* p = take_victim();
+        if (!p)
+            break;
+        p->hnext = dead;
+        dead = p;
+        n++;
+    }
+    st.reclaimed += n;
+    spin_unlock_irqrestore(&pc_lock, fl);
+    free_pages(dead);
+    return n;
+}
+
+void* vfs_mmap(vnode_t* vn, uint32_t off, uint32_t size, uint32_t* mapped)
+{
+    if (!vn || vn->type != VNODE_FILE || !vn->ops || !vn->ops->read || off % PCACHE_PAGE)
+        return 0;
+    uint32_t want = size ? (size + PCACHE_PAGE - 1) / PCACHE_PAGE : PCACHE_MAP_PAGES;
+    if (want > PCACHE_MAP_PAGES)
+        return 0;
+    pc_page_t** pages = (pc_page_t**)kmalloc(want * sizeof(pc_page_t*));
+    if (!pages)
+        return 0;
+
+    /* fill and pin the pages up to EOF or size */
+    uint32_t n = 0, bytes = 0;
+    int ok = 1;
+    while (n < want) {
+        pc_page_t* p = get_page(vn, off / PCACHE_PAGE + n);
+        if (!p) {
+            ok = 0;
+            break;
+        }
+        if (p->valid == 0) {
+            unpin(p);
+            break;
+        }
+        pages[n++] = p;
+        bytes += p->valid;
+        if (p->valid < PCACHE_PAGE)
+            break;
+    }
+    if (size && bytes > size)
+        bytes = size;
+
+    /* a run of free window slots and a mapping entry */
+    uint32_t first = 0;
+    pc_map_t* m = 0;
+    if (ok && n) {
+        uint32_t fl = spin_lock_irqsave(&pc_lock);
+        for (int i = 0; i < PCACHE_MAPS && !m; i++) {
+            if (maps[i].count == 0)
+                m = &maps[i];
+        }
+        uint32_t run = 0;
+        for (uint32_t s = 0; m && s < PCACHE_MAP_PAGES && run < n; s++) {
+            run = win[s] ? 0 : run + 1;
+            first = s + 1 - run;
+        }
+        if (m && run == n) {
+            for (uint32_t i = 0; i < n; i++)
+                win[first + i] = pages[i];
+            m->first = first;
+            m->count = n;
+            m->vn = vn;
+            st.mapped += n;
+        } else {
+            m = 0;
+        }
+        spin_unlock_irqrestore(&pc_lock, fl);
+    }
+
+    if (!m) {
+        for (uint32_t i = 0; i < n; i++)
+            unpin(pages[i]);
+        kfree(pages);
+        return 0;
+    }
+
+    uint32_t va = PCACHE_MAP_BASE + first * PCACHE_PAGE;
+    for (uint32_t i = 0; i < n; i++)
+        vmm_map_page(kernel_page_directory, va + i * PCACHE_PAGE, pages[i]->phys, PAGE_PRESENT);
+    kfree(pages);
+    vnode_get(vn);
+    if (mapped)
+        *mapped = bytes;
+    return (void*)(uintptr_t)va;
+}
+
+void vfs_munmap(void* addr)
+{
+    uint32_t va = (uint32_t)(uintptr_t)addr;
+    if (va < PCACHE_MAP_BASE || va % PCACHE_PAGE)
+        return;
+    uint32_t first = (va - PCACHE_MAP_BASE) / PCACHE_PAGE;
+
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    pc_map_t* m = 0;
+    for (int i = 0; i < PCACHE_MAPS && !m; i++) {
+        if (maps[i].count && maps[i].first == first)
+            m = &maps[i];
+    }
+    spin_unlock_irqrestore(&pc_lock, fl);
+    if (!m)
+        return;
+
+    /* unmap while the slots are still taken, then give the pages back */
+    for (uint32_t i = 0; i < m->count; i++)
+        vmm_unmap_page(kernel_page_directory, va + i * PCACHE_PAGE);
+
+    pc_page_t* dead = 0;
+    fl = spin_lock_irqsave(&pc_lock);
+    for (uint32_t i = 0; i < m->count; i++) {
+        pc_page_t* p = win[first + i];
+        win[first + i] = 0;
+        if (--p->pins == 0 && (p->flags & PC_DETACHED)) {
+            p->hnext = dead;
+            dead = p;
+        }
+    }
+    st.mapped -= m->count;
+    vnode_t* vn = m->vn;
+    m->count = 0;
+    m->vn = 0;
+    spin_unlock_irqrestore(&pc_lock, fl);
+    free_pages(dead);
+    vnode_put(vn);
+}
+
+void pcache_get_stats(pcache_stats_t* out)
+{
+    if (!out)
+        return;
+    uint32_t fl = spin_lock_irqsave(&pc_lock);
+    *out = st;
+    spin_unlock_irqrestore(&pc_lock, fl);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include "vnode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kernel/fs/vfs/pcache.c
+   Page cache: file data in 4 KB pages keyed on (vnode, page index), filled
+   through the vnode's ops->read (so from the buffer cache and the block
+   layer underneath). Every reader of a file shares the same pages, and
+   vfs_mmap() maps them into a kernel window instead of copying. Unpinned
+   pages are recycled LRU first when the cache reaches PCACHE_MAX_PAGES,
+   when fewer than PCACHE_MIN_FREE frames are free, and by the PMM itself
+   when an allocation finds no free frame (pmm_set_reclaim). */
+
+#define PCACHE_PAGE       4096
+#define PCACHE_MAX_PAGES  8192          /* 32 MB */
+#define PCACHE_MIN_FREE   1024          /* frames left to everyone else */
+
+#define PCACHE_MAP_BASE   0xE8000000u   /* vfs_mmap() window */
+#define PCACHE_MAP_PAGES  8192          /* 32 MB */
+#define PCACHE_MAPS       64            /* mappings at once */
+
+void pcache_init(void);
+
+/* Read through the cache: bytes copied (short at EOF), negative on error.
+   Non-file vnodes, and reads no page can be found for, go straight to
+   ops->read. */
+int pcache_read(vnode_t* vn, uint32_t off, void* buf, uint32_t size);
+
+/* Drop the cached pages of vn (it was written, or is being freed). Pages
+   still mapped stay valid for their mapping and are freed at munmap. */
+void pcache_invalidate(vnode_t* vn);
+
+/* Same for every cached vnode match() accepts, for changes made below the
+   VFS. match runs under the cache lock and must not block. */
+void pcache_invalidate_if(int (*match)(vnode_t* vn, const void* arg), const void* arg);
+
+/* Map file bytes from off (page aligned) read-only into the kernel,
+   sharing the cached pages; size 0 maps to EOF. Returns the address and
+   sets *mapped to the bytes of file data there (short at EOF), or NULL.
+   The mapping holds a reference on vn; vfs_munmap() drops it. */
+void* vfs_mmap(vnode_t* vn, uint32_t off, uint32_t size, uint32_t* mapped);
+void vfs_munmap(void* addr);
+
+/* Free up to want unpinned pages, least recently used first */
+uint32_t pcache_shrink(uint32_t want);
+
+typedef struct {
+    uint32_t pages;
+    uint32_t mapped;        /* pages pinned by vfs_mmap() */
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;     /* recycled for other pages */
+    uint32_t reclaimed;     /* given back to the PMM */
+} pcache_stats_t;
+
+void pcache_get_stats(pcache_stats_t* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,29 +1,75 @@
 #include "mount.h"
 #include "vnode.h"
+#include "vfs.h"
+#include "fs_ops.h"
+#include "pcache.h"
 #include <stdint.h>
 
 /* Use project string lib; if you don't have it replace with <string.h> */
 #include "../../string.h"
 
-#define MAX_MOUNTS 8
-
 typedef struct mount {
-    const char* path;   /* mount point string (e.g. "/") */
-    vnode_t* root;      /* root vnode of the mounted FS */
+    char path[VFS_PATH_MAX]; /* canonical mount point (e.g. "/", "/mnt/a") */
+    int len;
+    vnode_t* root;           /* root vnode of the mounted FS */
 } mount_t;
 
 static mount_t mounts[MAX_MOUNTS];
 static int mount_count = 0;
 
+/* Fold path into out as "/a/b": no ".", "..", empty components or
+   trailing '/'. ".." at the top stays at "/". -1 if path is relative or
+   too long. */
+int vfs_canonicalize(const char* path, char* out)
+{
+    if (path[0] != '/')
+        return -1;
+    int o = 0;
+    const char* p = path;
+    while (*p) {
+        while (*p == '/')
+            p++;
+        const char* c = p;
+        while (*p && *p != '/')
+            p++;
+        int len = p - c;
+        if (len == 0 || (len == 1 && c[0] == '.'))
+            continue;
+        if (len == 2 && c[0] == '.' && c[1] == '.') {
+            while (o > 0 && out[o - 1] != '/')
+                o--;
+            if (o > 0)
+                o--;
+            continue;
+        }
+        if (o + 1 + len >= VFS_PATH_MAX)
+            return -1;
+        out[o++] = '/';
+        memcpy(out + o, c, len);
+        o += len;
+    }
+    if (o == 0)
+        out[o++] = '/';
+    out[o] = 0;
+    return o;
+}
+
 void vfs_mount(const char* path, vnode_t* root)
 {
     if (!path || !root)
         return;
 
+    char cpath[VFS_PATH_MAX];
+    int len = vfs_canonicalize(path, cpath);
+    if (len < 0)
+        return;
+
     /* simple duplicate check */
     for (int i = 0; i < mount_count; i++) {
-        if (strcmp(mounts[i].path, path) == 0) {
+        if (strcmp(mounts[i].path, cpath) == 0) {
             mounts[i].root = root; /* replace */
+            /* vnodes of the old filesystem are no longer reachable */
+            vnode_cache_flush();
             return;
         }
     }
@@ -31,40 +77,83 @@ void vfs_mount(const char* path, vnode_t* root)
     if (mount_count >= MAX_MOUNTS)
         return;
 
-    mounts[mount_count].path = path;
+    memcpy(mounts[mount_count].path, cpath, len + 1);
+    mounts[mount_count].len = len;
     mounts[mount_count].root = root;
     mount_count++;
 }
 
-vnode_t* vfs_resolve(const char* path)
+int vfs_mount_at(int index, const char** path, vnode_t** root)
 {
-    if (!path)
+    if (index < 0 || index >= mount_count)
         return 0;
+    if (path)
+        *path = mounts[index].path;
+    if (root)
+        *root = mounts[index].root;
+    return 1;
+}
 
-    /* only absolute paths supported for now */
-    if (path[0] != '/')
-        return 0;
-
-    /* exact-match mount points only for now. If user mounts "/" it will match "/".
-       We also support the case where a mount point is "/" and any path starting with
-       "/" should return the mount's root (later we'll parse path components).
-    */
-
+/* Longest mount point that is a whole-component prefix of cpath */
+static mount_t* match_mount(const char* cpath)
+{
+    mount_t* best = 0;
     for (int i = 0; i < mount_count; i++) {
-        const char* mp = mounts[i].path;
-        if (!mp)
+        mount_t* m = &mounts[i];
+        if (best && m->len <= best->len)
+            continue;
+        if (m->len == 1) { /* "/" covers everything */
+            best = m;
             continue;
+        }
+        if (strncmp(cpath, m->path, m->len) == 0 &&
+            (cpath[m->len] == 0 || cpath[m->len] == '/'))
+            best = m;
+    }
+    return best;
+}
 
-        /* exact match */
-        if (strcmp(path, mp) == 0)
-            return mounts[i].root;
+vnode_t* vfs_resolve(const char* path)
+{
+    if (!path)
+        return 0;
 
-        /* if mount point is "/" and path starts with "/", return root */
-        if (strcmp(mp, "/") == 0)
-            return mounts[i].root;
+    char cpath[VFS_PATH_MAX];
+    if (vfs_canonicalize(path, cpath) < 0)
+        return 0;
+
+    mount_t* m = match_mount(cpath);
+    if (!m)
+        return 0;
 
-        /* future: match prefix mount points (e.g. /mnt/foo -> /mnt/foo/bar) */
+    vnode_t* v = vnode_get(m->root);
+    const char* p = cpath + m->len;
+    if (m->len == 1)
+        p = cpath[1] ? cpath : cpath + 1;
+    while (*p == '/') {
+        p++;
+        const char* c = p;
+        while (*p && *p != '/')
+            p++;
+        vnode_t* next = vnode_lookup(v, c, p - c);
+        vnode_put(v);
+        if (!next)
+            return 0;
+        v = next;
     }
+    return v;
+}
 
-    return 0;
+int vfs_read(vnode_t* node, uint32_t off, void* buf, uint32_t size)
+{
+    return pcache_read(node, off, buf, size);
+}
+
+int vfs_write(vnode_t* node, uint32_t off, const void* buf, uint32_t size)
+{
+    if (!node || !node->ops || !node->ops->write)
+        return -1;
+    int r = node->ops->write(node, off, (const uint8_t*)buf, size);
+    pcache_invalidate(node);
+    return r;
 }
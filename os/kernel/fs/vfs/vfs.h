@@ -9,7 +9,7 @@ extern "C" {
 #define MAX_FILES_PER_PROCESS 16
 
 typedef struct file {
-  vnode_t *node;
+  vnode_t *node;    /* referenced; vnode_put() on close */
   uint32_t offset;
   int flags;
 } file_t;
@@ -18,6 +18,11 @@ typedef struct file {
 void vfs_mount(const char *path, vnode_t *root);
 vnode_t *vfs_resolve(const char *path);
 
+/* File I/O: reads go through the page cache (pcache.h), writes go to the
+   FS and drop the node's cached pages. Bytes, or negative on error. */
+int vfs_read(vnode_t *node, uint32_t off, void *buf, uint32_t size);
+int vfs_write(vnode_t *node, uint32_t off, const void *buf, uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -64,6 +64,7 @@ vnode_t *vfs_create_ram_file(const char *name) {
   ram_files = rn;
 
   vnode_t *vn = (vnode_t *)kmalloc(sizeof(vnode_t));
+  memset(vn, 0, sizeof(vnode_t));
   vn->name = rn->name;
   vn->type = VNODE_FILE;
   vn->ops = &ram_ops;
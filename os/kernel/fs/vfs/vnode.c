@@ -0,0 +1,203 @@
+/* kernel/fs/vfs/vnode.c
+   Vnode cache (see vnode.h). Lookups that miss call the filesystem with
+   the lock dropped, since that may do disk I/O, and recheck before
+   inserting so two racing walkers end up sharing one vnode. */
+
+#include "vnode.h"
+#include "fs_ops.h"
+#include "mount.h"
+#include "pcache.h"
+#include "../../mem/kmalloc.h"
+#include "../../string.h"
+#include "../../sync/spinlock.h"
+
+#define VNODE_BUCKETS 128   /* power of two */
+
+static vnode_t* buckets[VNODE_BUCKETS];
+static spinlock_t vc_lock = SPINLOCK_INIT("vnode");
+static uint32_t vc_cached, vc_hits, vc_misses;
+
+static inline int nocase(const vnode_t* dir)
+{
+    return dir->ops && (dir->ops->flags & FS_NOCASE);
+}
+
+static inline char fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+}
+
+/* children of a FS_NOCASE directory are keyed on the case-folded name */
+static uint32_t vnode_hash(const vnode_t* dir, const char* name, int len)
+{
+    int nc = nocase(dir);
+    uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)dir;
+    for (int i = 0; i < len; i++)
+        h = (h ^ (uint8_t)(nc ? fold(name[i]) : name[i])) * 16777619u;
+    return h;
+}
+
+static int name_eq(const vnode_t* dir, const char* a, const char* name, int len)
+{
+    if (!nocase(dir))
+        return strncmp(a, name, len) == 0 && a[len] == 0;
+    for (int i = 0; i < len; i++)
+        if (fold(a[i]) != fold(name[i]))
+            return 0;
+    return a[len] == 0;
+}
+
+static vnode_t* probe(const vnode_t* dir, const char* name, int len, uint32_t h)
+{
+    for (vnode_t* v = buckets[h & (VNODE_BUCKETS - 1)]; v; v = v->hnext) {
+        if (v->hash == h && v->parent == dir && name_eq(dir, v->name, name, len))
+            return v;
+    }
+    return 0;
+}
+
+static void unlink_locked(vnode_t* v)
+{
+    vnode_t** pp = &buckets[v->hash & (VNODE_BUCKETS - 1)];
+    while (*pp && *pp != v)
+        pp = &(*pp)->hnext;
+    if (*pp)
+        *pp = v->hnext;
+    v->hnext = 0;
+    vc_cached--;
+}
+
+/* Unlink unreferenced vnodes until at most keep are cached. Freeing a
+   vnode drops its hold on the parent, which may free that in turn on the
+   next pass. Returns the victims chained through hnext. */
+static vnode_t* trim_locked(uint32_t keep)
+{
+    vnode_t* victims = 0;
+    int progress = 1;
+    while (vc_cached > keep && progress) {
+        progress = 0;
+        for (int b = 0; b < VNODE_BUCKETS && vc_cached > keep; b++) {
+            vnode_t* v = buckets[b];
+            while (v && vc_cached > keep) {
+                vnode_t* next = v->hnext;
+                if (v->refcount == 0) {
+                    unlink_locked(v);
+                    if (v->parent && v->parent->refcount)
+                        v->parent->refcount--;
+                    v->hnext = victims;
+                    victims = v;
+                    progress = 1;
+                }
+                v = next;
+            }
+        }
+    }
+    return victims;
+}
+
+static void free_victims(vnode_t* v)
+{
+    while (v) {
+        vnode_t* next = v->hnext;
+        pcache_invalidate(v);
+        if (v->ops && v->ops->release)
+            v->ops->release(v);
+        kfree(v);
+        v = next;
+    }
+}
+
+vnode_t* vnode_lookup(vnode_t* dir, const char* name, int len)
+{
+    if (!dir || !name || len <= 0 || len >= VFS_PATH_MAX)
+        return 0;
+    uint32_t h = vnode_hash(dir, name, len);
+
+    uint32_t fl = spin_lock_irqsave(&vc_lock);
+    vnode_t* v = probe(dir, name, len, h);
+    if (v) {
+        v->refcount++;
+        vc_hits++;
+        spin_unlock_irqrestore(&vc_lock, fl);
+        return v;
+    }
+    vc_misses++;
+    spin_unlock_irqrestore(&vc_lock, fl);
+
+    if (dir->type != VNODE_DIR || !dir->ops || !dir->ops->lookup)
+        return 0;
+
+    /* the name is kept right after the vnode */
+    vnode_t* n = (vnode_t*)kmalloc(sizeof(vnode_t) + len + 1);
+    if (!n)
+        return 0;
+    memset(n, 0, sizeof(vnode_t));
+    char* nm = (char*)(n + 1);
+    memcpy(nm, name, len);
+    nm[len] = 0;
+    n->name = nm;
+    n->parent = dir;
+    if (dir->ops->lookup(dir, nm, n) != 0) {
+        kfree(n);
+        return 0;
+    }
+
+    fl = spin_lock_irqsave(&vc_lock);
+    v = probe(dir, name, len, h);
+    if (v) {
+        v->refcount++;
+        spin_unlock_irqrestore(&vc_lock, fl);
+        free_victims(n);
+        return v;
+    }
+    n->flags = VNODE_CACHED;
+    n->refcount = 1;
+    n->hash = h;
+    n->hnext = buckets[h & (VNODE_BUCKETS - 1)];
+    buckets[h & (VNODE_BUCKETS - 1)] = n;
+    dir->refcount++;
+    vc_cached++;
+    vnode_t* victims = vc_cached > VNODE_CACHE_MAX ? trim_locked(VNODE_CACHE_MAX) : 0;
+    spin_unlock_irqrestore(&vc_lock, fl);
+    free_victims(victims);
+    return n;
+}
+
+vnode_t* vnode_get(vnode_t* v)
+{
+    if (!v)
+        return 0;
+    uint32_t fl = spin_lock_irqsave(&vc_lock);
+    v->refcount++;
+    spin_unlock_irqrestore(&vc_lock, fl);
+    return v;
+}
+
+void vnode_put(vnode_t* v)
+{
+    if (!v)
+        return;
+    uint32_t fl = spin_lock_irqsave(&vc_lock);
+    if (v->refcount)
+        v->refcount--;
+    spin_unlock_irqrestore(&vc_lock, fl);
+}
+
+void vnode_cache_flush(void)
+{
+    uint32_t fl = spin_lock_irqsave(&vc_lock);
+    vnode_t* victims = trim_locked(0);
+    spin_unlock_irqrestore(&vc_lock, fl);
+    free_victims(victims);
+}
+
+void vnode_cache_stats(vnode_cache_stats_t* out)
+{
+    if (!out)
+        return;
+    uint32_t fl = spin_lock_irqsave(&vc_lock);
+    out->cached = vc_cached;
+    out->hits = vc_hits;
+    out->misses = vc_misses;
+    spin_unlock_irqrestore(&vc_lock, fl);
+}
@@ -13,18 +13,58 @@ typedef enum {
 } vnode_type_t;
 
 struct fs_ops;
+struct pc_page;
+
+#define VNODE_CACHED 0x1     /* lives in the vnode cache (vnode.c) */
 
 /* generic VFS node */
 typedef struct vnode {
-    const char* name;         /* pointer to a static string (no heap) */
+    const char* name;         /* static string, or kept with a cached vnode */
     vnode_type_t type;
 
     struct fs_ops* ops;      /* pointer to operations implemented by FS */
     void* internal;          /* FS-private data */
 
     struct vnode* parent;    /* parent vnode (or NULL for root) */
+
+    /* vnode cache; all zero for static vnodes such as FS roots */
+    uint32_t flags;
+    uint32_t refcount;
+    uint32_t hash;
+    struct vnode* hnext;
+
+    struct pc_page* pages;   /* cached file pages (pcache.c) */
 } vnode_t;
 
+/* kernel/fs/vfs/vnode.c
+   Vnodes found by lookup are cached in a hash keyed by (parent, name),
+   so walking a path that was walked before costs one probe per component
+   and no FS call. A cached vnode holds a reference on its parent; the
+   cache keeps unreferenced vnodes until it grows past VNODE_CACHE_MAX and
+   then frees unreferenced ones, children before their parents (their
+   cached pages go first, then ops->release drops the FS data). Static
+   vnodes (FS roots) are never freed. */
+
+#define VNODE_CACHE_MAX 256
+
+/* Child name[0..len) of dir, referenced: vnode_put() when done.
+   NULL if the FS has no such entry (or no lookup). */
+vnode_t* vnode_lookup(vnode_t* dir, const char* name, int len);
+
+vnode_t* vnode_get(vnode_t* v);
+void vnode_put(vnode_t* v);
+
+/* Free every unreferenced cached vnode (after a mount changes) */
+void vnode_cache_flush(void);
+
+typedef struct {
+    uint32_t cached;
+    uint32_t hits;
+    uint32_t misses;
+} vnode_cache_stats_t;
+
+void vnode_cache_stats(vnode_cache_stats_t* out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,6 @@
 #include "lapic.h"
 #include "../paging.h" // Folosim paging.h pentru paging_map_page
+#include "hpet.h"
 
 // Adresa de bază a LAPIC (mapată virtual)
 static volatile uint32_t* lapic_base = (volatile uint32_t*)0xFEE00000;
@@ -22,6 +23,12 @@ static volatile uint32_t* lapic_base = (volatile uint32_t*)0xFEE00000;
 #define LAPIC_TCCR      0x0390
 #define LAPIC_TDCR      0x03E0
 
+#define LAPIC_ICR_PENDING     (1u << 12)
+#define LAPIC_ICR_ASSERT      (1u << 14)
+#define LAPIC_TIMER_MASKED    (1u << 16)
+#define LAPIC_TIMER_PERIODIC  (1u << 17)
+#define LAPIC_TDCR_DIV16      0x3
+
 static uint32_t lapic_read(uint32_t reg) {
     return *(volatile uint32_t*)((uint8_t*)lapic_base + reg);
 }
@@ -51,11 +58,47 @@ uint32_t lapic_get_id(void) {
 }
 
 void lapic_send_ipi(uint8_t apic_id, uint32_t type, uint8_t vector) {
+    // Așteaptă trimiterea IPI-ului anterior (Delivery Status)
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING)
+        asm volatile("pause");
+
     // Scrie High DWORD (Destination Field)
     lapic_write(LAPIC_ICR_HI, ((uint32_t)apic_id) << 24);
     
-    // Scrie Low DWORD (Type, Vector, Level, etc.)
-    lapic_write(LAPIC_ICR_LO, type | vector);
+    // Scrie Low DWORD: delivery mode în biții 8-10, INIT cu Level=Assert
+    uint32_t lo = (type << 8) | vector;
+    if (type == LAPIC_IPI_INIT) lo |= LAPIC_ICR_ASSERT;
+    lapic_write(LAPIC_ICR_LO, lo);
+}
+
+uint32_t lapic_timer_calibrate(void) {
+    // Referința: HPET (PIT-ul nu are încă întreruperi active la SMP bring-up)
+    // Rezultatul se păstrează: SMP și timer.c calibrează o singură dată.
+    static uint32_t cached = 0;
+    if (cached) return cached;
+    if (!hpet_is_active()) return 0;
+
+    lapic_write(LAPIC_TDCR, LAPIC_TDCR_DIV16);
+    lapic_write(LAPIC_TIMER, LAPIC_TIMER_MASKED);
+    lapic_write(LAPIC_TICR, 0xFFFFFFFF);
+    hpet_delay_us(10000);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TCCR);
+    lapic_write(LAPIC_TICR, 0);
+    cached = elapsed / 10;
+    return cached;
+}
+
+void lapic_timer_start(uint8_t vector, uint32_t initial_count) {
+    lapic_write(LAPIC_TDCR, LAPIC_TDCR_DIV16);
+    lapic_write(LAPIC_TIMER, LAPIC_TIMER_PERIODIC | vector);
+    lapic_write(LAPIC_TICR, initial_count);
+}
+
+/* one-shot: fires once after initial_count ticks; 0 stops the timer */
+void lapic_timer_oneshot(uint8_t vector, uint32_t initial_count) {
+    lapic_write(LAPIC_TDCR, LAPIC_TDCR_DIV16);
+    lapic_write(LAPIC_TIMER, vector);
+    lapic_write(LAPIC_TICR, initial_count);
 }
 
 void lapic_disable(void) {
@@ -19,6 +19,17 @@ uint32_t lapic_get_id(void);
 void lapic_send_ipi(uint8_t apic_id, uint32_t type, uint8_t vector);
 void lapic_disable(void);
 
+/* IPI delivery modes (type argument of lapic_send_ipi) */
+#define LAPIC_IPI_FIXED 0
+#define LAPIC_IPI_INIT  5
+#define LAPIC_IPI_SIPI  6
+
+/* LAPIC timer: ticks per ms at divide-by-16 (0 if no reference clock),
+ * periodic or one-shot mode on the calling CPU */
+uint32_t lapic_timer_calibrate(void);
+void lapic_timer_start(uint8_t vector, uint32_t initial_count);
+void lapic_timer_oneshot(uint8_t vector, uint32_t initial_count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -193,6 +193,30 @@ int pci_find_device_by_class(uint8_t class_code, uint8_t sub, uint8_t prog_if, u
     return 0;
 }
 
+/* first function of class/subclass, whatever its programming interface */
+int pci_find_device_by_subclass(uint8_t class_code, uint8_t sub, uint8_t *out_bus, uint8_t *out_dev, uint8_t *out_func) {
+    for (uint16_t bus = 0; bus < 256; bus++) {
+        for (uint8_t dev = 0; dev < 32; dev++) {
+            for (uint8_t func = 0; func < 8; func++) {
+                if (pci_get_vendor(bus, dev, func) == 0xFFFF) continue;
+
+                if (pci_get_class(bus, dev, func) == class_code &&
+                    pci_get_subclass(bus, dev, func) == sub) {
+                    *out_bus = (uint8_t)bus;
+                    *out_dev = dev;
+                    *out_func = func;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+uint8_t pci_read_prog_if(uint8_t bus, uint8_t dev, uint8_t func) {
+    return pci_get_progif(bus, dev, func);
+}
+
 uint32_t pci_read_bar32(uint8_t bus, uint8_t dev, uint8_t func, int bar_index) {
     return pci_read(bus, dev, func, 0x10 + bar_index * 4);
 }
@@ -203,4 +227,8 @@ void pci_enable_busmaster(uint8_t bus, uint8_t dev, uint8_t func) {
     pci_write(bus, dev, func, 0x04, cmd);
 }
 
+uint8_t pci_read_irq_line(uint8_t bus, uint8_t dev, uint8_t func) {
+    return (uint8_t)(pci_read(bus, dev, func, 0x3C) & 0xFF);
+}
+
 }
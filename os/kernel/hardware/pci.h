@@ -8,6 +8,16 @@ extern "C" {
 
 void pci_init(void);
 
+/* driver API: 1 and the location if a function matches, 0 otherwise */
+int pci_find_device_by_class(uint8_t class_code, uint8_t sub, uint8_t prog_if,
+                             uint8_t *out_bus, uint8_t *out_dev, uint8_t *out_func);
+int pci_find_device_by_subclass(uint8_t class_code, uint8_t sub,
+                                uint8_t *out_bus, uint8_t *out_dev, uint8_t *out_func);
+uint32_t pci_read_bar32(uint8_t bus, uint8_t dev, uint8_t func, int bar_index);
+uint8_t pci_read_prog_if(uint8_t bus, uint8_t dev, uint8_t func);
+void pci_enable_busmaster(uint8_t bus, uint8_t dev, uint8_t func);
+uint8_t pci_read_irq_line(uint8_t bus, uint8_t dev, uint8_t func);
+
 #ifdef __cplusplus
 }
 #endif
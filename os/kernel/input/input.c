@@ -1,4 +1,8 @@
 #include "input.h"
+#include "../sync/spinlock.h"
+#include "../sched/pcb.h"
+#include "../sched/scheduler.h"
+#include "../time/timer.h"
 
 /* Kernel logging helper */
 extern void serial(const char *fmt, ...);
@@ -10,6 +14,11 @@ static int head = 0;
 static int tail = 0;
 static volatile bool input_ready = false;
 static volatile bool usb_keyboard_active = false;
+/* keyboard/mouse IRQs push, the WM loop pops */
+static spinlock_t input_lock = SPINLOCK_INIT("input");
+/* task sleeping in input_wait(), -1 if none */
+static int waiter_tid = -1;
+static volatile int waiter_woken = 0;
 
 void input_init(void) {
     head = 0;
@@ -18,29 +27,90 @@ void input_init(void) {
 }
 
 void input_push(input_event_t event) {
+    uint32_t flags = spin_lock_irqsave(&input_lock);
     int next = (head + 1) % INPUT_QUEUE_SIZE;
     if (next == tail) {
         // Queue full, drop event
+        spin_unlock_irqrestore(&input_lock, flags);
         return;
     }
     
     queue[head] = event;
     head = next;
+    int tid = waiter_tid;
+    waiter_tid = -1;
+    waiter_woken = 1;
+    spin_unlock_irqrestore(&input_lock, flags);
+
+    /* interactive wake-up: the reader jumps ahead of CPU-bound tasks */
+    if (tid >= 0) scheduler_wake(tid, SCHED_BOOST_INPUT);
     
     // Optional debug
     // serial("[INPUT] push key: %c (%d)\n", (char)event.keycode, event.pressed);
 }
 
 bool input_pop(input_event_t *out_event) {
+    uint32_t flags = spin_lock_irqsave(&input_lock);
     if (head == tail) {
+        spin_unlock_irqrestore(&input_lock, flags);
         return false;
     }
     
     *out_event = queue[tail];
     tail = (tail + 1) % INPUT_QUEUE_SIZE;
+    spin_unlock_irqrestore(&input_lock, flags);
     return true;
 }
 
+static inline int irqs_enabled(void) {
+    uint32_t fl;
+    asm volatile("pushfl\n\tpopl %0" : "=r"(fl));
+    return (fl & 0x200) != 0;
+}
+
+/* max_ms ran out before any input: wake the waiter without a boost */
+static void input_wait_timeout(void *arg) {
+    (void)arg;
+    uint32_t flags = spin_lock_irqsave(&input_lock);
+    int tid = waiter_tid;
+    waiter_tid = -1;
+    waiter_woken = 1;
+    spin_unlock_irqrestore(&input_lock, flags);
+    if (tid >= 0) scheduler_wake(tid, 0);
+}
+
+void input_wait(uint32_t max_ms) {
+    pcb_t *cur = pcb_get_current();
+    if (cur && irqs_enabled()) {
+        uint32_t flags = spin_lock_irqsave(&input_lock);
+        if (head != tail) {
+            spin_unlock_irqrestore(&input_lock, flags);
+            return;
+        }
+        waiter_tid = (int)cur->tid;
+        waiter_woken = 0;
+        spin_unlock_irqrestore(&input_lock, flags);
+
+        ktimer_t t;
+        ktimer_init(&t, input_wait_timeout, 0);
+        int armed = max_ms &&
+                    ktimer_arm(&t, timer_now_ns() + (uint64_t)max_ms * 1000000u) == 0;
+
+        /* scheduled task: sleep until input_push() (or the timer) wakes us */
+        int r = scheduler_block_until(&waiter_woken);
+        if (armed) ktimer_cancel(&t);
+        if (r == 0)
+            return;
+
+        flags = spin_lock_irqsave(&input_lock);
+        if (waiter_tid == (int)cur->tid) waiter_tid = -1;
+        spin_unlock_irqrestore(&input_lock, flags);
+    }
+    /* kernel_main / idle context: halt until the next interrupt */
+    if (max_ms) timer_idle(max_ms);
+    else asm volatile("hlt");
+}
+
 void input_push_key(uint32_t keycode, bool pressed) {
     input_event_t ev = {0};
     ev.type = INPUT_KEYBOARD;
@@ -26,6 +26,12 @@ void input_push(input_event_t event);
 bool input_pop(input_event_t *out_event);
 void input_push_key(uint32_t keycode, bool pressed);
 
+/* Sleep until an event is queued or max_ms (0: no limit) has passed. A
+   scheduled task blocks and is woken with SCHED_BOOST_INPUT by
+   input_push(); other contexts halt until the next interrupt. Returns at
+   once if the queue is not empty. */
+void input_wait(uint32_t max_ms);
+
 /* Synchronization for shell start */
 void input_signal_ready(void);
 bool input_is_ready(void);
@@ -158,6 +158,7 @@ isr_common_stub:
     mov fs, ax
     mov gs, ax
 
+    cld                  ; codul C presupune DF = 0 (iretd reface EFLAGS)
     push esp             ; Pointer la structura registers_t
     call isr_handler     ; Apelăm handler-ul C++
     add esp, 4           ; Curățăm argumentul (pointerul)
@@ -188,6 +189,7 @@ irq_common_stub:
     mov fs, ax
     mov gs, ax
 
+    cld                  ; C code expects DF = 0 (iretd restores EFLAGS)
     push esp             ; pointer to registers_t
     call irq_handler
     add esp, 4
@@ -51,6 +51,7 @@
 #include "fs/fs.h"
 #include "fs/ramfs/ramfs.h"
 #include "fs/vfs/mount.h"
+#include "fs/vfs/pcache.h"
 #include "hardware/acpi.h"
 #include "hardware/apic.h"
 #include "hardware/hpet.h"
@@ -71,6 +72,7 @@
 #include "storage/ahci/ahci.h"
 #include "storage/ata.h"
 #include "storage/block.h"
+#include "storage/bcache.h"
 #include "storage/io_sched.h"
 #include "string.h"
 #include "terminal.h"
@@ -478,7 +480,9 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
   // 5) Optional boot logo
   bootlogo_show();
 
-  // 6) Filesystem core: initialize and mount a minimal root
+  // 6) Filesystem core: initialize and mount a minimal root (an empty
+  //    placeholder; mounting a FAT partition replaces it, see
+  //    fat32_set_mounted)
   fs_init();
   if (!ramfs_root()) {
     // ramfs_root failure is fatal for our simple early boot; panic instead of
@@ -488,9 +492,10 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
   vfs_mount("/", ramfs_root());
 
   vnode_t *v = vfs_resolve("/");
-  if (v)
+  if (v) {
     terminal_writestring("[vfs] root mounted OK\n");
-  else
+    vnode_put(v);
+  } else
     terminal_writestring("[vfs] mount FAILED\n");
 
   // 7) User subsystem (if present)
@@ -511,9 +516,19 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
     panic_if_fatal("Heap region invalid (heap_end <= heap_start)");
   }
 
-  heap_init(&__heap_start, (size_t)(&__heap_end - &__heap_start));
-  buddy_init_from_heap();
-  kmalloc_init();
+  kmalloc_init();         // heap_init() on the lower part of the region
+  buddy_init_from_heap(); // top BUDDY_HEAP_BYTES: pages for slab caches
+  if (kmalloc_enable_magazines() != 0) // small kmallocs: per-CPU magazines
+    serial("[kmalloc] magazine caches unavailable, heap only\n");
+
+  // mem* fast paths: CPUID probe, then verify every size class once
+  string_init_cpu();
+  {
+    int rc = string_selftest();
+    if (rc != 0)
+      serial("[string] mem* self-test failed (rc=%d)%s\n", rc,
+             rc == -2 ? ", non-temporal path disabled" : "");
+  }
 
   /* Register multiboot modules directly in RAMFS (don't copy - just point to
    * them) */
@@ -679,6 +694,8 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
 
   input_init();
   block_init();
+  bcache_init(BCACHE_DEFAULT_BLOCKS); /* sector cache under FAT/ChrysFS */
+  pcache_init();                      /* file pages above the VFS */
   chrysfs_init();
 
   /* BIOS + ACPI legacy areas */
@@ -702,14 +719,15 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
     serial("[KERNEL] AHCI initialized (%d ports).\n", ahci_ports);
   }
 
+  int ata_disks = 0;
   if (ahci_ports == 0) {
     serial("[KERNEL] AHCI not active or ahci0 missing. Initializing Legacy "
            "ATA...\n");
-    ata_init();
+    ata_disks = ata_init();
   }
 
   /* Auto-mount: Scan partitions and try to mount FAT32 */
-  if (ahci_ports > 0) {
+  if (ahci_ports > 0 || ata_disks > 0) {
     serial("[KERNEL] Probing partitions...\n");
     disk_probe_partitions();
     fat_automount();
@@ -768,6 +786,9 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
     mouse_init();
   }
 
+  /* IRQ routing is final now: move deadlines to the LAPIC one-shot */
+  timer_hires_init();
+
   // 20) Heap test (defensive frees)
   void *heap_a = kmalloc(64);
   void *heap_b = kmalloc_aligned(100, 64);
@@ -856,6 +877,7 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
   while (1) {
     usb_poll();                // Poll USB HID devices
     io_sched_poll();           // Process Async I/O requests
+    bcache_periodic();         // Write back aged dirty sectors
     net_poll();                // Poll Network Stack
     ps2_controller_watchdog(); // Scan for PS/2 freezes
 
@@ -876,7 +898,7 @@ extern "C" void kernel_main(uint32_t magic, uint32_t addr) {
       }
     }
 
-    asm volatile("hlt"); // reduce power until next interrupt
+    input_wait(10); // sleep until input or the next 10 ms poll
   }
 }
 
@@ -1,9 +1,16 @@
 /* kernel/mem/buddy.c
-   Simple buddy allocator backed by a contiguous page range (buddy_base .. buddy_base + buddy_page_count*PAGE).
-   It expects buddy_init_from_heap() to set buddy_base and buddy_page_count and call buddy_init().
+   Buddy allocator backed by a contiguous page range (buddy_base .. buddy_base + buddy_page_count*PAGE).
+   - free blocks live on intrusive doubly linked lists, one per order
+   - a per-page state byte records "free head of order o" / "allocated head of order o",
+     so finding, unlinking and merging a buddy is O(1) (no list scans)
+   - the state array is static for the heap slice, or carved from the first
+     pages of a larger managed range
+   It expects buddy_init_from_heap() (or buddy_init_region()) to set the range.
+   buddy_lock (irqsave) serializes alloc/free/stats.
 */
 
 #include "buddy.h"
+#include "../sync/spinlock.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -19,20 +26,35 @@ extern uint8_t __heap_end;
 /* configuration */
 #define PAGE_SIZE 0x1000
 #ifndef BUDDY_MAX_ORDER
-#define BUDDY_MAX_ORDER 10
+#define BUDDY_MAX_ORDER 12
 #endif
 
+/* page_state[] encoding (only meaningful for the first page of a block) */
+#define PS_FREE      0x80u   /* block head on free_lists[order] */
+#define PS_ALLOC     0x40u   /* block head handed out by buddy_alloc_page */
+#define PS_SLAB      0x20u   /* with PS_ALLOC: order-0 page owned by a slab */
+#define PS_NONE      0x00u   /* interior page, metadata page, or not a head */
+
 typedef struct free_block {
     struct free_block* next;
+    struct free_block* prev;
 } free_block_t;
 
 /* free lists indexed by order: list of blocks of size (1 << order) pages */
 static free_block_t* free_lists[BUDDY_MAX_ORDER + 1];
+static uint32_t free_counts[BUDDY_MAX_ORDER + 1];
 
 /* total frames the buddy manages and base physical address */
 static uint32_t frames_total = 0;
 static uintptr_t buddy_base = 0;
 static uint32_t buddy_page_count = 0;
+static uint8_t* page_state = NULL;
+static uint32_t meta_pages = 0;
+
+static spinlock_t buddy_lock = SPINLOCK_INIT("buddy");
+
+/* state bytes for the default heap slice; larger ranges carve their own */
+static uint8_t page_state_static[BUDDY_HEAP_BYTES / PAGE_SIZE];
 
 /* helpers: convert page-index <-> address */
 static inline uintptr_t page_index_to_addr(uint32_t idx) {
@@ -42,33 +64,23 @@ static inline uint32_t addr_to_page_index(uintptr_t addr) {
     return (uint32_t)((addr - buddy_base) / PAGE_SIZE);
 }
 
-/* push block into free list (order) */
+/* push block into free list (order) and tag its head page */
 static void fl_push(int order, free_block_t* block) {
+    block->prev = NULL;
     block->next = free_lists[order];
+    if (block->next) block->next->prev = block;
     free_lists[order] = block;
+    free_counts[order]++;
+    page_state[addr_to_page_index((uintptr_t)block)] = PS_FREE | (uint8_t)order;
 }
 
-/* remove a specific block pointer from free list order; returns 1 if removed */
-static int fl_remove(int order, free_block_t* target) {
-    free_block_t** cur = &free_lists[order];
-    while (*cur) {
-        if (*cur == target) {
-            *cur = target->next;
-            return 1;
-        }
-        cur = &((*cur)->next);
-    }
-    return 0;
-}
-
-/* find a buddy block pointer in free list at given order matching address; returns pointer or NULL */
-static free_block_t* fl_find_by_addr(int order, uintptr_t addr) {
-    free_block_t* cur = free_lists[order];
-    while (cur) {
-        if ((uintptr_t)cur == addr) return cur;
-        cur = cur->next;
-    }
-    return NULL;
+/* unlink a specific block from free list order: O(1) thanks to the back link */
+static void fl_remove(int order, free_block_t* target) {
+    if (target->prev) target->prev->next = target->next;
+    else free_lists[order] = target->next;
+    if (target->next) target->next->prev = target->prev;
+    free_counts[order]--;
+    page_state[addr_to_page_index((uintptr_t)target)] = PS_NONE;
 }
 
 /* Initialize buddy free lists for total_frames pages.
@@ -78,62 +90,71 @@ void buddy_init(uint32_t total_frames_param) {
     /* clear lists */
     frames_total = total_frames_param;
     buddy_page_count = total_frames_param;
-    for (int i = 0; i <= BUDDY_MAX_ORDER; ++i) free_lists[i] = NULL;
+    for (int i = 0; i <= BUDDY_MAX_ORDER; ++i) {
+        free_lists[i] = NULL;
+        free_counts[i] = 0;
+    }
+    page_state = NULL;
+    meta_pages = 0;
 
     if (frames_total == 0 || buddy_base == 0) return;
 
-    /* cover the region with largest power-of-two blocks (greedy) */
-    uint32_t remaining = frames_total;
-    uint32_t base_idx = 0;
+    /* one state byte per page: static table if it fits, else the first pages of the range */
+    if (frames_total <= sizeof(page_state_static)) {
+        page_state = page_state_static;
+    } else {
+        meta_pages = (frames_total + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (meta_pages >= frames_total) {
+            frames_total = buddy_page_count = 0;
+            return;
+        }
+        page_state = (uint8_t*)buddy_base;
+    }
+    for (uint32_t i = 0; i < frames_total; ++i) page_state[i] = PS_NONE;
 
-    while (remaining > 0) {
-        /* find largest order <= BUDDY_MAX_ORDER s.t. (1<<order) <= remaining */
+    /* cover the rest with the largest naturally aligned power-of-two blocks */
+    uint32_t idx = meta_pages;
+    while (idx < frames_total) {
         int order = 0;
-        while ((1u << (order + 1)) <= remaining && order + 1 <= BUDDY_MAX_ORDER) order++;
-        /* create block at base_idx with 'order' */
-        uintptr_t addr = page_index_to_addr(base_idx);
-        free_block_t* blk = (free_block_t*)addr;
-        blk->next = NULL;
-        fl_push(order, blk);
-
-        uint32_t block_pages = (1u << order);
-        base_idx += block_pages;
-        remaining -= block_pages;
+        while (order + 1 <= BUDDY_MAX_ORDER &&
+               (idx & ((1u << (order + 1)) - 1)) == 0 &&
+               idx + (1u << (order + 1)) <= frames_total) {
+            order++;
+        }
+        fl_push(order, (free_block_t*)page_index_to_addr(idx));
+        idx += (1u << order);
     }
 }
 
 /* Allocate a block of size (1<<order) pages. Returns physical address (page aligned) or NULL. */
 void* buddy_alloc_page(int order) {
     if (order < 0 || order > BUDDY_MAX_ORDER) return NULL;
+    if (!page_state) return NULL;
 
+    uint32_t flags = spin_lock_irqsave(&buddy_lock);
     /* find first order >= requested that has a free block */
     int o;
     for (o = order; o <= BUDDY_MAX_ORDER; ++o) {
         if (free_lists[o]) break;
     }
-    if (o > BUDDY_MAX_ORDER) return NULL; /* no block available */
+    if (o > BUDDY_MAX_ORDER) { /* no block available */
+        spin_unlock_irqrestore(&buddy_lock, flags);
+        return NULL;
+    }
 
     /* take block from free_lists[o] */
     free_block_t* blk = free_lists[o];
-    free_lists[o] = blk->next;
+    fl_remove(o, blk);
 
-    /* split down to requested order */
+    /* split down to requested order: keep the left half, free the right half */
     while (o > order) {
         --o;
-        /* split: current block at address 'blk' -> two buddies:
-           left = blk (same address)
-           right = left + (1<<o)*PAGE_SIZE
-           we push right into free_lists[o]
-        */
-        uintptr_t left_addr = (uintptr_t)blk;
-        uintptr_t right_addr = left_addr + ((uintptr_t)(1u << o) * PAGE_SIZE);
-        free_block_t* right_blk = (free_block_t*)right_addr;
-        right_blk->next = free_lists[o];
-        free_lists[o] = right_blk;
-        /* keep left as blk (already) and continue */
-        blk = (free_block_t*)left_addr;
+        uintptr_t right_addr = (uintptr_t)blk + ((uintptr_t)(1u << o) * PAGE_SIZE);
+        fl_push(o, (free_block_t*)right_addr);
     }
 
+    page_state[addr_to_page_index((uintptr_t)blk)] = PS_ALLOC | (uint8_t)order;
+    spin_unlock_irqrestore(&buddy_lock, flags);
     return (void*)blk;
 }
 
@@ -141,7 +162,7 @@ void* buddy_alloc_page(int order) {
 void buddy_free_page(void* phys, int order) {
     if (!phys) return;
     if (order < 0 || order > BUDDY_MAX_ORDER) return;
-    if (buddy_base == 0) return;
+    if (buddy_base == 0 || !page_state) return;
 
     uintptr_t addr = (uintptr_t)phys;
     /* ensure address aligned and inside managed region */
@@ -151,57 +172,107 @@ void buddy_free_page(void* phys, int order) {
     if ((addr - buddy_base) % PAGE_SIZE != 0) return;
 
     uint32_t index = addr_to_page_index(addr);
+    uint32_t flags = spin_lock_irqsave(&buddy_lock);
+    /* reject double frees and order mismatches */
+    if ((page_state[index] & ~PS_SLAB) != (PS_ALLOC | (uint8_t)order)) {
+        spin_unlock_irqrestore(&buddy_lock, flags);
+        return;
+    }
+    page_state[index] = PS_NONE;
 
     int o = order;
-    uintptr_t cur_addr = addr;
     while (o < BUDDY_MAX_ORDER) {
-        uint32_t block_pages = (1u << o);
-        uint32_t buddy_index = index ^ block_pages; /* flip o-th bit */
-        uintptr_t buddy_addr = page_index_to_addr(buddy_index);
-
-        /* check if buddy block is free at this order */
-        free_block_t* buddy_blk = fl_find_by_addr(o, buddy_addr);
-        if (buddy_blk == NULL) {
-            break; /* cannot coalesce */
-        }
+        uint32_t buddy_index = index ^ (1u << o); /* flip o-th bit */
+        if (buddy_index + (1u << o) > frames_total) break;
+        if (page_state[buddy_index] != (PS_FREE | (uint8_t)o)) break; /* cannot coalesce */
 
         /* remove buddy from free list and merge */
-        fl_remove(o, buddy_blk);
+        fl_remove(o, (free_block_t*)page_index_to_addr(buddy_index));
 
-        /* new merged block is at min(cur_addr, buddy_addr) */
-        if (buddy_addr < cur_addr) cur_addr = buddy_addr;
-        index = addr_to_page_index(cur_addr);
+        /* new merged block starts at the lower of the two */
+        if (buddy_index < index) index = buddy_index;
         ++o; /* try to coalesce one order up */
     }
 
-    /* push merged block into free_lists[o] */
-    free_block_t* newblk = (free_block_t*)cur_addr;
-    newblk->next = free_lists[o];
-    free_lists[o] = newblk;
+    fl_push(o, (free_block_t*)page_index_to_addr(index));
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+int buddy_owns(const void* p) {
+    uintptr_t a = (uintptr_t)p;
+    return buddy_page_count && a >= buddy_base &&
+           a - buddy_base < (uintptr_t)buddy_page_count * PAGE_SIZE;
+}
+
+/* The tag lives until buddy_free_page resets the page state. */
+void buddy_mark_slab(void* page) {
+    if (!buddy_owns(page) || !page_state) return;
+    uint32_t index = addr_to_page_index((uintptr_t)page);
+    uint32_t flags = spin_lock_irqsave(&buddy_lock);
+    if (page_state[index] == PS_ALLOC)   /* allocated, order 0 */
+        page_state[index] = PS_ALLOC | PS_SLAB;
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+int buddy_is_slab(const void* p) {
+    if (!buddy_owns(p) || !page_state) return 0;
+    return page_state[addr_to_page_index((uintptr_t)p)] == (PS_ALLOC | PS_SLAB);
+}
+
+/* Free pages per order plus a fragmentation figure: how far the largest free
+   block falls short of the biggest block the free pages could form, in percent. */
+void buddy_get_stats(buddy_stats_t* out) {
+    if (!out) return;
+    uint32_t flags = spin_lock_irqsave(&buddy_lock);
+    out->total_pages = frames_total > meta_pages ? frames_total - meta_pages : 0;
+    out->free_pages = 0;
+    out->largest_order = -1;
+    for (int o = 0; o <= BUDDY_MAX_ORDER; ++o) {
+        out->free_blocks[o] = free_counts[o];
+        out->free_pages += free_counts[o] << o;
+        if (free_counts[o]) out->largest_order = o;
+    }
+    if (out->free_pages == 0 || out->largest_order < 0) {
+        out->frag_percent = 0;
+    } else {
+        uint32_t largest = 1u << out->largest_order;
+        uint32_t best = out->free_pages;
+        if (best > (1u << BUDDY_MAX_ORDER)) best = 1u << BUDDY_MAX_ORDER;
+        out->frag_percent = 100u - (largest * 100u) / best;
+    }
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+/* Bind the allocator to an arbitrary page range (used by buddy_init_from_heap
+   and by the host-side benchmark in tools/bench). */
+void buddy_init_region(void* base, uint32_t pages) {
+    uintptr_t start = (uintptr_t)base;
+    uintptr_t aligned_start = (start + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+    if (pages && aligned_start != start) pages--;
+
+    buddy_base = pages ? aligned_start : 0;
+    buddy_page_count = pages;
+    buddy_init(pages);
 }
 
-/* Bind buddy base to heap region and call buddy_init with computed pages.
-   This is called externally (from kernel_main) after heap_init has been run.
+/* Bind buddy base to the top BUDDY_HEAP_BYTES of the heap region and call
+   buddy_init with computed pages. kmalloc_init() keeps the rest of the region,
+   so the two allocators never hand out the same memory.
+   This is called externally (from kernel_main) after kmalloc_init has been run.
 */
 void buddy_init_from_heap(void) {
     uintptr_t start = (uintptr_t)&__heap_start;
     uintptr_t end   = (uintptr_t)&__heap_end;
+    if (end - start > BUDDY_HEAP_BYTES) start = end - BUDDY_HEAP_BYTES;
 
     /* align start up to page boundary */
     uintptr_t aligned_start = (start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 
     if (end <= aligned_start) {
         /* nothing to manage */
-        buddy_base = 0;
-        buddy_page_count = 0;
-        buddy_init(0);
+        buddy_init_region(NULL, 0);
         return;
     }
 
-    size_t bytes = end - aligned_start;
-    uint32_t pages = (uint32_t)(bytes / PAGE_SIZE);
-    buddy_base = aligned_start;
-    buddy_page_count = pages;
-
-    buddy_init(pages);
+    buddy_init_region((void*)aligned_start, (uint32_t)((end - aligned_start) / PAGE_SIZE));
 }
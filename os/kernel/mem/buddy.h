@@ -6,11 +6,36 @@
 extern "C" {
 #endif
 
-#define BUDDY_MAX_ORDER 10
+/* largest block: 1 << 12 pages = 16MB (DMA pools, framebuffers) */
+#define BUDDY_MAX_ORDER 12
+
+/* Top slice of the linker heap (__heap_start..__heap_end) owned by the buddy
+   allocator; kmalloc gets everything below it. */
+#define BUDDY_HEAP_BYTES 0x1000000u
 
 void buddy_init(uint32_t total_frames);
 void* buddy_alloc_page(int order);
 void  buddy_free_page(void* phys, int order);
+void  buddy_init_from_heap(void);
+void  buddy_init_region(void* base, uint32_t pages);
+
+/* 1 if p lies in the page range the allocator manages */
+int   buddy_owns(const void* p);
+
+/* Tag an allocated order-0 page as a slab page (slab.c) */
+void  buddy_mark_slab(void* page);
+/* 1 if p lies in a page tagged by buddy_mark_slab */
+int   buddy_is_slab(const void* p);
+
+typedef struct {
+    uint32_t total_pages;
+    uint32_t free_pages;
+    uint32_t free_blocks[BUDDY_MAX_ORDER + 1];
+    int      largest_order;   /* -1 if nothing is free */
+    uint32_t frag_percent;    /* 0 = largest free block is as big as possible */
+} buddy_stats_t;
+
+void  buddy_get_stats(buddy_stats_t* out);
 
 #ifdef __cplusplus
 }
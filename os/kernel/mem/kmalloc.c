@@ -1,12 +1,24 @@
 /* kernel/mem/kmalloc.c
-   Simple free-list kernel heap allocator with coalescing.
-   - first-fit
-   - split_block support
+   Kernel heap allocator with a segregated size-class front end.
+   - small requests (<= KMEM_SMALL_MAX) are served from per-class bins
+     (two classes per power of two, 16 .. 2048 bytes): O(1) pop/push
+   - empty bins are refilled in batches carved from the large free list
+   - large requests use the explicit free list (first-fit, split_block)
+   - boundary tags (size in header + footer on free blocks) so kfree
+     coalesces with both physical neighbours in O(1)
    - basic kmalloc_aligned with stored raw-pointer + magic so kfree can recover
-   - no locking (disable interrupts or add spinlock externally if needed)
+   - one irqsave spinlock (heap_lock) around the public entry points, so
+     IRQ handlers and APs can allocate too
+   - once kmalloc_enable_magazines() has run, requests up to KMEM_MAG_MAX
+     go to per-CPU magazine caches over slab pages (mem/magazine.h) and
+     never touch heap_lock; kfree tells those objects apart by address
+     (they live in the buddy range, the heap below it)
 */
 
 #include "kmalloc.h"
+#include "buddy.h"
+#include "magazine.h"
+#include "../sync/spinlock.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -23,92 +35,316 @@
 /* magic for aligned allocations */
 #define KMALLOC_ALIGN_MAGIC 0xDEADBEEFu
 
-/* block header placed immediately before the returned user pointer (for normal allocations) */
+/* size classes */
+#define KMEM_NUM_CLASSES  15
+#define KMEM_SMALL_MAX    2048u
+#define KMEM_CLASS_LARGE  0xFFFFFFFFu
+#define KMEM_REFILL_BYTES 4096u   /* bytes carved per bin refill */
+
+/* flag bits kept in the low bits of kmem_block_t.size (sizes are 8-aligned) */
+#define KMEM_FREE      0x1u   /* block sits on the large free list */
+#define KMEM_PREV_FREE 0x2u   /* physical predecessor is free, its footer is valid */
+#define KMEM_FLAGS     (KMEM_FREE | KMEM_PREV_FREE)
+
+/* block header placed immediately before the returned user pointer (for normal allocations).
+   Free blocks reuse the start of their payload for list links and store a copy of
+   their size in the last word of the payload (footer / boundary tag). */
 typedef struct kmem_block {
-    size_t size;               /* usable size in bytes (not including header) */
-    struct kmem_block* next;   /* next block in the free list (physical order) */
-    uint8_t free;              /* 1 = free, 0 = allocated */
-    /* padding to keep header size aligned */
+    size_t size;               /* usable size in bytes | KMEM_FREE | KMEM_PREV_FREE */
+    uint32_t cls;              /* size class index, or KMEM_CLASS_LARGE */
+    /* --- payload starts here --- */
+    struct kmem_block* next;   /* free list / bin link */
+    struct kmem_block* prev;   /* free list back link (large free list only) */
 } kmem_block_t;
 
+#define HDR_SIZE    ((size_t)__builtin_offsetof(kmem_block_t, next))
+#define MIN_PAYLOAD ((size_t)ALIGN_UP(2 * sizeof(void*) + sizeof(size_t), ALIGNMENT))
+
+static const size_t class_size[KMEM_NUM_CLASSES] = {
+    16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
 /* Globals */
-static kmem_block_t* free_list = NULL;
+static kmem_block_t* free_list = NULL;            /* large free blocks, unordered */
+static kmem_block_t* bins[KMEM_NUM_CLASSES];      /* small free blocks per class */
 static uint8_t* heap_start = NULL;
 static uint8_t* heap_end = NULL;
 
+static kmalloc_stats_t stats;
+
+/* magazine front end for small requests */
+#define KMEM_MAG_CLASSES 5
+#define KMEM_MAG_MAX     256u
+
+static const size_t mag_class_size[KMEM_MAG_CLASSES] = { 16, 32, 64, 128, 256 };
+static const char* const mag_class_name[KMEM_MAG_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256"
+};
+static mag_cache_t* mag_class[KMEM_MAG_CLASSES];
+static volatile int mags_on = 0;
+
 /* Forward decl */
 static void split_block(kmem_block_t* block, size_t size);
 
+/* --- block helpers --- */
+
+static inline size_t blk_size(const kmem_block_t* b) {
+    return b->size & ~(size_t)KMEM_FLAGS;
+}
+
+static inline void* blk_payload(kmem_block_t* b) {
+    return (uint8_t*)b + HDR_SIZE;
+}
+
+static inline kmem_block_t* blk_next_phys(kmem_block_t* b) {
+    uint8_t* n = (uint8_t*)b + HDR_SIZE + blk_size(b);
+    return (n + HDR_SIZE <= heap_end) ? (kmem_block_t*)n : NULL;
+}
+
+/* only valid when b->size has KMEM_PREV_FREE */
+static inline kmem_block_t* blk_prev_phys(kmem_block_t* b) {
+    size_t prev_size = *((size_t*)b - 1);
+    return (kmem_block_t*)((uint8_t*)b - prev_size - HDR_SIZE);
+}
+
+static inline void blk_set_footer(kmem_block_t* b) {
+    size_t sz = blk_size(b);
+    *(size_t*)((uint8_t*)b + HDR_SIZE + sz - sizeof(size_t)) = sz;
+}
+
+/* O(1) map of an aligned size (MIN_PAYLOAD .. KMEM_SMALL_MAX) to its class */
+static inline uint32_t size_to_class(size_t size) {
+    if (size <= 16) return 0;
+    uint32_t msb = 31u - (uint32_t)__builtin_clz((uint32_t)(size - 1));
+    size_t half = ((size_t)1 << msb) + ((size_t)1 << (msb - 1));
+    return (msb - 4u) * 2u + (size > half ? 2u : 1u);
+}
+
+/* --- large free list (doubly linked, unordered) --- */
+
+static void fl_insert(kmem_block_t* b) {
+    b->prev = NULL;
+    b->next = free_list;
+    if (free_list) free_list->prev = b;
+    free_list = b;
+}
+
+static void fl_unlink(kmem_block_t* b) {
+    if (b->prev) b->prev->next = b->next;
+    else free_list = b->next;
+    if (b->next) b->next->prev = b->prev;
+}
+
+/* Put a block on the large free list, merging it with free physical neighbours.
+   Boundary tags make both merges O(1). */
+static void block_release(kmem_block_t* b) {
+    size_t size = blk_size(b);
+    size_t prev_flag = b->size & KMEM_PREV_FREE;
+
+    kmem_block_t* next = blk_next_phys(b);
+    if (next && (next->size & KMEM_FREE)) {
+        fl_unlink(next);
+        size += HDR_SIZE + blk_size(next);
+    }
+
+    if (prev_flag) {
+        kmem_block_t* prev = blk_prev_phys(b);
+        fl_unlink(prev);
+        size += HDR_SIZE + blk_size(prev);
+        prev_flag = prev->size & KMEM_PREV_FREE;
+        b = prev;
+    }
+
+    b->size = size | prev_flag | KMEM_FREE;
+    b->cls = KMEM_CLASS_LARGE;
+    blk_set_footer(b);
+
+    next = blk_next_phys(b);
+    if (next) next->size |= KMEM_PREV_FREE;
+
+    fl_insert(b);
+}
+
 /* Initialize heap region: start must be an address within kernel image after linking.
    size is the total bytes available for the heap region.
 */
 
 
 void heap_init(void* start, size_t size) {
-    if (!start || size <= sizeof(kmem_block_t) + ALIGNMENT) return;
+    if (!start || size <= HDR_SIZE + MIN_PAYLOAD + ALIGNMENT) return;
 
     uintptr_t s = (uintptr_t)start;
     s = ALIGN_UP(s, ALIGNMENT);
     heap_start = (uint8_t*)s;
-    heap_end = (uint8_t*)((uintptr_t)start + size);
+    heap_end = (uint8_t*)(((uintptr_t)start + size) & ~(uintptr_t)(ALIGNMENT - 1u));
 
-    free_list = (kmem_block_t*)heap_start;
-    free_list->size = (size_t)(heap_end - heap_start) - sizeof(kmem_block_t);
-    free_list->next = NULL;
-    free_list->free = 1;
+    for (int i = 0; i < KMEM_NUM_CLASSES; ++i) bins[i] = NULL;
+    stats = (kmalloc_stats_t){0};
+    stats.heap_bytes = (size_t)(heap_end - heap_start);
+
+    free_list = NULL;
+    kmem_block_t* first = (kmem_block_t*)heap_start;
+    first->size = (size_t)(heap_end - heap_start) - HDR_SIZE;
+    first->cls = KMEM_CLASS_LARGE;
+    block_release(first);
 }
 
 /* Split a block into [block(size)] + [new_block(rest)] if big enough.
-   'size' must be aligned already.
+   'size' must be aligned already; block must not be on the free list.
+   The remainder goes back to the large free list.
 */
 static void split_block(kmem_block_t* block, size_t size) {
     if (!block) return;
-    /* Need enough space for a new header + ALIGNMENT payload */
-    if (block->size < size + sizeof(kmem_block_t) + ALIGNMENT) return;
+    /* Need enough space for a new header + minimal free payload */
+    if (blk_size(block) < size + HDR_SIZE + MIN_PAYLOAD) return;
+
+    kmem_block_t* new_block = (kmem_block_t*)((uint8_t*)block + HDR_SIZE + size);
+    new_block->size = blk_size(block) - size - HDR_SIZE;
+    new_block->cls = KMEM_CLASS_LARGE;
 
-    uint8_t* new_block_ptr = (uint8_t*)block + sizeof(kmem_block_t) + size;
-    kmem_block_t* new_block = (kmem_block_t*)new_block_ptr;
+    block->size = size | (block->size & KMEM_PREV_FREE);
+    block_release(new_block);
+}
+
+/* first-fit over the large free list; returns a used block of at least size bytes */
+static kmem_block_t* large_alloc(size_t size) {
+    kmem_block_t* cur = free_list;
+    while (cur && blk_size(cur) < size) cur = cur->next;
+    if (!cur) return NULL;
 
-    new_block->size = block->size - size - sizeof(kmem_block_t);
-    new_block->next = block->next;
-    new_block->free = 1;
+    fl_unlink(cur);
+    cur->size &= ~(size_t)KMEM_FREE;
+    kmem_block_t* next = blk_next_phys(cur);
+    if (next) next->size &= ~(size_t)KMEM_PREV_FREE;
 
-    block->next = new_block;
-    block->size = size;
+    split_block(cur, size);
+    cur->cls = KMEM_CLASS_LARGE;
+    return cur;
 }
 
-/* kmalloc: allocate size bytes (aligned to ALIGNMENT) */
-void* kmalloc(size_t size) {
-    if (size == 0) return NULL;
+/* Give every cached small block back to the large free list so it can coalesce.
+   Only used when the large list cannot satisfy a request. */
+static void drain_bins(void) {
+    for (int c = 0; c < KMEM_NUM_CLASSES; ++c) {
+        kmem_block_t* b = bins[c];
+        bins[c] = NULL;
+        while (b) {
+            kmem_block_t* n = b->next;
+            stats.bin_bytes -= blk_size(b);
+            block_release(b);
+            b = n;
+        }
+    }
+}
+
+static kmem_block_t* large_alloc_or_drain(size_t size) {
+    kmem_block_t* b = large_alloc(size);
+    if (!b && stats.bin_bytes) {
+        drain_bins();
+        b = large_alloc(size);
+    }
+    return b;
+}
+
+/* Carve a run of blocks for class 'cls' out of one large allocation */
+static int bin_refill(uint32_t cls) {
+    size_t csize = class_size[cls];
+    size_t stride = HDR_SIZE + csize;
+    size_t count = KMEM_REFILL_BYTES / stride;
+    if (count == 0) count = 1;
+
+    kmem_block_t* run = large_alloc(count * stride - HDR_SIZE);
+    if (!run) run = large_alloc_or_drain(csize);
+    if (!run) return 0;
+
+    uint8_t* p = (uint8_t*)run;
+    uint8_t* end = p + HDR_SIZE + blk_size(run);
+    size_t prev_flag = run->size & KMEM_PREV_FREE;
+
+    while (p < end) {
+        kmem_block_t* b = (kmem_block_t*)p;
+        size_t room = (size_t)(end - p) - HDR_SIZE;
+        /* the last block absorbs any slack so the physical chain stays exact */
+        size_t sz = (room >= csize + stride) ? csize : room;
+        b->size = sz | prev_flag;
+        b->cls = cls;
+        b->next = bins[cls];
+        bins[cls] = b;
+        stats.bin_bytes += sz;
+        prev_flag = 0;
+        p += HDR_SIZE + sz;
+    }
+
+    stats.small_refills++;
+    return 1;
+}
+
+static spinlock_t heap_lock = SPINLOCK_INIT("kmalloc");
+
+/* kmalloc: allocate size bytes (aligned to ALIGNMENT); heap_lock held */
+static void* kmalloc_locked(size_t size) {
     size = (size_t)ALIGN_UP(size, ALIGNMENT);
+    if (size < MIN_PAYLOAD) size = MIN_PAYLOAD;
 
-    /* search first-fit */
-    /* kmem_block_t* prev = NULL; */
-    kmem_block_t* cur = free_list;
+    kmem_block_t* b;
+    if (size <= KMEM_SMALL_MAX) {
+        uint32_t cls = size_to_class(size);
+        if (!bins[cls] && !bin_refill(cls)) {
+            stats.failures++;
+            return NULL;
+        }
+        b = bins[cls];
+        bins[cls] = b->next;
+        stats.bin_bytes -= blk_size(b);
+        stats.small_allocs++;
+    } else {
+        b = large_alloc_or_drain(size);
+        if (!b) {
+            stats.failures++;
+            return NULL;
+        }
+        stats.large_allocs++;
+    }
 
-    while (cur) {
-        if (cur->free && cur->size >= size) {
-            split_block(cur, size);
-            cur->free = 0;
-            void* userptr = (void*)((uint8_t*)cur + sizeof(kmem_block_t));
+    void* userptr = blk_payload(b);
 #ifdef KMALLOC_DEBUG
-            /* cast for printing (kernel's printf signature may differ) */
-            terminal_printf("[kmalloc] %u -> %p\n", (unsigned)size, userptr);
+    /* cast for printing (kernel's printf signature may differ) */
+    terminal_printf("[kmalloc] %u -> %p\n", (unsigned)size, userptr);
 #endif
-            return userptr;
-        }
-        /* prev = cur; */
-        cur = cur->next;
-    }
+    return userptr;
+}
 
-    /* no suitable block */
-    return NULL;
+static void* kmalloc_heap(size_t size) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    void* p = kmalloc_locked(size);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return p;
 }
 
-/* kfree: free the pointer previously returned by kmalloc or kmalloc_aligned */
-void kfree(void* ptr) {
-    if (!ptr) return;
+void* kmalloc(size_t size) {
+    if (size == 0) return NULL;
+    if (mags_on && size <= KMEM_MAG_MAX) {
+        int i = 0;
+        while (mag_class_size[i] < size) i++;
+        void* p = mag_alloc(mag_class[i]);
+        if (p) return p;
+        /* slab pages exhausted: the heap still has room */
+    }
+    return kmalloc_heap(size);
+}
+
+int kmalloc_enable_magazines(void) {
+    for (int i = 0; i < KMEM_MAG_CLASSES; i++) {
+        if (!mag_class[i]) mag_class[i] = mag_cache_create(mag_class_name[i], mag_class_size[i]);
+        if (!mag_class[i]) return -1;
+    }
+    mags_on = 1;
+    return 0;
+}
 
+/* kfree: free the pointer previously returned by kmalloc or kmalloc_aligned;
+   heap_lock held */
+static void kfree_locked(void* ptr) {
     /* First: detect if this pointer was an aligned allocation wrapper.
        The scheme used by kmalloc_aligned stores:
          [magic: uint32_t][raw_ptr: uintptr_t] just before the aligned user pointer.
@@ -132,25 +368,37 @@ void kfree(void* ptr) {
     }
 
     /* header is immediately before ptr now */
-    kmem_block_t* block = (kmem_block_t*)((uint8_t*)ptr - sizeof(kmem_block_t));
-    block->free = 1;
+    kmem_block_t* block = (kmem_block_t*)((uint8_t*)ptr - HDR_SIZE);
+    if ((uint8_t*)block < heap_start || (uint8_t*)block >= heap_end) return;
+    if (block->size & KMEM_FREE) return; /* double free of a large block */
 
-    /* coalesce adjacent free blocks: iterate from start (simple) */
-    kmem_block_t* cur = free_list;
-    while (cur && cur->next) {
-        if (cur->free && cur->next->free) {
-            /* check adjacency in memory */
-            uint8_t* cur_end = (uint8_t*)cur + sizeof(kmem_block_t) + cur->size;
-            if (cur_end == (uint8_t*)cur->next) {
-                /* merge */
-                cur->size = cur->size + sizeof(kmem_block_t) + cur->next->size;
-                cur->next = cur->next->next;
-                /* continue without advancing cur to try to merge further */
-                continue;
+    if (block->cls < KMEM_NUM_CLASSES) {
+        /* small block: straight back onto its bin, O(1) */
+        block->next = bins[block->cls];
+        bins[block->cls] = block;
+        stats.bin_bytes += blk_size(block);
+        stats.small_frees++;
+        return;
+    }
+
+    stats.large_frees++;
+    block_release(block);
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+    if (mags_on && buddy_owns(ptr)) {
+        for (int i = 0; i < KMEM_MAG_CLASSES; i++) {
+            if (mag_owns(mag_class[i], ptr)) {
+                mag_free(mag_class[i], ptr);
+                return;
             }
         }
-        cur = cur->next;
+        return; /* a buddy page, not ours */
     }
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    kfree_locked(ptr);
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
 
 /* kmalloc_aligned: returns pointer aligned to 'alignment' (power-of-two recommended)
@@ -168,7 +416,7 @@ void* kmalloc_aligned(size_t size, size_t alignment) {
     */
     size_t extra = alignment + sizeof(uint32_t) + sizeof(uintptr_t);
     size_t real_size = size + extra;
-    void* raw = kmalloc(real_size);
+    void* raw = kmalloc_heap(real_size); /* kfree finds the header in the heap */
     if (!raw) return NULL;
 
     uintptr_t p = (uintptr_t)raw;
@@ -185,3 +433,20 @@ void* kmalloc_aligned(size_t size, size_t alignment) {
 
     return (void*)aligned;
 }
+
+/* Snapshot allocator counters; walks the large free list (not a hot path). */
+void kmalloc_get_stats(kmalloc_stats_t* out) {
+    if (!out) return;
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    *out = stats;
+    out->free_bytes = 0;
+    out->free_blocks = 0;
+    out->largest_free = 0;
+    for (kmem_block_t* b = free_list; b; b = b->next) {
+        size_t sz = blk_size(b);
+        out->free_bytes += sz;
+        out->free_blocks++;
+        if (sz > out->largest_free) out->largest_free = sz;
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
@@ -15,6 +15,27 @@ void  kfree(void* ptr);
 /* aligned allocation (falls back to NULL if not possible) */
 void* kmalloc_aligned(size_t size, size_t alignment);
 
+/* Serve small sizes from per-CPU magazines over slab caches; needs the
+   buddy allocator. 0 on success (see `mem caches`) */
+int   kmalloc_enable_magazines(void);
+
+/* Allocator counters (see `mem status`) */
+typedef struct {
+    size_t   heap_bytes;     /* total managed bytes */
+    size_t   free_bytes;     /* bytes on the large free list */
+    size_t   largest_free;   /* largest large free block */
+    size_t   bin_bytes;      /* bytes cached in size-class bins */
+    uint32_t free_blocks;    /* blocks on the large free list */
+    uint32_t small_allocs;   /* allocations served by a size-class bin */
+    uint32_t small_frees;
+    uint32_t small_refills;  /* bin refills carved from the large list */
+    uint32_t large_allocs;
+    uint32_t large_frees;
+    uint32_t failures;
+} kmalloc_stats_t;
+
+void kmalloc_get_stats(kmalloc_stats_t* out);
+
 /* Optional debug define:
    #define KMALLOC_DEBUG 1
    If defined, kmalloc.c will attempt to call terminal_printf.
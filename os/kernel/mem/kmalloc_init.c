@@ -1,6 +1,7 @@
 /* kernel/mem/kmalloc_init.c */
 #include <stdint.h>
 #include "kmalloc.h"   /* declară kmalloc_init în header deja */
+#include "buddy.h"     /* BUDDY_HEAP_BYTES: top of the region belongs to the buddy */
 
 extern uint8_t __heap_start; /* definite în linker.ld */
 extern uint8_t __heap_end;
@@ -8,5 +9,6 @@ extern uint8_t __heap_end;
 void kmalloc_init(void) {
     void* heap_start = (void*)&__heap_start;
     size_t heap_size = (size_t)(&__heap_end - &__heap_start);
+    if (heap_size > BUDDY_HEAP_BYTES) heap_size -= BUDDY_HEAP_BYTES;
     heap_init(heap_start, heap_size);
 }
@@ -0,0 +1,231 @@
+/* kernel/mem/magazine.c
+   Per-CPU magazine caches in front of the slab allocator (Bonwick style).
+   - each CPU keeps a loaded and a previous magazine (stack of MAG_ROUNDS objects)
+   - alloc/free only touch CPU-local state with interrupts off
+   - when both magazines are exhausted the CPU swaps one with the depot
+     (shared lists of full / empty magazines) under the depot lock
+   - the slab layer itself is only entered with the depot lock held
+   - kmalloc serves its small sizes from these caches (mem/kmalloc.c)
+*/
+
+#include "magazine.h"
+#include "kmalloc.h"
+#include "../smp/smp.h"
+#include "../sync/spinlock.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct magazine {
+    struct magazine* next;
+    uint32_t rounds;
+    void* objs[MAG_ROUNDS];
+} magazine_t;
+
+typedef struct {
+    magazine_t* loaded;
+    magazine_t* prev;
+    uint32_t hits;
+    uint32_t depot_swaps;
+    uint32_t misses;
+} mag_cpu_t;
+
+struct mag_cache {
+    const char* name;
+    slab_cache_t* slab;
+    mag_cpu_t cpu[MAX_CPUS];
+    magazine_t* depot_full;
+    magazine_t* depot_empty;
+    uint32_t nr_full;
+    uint32_t nr_empty;
+    struct mag_cache* next_cache;
+};
+
+static mag_cache_t* mag_list = NULL;
+
+/* Depot lock: serializes depot lists, magazine allocation and the slab layer */
+static spinlock_t depot_lock = SPINLOCK_INIT("mag_depot");
+
+static inline void depot_acquire(void) {
+    spin_lock(&depot_lock);
+}
+
+static inline void depot_release(void) {
+    spin_unlock(&depot_lock);
+}
+
+static inline int mag_full(const magazine_t* m)  { return m && m->rounds == MAG_ROUNDS; }
+static inline int mag_empty(const magazine_t* m) { return !m || m->rounds == 0; }
+
+/* magazines themselves come from a slab cache of their own, so the
+   depot never calls back into kmalloc (whose small sizes sit on top of
+   this layer) */
+static slab_cache_t* mag_slab = NULL;
+
+mag_cache_t* mag_cache_create(const char* name, size_t obj_size) {
+    if (!mag_slab) {
+        slab_cache_t* ms = slab_create("magazine", sizeof(magazine_t));
+        if (!ms) return NULL;
+        uint32_t flags = irq_save();
+        depot_acquire();
+        if (!mag_slab) {
+            mag_slab = ms;
+            ms = NULL;
+        }
+        depot_release();
+        irq_restore(flags);
+        if (ms) slab_destroy(ms);
+    }
+
+    slab_cache_t* slab = slab_create(name, obj_size);
+    if (!slab) return NULL;
+    mag_cache_t* c = (mag_cache_t*)kmalloc(sizeof(mag_cache_t));
+    if (!c) {
+        slab_destroy(slab);
+        return NULL;
+    }
+    c->name = name;
+    c->slab = slab;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        c->cpu[i].loaded = c->cpu[i].prev = NULL;
+        c->cpu[i].hits = c->cpu[i].depot_swaps = c->cpu[i].misses = 0;
+    }
+    c->depot_full = c->depot_empty = NULL;
+    c->nr_full = c->nr_empty = 0;
+
+    uint32_t flags = irq_save();
+    depot_acquire();
+    c->next_cache = mag_list;
+    mag_list = c;
+    depot_release();
+    irq_restore(flags);
+    return c;
+}
+
+int mag_owns(mag_cache_t* cache, const void* obj) {
+    return cache && slab_owns(cache->slab, obj);
+}
+
+void* mag_alloc(mag_cache_t* cache) {
+    if (!cache) return NULL;
+    uint32_t flags = irq_save();
+    mag_cpu_t* cpu = &cache->cpu[smp_current_cpu()];
+    void* obj = NULL;
+
+    if (!mag_empty(cpu->loaded)) {
+        cpu->hits++;
+    } else if (mag_full(cpu->prev)) {
+        magazine_t* t = cpu->loaded;
+        cpu->loaded = cpu->prev;
+        cpu->prev = t;
+        cpu->hits++;
+    } else {
+        depot_acquire();
+        if (cache->depot_full) {
+            /* park our empty magazine, load a full one from the depot */
+            if (cpu->prev) {
+                cpu->prev->next = cache->depot_empty;
+                cache->depot_empty = cpu->prev;
+                cache->nr_empty++;
+            }
+            cpu->prev = cpu->loaded;
+            cpu->loaded = cache->depot_full;
+            cache->depot_full = cpu->loaded->next;
+            cache->nr_full--;
+            cpu->depot_swaps++;
+        } else {
+            obj = slab_alloc(cache->slab);
+            cpu->misses++;
+        }
+        depot_release();
+        if (!cpu->loaded || cpu->loaded->rounds == 0) {
+            irq_restore(flags);
+            return obj;
+        }
+    }
+
+    obj = cpu->loaded->objs[--cpu->loaded->rounds];
+    irq_restore(flags);
+    return obj;
+}
+
+void mag_free(mag_cache_t* cache, void* obj) {
+    if (!cache || !obj) return;
+    uint32_t flags = irq_save();
+    mag_cpu_t* cpu = &cache->cpu[smp_current_cpu()];
+
+    if (cpu->loaded && !mag_full(cpu->loaded)) {
+        cpu->hits++;
+    } else if (cpu->prev && mag_empty(cpu->prev)) {
+        magazine_t* t = cpu->loaded;
+        cpu->loaded = cpu->prev;
+        cpu->prev = t;
+        cpu->hits++;
+    } else {
+        depot_acquire();
+        magazine_t* m = cache->depot_empty;
+        if (m) {
+            cache->depot_empty = m->next;
+            cache->nr_empty--;
+        } else {
+            m = (magazine_t*)slab_alloc(mag_slab);
+            if (m) m->rounds = 0;
+        }
+        if (!m) {
+            /* no magazine available: hand the object straight back */
+            slab_free(cache->slab, obj);
+            cpu->misses++;
+            depot_release();
+            irq_restore(flags);
+            return;
+        }
+        /* park our full previous magazine in the depot */
+        if (cpu->prev) {
+            cpu->prev->next = cache->depot_full;
+            cache->depot_full = cpu->prev;
+            cache->nr_full++;
+        }
+        cpu->prev = cpu->loaded;
+        cpu->loaded = m;
+        cpu->depot_swaps++;
+        depot_release();
+    }
+
+    cpu->loaded->objs[cpu->loaded->rounds++] = obj;
+    irq_restore(flags);
+}
+
+void mag_cache_reap(mag_cache_t* cache) {
+    if (!cache) return;
+    uint32_t flags = irq_save();
+    depot_acquire();
+    while (cache->depot_full) {
+        magazine_t* m = cache->depot_full;
+        cache->depot_full = m->next;
+        while (m->rounds) slab_free(cache->slab, m->objs[--m->rounds]);
+        slab_free(mag_slab, m);
+    }
+    while (cache->depot_empty) {
+        magazine_t* m = cache->depot_empty;
+        cache->depot_empty = m->next;
+        slab_free(mag_slab, m);
+    }
+    cache->nr_full = cache->nr_empty = 0;
+    depot_release();
+    irq_restore(flags);
+}
+
+int mag_get_stats(int idx, mag_stats_t* out) {
+    mag_cache_t* c = mag_list;
+    while (c && idx-- > 0) c = c->next_cache;
+    if (!c || !out) return 0;
+    out->name = c->name;
+    out->hits = out->depot_swaps = out->misses = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        out->hits += c->cpu[i].hits;
+        out->depot_swaps += c->cpu[i].depot_swaps;
+        out->misses += c->cpu[i].misses;
+    }
+    out->depot_full = c->nr_full;
+    out->depot_empty = c->nr_empty;
+    return 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "slab.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* objects held by one magazine */
+#define MAG_ROUNDS 15
+
+typedef struct mag_cache mag_cache_t;
+
+/* Per-CPU magazine layer over a slab cache: allocations and frees hit a
+   CPU-local object stack and only take the depot lock to swap magazines. */
+mag_cache_t* mag_cache_create(const char* name, size_t obj_size);
+void* mag_alloc(mag_cache_t* cache);
+void  mag_free(mag_cache_t* cache, void* obj);
+
+/* 1 if obj was allocated from cache's slab */
+int   mag_owns(mag_cache_t* cache, const void* obj);
+
+/* Return every object cached in the depot to the slab layer */
+void  mag_cache_reap(mag_cache_t* cache);
+
+/* Counters summed over all CPUs (see `mem caches`) */
+typedef struct {
+    const char* name;
+    uint32_t hits;          /* served from the CPU's loaded/previous magazine */
+    uint32_t depot_swaps;   /* magazine exchanged with the depot */
+    uint32_t misses;        /* fell through to slab_alloc/slab_free */
+    uint32_t depot_full;    /* full magazines parked in the depot */
+    uint32_t depot_empty;   /* empty magazines parked in the depot */
+} mag_stats_t;
+
+/* Walk registered caches: returns 0 once idx is past the last cache */
+int mag_get_stats(int idx, mag_stats_t* out);
+
+#ifdef __cplusplus
+}
+#endif
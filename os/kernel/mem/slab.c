@@ -1,5 +1,20 @@
+/* kernel/mem/slab.c
+   Object caches on top of the buddy allocator.
+   - one 4KB buddy page per slab, slab_t header at the start of the page,
+     so the owning slab of any object is found by masking its address (O(1));
+     the buddy page state tags slab pages (buddy_mark_slab), so a pointer
+     into any other buddy page is never taken for a slab object
+   - each cache keeps separate partial / full / empty lists; alloc takes from
+     partial first and never walks full slabs
+   - empty slabs above SLAB_EMPTY_WATERMARK go back to buddy_free_page
+   - a spinlock per cache (irqsave) guards its lists; the buddy allocator
+     underneath has its own lock
+*/
+
 #include "slab.h"
 #include "buddy.h" /* pentru pagini */
+#include "kmalloc.h"
+#include "../sync/spinlock.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -7,72 +22,196 @@
 
 typedef struct slab {
     struct slab* next;
+    struct slab* prev;
+    struct slab_cache* cache;  /* owner, used to validate slab_free */
     void* free_list;
-    uint32_t free_count;
-    char data[]; /* începutul obiectelor */
+    uint32_t inuse;
+    char data[] __attribute__((aligned(8))); /* începutul obiectelor (8-aligned, ca la kmalloc) */
 } slab_t;
 
+/* a slab list with O(1) unlink */
+typedef struct {
+    slab_t* head;
+    uint32_t count;
+} slab_list_t;
+
 struct slab_cache {
+    spinlock_t lock;
     const char* name;
-    size_t obj_size;
-    slab_t* slabs;
+    size_t obj_size;           /* aligned object stride */
+    uint32_t objs_per_slab;
+    slab_list_t partial;
+    slab_list_t full;
+    slab_list_t empty;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t pages_released;
+    struct slab_cache* next_cache;
 };
 
+static slab_cache_t* cache_list = NULL;
+
 static inline size_t align_up(size_t v, size_t a){ return (v + a - 1) & ~(a-1); }
 
+static inline slab_t* slab_of(void* obj) {
+    return (slab_t*)((uintptr_t)obj & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+static void list_push(slab_list_t* l, slab_t* s) {
+    s->prev = NULL;
+    s->next = l->head;
+    if (l->head) l->head->prev = s;
+    l->head = s;
+    l->count++;
+}
+
+static void list_unlink(slab_list_t* l, slab_t* s) {
+    if (s->prev) s->prev->next = s->next;
+    else l->head = s->next;
+    if (s->next) s->next->prev = s->prev;
+    l->count--;
+}
+
 slab_cache_t* slab_create(const char* name, size_t obj_size) {
-    slab_cache_t* c = (slab_cache_t*)buddy_alloc_page(0); /* folosește o pagină pentru struct cache */
+    size_t obj_sz = align_up((obj_size < sizeof(void*)) ? sizeof(void*) : obj_size, sizeof(void*));
+    if (obj_sz > PAGE_SIZE - sizeof(slab_t)) return NULL; /* one object must fit a page */
+
+    slab_cache_t* c = (slab_cache_t*)kmalloc(sizeof(slab_cache_t));
     if (!c) return NULL;
+    spin_init(&c->lock, name);
     c->name = name;
-    c->obj_size = (obj_size < sizeof(void*)) ? sizeof(void*) : obj_size;
-    c->slabs = NULL;
+    c->obj_size = obj_sz;
+    c->objs_per_slab = (uint32_t)((PAGE_SIZE - sizeof(slab_t)) / obj_sz);
+    c->partial.head = c->full.head = c->empty.head = NULL;
+    c->partial.count = c->full.count = c->empty.count = 0;
+    c->allocs = c->frees = c->pages_released = 0;
+
+    c->next_cache = cache_list;
+    cache_list = c;
     return c;
 }
 
+static void release_list(slab_list_t* l) {
+    while (l->head) {
+        slab_t* s = l->head;
+        list_unlink(l, s);
+        buddy_free_page(s, 0);
+    }
+}
+
+/* Free the cache and every page it owns; outstanding objects become invalid. */
+void slab_destroy(slab_cache_t* cache) {
+    if (!cache) return;
+    for (slab_cache_t** pp = &cache_list; *pp; pp = &(*pp)->next_cache) {
+        if (*pp == cache) { *pp = cache->next_cache; break; }
+    }
+    release_list(&cache->partial);
+    release_list(&cache->full);
+    release_list(&cache->empty);
+    kfree(cache);
+}
+
 static slab_t* slab_alloc_new_slab(slab_cache_t* cache) {
     void* page = buddy_alloc_page(0);
     if (!page) return NULL;
+    buddy_mark_slab(page);
     slab_t* s = (slab_t*)page;
-    s->next = cache->slabs;
-    cache->slabs = s;
-    size_t hdr = sizeof(slab_t);
-    size_t usable = PAGE_SIZE - hdr;
-    size_t obj_sz = align_up(cache->obj_size, sizeof(void*));
-    int count = usable / obj_sz;
-    s->free_count = count;
+    s->cache = cache;
+    s->inuse = 0;
     s->free_list = NULL;
-    uint8_t* ptr = (uint8_t*)s + hdr;
-    for (int i=0;i<count;i++) {
+    /* thread objects back to front so the free list hands them out in address order */
+    uint8_t* ptr = (uint8_t*)s->data + (size_t)(cache->objs_per_slab - 1) * cache->obj_size;
+    for (uint32_t i = 0; i < cache->objs_per_slab; i++) {
         *(void**)ptr = s->free_list;
         s->free_list = ptr;
-        ptr += obj_sz;
+        ptr -= cache->obj_size;
     }
+    list_push(&cache->empty, s);
     return s;
 }
 
 void* slab_alloc(slab_cache_t* cache) {
-    slab_t* s = cache->slabs;
-    while (s && s->free_list == NULL) s = s->next;
-    if (!s) s = slab_alloc_new_slab(cache);
-    if (!s) return NULL;
+    if (!cache) return NULL;
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    slab_t* s = cache->partial.head;
+    if (!s) {
+        s = cache->empty.head;
+        if (!s) s = slab_alloc_new_slab(cache);
+        if (!s) {
+            spin_unlock_irqrestore(&cache->lock, flags);
+            return NULL;
+        }
+        list_unlink(&cache->empty, s);
+        list_push(&cache->partial, s);
+    }
+
     void* obj = s->free_list;
     s->free_list = *(void**)obj;
-    s->free_count--;
+    s->inuse++;
+    if (!s->free_list) {
+        list_unlink(&cache->partial, s);
+        list_push(&cache->full, s);
+    }
+    cache->allocs++;
+    spin_unlock_irqrestore(&cache->lock, flags);
     return obj;
 }
 
 void slab_free(slab_cache_t* cache, void* obj) {
-    /* simplificat: găsim slab-ul care conține obj parcurgând listele (cost O(n)) */
-    for (slab_t* s = cache->slabs; s; s = s->next) {
-        uintptr_t start = (uintptr_t)s;
-        uintptr_t end = start + PAGE_SIZE;
-        if ((uintptr_t)obj >= start && (uintptr_t)obj < end) {
-            *(void**)obj = s->free_list;
-            s->free_list = obj;
-            s->free_count++;
-            return;
+    if (!cache || !obj || !buddy_is_slab(obj)) return;
+    slab_t* s = slab_of(obj);
+
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    if (s->cache != cache) { /* not ours */
+        spin_unlock_irqrestore(&cache->lock, flags);
+        return;
+    }
+    int was_full = (s->free_list == NULL);
+    *(void**)obj = s->free_list;
+    s->free_list = obj;
+    s->inuse--;
+    cache->frees++;
+
+    if (was_full) {
+        list_unlink(&cache->full, s);
+        list_push(&cache->partial, s);
+    }
+    if (s->inuse == 0) {
+        list_unlink(&cache->partial, s);
+        if (cache->empty.count >= SLAB_EMPTY_WATERMARK) {
+            s->cache = NULL;
+            buddy_free_page(s, 0);
+            cache->pages_released++;
+        } else {
+            list_push(&cache->empty, s);
         }
     }
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+int slab_owns(slab_cache_t* cache, const void* obj) {
+    if (!cache || !obj || !buddy_is_slab(obj)) return 0;
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    int owns = slab_of((void*)obj)->cache == cache;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return owns;
+}
+
+int slab_get_stats(int idx, slab_stats_t* out) {
+    slab_cache_t* c = cache_list;
+    while (c && idx-- > 0) c = c->next_cache;
+    if (!c || !out) return 0;
+    out->name = c->name;
+    out->obj_size = c->obj_size;
+    out->objs_per_slab = c->objs_per_slab;
+    out->slabs_partial = c->partial.count;
+    out->slabs_full = c->full.count;
+    out->slabs_empty = c->empty.count;
+    out->objs_inuse = c->allocs - c->frees;
+    out->allocs = c->allocs;
+    out->frees = c->frees;
+    out->pages_released = c->pages_released;
+    return 1;
 }
 
 void* slab_alloc_page(void) {
@@ -8,10 +8,34 @@ extern "C" {
 
 typedef struct slab_cache slab_cache_t;
 
+/* empty slabs kept per cache before pages go back to the buddy allocator */
+#define SLAB_EMPTY_WATERMARK 2
+
 slab_cache_t* slab_create(const char* name, size_t obj_size);
+void  slab_destroy(slab_cache_t* cache);
 void* slab_alloc(slab_cache_t* cache);
 void  slab_free(slab_cache_t* cache, void* obj);
 
+/* 1 if obj (a pointer into a slab page) belongs to cache */
+int   slab_owns(slab_cache_t* cache, const void* obj);
+
+/* Per-cache counters (see `mem slab`) */
+typedef struct {
+    const char* name;
+    size_t   obj_size;
+    uint32_t objs_per_slab;
+    uint32_t slabs_partial;
+    uint32_t slabs_full;
+    uint32_t slabs_empty;
+    uint32_t objs_inuse;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t pages_released;  /* empty pages returned above the watermark */
+} slab_stats_t;
+
+/* Walk registered caches: returns 0 once idx is past the last cache */
+int slab_get_stats(int idx, slab_stats_t* out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,15 +3,34 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "../drivers/serial.h"
+#include "../sync/spinlock.h"
 
 /* kernel symbol (defined in linker.ld) */
 extern uint32_t kernel_end;
 
-/* bitmap data */
+/* bitmap data: bit = 1 -> frame used */
 static uint32_t* bitmap;
+static uint32_t  bitmap_words;   /* words covering total_frames */
 static uint32_t  total_frames;
 static uint32_t  used_frames;
 
+/* summary level: bit = 1 -> bitmap word is completely used (0xFFFFFFFF),
+   so searches skip 32 words (1024 frames) per summary word */
+static uint32_t* summary;
+
+/* next-fit cursor (frame index where the last search succeeded) */
+static uint32_t  next_fit;
+
+/* cache shrinker run when memory runs out (pmm_set_reclaim) */
+static uint32_t (*reclaim_fn)(uint32_t frames);
+static int reclaiming;
+
+/* bitmap, summary, counters and next_fit; taken from any CPU and from IRQ
+   paths (DMA buffers, page cache), never held across the shrinker */
+static spinlock_t pmm_lock = SPINLOCK_INIT("pmm");
+
+#define PMM_NONE 0xFFFFFFFFu
+
 /* Import serial logging from kernel glue */
 extern void serial(const char *fmt, ...);
 
@@ -21,15 +40,25 @@ static inline uintptr_t align_up_uintptr(uintptr_t v)
     return (v + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 }
 
-/* bitmap helpers */
+/* bitmap helpers (keep the summary level in sync) */
+static inline void summary_update(uint32_t word)
+{
+    if (bitmap[word] == 0xFFFFFFFFu)
+        summary[word / 32] |= (1u << (word % 32));
+    else
+        summary[word / 32] &= ~(1u << (word % 32));
+}
+
 static inline void bitmap_set(uint32_t frame)
 {
     bitmap[frame / 32] |= (1u << (frame % 32));
+    summary_update(frame / 32);
 }
 
 static inline void bitmap_clear(uint32_t frame)
 {
     bitmap[frame / 32] &= ~(1u << (frame % 32));
+    summary_update(frame / 32);
 }
 
 static inline int bitmap_test(uint32_t frame)
@@ -95,12 +124,20 @@ void pmm_init(uint32_t mb_magic, void* mb_addr)
     /* place bitmap right after kernel_end, page-aligned */
     bitmap = (uint32_t*)align_up_uintptr((uintptr_t)&kernel_end);
 
+    /* summary (one bit per bitmap word) right after the bitmap */
+    bitmap_words = (total_frames + 31) / 32;
+    uintptr_t summary_bytes = align_up_uintptr((uintptr_t)((bitmap_words + 31) / 32) * 4);
+    summary = (uint32_t*)((uintptr_t)bitmap + bitmap_bytes);
+
     /* 2. mark all frames as USED initially (set all bits = 1) */
     uint32_t bitmap_dwords = (uint32_t)(bitmap_bytes / 4);
     for (uint32_t i = 0; i < bitmap_dwords; i++)
         bitmap[i] = 0xFFFFFFFFu;
+    for (uint32_t i = 0; i < (uint32_t)(summary_bytes / 4); i++)
+        summary[i] = 0xFFFFFFFFu;
 
     used_frames = total_frames;
+    next_fit = 0;
 
     /* 3. parse multiboot memory map and free AVAILABLE (type == 1) frames */
     if (is_mb2 && mmap_addr != 0) {
@@ -201,9 +238,9 @@ void pmm_init(uint32_t mb_magic, void* mb_addr)
         }
     }
 
-    /* Reserve bitmap itself */
+    /* Reserve bitmap itself (and its summary) */
     uintptr_t bitmap_start = (uintptr_t)bitmap;
-    uintptr_t bitmap_end   = bitmap_start + bitmap_bytes;
+    uintptr_t bitmap_end   = bitmap_start + bitmap_bytes + summary_bytes;
 
     for (uintptr_t addr = bitmap_start; addr < bitmap_end; addr += PAGE_SIZE) {
         uint32_t f = (uint32_t)(addr >> 12);
@@ -220,26 +257,185 @@ void pmm_init(uint32_t mb_magic, void* mb_addr)
     serial("[PMM] init done. Total: %u, Used: %u, Free: %u\n", total_frames, used_frames, total_frames - used_frames);
 }
 
+/* First free frame >= from, or total_frames. Skips whole used words through
+   the summary level and finds the bit with ctz over the inverted word. */
+static uint32_t find_free_from(uint32_t from)
+{
+    if (from >= total_frames) return total_frames;
+
+    uint32_t w = from / 32;
+    uint32_t word = bitmap[w] | ((1u << (from % 32)) - 1u);
+    if (word != 0xFFFFFFFFu) {
+        uint32_t f = w * 32 + (uint32_t)__builtin_ctz(~word);
+        return f < total_frames ? f : total_frames;
+    }
+
+    for (w++; w < bitmap_words; ) {
+        uint32_t s = w / 32;
+        uint32_t sum = summary[s] | ((1u << (w % 32)) - 1u);
+        if (sum == 0xFFFFFFFFu) {
+            w = (s + 1) * 32;
+            continue;
+        }
+        w = s * 32 + (uint32_t)__builtin_ctz(~sum);
+        if (w >= bitmap_words) break;
+        uint32_t f = w * 32 + (uint32_t)__builtin_ctz(~bitmap[w]);
+        return f < total_frames ? f : total_frames;
+    }
+    return total_frames;
+}
+
+/* First used frame in [from, limit), or limit. */
+static uint32_t find_used_from(uint32_t from, uint32_t limit)
+{
+    while (from < limit) {
+        uint32_t w = from / 32;
+        uint32_t word = bitmap[w] & ~((1u << (from % 32)) - 1u);
+        if (word) {
+            uint32_t f = w * 32 + (uint32_t)__builtin_ctz(word);
+            return f < limit ? f : limit;
+        }
+        from = (w + 1) * 32;
+    }
+    return limit;
+}
+
+/* Aligned run of count free frames starting in [start, end), or PMM_NONE. */
+static uint32_t find_run(uint32_t start, uint32_t end, uint32_t count, uint32_t align)
+{
+    uint32_t f = start;
+    for (;;) {
+        f = find_free_from(f);
+        f = (f + align - 1) & ~(align - 1);
+        if (f >= end || f + count > total_frames || f + count < f) return PMM_NONE;
+        uint32_t u = find_used_from(f, f + count);
+        if (u == f + count) return f;
+        f = u + 1;
+    }
+}
+
+static void mark_range(uint32_t first, uint32_t count, int used)
+{
+    for (uint32_t f = first; f < first + count; ) {
+        uint32_t w = f / 32;
+        uint32_t bit = f % 32;
+        uint32_t n = 32 - bit;
+        if (n > first + count - f) n = first + count - f;
+        uint32_t mask = (n == 32) ? 0xFFFFFFFFu : (((1u << n) - 1u) << bit);
+        if (used) bitmap[w] |= mask;
+        else bitmap[w] &= ~mask;
+        summary_update(w);
+        f += n;
+    }
+    if (used) used_frames += count;
+    else used_frames -= count;
+}
+
+void pmm_set_reclaim(uint32_t (*fn)(uint32_t frames))
+{
+    reclaim_fn = fn;
+}
+
+/* Out of frames: let the shrinker free some. Called without pmm_lock,
+   since the shrinker frees frames; not reentered, since it may also free
+   through paths that allocate. */
+static int reclaim(uint32_t frames)
+{
+    uint32_t fl = spin_lock_irqsave(&pmm_lock);
+    uint32_t (*fn)(uint32_t) = reclaiming ? 0 : reclaim_fn;
+    if (fn) reclaiming = 1;
+    spin_unlock_irqrestore(&pmm_lock, fl);
+    if (!fn) return 0;
+
+    uint32_t n = fn(frames);
+
+    fl = spin_lock_irqsave(&pmm_lock);
+    reclaiming = 0;
+    spin_unlock_irqrestore(&pmm_lock, fl);
+    return n != 0;
+}
+
 uint32_t pmm_alloc_frame(void)
 {
-    for (uint32_t f = 0; f < total_frames; f++) {
-        if (!bitmap_test(f)) {
-            bitmap_set(f);
-            used_frames++;
-            return f * PAGE_SIZE;
+    /* next-fit: continue after the last allocation, wrap once */
+    uint32_t fl = spin_lock_irqsave(&pmm_lock);
+    uint32_t f = find_free_from(next_fit);
+    if (f >= total_frames) f = find_free_from(0);
+    if (f >= total_frames) {
+        spin_unlock_irqrestore(&pmm_lock, fl);
+        if (!reclaim(1)) return 0; /* out of memory */
+        fl = spin_lock_irqsave(&pmm_lock);
+        f = find_free_from(0);
+        if (f >= total_frames) {
+            spin_unlock_irqrestore(&pmm_lock, fl);
+            return 0;
+        }
+    }
+
+    bitmap_set(f);
+    used_frames++;
+    next_fit = f + 1;
+    spin_unlock_irqrestore(&pmm_lock, fl);
+    return f * PAGE_SIZE;
+}
+
+/* Contiguous, aligned allocation of count frames.
+   align is in bytes (0 or anything <= PAGE_SIZE means page aligned; must be a power of two).
+   Returns the physical address or NULL. */
+void* pmm_alloc_frames(uint32_t count, uint32_t align)
+{
+    if (count == 0 || total_frames == 0) return NULL;
+    uint32_t align_frames = (align > PAGE_SIZE) ? align / PAGE_SIZE : 1;
+    if (align_frames & (align_frames - 1)) return NULL;
+
+    if (count == 1 && align_frames == 1) {
+        uint32_t phys = pmm_alloc_frame();
+        return phys ? (void*)(uintptr_t)phys : NULL;
+    }
+
+    uint32_t fl = spin_lock_irqsave(&pmm_lock);
+    uint32_t f = find_run(next_fit, total_frames, count, align_frames);
+    if (f == PMM_NONE) f = find_run(0, next_fit, count, align_frames);
+    if (f == PMM_NONE) {
+        spin_unlock_irqrestore(&pmm_lock, fl);
+        if (!reclaim(count)) return NULL;
+        fl = spin_lock_irqsave(&pmm_lock);
+        f = find_run(0, total_frames, count, align_frames);
+        if (f == PMM_NONE) {
+            spin_unlock_irqrestore(&pmm_lock, fl);
+            return NULL;
         }
     }
-    return 0; /* out of memory */
+
+    mark_range(f, count, 1);
+    next_fit = f + count;
+    spin_unlock_irqrestore(&pmm_lock, fl);
+    return (void*)(uintptr_t)(f * PAGE_SIZE);
 }
 
 void pmm_free_frame(uint32_t phys_addr)
 {
     uint32_t frame = phys_addr / PAGE_SIZE;
     if (frame >= total_frames) return;
+    uint32_t fl = spin_lock_irqsave(&pmm_lock);
     if (bitmap_test(frame)) {
         bitmap_clear(frame);
         used_frames--;
     }
+    spin_unlock_irqrestore(&pmm_lock, fl);
+}
+
+void pmm_free_frames(uint32_t phys_addr, uint32_t count)
+{
+    uint32_t first = phys_addr / PAGE_SIZE;
+    uint32_t fl = spin_lock_irqsave(&pmm_lock);
+    for (uint32_t f = first; f < first + count && f < total_frames; f++) {
+        if (bitmap_test(f)) {
+            bitmap_clear(f);
+            used_frames--;
+        }
+    }
+    spin_unlock_irqrestore(&pmm_lock, fl);
 }
 
 void pmm_reserve_area(uint32_t start_addr, uint32_t size)
@@ -247,6 +443,7 @@ void pmm_reserve_area(uint32_t start_addr, uint32_t size)
     uint32_t start_frame = start_addr / PAGE_SIZE;
     uint32_t num_frames = (size + PAGE_SIZE - 1) / PAGE_SIZE;
 
+    uint32_t fl = spin_lock_irqsave(&pmm_lock);
     for (uint32_t i = 0; i < num_frames; i++) {
         uint32_t f = start_frame + i;
         if (f < total_frames) {
@@ -256,6 +453,7 @@ void pmm_reserve_area(uint32_t start_addr, uint32_t size)
             }
         }
     }
+    spin_unlock_irqrestore(&pmm_lock, fl);
 }
 
 uint32_t pmm_total_frames(void)
@@ -10,8 +10,17 @@ extern "C" {
 void     pmm_init(uint32_t mb_magic, void* mb_addr);
 uint32_t pmm_alloc_frame(void);
 void     pmm_free_frame(uint32_t phys_addr);
+
+/* count contiguous frames aligned to align bytes (0 = page); physical address or NULL */
+void*    pmm_alloc_frames(uint32_t count, uint32_t align);
+void     pmm_free_frames(uint32_t phys_addr, uint32_t count);
 void     pmm_reserve_area(uint32_t start_addr, uint32_t size);
 
+/* Shrinker called once when an allocation finds no free frames: it should
+   free up to frames frames (clean cache pages) and return how many it
+   did; the allocation is then retried. */
+void     pmm_set_reclaim(uint32_t (*fn)(uint32_t frames));
+
 uint32_t pmm_total_frames(void);
 uint32_t pmm_used_frames(void);
 
@@ -119,6 +119,15 @@ uint32_t vmm_virt_to_phys(void* vaddr)
     return phys_page + offset;
 }
 
+uint32_t vmm_dma_phys(const void* vaddr)
+{
+    uint32_t virt = (uint32_t)(uintptr_t)vaddr;
+    uint32_t phys = vmm_virt_to_phys((void*)vaddr);
+    if (phys) return phys;
+    if (virt >= KERNEL_BASE) return virt - KERNEL_BASE;
+    return virt;
+}
+
 void vmm_identity_map(uint32_t phys, uint32_t size)
 {
     extern uint32_t* kernel_page_directory;
@@ -47,6 +47,12 @@ void vmm_identity_map(uint32_t phys, uint32_t size);
 
 uint32_t vmm_virt_to_phys(void* vaddr);
 
+/* Physical address of a kernel buffer for a bus-master device: the kernel
+ * page tables first, then the fixed layout (KERNEL_BASE maps phys 0, low
+ * memory is identity mapped). Used by the ATA and AHCI DMA paths.
+ */
+uint32_t vmm_dma_phys(const void* vaddr);
+
 /* Get the current active page directory (virtual pointer) */
 uint32_t* vmm_get_current_pd(void);
 
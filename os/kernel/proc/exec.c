@@ -24,7 +24,7 @@ extern void  vmm_activate_page_directory(void* pd);
 extern void  vmm_free_page_directory(void* pd) __attribute__((weak));
 
 /* PMM helper */
-extern void* pmm_alloc_frames(uint32_t pages); /* returns physical pointer or NULL */
+extern void* pmm_alloc_frames(uint32_t count, uint32_t align); /* returns physical pointer or NULL; align 0 = page */
 
 /* Process / scheduler helpers (assumed) */
 extern int scheduler_add_process(process_t* p); /* returns pid or <0 */
@@ -126,7 +126,7 @@ int exec_from_path(const char* path, char* const argv[]) {
         uint32_t map_size = memsz_pages * PAGE_SIZE;
 
         /* allocate physical frames */
-        void* phys = pmm_alloc_frames(memsz_pages);
+        void* phys = pmm_alloc_frames(memsz_pages, 0);
         if (!phys) {
             terminal_printf("[exec] pmm_alloc_frames failed for segment %d\n", i);
             process_destroy(proc);
@@ -172,7 +172,7 @@ int exec_from_path(const char* path, char* const argv[]) {
     /* allocate and map user stack */
     {
         uint32_t stack_pages = (USER_STACK_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
-        void* stack_phys = pmm_alloc_frames(stack_pages);
+        void* stack_phys = pmm_alloc_frames(stack_pages, 0);
         if (!stack_phys) {
             terminal_printf("[exec] cannot allocate user stack\n");
             process_destroy(proc);
@@ -5,6 +5,8 @@
 #include "exec.h"
 #include "../fs/fs.h"
 #include "../fs/chrysfs/chrysfs.h"
+#include "../fs/vfs/vfs.h"
+#include "../fs/vfs/pcache.h"
 #include "../mem/kmalloc.h"
 #include "../string.h"
 #include "../terminal.h"
@@ -14,9 +16,6 @@
 #include "../cmds/cs.h"
 #include "../cmds/fat.h"
 
-/* FAT32 Driver API */
-extern "C" int fat32_read_file(const char* path, void* buf, uint32_t max_size);
-
 /* ELF Header Definitions */
 #define ELF_MAGIC 0x464C457F
 
@@ -55,23 +54,34 @@ typedef struct {
 
 #define PT_LOAD 1
 
-/* Helper to read file content into a buffer */
-static uint8_t* read_executable(const char* path, size_t* out_size) {
-    /* 1. Try Disk (FAT32) */
+#define EXEC_MAX_SIZE (1024 * 1024) /* 1MB limit for now */
+
+/* The executable's bytes: a page cache mapping for files on disk, so
+   launching the same binary again reads RAM instead of the disk, or a
+   copy of the RAMFS data. Given back with release_executable(). */
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    int mapped;     /* vfs_mmap() view, else kmalloc'd */
+} exec_image_t;
+
+static int read_executable(const char* path, exec_image_t* img) {
+    /* 1. Try Disk (FAT32) through the VFS */
     if (strncmp(path, "/root", 5) == 0) {
         fat_automount();
 
-        /* Allocate a reasonable buffer for the binary */
-        size_t max_size = 1024 * 1024; // 1MB limit for now
-        uint8_t* buf = (uint8_t*)kmalloc(max_size);
-        if (!buf) return nullptr;
-
-        int bytes = fat32_read_file(path, buf, max_size);
-        if (bytes > 0) {
-            *out_size = (size_t)bytes;
-            return buf;
+        vnode_t* node = vfs_resolve(path);
+        if (node) {
+            uint32_t size = 0;
+            void* map = vfs_mmap(node, 0, EXEC_MAX_SIZE, &size);
+            vnode_put(node); /* the mapping keeps its own reference */
+            if (map) {
+                img->data = (uint8_t*)map;
+                img->size = size;
+                img->mapped = 1;
+                return 0;
+            }
         }
-        kfree(buf);
     }
 
     /* 2. Try RAMFS */
@@ -81,13 +91,23 @@ static uint8_t* read_executable(const char* path, size_t* out_size) {
         size_t len = strlen(text);
         /* Copy to new buffer to be safe/uniform */
         uint8_t* buf = (uint8_t*)kmalloc(len);
-        if (!buf) return nullptr;
+        if (!buf) return -1;
         memcpy(buf, text, len);
-        *out_size = len;
-        return buf;
+        img->data = buf;
+        img->size = len;
+        img->mapped = 0;
+        return 0;
     }
 
-    return nullptr;
+    return -1;
+}
+
+static void release_executable(exec_image_t* img) {
+    if (img->mapped)
+        vfs_munmap(img->data);
+    else
+        kfree(img->data);
+    img->data = nullptr;
 }
 
 extern "C" int execve(const char *filename, char *const argv[], char *const envp[]) {
@@ -108,25 +128,24 @@ extern "C" int execve(const char *filename, char *const argv[], char *const envp
 
     terminal_printf("[EXEC] Loading '%s'...\n", filename);
 
-    size_t file_size = 0;
-    uint8_t* file_data = read_executable(filename, &file_size);
-
-    if (!file_data) {
+    exec_image_t img;
+    if (read_executable(filename, &img) != 0) {
         terminal_printf("[EXEC] Error: Could not read file '%s'\n", filename);
         return -1;
     }
 
     /* Verify ELF Header */
-    if (file_size < sizeof(Elf32_Ehdr)) {
+    uint8_t* file_data = img.data;
+    if (img.size < sizeof(Elf32_Ehdr)) {
         terminal_printf("[EXEC] Error: File too small\n");
-        kfree(file_data);
+        release_executable(&img);
         return -1;
     }
 
     Elf32_Ehdr* ehdr = (Elf32_Ehdr*)file_data;
     if (*(uint32_t*)ehdr->e_ident != ELF_MAGIC) {
         terminal_printf("[EXEC] Error: Not a valid ELF binary\n");
-        kfree(file_data);
+        release_executable(&img);
         return -1;
     }
 
@@ -135,6 +154,11 @@ extern "C" int execve(const char *filename, char *const argv[], char *const envp
     }
 
     /* Load Segments */
+    if ((uint64_t)ehdr->e_phoff + (uint64_t)ehdr->e_phnum * sizeof(Elf32_Phdr) > img.size) {
+        terminal_printf("[EXEC] Error: Program headers past end of file\n");
+        release_executable(&img);
+        return -1;
+    }
     Elf32_Phdr* phdr = (Elf32_Phdr*)(file_data + ehdr->e_phoff);
     
     for (int i = 0; i < ehdr->e_phnum; i++) {
@@ -142,6 +166,15 @@ extern "C" int execve(const char *filename, char *const argv[], char *const envp
             terminal_printf("[EXEC] Segment %d: FileOff=0x%x VAddr=0x%x FileSz=0x%x MemSz=0x%x\n",
                             i, phdr[i].p_offset, phdr[i].p_vaddr, phdr[i].p_filesz, phdr[i].p_memsz);
 
+            /* the file bytes must lie in the image (it may be a mapping of
+               cached pages, so nothing past it can be read) */
+            if ((uint64_t)phdr[i].p_offset + phdr[i].p_filesz > img.size ||
+                phdr[i].p_filesz > phdr[i].p_memsz) {
+                terminal_printf("[EXEC] Error: Segment %d has a bad file range\n", i);
+                release_executable(&img);
+                return -1;
+            }
+
             /* Map memory for this segment */
             
             uint32_t start_page = phdr[i].p_vaddr & PAGE_FRAME_MASK;
@@ -151,7 +184,7 @@ extern "C" int execve(const char *filename, char *const argv[], char *const envp
                 /* Check if mapped, if not allocate */
                 if (page >= 0xC0000000) {
                     terminal_printf("[EXEC] Error: Segment overlaps kernel memory (0x%x)\n", page);
-                    kfree(file_data);
+                    release_executable(&img);
                     return -1;
                 }
 
@@ -159,7 +192,7 @@ extern "C" int execve(const char *filename, char *const argv[], char *const envp
                 void* new_page = vmm_alloc_page();
                 if (!new_page) {
                     terminal_printf("[EXEC] Error: OOM during load\n");
-                    kfree(file_data);
+                    release_executable(&img);
                     return -1;
                 }
                 
@@ -179,7 +212,7 @@ extern "C" int execve(const char *filename, char *const argv[], char *const envp
     terminal_printf("[EXEC] Jumping to entry point: 0x%x\n", entry_point);
 
     /* Cleanup buffer */
-    kfree(file_data);
+    release_executable(&img);
 
     /* Execute */
     entry_point();
@@ -7,7 +7,7 @@
 extern void* vmm_create_page_directory(void);
 extern void vmm_switch_page_directory(void* pd);
 extern void vmm_map_region(void* pd, uint32_t vaddr, void* phys, uint32_t size, uint32_t flags);
-extern void* pmm_alloc_frames(uint32_t pages); /* returns physical pointer or NULL */
+extern void* pmm_alloc_frames(uint32_t count, uint32_t align); /* returns physical pointer or NULL; align 0 = page */
 
 extern void* kmalloc(uint32_t s);
 extern void  kfree(void* p);
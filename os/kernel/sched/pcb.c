@@ -2,6 +2,7 @@
 #include "pcb.h"
 #include "../terminal.h" /* păstrează pentru debug dacă vrei */
 #include "scheduler.h"
+#include "../smp/smp.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -13,7 +14,8 @@ static void zero_mem(void *dst, size_t n) {
 }
 
 static pcb_t pcbs[MAX_TASKS];
-static int current_tid = -1;
+/* task running on each CPU (-1 = idle / kernel_main) */
+static int current_tid[MAX_CPUS] = {[0 ... MAX_CPUS - 1] = -1};
 
 void pcb_init_all(void) {
   for (int i = 0; i < MAX_TASKS; ++i) {
@@ -23,11 +25,18 @@ void pcb_init_all(void) {
     pcbs[i].entry = 0;
     pcbs[i].arg = 0;
     pcbs[i].ticks_remaining = 0;
+    pcbs[i].base_prio = SCHED_PRIO_NORMAL;
+    pcbs[i].prio = SCHED_PRIO_NORMAL;
+    pcbs[i].rq_next = -1;
+    pcbs[i].rq_prev = -1;
+    pcbs[i].cpu = -1;
+    pcbs[i].on_cpu = 0;
     zero_mem(pcbs[i].stack, TASK_STACK_SIZE);
     for (int j = 0; j < MAX_FILES_PER_PROCESS; j++)
       pcbs[i].files[j] = NULL;
   }
-  current_tid = -1;
+  for (int c = 0; c < MAX_CPUS; ++c)
+    current_tid[c] = -1;
 }
 
 /* internal helper to prepare initial stack for a fresh task
@@ -60,6 +69,11 @@ int pcb_create(task_fn_t entry, void *arg) {
       pcbs[i].arg = arg;
       pcbs[i].esp = init_stack_for(&pcbs[i]);
       pcbs[i].ticks_remaining = 0;
+      pcbs[i].base_prio = SCHED_PRIO_NORMAL;
+      pcbs[i].prio = SCHED_PRIO_NORMAL;
+      pcbs[i].cpu = -1;
+      pcbs[i].on_cpu = 0;
+      scheduler_enqueue(pcbs[i].tid);
       return pcbs[i].tid;
     }
   }
@@ -67,9 +81,16 @@ int pcb_create(task_fn_t entry, void *arg) {
 }
 
 pcb_t *pcb_get_current(void) {
-  if (current_tid < 0)
+  int tid = current_tid[smp_current_cpu()];
+  if (tid < 0)
     return NULL;
-  return &pcbs[current_tid];
+  return &pcbs[tid];
+}
+
+pcb_t *pcb_get(int tid) {
+  if (tid < 0 || tid >= MAX_TASKS)
+    return NULL;
+  return &pcbs[tid];
 }
 
 /* small helpers used by scheduler.c */
@@ -88,5 +109,5 @@ int _pcb_count(void) {
 }
 
 /* expose a way for scheduler to set current */
-void _pcb_set_current(int idx) { current_tid = idx; }
-int _pcb_get_current_idx(void) { return current_tid; }
+void _pcb_set_current(int idx) { current_tid[smp_current_cpu()] = idx; }
+int _pcb_get_current_idx(void) { return current_tid[smp_current_cpu()]; }
@@ -9,6 +9,12 @@ extern "C" {
 #define MAX_TASKS 16
 #define TASK_STACK_SIZE 4096
 
+/* priority levels: 0 = highest, SCHED_PRIO_LEVELS-1 = idle */
+#define SCHED_PRIO_LEVELS 8
+#define SCHED_PRIO_HIGH 1
+#define SCHED_PRIO_NORMAL 4
+#define SCHED_PRIO_IDLE (SCHED_PRIO_LEVELS - 1)
+
 typedef enum {
   TASK_UNUSED = 0,
   TASK_READY,
@@ -33,6 +39,12 @@ typedef struct {
   task_fn_t entry;
   void *arg;
   uint32_t ticks_remaining; /* quantum remaining (in ticks) */
+  uint8_t base_prio;        /* priority set by the owner (0 = highest) */
+  uint8_t prio;             /* effective priority: base minus wake-up boost */
+  int8_t rq_next;           /* ready queue links (pcb index, -1 = none) */
+  int8_t rq_prev;
+  int8_t cpu;               /* run queue owner (cpus[] index, -1 = unassigned) */
+  volatile int8_t on_cpu;   /* cpu + 1 while running or being switched out */
   file_t *files[MAX_FILES_PER_PROCESS];
 } pcb_t;
 
@@ -40,6 +52,7 @@ typedef struct {
 void pcb_init_all(void);
 int pcb_create(task_fn_t entry, void *arg);
 pcb_t *pcb_get_current(void);
+pcb_t *pcb_get(int tid); /* NULL if tid is out of range */
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -2,6 +2,7 @@
 #include "scheduler.h"
 #include "pcb.h"
 #include "../terminal.h" /* optional */
+#include "../smp/smp.h"
 #include <stdint.h>
 
 /* ---- defensive declarations for helpers provided by pcb.c ----
@@ -21,27 +22,212 @@ static uint32_t QUANTUM_TICKS = 2; /* default (change via scheduler_init) */
  * the scheduler becomes a no-op (fallback).
  */
 static volatile int scheduler_enabled = 0;
-
-#ifndef SCHED_COOPERATIVE
-/* preemptive: this variable set by PIT IRQ handler (scheduler_tick),
- * scheduler checks it and switches when needed.
- */
-static volatile int need_reschedule = 0;
-#endif
+/* set once scheduler_init() has reset the run queues: APs come online
+ * before that and must not touch a queue (or its lock) until then */
+static volatile int sched_ready = 0;
 
 /* forward: context switch primitive */
-static void context_switch(uint32_t **old_esp, uint32_t *new_esp);
+__attribute__((naked, noinline)) static void context_switch(uint32_t **old_esp, uint32_t *new_esp);
 
 /* helper trampoline (assembly wrapper) - called when a fresh task is started */
 extern void task_trampoline(void);
 
-/* round robin queue simple pointer */
-static int last_run = -1;
+/* ---------- per-CPU ready queues ----------
+ * Every CPU owns cpus[i].rq: one FIFO per priority level, linked through
+ * pcb_t.rq_next/rq_prev, and a bitmap with bit p set while level p is
+ * non-empty. Picking the next task is a ctz on the bitmap plus a list pop:
+ * O(1), independent of MAX_TASKS.
+ * Invariant: a task is queued (on rq of pcb_t.cpu) exactly when its state
+ * is TASK_READY. on_cpu (cpu index + 1) stays set until the CPU that ran
+ * the task has saved its stack, so other CPUs never pick up a half-switched
+ * task.
+ * preemptive: need_resched is set by the timer tick (scheduler_tick) or a
+ * wakeup, and checked at the end of the IRQ.
+ */
+_Static_assert(CPU_RQ_LEVELS == SCHED_PRIO_LEVELS, "cpu_runqueue_t level count");
+
+static inline int ncpus(void) {
+    return cpu_count > 0 ? cpu_count : 1;
+}
+
+static inline cpu_runqueue_t* rq_of(int cpu) {
+    return &cpus[cpu].rq;
+}
+
+static inline uint32_t rq_lock(cpu_runqueue_t* rq) {
+    return spin_lock_irqsave(&rq->lock);
+}
+
+static inline void rq_unlock(cpu_runqueue_t* rq, uint32_t fl) {
+    spin_unlock_irqrestore(&rq->lock, fl);
+}
+
+static void rq_reset(cpu_runqueue_t* rq) {
+    spin_init(&rq->lock, "runqueue");
+    for (int i = 0; i < SCHED_PRIO_LEVELS; ++i) {
+        rq->head[i] = -1;
+        rq->tail[i] = -1;
+    }
+    rq->ready_bitmap = 0;
+    rq->nr_ready = 0;
+    rq->need_resched = 0;
+    rq->curr_prio = SCHED_PRIO_LEVELS;
+    rq->prev_tid = -1;
+}
+
+static int rq_contains(cpu_runqueue_t* rq, pcb_t* p) {
+    return p->rq_prev >= 0 || rq->head[p->prio] == (int8_t)p->tid;
+}
+
+static void rq_push(cpu_runqueue_t* rq, pcb_t* p, int at_head) {
+    int pr = p->prio;
+    int8_t idx = (int8_t)p->tid;
+    if (at_head) {
+        p->rq_prev = -1;
+        p->rq_next = rq->head[pr];
+        if (rq->head[pr] >= 0) _pcb_get_by_index(rq->head[pr])->rq_prev = idx;
+        else rq->tail[pr] = idx;
+        rq->head[pr] = idx;
+    } else {
+        p->rq_next = -1;
+        p->rq_prev = rq->tail[pr];
+        if (rq->tail[pr] >= 0) _pcb_get_by_index(rq->tail[pr])->rq_next = idx;
+        else rq->head[pr] = idx;
+        rq->tail[pr] = idx;
+    }
+    rq->ready_bitmap |= 1u << pr;
+    rq->nr_ready++;
+}
+
+static void rq_remove(cpu_runqueue_t* rq, pcb_t* p) {
+    int pr = p->prio;
+    if (p->rq_prev >= 0) _pcb_get_by_index(p->rq_prev)->rq_next = p->rq_next;
+    else rq->head[pr] = p->rq_next;
+    if (p->rq_next >= 0) _pcb_get_by_index(p->rq_next)->rq_prev = p->rq_prev;
+    else rq->tail[pr] = p->rq_prev;
+    p->rq_next = -1;
+    p->rq_prev = -1;
+    if (rq->head[pr] < 0) rq->ready_bitmap &= ~(1u << pr);
+    rq->nr_ready--;
+}
+
+/* highest non-empty level, or SCHED_PRIO_LEVELS when nothing is ready */
+static inline int rq_top_prio(cpu_runqueue_t* rq) {
+    uint32_t bm = rq->ready_bitmap;
+    return bm ? __builtin_ctz(bm) : SCHED_PRIO_LEVELS;
+}
+
+/* pop the best task that is not still running on (or being switched out
+ * by) another CPU */
+static int rq_pop_highest(cpu_runqueue_t* rq, int self) {
+    uint32_t bm = rq->ready_bitmap;
+    while (bm) {
+        int pr = __builtin_ctz(bm);
+        for (int idx = rq->head[pr]; idx >= 0; idx = _pcb_get_by_index(idx)->rq_next) {
+            pcb_t* p = _pcb_get_by_index(idx);
+            if (p->on_cpu && p->on_cpu != self + 1) continue;
+            rq_remove(rq, p);
+            return idx;
+        }
+        bm &= bm - 1;
+    }
+    return -1;
+}
+
+/* Idle CPU: take the best ready task from the busiest other queue */
+static int rq_steal(int self) {
+    int victim = -1;
+    uint32_t most = 0;
+    for (int c = 0; c < ncpus(); ++c) {
+        if (c == self || rq_of(c)->nr_ready <= most) continue;
+        most = rq_of(c)->nr_ready;
+        victim = c;
+    }
+    if (victim < 0) return -1;
+
+    cpu_runqueue_t* rq = rq_of(victim);
+    uint32_t fl = rq_lock(rq);
+    int idx = rq_pop_highest(rq, self);
+    rq_unlock(rq, fl);
+    if (idx >= 0) {
+        _pcb_get_by_index(idx)->cpu = (int8_t)self;
+        rq_of(self)->steals++;
+    }
+    return idx;
+}
+
+/* New tasks go to the least loaded CPU, preferring CPUs that run the idle
+ * loop (the BSP keeps running kernel_main and only schedules on yield). */
+static int pick_cpu(void) {
+    int best = 0;
+    uint32_t best_load = 0xFFFFFFFFu;
+    for (int c = 0; c < ncpus(); ++c) {
+        if (c != 0 && !cpus[c].online) continue;
+        cpu_runqueue_t* rq = rq_of(c);
+        uint32_t load = rq->nr_ready * 2 + (rq->curr_prio < SCHED_PRIO_LEVELS ? 2 : 0)
+                        + (rq->idle_loop ? 0 : 1);
+        if (load < best_load) {
+            best_load = load;
+            best = c;
+        }
+    }
+    return best;
+}
+
+/* A task of priority prio became ready on `cpu`: preempt it if that task
+ * matters more than what runs there, otherwise wake an idle CPU to steal. */
+static void kick_cpu(int cpu, int prio) {
+    int self = smp_current_cpu();
+    cpu_runqueue_t* rq = rq_of(cpu);
+    if (prio < rq->curr_prio) {
+        rq->need_resched = 1;
+        if (cpu != self && rq->idle_loop) smp_send_resched(cpu);
+        return;
+    }
+    for (int c = 0; c < ncpus(); ++c) {
+        cpu_runqueue_t* other = rq_of(c);
+        if (c == self || !cpus[c].online || !other->idle_loop) continue;
+        if (other->curr_prio < SCHED_PRIO_LEVELS) continue;
+        other->need_resched = 1;
+        smp_send_resched(c);
+        return;
+    }
+}
+
+/* called in the context that was switched to: the previous task's stack
+ * is saved now, so other CPUs may pick it up */
+static void finish_switch(void) {
+    cpu_runqueue_t* rq = rq_of(smp_current_cpu());
+    int prev = rq->prev_tid;
+    if (prev >= 0) {
+        _pcb_get_by_index(prev)->on_cpu = 0;
+        rq->prev_tid = -1;
+    }
+}
+
+void scheduler_enqueue(int tid) {
+    pcb_t* p = _pcb_get_by_index(tid);
+    if (!p || p->state == TASK_UNUSED || p->state == TASK_ZOMBIE) return;
+    if (p->state == TASK_RUNNING) return; /* requeued when it loses the CPU */
+    if (p->cpu < 0 || p->cpu >= ncpus()) p->cpu = (int8_t)pick_cpu();
+
+    int cpu = p->cpu;
+    cpu_runqueue_t* rq = rq_of(cpu);
+    uint32_t fl = rq_lock(rq);
+    int queued = rq_contains(rq, p);
+    if (!queued) {
+        p->state = TASK_READY;
+        rq_push(rq, p, 0);
+    }
+    rq_unlock(rq, fl);
+    if (!queued) kick_cpu(cpu, p->prio);
+}
 
 void scheduler_init(uint32_t quantum_ticks) {
     QUANTUM_TICKS = quantum_ticks ? quantum_ticks : QUANTUM_TICKS;
+    if (sched_ready) return; /* the queues may be in use by now */
     pcb_init_all();
-    last_run = -1;
+    for (int c = 0; c < MAX_CPUS; ++c) rq_reset(rq_of(c));
 
     /* basic sanity: if there are no pcb slots, disable scheduler (fallback) */
     if (_pcb_count() <= 0) {
@@ -50,125 +236,253 @@ void scheduler_init(uint32_t quantum_ticks) {
     } else {
         scheduler_enabled = 1;
     }
+
+    /* publish the queues, then wake the APs parked in scheduler_idle_loop() */
+    __atomic_store_n(&sched_ready, 1, __ATOMIC_RELEASE);
+    for (int c = 0; c < ncpus(); ++c)
+        if (c != smp_current_cpu()) smp_send_resched(c);
 }
 
-/* Called by PIT IRQ handler every tick */
+/* Called by the timer IRQ handler every tick */
 void scheduler_tick(void) {
     if (!scheduler_enabled) return;
 #ifndef SCHED_COOPERATIVE
-    /* set flag: reschedule required at next safe point (end of IRQ) */
-    need_reschedule = 1;
-    /* Optionally: decrement current's remaining ticks here to force switch */
+    /* request a reschedule at the next safe point (end of IRQ) when the
+     * quantum ran out or a higher priority level has work */
+    cpu_runqueue_t* rq = rq_of(smp_current_cpu());
     pcb_t* cur = pcb_get_current();
-    if (cur) {
-        if (cur->ticks_remaining > 0) cur->ticks_remaining--;
-        if (cur->ticks_remaining == 0) need_reschedule = 1;
+    if (!cur) {
+        if (rq->ready_bitmap) rq->need_resched = 1;
+        return;
     }
+    if (cur->ticks_remaining > 0) cur->ticks_remaining--;
+    if (cur->ticks_remaining == 0 || rq_top_prio(rq) < cur->prio) rq->need_resched = 1;
 #endif
 }
 
-/* yield (cooperative) or voluntary yield call */
-void scheduler_yield(void) {
-    if (!scheduler_enabled) return;
+/* Requeue the current task (if it can still run) and switch to the head of
+ * the highest priority queue of this CPU, stealing when it is empty.
+ * voluntary: yield/block - the task goes to the tail of its level.
+ * otherwise (preemption) it only loses the CPU when its quantum is used up
+ * (tail, boost decays by one level) or a higher level is ready (head, keeps
+ * its turn). With nothing to run, a blocked task hands the CPU back to the
+ * idle context. */
+static void reschedule(int voluntary) {
+    uint32_t irq = irq_save();
+    int cpu = smp_current_cpu();
+    cpu_runqueue_t* rq = rq_of(cpu);
+    uint32_t fl = rq_lock(rq);
 
-    /* mark current as ready and force reschedule */
-    pcb_t* cur = pcb_get_current();
-    if (cur) {
-        cur->state = TASK_READY;
-    }
-#ifndef SCHED_COOPERATIVE
-    need_reschedule = 1;
-    /* call schedule immediately (safe to call from code path) */
-#endif
+    int prev = _pcb_get_current_idx();
+    pcb_t* prev_p = _pcb_get_by_index(prev);
 
-    /* do scheduling now */
-    int start = last_run;
-    int found = -1;
-    for (int i = 1; i <= MAX_TASKS; ++i) {
-        int idx = (start + i) % MAX_TASKS;
-        pcb_t* p = _pcb_get_by_index(idx);
-        if (!p) continue;
-        if (p->state == TASK_READY) { found = idx; break; }
+    if (prev_p && prev_p->state == TASK_RUNNING) {
+        int expired = prev_p->ticks_remaining == 0;
+        if (!voluntary && !expired && rq_top_prio(rq) >= prev_p->prio) {
+            rq_unlock(rq, fl);
+            irq_restore(irq);
+            return;
+        }
+        if (!voluntary && expired && prev_p->prio < prev_p->base_prio) prev_p->prio++;
+        prev_p->state = TASK_READY;
+        prev_p->cpu = (int8_t)cpu;
+        rq_push(rq, prev_p, !voluntary && !expired);
     }
+
+    int found = rq_pop_highest(rq, cpu);
+    rq_unlock(rq, fl);
+    if (found == -1) found = rq_steal(cpu);
+
     if (found == -1) {
-        /* nothing to run -> fallback: leave scheduler enabled but do nothing */
+        /* nothing to run: a task that cannot continue returns to idle */
+        if (prev_p && prev_p->state != TASK_RUNNING && rq->idle_esp) {
+            _pcb_set_current(-1);
+            rq->curr_prio = SCHED_PRIO_LEVELS;
+            rq->prev_tid = prev;
+            rq->switches++;
+            context_switch(&prev_p->esp, rq->idle_esp);
+            finish_switch();
+        }
+        irq_restore(irq);
         return;
     }
 
-    /* perform switch */
-    int prev = _pcb_get_current_idx();
-    pcb_t* prev_p = _pcb_get_by_index(prev);
     pcb_t* next_p = _pcb_get_by_index(found);
-
     if (!next_p) {
         /* defensive: invalid next pointer -> disable scheduler as precaution */
         terminal_writestring("[sched] invalid next_p -> disabling scheduler (fallback)\n");
         scheduler_enabled = 0;
+        irq_restore(irq);
         return;
     }
 
-    if (prev_p) prev_p->state = TASK_READY;
     next_p->state = TASK_RUNNING;
     next_p->ticks_remaining = QUANTUM_TICKS;
+    next_p->cpu = (int8_t)cpu;
+    next_p->on_cpu = (int8_t)(cpu + 1);
     _pcb_set_current(found);
-    last_run = found;
+    rq->curr_prio = next_p->prio;
 
+    if (found == prev) { /* still the best candidate */
+        irq_restore(irq);
+        return;
+    }
+
+    rq->prev_tid = prev_p ? prev : -1;
+    rq->switches++;
     if (prev_p) {
         context_switch(&prev_p->esp, next_p->esp);
     } else {
-        /* no previous (first run) */
-        uint32_t *dummy = 0;
-        context_switch(&dummy, next_p->esp);
+        /* switching away from the idle context of this CPU */
+        context_switch(&rq->idle_esp, next_p->esp);
     }
+    finish_switch();
+    irq_restore(irq);
+}
+
+/* yield (cooperative) or voluntary yield call */
+void scheduler_yield(void) {
+    if (!scheduler_enabled) return;
+    reschedule(1);
 }
 
 /* internal schedule used by IRQ handler: called from end of IRQ or tick path.
- * This is kept minimal: it only swaps if need_reschedule is set.
+ * This is kept minimal: it only swaps if need_resched is set.
  */
 void scheduler_handle_reschedule_if_needed(void) {
     if (!scheduler_enabled) return;
 #ifndef SCHED_COOPERATIVE
-    if (!need_reschedule) return;
-    need_reschedule = 0;
+    cpu_runqueue_t* rq = rq_of(smp_current_cpu());
+    if (!rq->need_resched) return;
+    rq->need_resched = 0;
+    reschedule(0);
+#endif
+}
+
+/* Reschedule IPI from another CPU (a task was queued or woken for us) */
+void scheduler_ipi(void) {
+    if (!scheduler_enabled) return;
+    rq_of(smp_current_cpu())->need_resched = 1;
+    scheduler_handle_reschedule_if_needed();
+}
+
+/* Idle context of an AP: run queued or stolen tasks, halt otherwise.
+ * sti;hlt is atomic, so a reschedule IPI cannot slip in between. */
+void scheduler_idle_loop(void) {
+    /* parked until scheduler_init() publishes the run queues (it sends a
+     * reschedule IPI); forever if the scheduler is never initialised */
+    for (;;) {
+        asm volatile("cli");
+        if (__atomic_load_n(&sched_ready, __ATOMIC_ACQUIRE)) break;
+        asm volatile("sti\n\thlt");
+    }
+    cpu_runqueue_t* rq = rq_of(smp_current_cpu());
+    rq->idle_loop = 1;
+    for (;;) {
+        asm volatile("cli");
+        if (scheduler_enabled) {
+            rq->need_resched = 0;
+            reschedule(1);
+        }
+        asm volatile("sti\n\thlt");
+    }
+}
+
+int scheduler_set_priority(int tid, int prio) {
+    pcb_t* p = _pcb_get_by_index(tid);
+    if (!p || p->state == TASK_UNUSED) return -1;
+    if (prio < 0 || prio >= SCHED_PRIO_LEVELS) return -1;
+
+    int cpu = p->cpu >= 0 ? p->cpu : 0;
+    cpu_runqueue_t* rq = rq_of(cpu);
+    uint32_t fl = rq_lock(rq);
+    int queued = p->state == TASK_READY && rq_contains(rq, p);
+    if (queued) rq_remove(rq, p);
+    p->base_prio = (uint8_t)prio;
+    p->prio = (uint8_t)prio;
+    if (queued) rq_push(rq, p, 0);
+    rq_unlock(rq, fl);
+    return 0;
+}
+
+int scheduler_get_priority(int tid) {
+    pcb_t* p = _pcb_get_by_index(tid);
+    if (!p || p->state == TASK_UNUSED) return -1;
+    return p->prio;
+}
 
-    /* find next ready task */
-    int start = last_run;
-    int found = -1;
-    for (int i = 1; i <= MAX_TASKS; ++i) {
-        int idx = (start + i) % MAX_TASKS;
-        pcb_t* p = _pcb_get_by_index(idx);
-        if (!p) continue;
-        if (p->state == TASK_READY) { found = idx; break; }
+/* Put the current task to sleep until scheduler_wake(). If nothing else is
+ * ready and there is no idle context to return to, wait for an interrupt. */
+void scheduler_block_current(void) {
+    scheduler_block_until(NULL);
+}
+
+/* The flag is tested under the run-queue lock scheduler_wake() takes, so a
+ * waker that sets it before calling scheduler_wake() is never lost. */
+int scheduler_block_until(volatile int* done) {
+    pcb_t* cur = pcb_get_current();
+    if (!cur || !scheduler_enabled) return -1;
+
+    uint32_t irq = irq_save();
+    cpu_runqueue_t* rq = rq_of(smp_current_cpu());
+    uint32_t fl = rq_lock(rq);
+    if (done && *done) {
+        rq_unlock(rq, fl);
+        irq_restore(irq);
+        return 0;
     }
-    if (found == -1) return;
+    cur->state = TASK_SLEEPING;
+    rq_unlock(rq, fl);
 
-    int prev = _pcb_get_current_idx();
-    pcb_t* prev_p = _pcb_get_by_index(prev);
-    pcb_t* next_p = _pcb_get_by_index(found);
+    while (cur->state == TASK_SLEEPING) {
+        reschedule(1);
+        if (cur->state == TASK_SLEEPING) asm volatile("sti\n\thlt\n\tcli");
+    }
 
-    if (!next_p) {
-        terminal_writestring("[sched] invalid next_p in IRQ handler -> disabling scheduler (fallback)\n");
-        scheduler_enabled = 0;
-        return;
+    /* woken without ever leaving this CPU (no idle context to go to):
+     * we are still current, so take ourselves back off the ready queue */
+    rq = rq_of(smp_current_cpu());
+    fl = rq_lock(rq);
+    if (cur->state == TASK_READY && rq_contains(rq, cur)) {
+        rq_remove(rq, cur);
+        cur->state = TASK_RUNNING;
+        rq->curr_prio = cur->prio;
     }
+    rq_unlock(rq, fl);
+    irq_restore(irq);
+    return 0;
+}
 
-    if (prev_p) prev_p->state = TASK_READY;
-    next_p->state = TASK_RUNNING;
-    next_p->ticks_remaining = QUANTUM_TICKS;
-    _pcb_set_current(found);
-    last_run = found;
+/* Wake a sleeping task on the CPU it last ran on; boost lifts it `boost`
+ * levels above its base priority so input/I/O bound tasks (WM, shell)
+ * preempt CPU-bound ones. */
+int scheduler_wake(int tid, int boost) {
+    pcb_t* p = _pcb_get_by_index(tid);
+    if (!p || p->state != TASK_SLEEPING) return -1;
 
-    if (prev_p) {
-        context_switch(&prev_p->esp, next_p->esp);
-    } else {
-        uint32_t *dummy = 0;
-        context_switch(&dummy, next_p->esp);
+    int cpu = (p->cpu >= 0 && p->cpu < ncpus()) ? p->cpu : pick_cpu();
+    cpu_runqueue_t* rq = rq_of(cpu);
+    uint32_t fl = rq_lock(rq);
+    if (p->state != TASK_SLEEPING) {
+        rq_unlock(rq, fl);
+        return -1;
     }
+    int prio = (int)p->base_prio - (boost > 0 ? boost : 0);
+    p->prio = (uint8_t)(prio < 0 ? 0 : prio);
+    p->state = TASK_READY;
+    p->cpu = (int8_t)cpu;
+    rq_push(rq, p, 0);
+    rq_unlock(rq, fl);
+
+#ifndef SCHED_COOPERATIVE
+    kick_cpu(cpu, p->prio);
 #endif
+    return 0;
 }
 
 /* Start scheduler — call from kernel_main once tasks created.
- * If you have an idle loop, you can enter it here.
+ * The caller becomes this CPU's idle context: it resumes once no task is
+ * left to run here.
  */
 void scheduler_start(void) {
     if (!scheduler_enabled) {
@@ -176,18 +490,9 @@ void scheduler_start(void) {
         return;
     }
 
-    /* find first ready task */
-    for (int i = 0; i < MAX_TASKS; ++i) {
-        pcb_t* p = _pcb_get_by_index(i);
-        if (!p) continue;
-        if (p->state == TASK_READY) {
-            p->state = TASK_RUNNING;
-            p->ticks_remaining = QUANTUM_TICKS;
-            _pcb_set_current(i);
-            last_run = i;
-            uint32_t *dummy = 0;
-            context_switch(&dummy, p->esp);
-            /* never returns unless task switches back */
+    for (int c = 0; c < ncpus(); ++c) {
+        if (rq_of(c)->nr_ready) {
+            reschedule(1); /* steals if our own queue is empty */
             return;
         }
     }
@@ -197,25 +502,27 @@ void scheduler_start(void) {
     scheduler_enabled = 0;
 }
 
-/* ---------- Context switch primitive (inline asm) ----------
- * We save the current ESP into *old_esp and load new_esp into ESP.
- * We wrap with pushad/popad so registers remain intact across switch.
+/* ---------- Context switch primitive ----------
+ * Saves the current ESP into *old_esp and loads new_esp into ESP.
+ * pushal/popal keep registers intact across the switch.
  *
  * Function prototype: static void context_switch(uint32_t **old_esp, uint32_t *new_esp);
  *
- * Note: this is a minimal primitive and assumes that stacks of tasks
- * are prepared in pcb_create to contain a return address that leads
- * to task_trampoline; see pcb.c.
+ * Naked and never inlined: the saved stack must end in a return address,
+ * both for suspended tasks (back into the caller) and for fresh stacks
+ * prepared by pcb_create (return into task_trampoline; see pcb.c).
  */
-static void context_switch(uint32_t **old_esp, uint32_t *new_esp) {
+__attribute__((naked, noinline)) static void context_switch(uint32_t **old_esp, uint32_t *new_esp) {
+    (void)old_esp;
+    (void)new_esp;
     asm volatile(
-        "pushal\n\t"                 /* save registers (EAX..EDI) */
-        "movl %%esp, (%0)\n\t"       /* store current esp into *old_esp */
-        "movl %1, %%esp\n\t"         /* load new esp */
-        "popal\n\t"                  /* restore registers for new task */
-        :
-        : "r"(old_esp), "r"(new_esp)
-        : "memory"
+        "movl 4(%esp), %eax\n\t"   /* old_esp */
+        "movl 8(%esp), %edx\n\t"   /* new_esp */
+        "pushal\n\t"               /* save registers (EAX..EDI) */
+        "movl %esp, (%eax)\n\t"    /* store current esp into *old_esp */
+        "movl %edx, %esp\n\t"      /* load new esp */
+        "popal\n\t"                /* restore registers for new task */
+        "ret\n\t"
     );
 }
 
@@ -225,6 +532,10 @@ static void context_switch(uint32_t **old_esp, uint32_t *new_esp) {
  * the task as ZOMBIE and yields.
  */
 void task_trampoline_c(void) {
+    /* first run: complete the switch that got us here (it ran with
+     * interrupts off) */
+    finish_switch();
+    asm volatile("sti");
     pcb_t* cur = pcb_get_current();
     if (!cur) {
         /* nothing */
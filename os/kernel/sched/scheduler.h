@@ -17,6 +17,31 @@ void scheduler_init(uint32_t quantum_ticks);
 void scheduler_tick(void);        /* call from PIT IRQ handler (increment tick) */
 void scheduler_yield(void);       /* cooperative yield (or forced by tick) */
 void scheduler_start(void);       /* start scheduling loop (call from kernel_main) */
+void scheduler_handle_reschedule_if_needed(void); /* end of timer IRQ */
+
+/* SMP: each CPU has its own ready queues (cpu_info_t.rq). APs park in
+ * scheduler_idle_loop() and steal work from busy CPUs when their queue is
+ * empty; scheduler_ipi() handles the reschedule IPI sent on wakeup. */
+void scheduler_idle_loop(void) __attribute__((noreturn));
+void scheduler_ipi(void);
+
+/* ready queues (one FIFO per priority + bitmap of non-empty levels) */
+void scheduler_enqueue(int tid);            /* mark READY and queue at the tail */
+
+/* priorities: 0 = highest .. SCHED_PRIO_LEVELS-1 (see pcb.h) */
+int scheduler_set_priority(int tid, int prio); /* sets base priority, 0 on success */
+int scheduler_get_priority(int tid);           /* effective priority or -1 */
+
+/* blocking: the current task sleeps until scheduler_wake(); a wake-up from
+ * input or I/O temporarily raises the task by `boost` levels, the boost
+ * decays by one level per full quantum the task then consumes. */
+#define SCHED_BOOST_INPUT 3
+#define SCHED_BOOST_IO 2
+void scheduler_block_current(void);
+int scheduler_wake(int tid, int boost);
+/* sleep until *done != 0 (set by the waker before scheduler_wake());
+ * -1 if not called from a scheduled task */
+int scheduler_block_until(volatile int* done);
 
 #ifdef __cplusplus
 }
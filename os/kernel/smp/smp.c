@@ -7,10 +7,51 @@
 #include "../arch/i386/gdt.h"
 #include "../arch/i386/idt.h"
 #include "../paging.h" // For paging_map_page
+#include "../sched/scheduler.h"
 
 cpu_info_t cpus[MAX_CPUS];
 volatile int cpu_count = 0;
 
+/* LAPIC timer ticks per ms (divide-by-16), measured once on the BSP */
+static uint32_t lapic_ticks_per_ms = 0;
+
+/* AP interrupt entry points: LAPIC timer and reschedule IPI.
+ * Kernel-only context, so no segment reloads are needed. */
+void smp_timer_handler(void);
+void smp_resched_handler(void);
+
+__attribute__((naked)) void smp_timer_isr(void) {
+    asm volatile(
+        "pushal\n\t"
+        "cld\n\t"
+        "call smp_timer_handler\n\t"
+        "popal\n\t"
+        "iretl\n\t"
+    );
+}
+
+__attribute__((naked)) void smp_resched_isr(void) {
+    asm volatile(
+        "pushal\n\t"
+        "cld\n\t"
+        "call smp_resched_handler\n\t"
+        "popal\n\t"
+        "iretl\n\t"
+    );
+}
+
+/* EOI first: the handler may switch tasks and return much later */
+void smp_timer_handler(void) {
+    lapic_eoi();
+    scheduler_tick();
+    scheduler_handle_reschedule_if_needed();
+}
+
+void smp_resched_handler(void) {
+    lapic_eoi();
+    scheduler_ipi();
+}
+
 /*
  * Main C entry point for Application Processors (APs).
  * This function is called by the trampoline code.
@@ -53,15 +94,35 @@ void ap_main(void) {
         }
     }
 
+    // Shared IDT (the trampoline only set up the GDT)
+    idt_load();
+
     serial_printf("[SMP] AP %d online\n", id);
 
-    // Enable interrupts on this core
-    asm volatile("sti");
+    // Periodic scheduler tick on this core
+    if (lapic_ticks_per_ms) {
+        lapic_timer_start(SMP_TIMER_VECTOR, lapic_ticks_per_ms * (1000 / SMP_TIMER_HZ));
+    }
+
+    // Run tasks from this CPU's queue (or stolen ones); halts while idle
+    scheduler_idle_loop();
+}
+
+/* Reschedule IPI: make `cpu` look at its run queue */
+void smp_send_resched(int cpu) {
+    if (cpu < 0 || cpu >= cpu_count || !cpus[cpu].online) return;
+    lapic_send_ipi(cpus[cpu].apic_id, LAPIC_IPI_FIXED, SMP_RESCHED_VECTOR);
+}
 
-    // Halt until an interrupt arrives
-    while (1) {
-        asm volatile("hlt");
+int smp_current_cpu(void) {
+    /* Uniprocessor (or LAPIC not mapped yet): everything runs on the BSP */
+    if (cpu_count <= 1) return 0;
+
+    uint8_t id = (uint8_t)lapic_get_id();
+    for (int i = 0; i < cpu_count; i++) {
+        if (cpus[i].apic_id == id) return i;
     }
+    return 0;
 }
 
 void smp_detect_cpus(void) {
@@ -183,6 +244,16 @@ void smp_start_aps(void) {
 
     serial_write_string("[SMP] Starting APs...\n");
 
+    // Scheduler vectors for the APs (the IDT is shared)
+    idt_set_gate(SMP_TIMER_VECTOR, (uint32_t)smp_timer_isr, 0x08, 0x8E);
+    idt_set_gate(SMP_RESCHED_VECTOR, (uint32_t)smp_resched_isr, 0x08, 0x8E);
+
+    lapic_ticks_per_ms = lapic_timer_calibrate();
+    if (lapic_ticks_per_ms)
+        serial_printf("[SMP] LAPIC timer: %u ticks/ms\n", lapic_ticks_per_ms);
+    else
+        serial_printf("[SMP] LAPIC timer not calibrated (no HPET): APs run without preemption\n");
+
     // Iterate through detected CPUs
     for (int i = 0; i < cpu_count; i++) {
         uint8_t apic_id = cpus[i].apic_id;
@@ -203,19 +274,19 @@ void smp_start_aps(void) {
         serial_printf("[SMP] Assigning stack 0x%x for APIC ID %d\n", stack_top, apic_id);
 
         serial_printf("[SMP] Sending INIT IPI to CPU %d\n", apic_id);
-        lapic_send_ipi(apic_id, 5, 0); // INIT (Type 5), Vector 0
+        lapic_send_ipi(apic_id, LAPIC_IPI_INIT, 0); // INIT (Type 5), Vector 0
         
         serial_write_string("[SMP] After INIT, waiting...\r\n");
         // Wait 10ms
         smp_busy_wait(100); // Approx 10ms
 
         serial_printf("[SMP] Sending SIPI #1 to CPU %d (Vector 0x%x)\n", apic_id, vector);
-        lapic_send_ipi(apic_id, 6, vector); // SIPI (Type 6)
+        lapic_send_ipi(apic_id, LAPIC_IPI_SIPI, vector); // SIPI (Type 6)
         
         smp_busy_wait(2); // Wait > 200 microseconds
 
         serial_printf("[SMP] Sending SIPI #2 to CPU %d (Vector 0x%x)\n", apic_id, vector);
-        lapic_send_ipi(apic_id, 6, vector); // SIPI (Type 6)
+        lapic_send_ipi(apic_id, LAPIC_IPI_SIPI, vector); // SIPI (Type 6)
         smp_busy_wait(2);
     }
 }
\ No newline at end of file
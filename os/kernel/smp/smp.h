@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include "../sync/spinlock.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -8,10 +9,34 @@ extern "C" {
 
 #define MAX_CPUS 8
 
+/* Interrupt vectors used by the APs' scheduler */
+#define SMP_TIMER_VECTOR   0xF0  /* LAPIC timer tick */
+#define SMP_RESCHED_VECTOR 0xF1  /* reschedule IPI sent on wakeup */
+#define SMP_DEADLINE_VECTOR 0xF2 /* BSP one-shot deadline timer (time/timer.c) */
+#define SMP_TIMER_HZ       100
+
+/* Per-CPU run queue (managed by sched/scheduler.c): one FIFO of pcb
+ * indexes per priority level plus a bitmap of non-empty levels. */
+#define CPU_RQ_LEVELS 8 /* == SCHED_PRIO_LEVELS */
+typedef struct {
+    spinlock_t lock;
+    volatile uint32_t ready_bitmap;
+    int8_t head[CPU_RQ_LEVELS];
+    int8_t tail[CPU_RQ_LEVELS];
+    volatile uint32_t nr_ready;
+    volatile int need_resched;
+    volatile int curr_prio;  /* priority of the running task, CPU_RQ_LEVELS = idle */
+    volatile int idle_loop;  /* CPU parks in scheduler_idle_loop() when idle */
+    volatile int prev_tid;   /* task switched away from, until the switch completes */
+    uint32_t* idle_esp;      /* saved idle context while a task runs */
+    uint32_t switches;
+    uint32_t steals;
+} cpu_runqueue_t;
+
 typedef struct {
     uint8_t apic_id;
     int online;
-    // Add other per-cpu data here later (e.g., current_task)
+    cpu_runqueue_t rq;
 } cpu_info_t;
 
 extern cpu_info_t cpus[MAX_CPUS];
@@ -26,6 +51,12 @@ bool smp_prepare_aps(void);
 /* Starts all Application Processors (APs) */
 void smp_start_aps(void);
 
+/* Index into cpus[] of the calling CPU (0 before APs are started) */
+int smp_current_cpu(void);
+
+/* Send a reschedule IPI to cpus[cpu] */
+void smp_send_resched(int cpu);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "../../sync/spinlock.h"
+#include "../block.h"
+#include "../../mm/vmm.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,6 +16,11 @@ extern "C" {
  * ------------------------------------------------- */
 #define AHCI_MAX_PORTS 32
 #define AHCI_MAX_CMDS  32
+#define AHCI_MAX_PRDT  248                      /* PRDT entries per command table */
+#define AHCI_CT_SIZE   (0x80 + AHCI_MAX_PRDT * 16) /* = 4096: one DMA page per slot */
+#define AHCI_PRD_MAX_BYTES (4U << 20)           /* one PRDT entry covers at most 4 MB */
+#define AHCI_MAX_SECTORS_LBA48 65535            /* per command (16-bit count) */
+#define AHCI_MAX_SECTORS_LBA28 256
 
 /* -------------------------------------------------
  * Kernel-provided helpers
@@ -53,6 +61,12 @@ extern void pci_enable_busmaster(
     uint8_t func
 );
 
+extern uint8_t pci_read_irq_line(
+    uint8_t bus,
+    uint8_t dev,
+    uint8_t func
+);
+
 extern uint32_t get_uptime_ms(void);
 
 /* -------------------------------------------------
@@ -148,9 +162,26 @@ typedef struct {
     uint8_t  cfis[64];
     uint8_t  acmd[16];
     uint8_t  rsv[48];
-    hba_prdt_entry_t prdt_entry[1];
+    hba_prdt_entry_t prdt_entry[AHCI_MAX_PRDT];
 } hba_cmd_tbl_t;
 
+/* register bits used by the command/IRQ paths */
+#define AHCI_CAP_SNCQ   (1U << 30)  /* HBA supports native command queuing */
+#define AHCI_GHC_IE     (1U << 1)   /* global interrupt enable */
+#define AHCI_PxIS_TFES  (1U << 30)  /* task file error */
+#define AHCI_PxIS_HBFS  (1U << 29)  /* host bus fatal error */
+#define AHCI_PxIS_HBDS  (1U << 28)  /* host bus data error */
+#define AHCI_PxIS_IFS   (1U << 27)  /* interface fatal error */
+#define AHCI_PxIS_ERR   (AHCI_PxIS_TFES | AHCI_PxIS_HBFS | AHCI_PxIS_HBDS | AHCI_PxIS_IFS)
+
+/* async completion: status 0 on success, <0 on error; may run in IRQ context */
+typedef void (*ahci_done_fn)(int status, void *ctx);
+
+typedef struct {
+    ahci_done_fn done;
+    void *ctx;
+} ahci_slot_t;
+
 /* -------------------------------------------------
  * Internal per-port software state
  * ------------------------------------------------- */
@@ -160,6 +191,19 @@ typedef struct {
     void *fb;
     void *cmd_tables[AHCI_MAX_CMDS];
     uint64_t sector_count;
+    uint8_t lba48;              /* READ/WRITE DMA EXT (IDENTIFY word 83 bit 10) */
+
+    /* async path: slots issued and not yet reaped (lock held) */
+    spinlock_t lock;
+    uint32_t active;
+    uint32_t depth;             /* usable slots: NCQ depth, or HBA slot count */
+    uint8_t ncq;                /* FPDMA QUEUED commands in use */
+    ahci_slot_t slots[AHCI_MAX_CMDS];
+
+    /* counters */
+    uint32_t completed;
+    uint32_t errors;
+    uint32_t max_inflight;
 } ahci_port_state_t;
 
 /* exported global port state table */
@@ -169,11 +213,16 @@ extern ahci_port_state_t port_states[AHCI_MAX_PORTS];
  * Internal init helpers
  * ------------------------------------------------- */
 int ahci_pci_probe_and_map(void);
+int ahci_pci_irq_line(void);
+hba_mem_t *ahci_get_abar(void);
 int find_cmdslot(hba_port_t *port);
+int ahci_irq_init(void);
 
-/* DMA Allocator helpers */
+/* DMA memory (ahci_dma.c): physically contiguous, zeroed, virt == phys.
+   Under a page: chunks from shared pool pages; otherwise whole frames.
+   ahci_dma_free takes the size/align the block was allocated with. */
 void* ahci_dma_alloc(size_t size, size_t align);
-uint32_t ahci_virt_to_phys(void* v);
+void  ahci_dma_free(void *p, size_t size, size_t align);
 
 /* -------------------------------------------------
  * Public AHCI API
@@ -194,6 +243,31 @@ int ahci_write_lba(
     const void *buf
 );
 
+/* Asynchronous submission: returns the slot used, AHCI_EBUSY when every
+ * slot is in flight, or another negative error (AHCI_ETOOBIG: count over
+ * the per-command limit or buffer too scattered for AHCI_MAX_PRDT).
+ * `done` runs once the command completes, from the AHCI IRQ or from
+ * ahci_poll(). The sync wrappers split large transfers themselves.
+ * The _sg form transfers several buffers (block_seg_t) with one command. */
+#define AHCI_EBUSY BLOCK_EBUSY
+#define AHCI_ETOOBIG (-5)
+int ahci_submit_async(
+    int port_id,
+    int write,
+    uint64_t lba,
+    uint32_t count,
+    void *buf,
+    ahci_done_fn done,
+    void *ctx
+);
+int ahci_submit_async_sg(int port_id, int write, uint64_t lba,
+                         const block_seg_t *segs, int nsegs,
+                         ahci_done_fn done, void *ctx);
+
+/* reap finished commands of one port / of every port (no IRQ needed) */
+void ahci_port_complete(int port_id);
+void ahci_poll(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,4 +1,5 @@
 #include "ahci.h"
+#include "../../debug/trace.h"
 #include <stdint.h>
 
 extern ahci_port_state_t port_states[]; /* from ahci_port.c (make static->extern if needed) */
@@ -6,6 +7,12 @@ extern ahci_port_state_t port_states[]; /* from ahci_port.c (make static->extern
 #define ATA_CMD_IDENTIFY 0xEC
 #define ATA_CMD_READ_DMA      0xC8
 #define ATA_CMD_WRITE_DMA     0xCA
+#define ATA_CMD_READ_DMA_EXT  0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_READ_FPDMA    0x60  /* READ FPDMA QUEUED (NCQ) */
+#define ATA_CMD_WRITE_FPDMA   0x61  /* WRITE FPDMA QUEUED (NCQ) */
+
+#define AHCI_CMD_TIMEOUT_MS 5000
 
 /* FIS types */
 #define FIS_TYPE_REG_H2D 0x27
@@ -20,9 +27,11 @@ static void setup_cmd_header(void *clb, int slot, uint8_t flags, uint16_t prdt_l
     hba_cmd_header_t *cl = (hba_cmd_header_t*)clb;
     /* clb is array of headers; each header is 32 bytes in spec; we simplified earlier */
     hba_cmd_header_t *h = (hba_cmd_header_t*)((uint8_t*)cl + slot * sizeof(hba_cmd_header_t));
-    h->flags = (flags & 0xFF) | ((prdt_len & 0xFFFF) << 8);
+    h->flags = flags; /* CFL + W; PRDTL has its own field */
     h->prdt_len = prdt_len;
+    h->prdt_byte_count = 0;
     h->ctba = ctba;
+    h->ctbau = 0;
 }
 
 /* small helper to wait for completion (CI clear) */
@@ -37,15 +46,37 @@ static int wait_for_cmd_complete(hba_port_t *port, int slot, uint32_t timeout_ms
     return 0;
 }
 
-/* Build a PRDT entry list for single buffer (handles up to 4G by splitting) */
+/* Append the PRDT entries for a virtually contiguous buffer to the n
+   already in prdt: one entry per physically contiguous run (split at 4 MB),
+   each page resolved separately, so buffers whose pages are scattered in
+   physical memory work too. Returns the new entry count, or -1 if
+   AHCI_MAX_PRDT entries are not enough. */
+static int prdt_add(hba_prdt_entry_t *prdt, int n, const void *buf, uint32_t byte_count) {
+    uintptr_t va = (uintptr_t)buf;
+    while (byte_count) {
+        uint32_t chunk = 0x1000 - (uint32_t)(va & 0xFFF);
+        if (chunk > byte_count) chunk = byte_count;
+        uint32_t phys = vmm_dma_phys((void*)va);
+        if (n > 0 && phys == prdt[n - 1].dba + prdt[n - 1].dbc + 1 &&
+            prdt[n - 1].dbc + 1 + chunk <= AHCI_PRD_MAX_BYTES) {
+            prdt[n - 1].dbc += chunk;
+        } else {
+            if (n >= AHCI_MAX_PRDT) return -1;
+            prdt[n].dba = phys;
+            prdt[n].dbau = 0;
+            prdt[n].rsv = 0;
+            prdt[n].dbc = chunk - 1; /* dbc is byte_count - 1 */
+            n++;
+        }
+        va += chunk;
+        byte_count -= chunk;
+    }
+    return n;
+}
+
 static int build_prdt_for_buffer(void *ct, const void *buf, uint32_t byte_count) {
-    /* ct assumed zeroed; PRDT starts after 0x80 in cmd table per spec; we'll place first at offset 0x80 */
-    uint8_t *ctb = (uint8_t*)ct;
-    hba_prdt_entry_t *prdt = (hba_prdt_entry_t*)(ctb + 0x80);
-    prdt->dba = (uint32_t)(uintptr_t)buf;
-    prdt->dbau = 0;
-    prdt->dbc = byte_count - 1; /* dbc is byte_count - 1 */
-    return 1;
+    /* PRDT starts at offset 0x80 of the command table */
+    return prdt_add(((hba_cmd_tbl_t*)ct)->prdt_entry, 0, buf, byte_count);
 }
 
 /* IDENTIFY implementation (polling) */
@@ -61,14 +92,13 @@ int ahci_send_identify(int port_no, hba_port_t *port, void *out_512) {
     ahci_port_state_t *st = &port_states[port_no];
     void *clb = st->clb;
     void *ct = st->cmd_tables[slot];
-    uint32_t ct_phys = ahci_virt_to_phys(ct);
+    uint32_t ct_phys = vmm_dma_phys(ct);
 
-    /* prepare command header */
-    setup_cmd_header(clb, slot, (5<<0), 1, ct_phys); /* flags: CFL=5 (RegH2D), PRDT len=1. Clear W (write) bit for Identify! */
+    /* build PRDT for output buffer (may straddle a page on the stack) */
+    int prdt_len = build_prdt_for_buffer(ct, out_512, 512);
 
-    /* build PRDT for output buffer */
-    /* PRDT must point to physical address of buffer */
-    build_prdt_for_buffer(ct, (void*)ahci_virt_to_phys(out_512), 512);
+    /* prepare command header */
+    setup_cmd_header(clb, slot, (5<<0), (uint16_t)prdt_len, ct_phys); /* flags: CFL=5 (RegH2D). Clear W (write) bit for Identify! */
 
     /* put FIS in command table (fis reg h2d) */
     fis_reg_h2d_t *fis = (fis_reg_h2d_t*)ct;
@@ -92,81 +122,245 @@ int ahci_send_identify(int port_no, hba_port_t *port, void *out_512) {
     return 0;
 }
 
-/* READ LBA (LBA28) simplified for single PRDT entry (assumes contiguous physical buffer) */
-int ahci_read_lba(int port_no, uint64_t lba, uint32_t count, void *buf) {
-    hba_port_t *port = port_states[port_no].port;
-    if (!port) {
-        serial("[AHCI] read: port %d not initialized\n", port_no);
-        return -1;
+/* ---- async submission / completion ---- */
+
+/* number of slots set in a PxCI/PxSACT-style mask (no libgcc popcount) */
+static uint32_t slot_count(uint32_t mask) {
+    uint32_t n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+}
+
+/* ST off/on: the HBA drops every outstanding command (PxCI/PxSACT clear) */
+static void port_restart(hba_port_t *port) {
+    port->cmd &= ~(1U << 0);
+    uint32_t timeout = get_uptime_ms() + 500;
+    while ((port->cmd & (1U << 15)) && get_uptime_ms() < timeout) {
+        asm volatile("pause");
     }
-    serial("[AHCI] read: port=%d lba=%llu count=%u\n", port_no, (unsigned long long)lba, count);
+    port->serr = 0xFFFFFFFF;
+    port->is = 0xFFFFFFFF;
+    port->cmd |= (1U << 0);
+}
 
-    int slot = find_cmdslot(port);
-    if (slot < 0) return -2;
-    void *clb = port_states[port_no].clb;
-    void *ct = port_states[port_no].cmd_tables[slot];
-    uint32_t ct_phys = ahci_virt_to_phys(ct);
-    setup_cmd_header(clb, slot, (5<<0), 1, ct_phys); /* Read: Clear W bit */
-    build_prdt_for_buffer(ct, (void*)ahci_virt_to_phys(buf), count * 512);
+int ahci_submit_async(int port_no, int write, uint64_t lba, uint32_t count,
+                      void *buf, ahci_done_fn done, void *ctx) {
+    block_seg_t seg = { buf, count };
+    return ahci_submit_async_sg(port_no, write, lba, &seg, 1, done, ctx);
+}
+
+int ahci_submit_async_sg(int port_no, int write, uint64_t lba,
+                         const block_seg_t *segs, int nsegs,
+                         ahci_done_fn done, void *ctx) {
+    if (port_no < 0 || port_no >= AHCI_MAX_PORTS) return -1;
+    ahci_port_state_t *st = &port_states[port_no];
+    hba_port_t *port = st->port;
+    if (!port) return -1;
+    uint32_t count = 0;
+    for (int i = 0; i < nsegs; i++) count += segs[i].count;
+    uint32_t max = (st->ncq || st->lba48) ? AHCI_MAX_SECTORS_LBA48 : AHCI_MAX_SECTORS_LBA28;
+    if (count == 0) return -4;
+    if (count > max) return AHCI_ETOOBIG;
+    if (max == AHCI_MAX_SECTORS_LBA28 && lba + count > (1ULL << 28)) return -4;
+
+    uint32_t flags = spin_lock_irqsave(&st->lock);
+    uint32_t busy = st->active | port->sact | port->ci;
+    int slot = -1;
+    for (uint32_t i = 0; i < st->depth; i++) {
+        if (!(busy & (1U << i))) { slot = (int)i; break; }
+    }
+    if (slot < 0) {
+        spin_unlock_irqrestore(&st->lock, flags);
+        return AHCI_EBUSY;
+    }
+
+    void *ct = st->cmd_tables[slot];
+    int prdt_len = 0;
+    for (int i = 0; i < nsegs && prdt_len >= 0; i++)
+        prdt_len = prdt_add(((hba_cmd_tbl_t*)ct)->prdt_entry, prdt_len, segs[i].buf, segs[i].count * 512);
+    if (prdt_len < 0) {
+        spin_unlock_irqrestore(&st->lock, flags);
+        return AHCI_ETOOBIG;
+    }
+    setup_cmd_header(st->clb, slot, (write ? (1 << 6) : 0) | (5 << 0), (uint16_t)prdt_len,
+                     vmm_dma_phys(ct));
 
     fis_reg_h2d_t *fis = (fis_reg_h2d_t*)ct;
     mem_zero(fis, sizeof(fis_reg_h2d_t));
     fis->fis_type = FIS_TYPE_REG_H2D;
     fis->c = 1;
-    fis->command = ATA_CMD_READ_DMA;
     fis->lba0 = (uint8_t)(lba & 0xFF);
     fis->lba1 = (uint8_t)((lba >> 8) & 0xFF);
     fis->lba2 = (uint8_t)((lba >> 16) & 0xFF);
-    fis->device = 0x40 | ((uint8_t)((lba >> 24) & 0x0F)); /* LBA mode + Head */
-    fis->countl = (uint8_t)(count & 0xFF);
+    if (st->ncq) {
+        /* FPDMA QUEUED: sector count in FEATURES, tag in COUNT[7:3] */
+        fis->command = write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+        fis->featurel = (uint8_t)(count & 0xFF);
+        fis->featureh = (uint8_t)((count >> 8) & 0xFF);
+        fis->countl = (uint8_t)(slot << 3);
+        fis->lba3 = (uint8_t)((lba >> 24) & 0xFF);
+        fis->lba4 = (uint8_t)((lba >> 32) & 0xFF);
+        fis->lba5 = (uint8_t)((lba >> 40) & 0xFF);
+        fis->device = 0x40;
+    } else if (st->lba48) {
+        /* DMA EXT: 48-bit LBA, 16-bit count */
+        fis->command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        fis->lba3 = (uint8_t)((lba >> 24) & 0xFF);
+        fis->lba4 = (uint8_t)((lba >> 32) & 0xFF);
+        fis->lba5 = (uint8_t)((lba >> 40) & 0xFF);
+        fis->device = 0x40;
+        fis->countl = (uint8_t)(count & 0xFF);
+        fis->counth = (uint8_t)((count >> 8) & 0xFF);
+    } else {
+        fis->command = write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+        fis->device = 0x40 | ((uint8_t)((lba >> 24) & 0x0F)); /* LBA mode + Head */
+        fis->countl = (uint8_t)(count & 0xFF);
+    }
 
-    port->ci = (1U << slot);
+    st->slots[slot].done = done;
+    st->slots[slot].ctx = ctx;
+    st->active |= 1U << slot;
+    uint32_t inflight = slot_count(st->active);
+    if (inflight > st->max_inflight) st->max_inflight = inflight;
 
-    int r = wait_for_cmd_complete(port, slot, 5000);
-    if (r != 0) {
-        serial("[AHCI] read: port %d cmd failed (%d) tfd=0x%08x\n", port_no, r, port->tfd);
-        return -3;
+    TRACE(TR_AHCI_SUBMIT, port_no, slot, lba, count | ((uint32_t)write << 31));
+    asm volatile("" ::: "memory"); /* command table written before the doorbell */
+    if (st->ncq) port->sact = 1U << slot;
+    port->ci = 1U << slot;
+    spin_unlock_irqrestore(&st->lock, flags);
+    return slot;
+}
+
+/* Finished = issued by us and gone from both PxSACT (NCQ) and PxCI.
+   On an error (or abort) every outstanding command fails and the port restarts. */
+static void port_reap(int port_no, int abort) {
+    ahci_port_state_t *st = &port_states[port_no];
+    hba_port_t *port = st->port;
+    if (!port) return;
+
+    ahci_slot_t done[AHCI_MAX_CMDS];
+    int n = 0;
+    int status = 0;
+
+    uint32_t flags = spin_lock_irqsave(&st->lock);
+    if (!st->active) {
+        port->is = port->is;
+        spin_unlock_irqrestore(&st->lock, flags);
+        return;
+    }
+    uint32_t is = port->is;
+    port->is = is; /* write-1-to-clear */
+    uint32_t finished;
+    if (abort || (is & AHCI_PxIS_ERR)) {
+        serial("[AHCI] port %d: %s is=0x%08x tfd=0x%08x serr=0x%08x, failing %u cmds\n",
+               port_no, abort ? "abort" : "error", is, port->tfd, port->serr, slot_count(st->active));
+        finished = st->active;
+        status = -3;
+        TRACE(TR_AHCI_ERROR, port_no, is, port->tfd, port->serr);
+        st->errors++;
+        port_restart(port);
+    } else {
+        finished = st->active & ~(port->sact | port->ci);
+    }
+    st->active &= ~finished;
+    if (finished) TRACE(TR_AHCI_DONE, port_no, finished, status, 0);
+    while (finished) {
+        int slot = __builtin_ctz(finished);
+        finished &= finished - 1;
+        done[n++] = st->slots[slot];
+        st->slots[slot].done = NULL;
+    }
+    st->completed += (uint32_t)n;
+    spin_unlock_irqrestore(&st->lock, flags);
+
+    /* callbacks run unlocked: they may submit the next request */
+    for (int i = 0; i < n; i++) {
+        if (done[i].done) done[i].done(status, done[i].ctx);
     }
-    serial("[AHCI] read: done port=%d lba=%llu count=%u\n", port_no, (unsigned long long)lba, count);
-    return 0;
 }
 
-/* write implementation mirrors read but uses ATA_CMD_WRITE_DMA */
-int ahci_write_lba(int port_no, uint64_t lba, uint32_t count, const void *buf) {
-    hba_port_t *port = port_states[port_no].port;
-    if (!port) {
-        serial("[AHCI] write: port %d not initialized\n", port_no);
-        return -1;
+void ahci_port_complete(int port_no) {
+    port_reap(port_no, 0);
+}
+
+void ahci_poll(void) {
+    for (int i = 0; i < AHCI_MAX_PORTS; i++) {
+        if (port_states[i].port && port_states[i].active) ahci_port_complete(i);
     }
-    serial("[AHCI] write: port=%d lba=%llu count=%u\n", port_no, (unsigned long long)lba, count);
+}
 
-    int slot = find_cmdslot(port);
-    if (slot < 0) return -2;
-    void *clb = port_states[port_no].clb;
-    void *ct = port_states[port_no].cmd_tables[slot];
-    uint32_t ct_phys = ahci_virt_to_phys(ct);
-    setup_cmd_header(clb, slot, (1<<6) | (5<<0), 1, ct_phys); /* Write: Set W bit (bit 6) */
-    /* PRDT must point to non-const buffer — cast away const for DMA */
-    build_prdt_for_buffer(ct, (void*)ahci_virt_to_phys((void*)buf), count * 512);
+/* ---- synchronous wrappers (async submit + polled wait) ---- */
 
-    fis_reg_h2d_t *fis = (fis_reg_h2d_t*)ct;
-    mem_zero(fis, sizeof(fis_reg_h2d_t));
-    fis->fis_type = FIS_TYPE_REG_H2D;
-    fis->c = 1;
-    fis->command = ATA_CMD_WRITE_DMA;
-    fis->lba0 = (uint8_t)(lba & 0xFF);
-    fis->lba1 = (uint8_t)((lba >> 8) & 0xFF);
-    fis->lba2 = (uint8_t)((lba >> 16) & 0xFF);
-    fis->device = 0x40 | ((uint8_t)((lba >> 24) & 0x0F)); /* LBA mode + Head */
-    fis->countl = (uint8_t)(count & 0xFF);
+typedef struct {
+    volatile int done;
+    volatile int status;
+} sync_wait_t;
 
-    port->ci = (1U << slot);
+static void sync_done(int status, void *ctx) {
+    sync_wait_t *w = (sync_wait_t*)ctx;
+    w->status = status;
+    w->done = 1;
+}
 
-    int r = wait_for_cmd_complete(port, slot, 5000);
-    if (r != 0) {
-        serial("[AHCI] write: port %d cmd failed (%d) tfd=0x%08x\n", port_no, r, port->tfd);
+/* Polls instead of sleeping so it also works before interrupts are on;
+   a timeout restarts the port, which fails (and so releases) our slot. */
+static int ahci_rw_sync_one(int port_no, int write, uint64_t lba, uint32_t count, void *buf) {
+    sync_wait_t w = { 0, 0 };
+    uint32_t start = get_uptime_ms();
+    int slot;
+    while ((slot = ahci_submit_async(port_no, write, lba, count, buf, sync_done, &w)) == AHCI_EBUSY) {
+        ahci_port_complete(port_no);
+        if (get_uptime_ms() - start > AHCI_CMD_TIMEOUT_MS) return -2;
+    }
+    if (slot < 0) return slot;
+
+    while (!w.done) {
+        ahci_port_complete(port_no);
+        if (!w.done && get_uptime_ms() - start > AHCI_CMD_TIMEOUT_MS) {
+            serial("[AHCI] %s: port %d timeout lba=%llu\n", write ? "write" : "read",
+                   port_no, (unsigned long long)lba);
+            port_reap(port_no, 1);
+        }
+    }
+    if (w.status != 0) {
+        serial("[AHCI] %s: port %d cmd failed (%d) lba=%llu\n", write ? "write" : "read",
+               port_no, w.status, (unsigned long long)lba);
         return -3;
     }
-    serial("[AHCI] write: done port=%d lba=%llu count=%u\n", port_no, (unsigned long long)lba, count);
     return 0;
 }
+
+/* Split into commands the HBA accepts: at most 65535 sectors with LBA48
+   (256 with LBA28), fewer if the buffer is too scattered for one PRDT
+   ((AHCI_MAX_PRDT - 1) pages always fit, whatever the alignment). */
+static int ahci_rw_sync(int port_no, int write, uint64_t lba, uint32_t count, void *buf) {
+    if (port_no < 0 || port_no >= AHCI_MAX_PORTS || !port_states[port_no].port) {
+        serial("[AHCI] %s: port %d not initialized\n", write ? "write" : "read", port_no);
+        return -1;
+    }
+    ahci_port_state_t *st = &port_states[port_no];
+    uint32_t max = (st->ncq || st->lba48) ? AHCI_MAX_SECTORS_LBA48 : AHCI_MAX_SECTORS_LBA28;
+    uint8_t *p = (uint8_t*)buf;
+    while (count) {
+        uint32_t n = count < max ? count : max;
+        int r = ahci_rw_sync_one(port_no, write, lba, n, p);
+        if (r == AHCI_ETOOBIG && n > (AHCI_MAX_PRDT - 1) * 8) {
+            max = (AHCI_MAX_PRDT - 1) * 8;
+            continue;
+        }
+        if (r != 0) return r;
+        lba += n;
+        p += n * 512;
+        count -= n;
+    }
+    return 0;
+}
+
+int ahci_read_lba(int port_no, uint64_t lba, uint32_t count, void *buf) {
+    return ahci_rw_sync(port_no, 0, lba, count, buf);
+}
+
+int ahci_write_lba(int port_no, uint64_t lba, uint32_t count, const void *buf) {
+    /* PRDT must point to non-const buffer — cast away const for DMA */
+    return ahci_rw_sync(port_no, 1, lba, count, (void*)buf);
+}
@@ -1,41 +1,111 @@
 #include "ahci.h"
+#include "../../memory/pmm.h"
+#include "../../mm/vmm.h"
+#include "../../sync/spinlock.h"
 
-/* 
- * AHCI DMA Pool
- * Static buffer in BSS (guaranteed physically contiguous by bootloader/linker layout in simple kernels).
- * Size: 64KB (enough for 32 ports * (1KB CLB + 256B FB + CTs))
- * Alignment: 4096 to be safe for page boundaries.
+/*
+ * AHCI DMA memory
+ * Physically contiguous blocks for the HBA, taken from the PMM and given back:
+ *  - a page or more: a run of frames straight from pmm_alloc_frames(),
+ *    aligned as asked (command tables, one page per slot)
+ *  - less than a page (command lists, received-FIS areas): power-of-two
+ *    chunks of 128..2048 bytes carved from pool pages, one free list per
+ *    size. A chunk is aligned to its size, so align <= size is free.
+ * Frames are used through the identity map of low memory; a frame the
+ * kernel cannot reach at virt == phys is handed back and the call fails.
  */
-static uint8_t __attribute__((aligned(4096))) ahci_dma_pool[64 * 1024];
-static uint32_t dma_offset = 0;
 
-/* Simple bump allocator with alignment support */
+#define DMA_MIN_SHIFT 7                     /* 128-byte chunks */
+#define DMA_MAX_SHIFT 11                    /* 2 KB chunks */
+#define DMA_ORDERS    (DMA_MAX_SHIFT - DMA_MIN_SHIFT + 1)
+
+typedef struct dma_chunk {
+    struct dma_chunk *next;
+} dma_chunk_t;
+
+static dma_chunk_t *free_chunks[DMA_ORDERS];
+static spinlock_t dma_lock = SPINLOCK_INIT("ahci_dma");
+
+static void dma_zero(void *ptr, size_t size) {
+    uint32_t *p = (uint32_t*)ptr; /* blocks are at least 128-byte aligned */
+    for (size_t i = 0; i < size / 4; i++) p[i] = 0;
+}
+
+/* count frames, phys == virt; 0 if the PMM has none or they are not mapped */
+static uint32_t dma_frames(uint32_t count, uint32_t align) {
+    uint32_t phys = (uint32_t)(uintptr_t)pmm_alloc_frames(count, align);
+    if (!phys) return 0;
+    uint32_t last = phys + (count - 1) * PAGE_SIZE;
+    if (vmm_virt_to_phys((void*)(uintptr_t)phys) != phys ||
+        vmm_virt_to_phys((void*)(uintptr_t)last) != last) {
+        pmm_free_frames(phys, count);
+        return 0;
+    }
+    return phys;
+}
+
+static int chunk_order(size_t size, size_t align) {
+    size_t want = size > align ? size : align;
+    for (int o = 0; o < DMA_ORDERS; o++) {
+        if (want <= (1U << (DMA_MIN_SHIFT + o))) return o;
+    }
+    return -1;
+}
+
 void* ahci_dma_alloc(size_t size, size_t align) {
-    uint32_t start = (uint32_t)&ahci_dma_pool[dma_offset];
-    
-    /* Calculate aligned address */
-    uint32_t aligned = (start + align - 1) & ~(align - 1);
-    uint32_t padding = aligned - start;
-    
-    if (dma_offset + padding + size > sizeof(ahci_dma_pool)) {
-        serial("[AHCI] DMA Allocator OOM! Requested %d bytes\n", size);
+    if (size == 0) return NULL;
+    if (align == 0) align = 1;
+    void *p = NULL;
+    int o = chunk_order(size, align);
+
+    if (o < 0) {
+        uint32_t pages = (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE);
+        uint32_t phys = dma_frames(pages, (uint32_t)align);
+        if (phys) p = (void*)(uintptr_t)phys;
+    } else {
+        uint32_t flags = spin_lock_irqsave(&dma_lock);
+        if (!free_chunks[o]) {
+            spin_unlock_irqrestore(&dma_lock, flags);
+            uint32_t phys = dma_frames(1, 0);
+            flags = spin_lock_irqsave(&dma_lock);
+            if (phys) {
+                /* split the new pool page into chunks of this order */
+                uint32_t csize = 1U << (DMA_MIN_SHIFT + o);
+                for (uint32_t off = PAGE_SIZE; off; off -= csize) {
+                    dma_chunk_t *c = (dma_chunk_t*)(uintptr_t)(phys + off - csize);
+                    c->next = free_chunks[o];
+                    free_chunks[o] = c;
+                }
+            }
+        }
+        if (free_chunks[o]) {
+            p = free_chunks[o];
+            free_chunks[o] = free_chunks[o]->next;
+        }
+        spin_unlock_irqrestore(&dma_lock, flags);
+    }
+
+    if (!p) {
+        serial("[AHCI] DMA alloc failed: %u bytes (align %u)\n", (uint32_t)size, (uint32_t)align);
         return NULL;
     }
-    
-    dma_offset += padding + size;
-    
-    /* Zero the memory */
-    uint8_t* p = (uint8_t*)aligned;
-    for(size_t i=0; i<size; i++) p[i] = 0;
-    
-    return (void*)aligned;
+    dma_zero(p, o < 0 ? size : (1U << (DMA_MIN_SHIFT + o)));
+    return p;
 }
 
-uint32_t ahci_virt_to_phys(void* v) {
-    uint32_t virt = (uint32_t)v;
-    /* Kernel mapped at 0xC0000000 -> Phys 0x00100000 */
-    if (virt >= 0xC0000000) {
-        return virt - 0xC0000000 + 0x00100000;
+/* size and align must be the ones given to ahci_dma_alloc */
+void ahci_dma_free(void *p, size_t size, size_t align) {
+    if (!p || size == 0) return;
+    if (align == 0) align = 1;
+    int o = chunk_order(size, align);
+    if (o < 0) {
+        pmm_free_frames((uint32_t)(uintptr_t)p, (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE));
+        return;
     }
-    return virt; /* Identity otherwise */
-}
\ No newline at end of file
+    /* pool pages stay in the pool: the next port init reuses them */
+    uint32_t flags = spin_lock_irqsave(&dma_lock);
+    dma_chunk_t *c = (dma_chunk_t*)p;
+    c->next = free_chunks[o];
+    free_chunks[o] = c;
+    spin_unlock_irqrestore(&dma_lock, flags);
+}
@@ -4,7 +4,6 @@
 #include "../../string.h"
 
 extern int ahci_port_init(int port_no, hba_port_t *port);
-extern void* ahci_get_abar(void);
 
 /* Block device wrappers */
 static int ahci_block_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buf) {
@@ -17,6 +16,18 @@ static int ahci_block_write(block_device_t *dev, uint64_t lba, uint32_t count, c
     return ahci_write_lba(port, lba, count, buf);
 }
 
+/* async path, driven by io_sched: one NCQ/DMA command per call */
+static int ahci_block_submit(block_device_t *dev, int write, uint64_t lba,
+                             const block_seg_t *segs, int nsegs, block_done_fn done, void *ctx) {
+    int port = (int)(uintptr_t)dev->priv;
+    int slot = ahci_submit_async_sg(port, write, lba, segs, nsegs, done, ctx);
+    return slot < 0 ? slot : 0;
+}
+
+static void ahci_block_poll(block_device_t *dev) {
+    ahci_port_complete((int)(uintptr_t)dev->priv);
+}
+
 int ahci_init(void) {
     serial("[AHCI] init start\n");
 
@@ -63,6 +74,8 @@ int ahci_init(void) {
                 bd->sector_size = 512;
                 bd->read = ahci_block_read;
                 bd->write = ahci_block_write;
+                bd->submit = ahci_block_submit;
+                bd->poll = ahci_block_poll;
                 bd->priv = (void*)(uintptr_t)i;
                 block_register(bd);
                 } else {
@@ -71,5 +84,6 @@ int ahci_init(void) {
             }
         }
     }
+    if (ports_found > 0) ahci_irq_init();
     return ports_found;
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "ahci.h"
+#include "../../interrupts/irq.h"
+
+/* AHCI interrupt: HBA IS says which ports raised PxIS; completions are
+   found by diffing the slots we issued against PxSACT/PxCI (ahci_cmd.c).
+   The line is also polled from io_sched_poll(), so a lost edge only
+   delays completion. */
+
+static hba_mem_t *irq_abar = NULL;
+
+static void ahci_irq_handler(registers_t *regs) {
+    (void)regs;
+    if (!irq_abar) return;
+    uint32_t is = irq_abar->is;
+    for (int i = 0; i < AHCI_MAX_PORTS; i++) {
+        if ((is & (1U << i)) && port_states[i].port) ahci_port_complete(i);
+    }
+    irq_abar->is = is; /* after PxIS, per spec */
+}
+
+int ahci_irq_init(void) {
+    irq_abar = ahci_get_abar();
+    if (!irq_abar) return -1;
+
+    int irq = ahci_pci_irq_line();
+    if (irq <= 0 || irq > 15) {
+        serial("[AHCI] irq: line %d not routed, completions are polled\n", irq);
+        return -2;
+    }
+    irq_install_handler(irq, ahci_irq_handler);
+    irq_abar->is = 0xFFFFFFFF;
+    irq_abar->ghc |= AHCI_GHC_IE;
+    serial("[AHCI] irq: IRQ %d, interrupts enabled\n", irq);
+    return 0;
+}
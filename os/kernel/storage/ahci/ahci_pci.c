@@ -48,3 +48,8 @@ int ahci_pci_probe_and_map(void) {
 hba_mem_t *ahci_get_abar(void) {
     return abar;
 }
+
+/* PCI interrupt line of the controller (0xFF: not routed) */
+int ahci_pci_irq_line(void) {
+    return pci_read_irq_line(controller_bus, controller_dev, controller_func);
+}
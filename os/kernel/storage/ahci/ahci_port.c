@@ -10,9 +10,26 @@ extern int ahci_send_identify(int port_no, hba_port_t *port, void *out_512);
 
 ahci_port_state_t port_states[AHCI_MAX_PORTS];
 
+/* give the CLB, FB and command tables of a port back to the DMA pool */
+static void port_dma_release(ahci_port_state_t *st) {
+    ahci_dma_free(st->clb, 1024, 1024);
+    ahci_dma_free(st->fb, 256, 256);
+    for (int s = 0; s < AHCI_MAX_CMDS; ++s) {
+        ahci_dma_free(st->cmd_tables[s], AHCI_CT_SIZE, 128);
+        st->cmd_tables[s] = NULL;
+    }
+    st->clb = NULL;
+    st->fb = NULL;
+}
+
 int ahci_port_init(int port_no, hba_port_t *port) {
     serial("[AHCI] port %d: init start\n", port_no);
     port_states[port_no].port = port;
+    spin_init(&port_states[port_no].lock, "ahci_port");
+    port_states[port_no].active = 0;
+    port_states[port_no].depth = 1;
+    port_states[port_no].ncq = 0;
+    port_states[port_no].lba48 = 0;
     
     /* 1. Stop Command Engine */
     port->cmd &= ~(1 << 0); /* ST = 0 */
@@ -28,6 +45,9 @@ int ahci_port_init(int port_no, hba_port_t *port) {
         // Try to continue anyway, maybe it's stuck but we can rebase
     }
 
+    /* re-init: the engine is stopped, the old DMA areas can go */
+    port_dma_release(&port_states[port_no]);
+
     /* 3. Allocate CLB (Command List Base) - 1024 bytes, 1024 align */
     void *clb = ahci_dma_alloc(1024, 1024);
     if (!clb) {
@@ -37,27 +57,29 @@ int ahci_port_init(int port_no, hba_port_t *port) {
     port_states[port_no].clb = clb;
     
     /* Set Physical Address in Register */
-    port->clb = ahci_virt_to_phys(clb);
+    port->clb = vmm_dma_phys(clb);
     port->clbu = 0;
 
     /* 4. Allocate FB (FIS Base) - 256 bytes, 256 align */
     void *fb = ahci_dma_alloc(256, 256);
     if (!fb) {
         serial("[AHCI] port %d: DMA alloc failed for FB\n", port_no);
+        port_dma_release(&port_states[port_no]);
         return -2;
     }
     port_states[port_no].fb = fb;
     
     /* Set Physical Address in Register */
-    port->fb = ahci_virt_to_phys(fb);
+    port->fb = vmm_dma_phys(fb);
     port->fbu = 0;
 
     /* 5. Allocate Command Tables for each slot (32 slots) */
-    /* Each CT is 128-256 bytes depending on PRDT count. We use 256B, align 128 */
+    /* Each CT is 0x80 bytes of FIS/ATAPI area + AHCI_MAX_PRDT entries: one page */
     for (int s = 0; s < AHCI_MAX_CMDS; ++s) {
-        void *ct = ahci_dma_alloc(256, 128);
+        void *ct = ahci_dma_alloc(AHCI_CT_SIZE, 128);
         if (!ct) {
             serial("[AHCI] port %d: DMA alloc failed for CT %d\n", port_no, s);
+            port_dma_release(&port_states[port_no]);
             return -3;
         }
         port_states[port_no].cmd_tables[s] = ct;
@@ -90,7 +112,7 @@ int ahci_port_init(int port_no, hba_port_t *port) {
         /* Swap bytes for model string (ATA strings are big-endian words) */
         for (int i = 0; i < 40; i+=2) { char tmp = model[i]; model[i] = model[i+1]; model[i+1] = tmp; }
         serial("[AHCI] port %d: identified model: %.40s\n", port_no, model);
-        serial("[AHCI] port %d: LBA48 support: %s\n", port_no, (ident[167] & (1<<10)) ? "Yes" : "No");
+        serial("[AHCI] port %d: LBA48 support: %s\n", port_no, (((uint16_t*)ident)[83] & (1<<10)) ? "Yes" : "No");
 
         /* Parse Sector Count */
         uint16_t *id_words = (uint16_t*)ident;
@@ -100,10 +122,26 @@ int ahci_port_init(int port_no, hba_port_t *port) {
         
         if (id_words[83] & (1<<10)) { /* LBA48 supported */
             port_states[port_no].sector_count = lba48;
+            port_states[port_no].lba48 = 1;
         } else {
             port_states[port_no].sector_count = lba28;
         }
         serial("[AHCI] port %d: capacity %llu sectors\n", port_no, (unsigned long long)port_states[port_no].sector_count);
+
+        /* Queue depth: NCQ when both HBA (CAP.SNCQ) and drive (word 76 bit 8)
+           support it, limited by the drive (word 75) and the HBA slots (CAP.NCS) */
+        hba_mem_t *abar = ahci_get_abar();
+        uint32_t cap = abar ? abar->cap : 0;
+        uint32_t hba_slots = ((cap >> 8) & 0x1F) + 1;
+        if ((cap & AHCI_CAP_SNCQ) && (id_words[76] & (1 << 8))) {
+            uint32_t qd = (uint32_t)(id_words[75] & 0x1F) + 1;
+            port_states[port_no].ncq = 1;
+            port_states[port_no].depth = qd < hba_slots ? qd : hba_slots;
+        } else {
+            port_states[port_no].depth = hba_slots;
+        }
+        serial("[AHCI] port %d: NCQ %s, queue depth %u\n", port_no,
+               port_states[port_no].ncq ? "on" : "off", port_states[port_no].depth);
     }
 
     serial("[AHCI] port %d: init done\n", port_no);
@@ -1,17 +1,47 @@
-/* kernel/storage/ata.c */
+/* kernel/storage/ata.c
+   Legacy ATA (IDE) PIO driver.
+   - both channels, master and slave; present disks register as block
+     devices ata0..ata3 (primary master/slave, secondary master/slave)
+   - READ/WRITE MULTIPLE: the drive moves a DRQ block of several sectors
+     per interrupt (SET MULTIPLE MODE to its maximum), copied with rep
+     insw/outsw; drives without it fall back to one sector per block
+   - LBA48 (EXT) commands for sectors past the 28-bit limit
+   - completion is IRQ driven (IRQ14/15): a waiting task sleeps, other
+     contexts halt; with interrupts off the status register is polled.
+     A channel whose interrupt never arrives drops back to polling.
+   - bus-master DMA through the PCI IDE controller (BAR4, one PRD table
+     per channel) for drives that do DMA: block I/O then goes through
+     submit/poll like AHCI, and completes from the IRQ handler
+   One command per channel at a time: the channel is claimed for a whole
+   transfer, so master and slave share it like the hardware does. */
 #include "ata.h"
 #include <stdint.h>
 #include <stddef.h>
-#include "../arch/i386/io.h"        /* inb/outb/inw/outw */
+#include "block.h"
+#include "../arch/i386/io.h"        /* inb/outb/inw/outw/insw/outsw */
 #include "../terminal.h"  /* terminal_writestring() for simple debug */
+#include "../interrupts/irq.h"
+#include "../hardware/apic.h"
+#include "../time/timer.h"
+#include "../sched/pcb.h"
+#include "../sched/scheduler.h"
+#include "../debug/trace.h"
+#include "../hardware/pci.h"
+#include "../memory/pmm.h"
+#include "../mm/vmm.h"
+#include "../mm/paging.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Primary bus */
-#define ATA_PRIMARY_IO   0x1F0
-#define ATA_PRIMARY_CTRL 0x3F6
+extern void serial(const char *fmt, ...);
+
+/* channel bases */
+#define ATA_PRIMARY_IO     0x1F0
+#define ATA_PRIMARY_CTRL   0x3F6
+#define ATA_SECONDARY_IO   0x170
+#define ATA_SECONDARY_CTRL 0x376
 
 /* registers (offsets from IO base) */
 #define ATA_REG_DATA       0x00
@@ -27,75 +57,564 @@ extern "C" {
 
 /* control registers (from CONTROL base) */
 #define ATA_CTRL_ALTSTATUS 0x00
-#define ATA_CTRL_DEVICECTL 0x02
+#define ATA_CTRL_DEVICECTL 0x00   /* same port: read = alt status, write = device control */
+#define ATA_DC_NIEN        0x02   /* interrupts off */
+#define ATA_DC_SRST        0x04
 
 /* commands */
-#define ATA_CMD_IDENTIFY     0xEC
-#define ATA_CMD_READ_PIO     0x20
-#define ATA_CMD_WRITE_PIO    0x30
-#define ATA_CMD_CACHE_FLUSH  0xE7
+#define ATA_CMD_IDENTIFY         0xEC
+#define ATA_CMD_READ_PIO         0x20
+#define ATA_CMD_READ_PIO_EXT     0x24
+#define ATA_CMD_WRITE_PIO        0x30
+#define ATA_CMD_WRITE_PIO_EXT    0x34
+#define ATA_CMD_READ_MULTIPLE    0xC4
+#define ATA_CMD_READ_MULT_EXT    0x29
+#define ATA_CMD_WRITE_MULTIPLE   0xC5
+#define ATA_CMD_WRITE_MULT_EXT   0x39
+#define ATA_CMD_SET_MULTIPLE     0xC6
+#define ATA_CMD_CACHE_FLUSH      0xE7
+#define ATA_CMD_CACHE_FLUSH_EXT  0xEA
+#define ATA_CMD_READ_DMA         0xC8
+#define ATA_CMD_READ_DMA_EXT     0x25
+#define ATA_CMD_WRITE_DMA        0xCA
+#define ATA_CMD_WRITE_DMA_EXT    0x35
+#define ATA_CMD_SET_FEATURES     0xEF
+#define ATA_FEAT_XFER_MODE       0x03
+
+/* bus-master IDE registers (from the channel's BAR4 base) */
+#define BM_REG_CMD      0x00
+#define BM_REG_STATUS   0x02
+#define BM_REG_PRDT     0x04
+#define BM_CMD_START    0x01
+#define BM_CMD_READ     0x08    /* device -> memory */
+#define BM_ST_ACTIVE    0x01
+#define BM_ST_ERR       0x02    /* write 1 to clear */
+#define BM_ST_IRQ       0x04    /* write 1 to clear */
+#define BM_ST_DRV_DMA   0x60    /* "drive 0/1 can DMA" (software bits) */
+
+/* PRD entry: a physically contiguous piece that does not cross 64 KB */
+typedef struct {
+    uint32_t phys;
+    uint16_t bytes;             /* 0 = 64 KB */
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+#define PRD_EOT         0x8000
+#define ATA_PRD_MAX     (PAGE_SIZE / sizeof(ata_prd_t))
 
 /* status bits */
 #define ATA_SR_BSY  0x80
 #define ATA_SR_DRDY 0x40
+#define ATA_SR_DF   0x20
 #define ATA_SR_DRQ  0x08
 #define ATA_SR_ERR  0x01
 
+#define ATA_TIMEOUT_MS  5000
+#define ATA_POLL_SPINS  1000000
+
+typedef struct {
+    uint16_t io;
+    uint16_t ctrl;
+    uint8_t irq;
+    uint8_t irq_ok;           /* handler installed and interrupts seen to arrive */
+    volatile int claimed;     /* one transfer at a time */
+    volatile int irq_done;    /* INTRQ since the last reset of the flag */
+    volatile int wake;        /* waiter: interrupt or timeout */
+    volatile uint8_t irq_status;
+    int tid;                  /* sleeping task, -1 if none */
+    uint16_t bmide;           /* bus-master registers, 0 without DMA */
+    ata_prd_t *prdt;          /* one page, virt == phys */
+    volatile int dma_active;  /* DMA command started, not yet finished */
+    block_done_fn dma_done;   /* async completion; NULL: a sync waiter */
+    void *dma_ctx;
+    int dma_status;
+    uint32_t dma_start_ms;
+    struct ata_dev *dma_dev;
+} ata_chan_t;
+
+typedef struct ata_dev {
+    ata_chan_t *ch;
+    uint8_t slave;
+    uint8_t present;
+    uint8_t lba48;
+    uint16_t multiple;        /* sectors per DRQ block (1 = plain READ/WRITE SECTORS) */
+    uint8_t dma;              /* bus-master DMA usable */
+    uint8_t pio;              /* DMA switched off by ata_set_pio */
+    uint8_t xfer_mode;        /* SET FEATURES transfer mode (0x40|udma, 0x20|mdma) */
+    uint64_t sectors;
+    block_device_t bd;
+} ata_dev_t;
+
+static ata_chan_t chans[2] = {
+    { .io = ATA_PRIMARY_IO, .ctrl = ATA_PRIMARY_CTRL, .irq = 14, .tid = -1 },
+    { .io = ATA_SECONDARY_IO, .ctrl = ATA_SECONDARY_CTRL, .irq = 15, .tid = -1 },
+};
+static ata_dev_t devs[ATA_MAX_DEVICES];
+
 /* global MBR write protection flag (default disabled) */
 static int g_allow_mbr_write = 0;
 static int g_skip_cache_flush = 0;
 
 /* small io wait (400ns) - 4 reads of alt status */
-static inline void ata_io_wait(void)
+static inline void chan_io_wait(ata_chan_t *c)
+{
+    (void)inb(c->ctrl + ATA_CTRL_ALTSTATUS);
+    (void)inb(c->ctrl + ATA_CTRL_ALTSTATUS);
+    (void)inb(c->ctrl + ATA_CTRL_ALTSTATUS);
+    (void)inb(c->ctrl + ATA_CTRL_ALTSTATUS);
+}
+
+static inline uint8_t chan_altstatus(ata_chan_t *c)
 {
-    (void)inb(ATA_PRIMARY_CTRL + ATA_CTRL_ALTSTATUS);
-    (void)inb(ATA_PRIMARY_CTRL + ATA_CTRL_ALTSTATUS);
-    (void)inb(ATA_PRIMARY_CTRL + ATA_CTRL_ALTSTATUS);
-    (void)inb(ATA_PRIMARY_CTRL + ATA_CTRL_ALTSTATUS);
+    return inb(c->ctrl + ATA_CTRL_ALTSTATUS);
 }
 
-/* helper: read status */
-static inline uint8_t ata_read_status(void)
+static inline int irqs_enabled(void)
 {
-    return inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    uint32_t fl;
+    asm volatile("pushfl\n\tpopl %0" : "=r"(fl));
+    return (fl & 0x200) != 0;
 }
 
-/* select primary master (0xA0) or slave (0xB0). we always use master (0xA0). */
-static inline void ata_select_master(void)
+static void chan_dma_poll(ata_chan_t *c);
+
+static void chan_claim(ata_chan_t *c)
 {
-    outb(ATA_PRIMARY_IO + ATA_REG_HDDEVSEL, 0xA0);
-    ata_io_wait();
+    while (__atomic_test_and_set(&c->claimed, __ATOMIC_ACQUIRE)) {
+        /* an async DMA command holds it: with interrupts off, or no working
+           IRQ line, only polling ends it */
+        if (!irqs_enabled() || !c->irq_ok) chan_dma_poll(c);
+        asm volatile("pause");
+    }
 }
 
-/* wait until BSY cleared, return last status */
-static uint8_t ata_wait_bsy_clear(void)
+static void chan_release(ata_chan_t *c)
 {
-    uint8_t status = ata_read_status();
-    for (int i = 0; i < 100000; i++) {
+    __atomic_clear(&c->claimed, __ATOMIC_RELEASE);
+}
+
+/* wait until BSY cleared; last status, or -1 on timeout */
+static int chan_wait_bsy_clear(ata_chan_t *c)
+{
+    uint8_t status = chan_altstatus(c);
+    for (int i = 0; i < ATA_POLL_SPINS; i++) {
         if (!(status & ATA_SR_BSY))
             return status;
-        status = ata_read_status();
+        asm volatile("pause");
+        status = chan_altstatus(c);
+    }
+    return -1;
+}
+
+/* after BSY: wait for DRQ (data phase) or an error */
+static int chan_wait_drq(ata_chan_t *c)
+{
+    int status = chan_wait_bsy_clear(c);
+    for (int i = 0; status >= 0 && i < ATA_POLL_SPINS; i++) {
+        if (status & (ATA_SR_ERR | ATA_SR_DF | ATA_SR_DRQ))
+            return status;
+        status = chan_altstatus(c);
+    }
+    return -1;
+}
+
+/* ---- interrupts ---- */
+
+static void chan_dma_finish(ata_chan_t *c, int timed_out);
+
+static void chan_irq(ata_chan_t *c)
+{
+    if (__atomic_load_n(&c->dma_active, __ATOMIC_ACQUIRE)) {
+        /* end of a DMA command; an async one completes right here */
+        int async = c->dma_done != 0;
+        chan_dma_finish(c, 0);
+        if (async) return;
+    } else {
+        c->irq_status = inb(c->io + ATA_REG_STATUS); /* reading STATUS acks INTRQ */
+    }
+    c->irq_done = 1;
+    c->wake = 1;
+    if (c->tid >= 0) scheduler_wake(c->tid, SCHED_BOOST_IO);
+}
+
+static void ata_irq_primary(registers_t *regs)
+{
+    (void)regs;
+    chan_irq(&chans[0]);
+}
+
+static void ata_irq_secondary(registers_t *regs)
+{
+    (void)regs;
+    chan_irq(&chans[1]);
+}
+
+static void chan_timeout(void *arg)
+{
+    ata_chan_t *c = (ata_chan_t*)arg;
+    c->wake = 1;
+    if (c->tid >= 0) scheduler_wake(c->tid, 0);
+}
+
+/* Wait for the interrupt that ends the current phase (c->irq_done was
+   cleared before the phase started); returns the status, -1 on timeout.
+   Polls when interrupts cannot arrive. */
+static int chan_wait_irq(ata_chan_t *c)
+{
+    if (!c->irq_ok || !irqs_enabled())
+        return chan_wait_bsy_clear(c);
+
+    pcb_t *cur = pcb_get_current();
+    ktimer_t t;
+    ktimer_init(&t, chan_timeout, c);
+    c->wake = c->irq_done;
+    c->tid = cur ? (int)cur->tid : -1;
+    if (ktimer_arm(&t, timer_now_ns() + (uint64_t)ATA_TIMEOUT_MS * 1000000u) != 0) {
+        c->tid = -1;
+        return chan_wait_bsy_clear(c);
+    }
+
+    /* scheduled task: sleep, the CPU runs others; else halt */
+    while (!c->wake) {
+        if (scheduler_block_until(&c->wake) != 0) {
+            c->tid = -1;
+            asm volatile("cli");
+            while (!c->wake) asm volatile("sti\n\thlt\n\tcli");
+            asm volatile("sti");
+        }
+    }
+    ktimer_cancel(&t);
+    c->tid = -1;
+
+    if (c->irq_done)
+        return c->irq_status;
+
+    /* no interrupt: if the drive is done anyway, the line is not routed */
+    int status = chan_altstatus(c);
+    if (status & ATA_SR_BSY)
+        return -1;
+    serial("[ATA] channel 0x%x: IRQ %u never arrived, polling from now on\n", c->io, c->irq);
+    c->irq_ok = 0;
+    return inb(c->io + ATA_REG_STATUS);
+}
+
+/* ---- commands ---- */
+
+static void dev_select(ata_dev_t *d, uint8_t bits)
+{
+    outb(d->ch->io + ATA_REG_HDDEVSEL, (uint8_t)(bits | (d->slave << 4)));
+    chan_io_wait(d->ch);
+}
+
+/* Program the task file and issue cmd; the LBA48 form writes the high
+   bytes first (the registers are two-deep FIFOs) */
+static int dev_issue(ata_dev_t *d, uint8_t cmd, uint8_t features, uint64_t lba,
+                     uint32_t count, int ext)
+{
+    ata_chan_t *c = d->ch;
+    if (chan_wait_bsy_clear(c) < 0)
+        return -1;
+    if (ext) {
+        dev_select(d, 0x40);
+        outb(c->io + ATA_REG_FEATURES, 0);
+        outb(c->io + ATA_REG_SECCOUNT0, (uint8_t)(count >> 8));
+        outb(c->io + ATA_REG_LBA0, (uint8_t)(lba >> 24));
+        outb(c->io + ATA_REG_LBA1, (uint8_t)(lba >> 32));
+        outb(c->io + ATA_REG_LBA2, (uint8_t)(lba >> 40));
+    } else {
+        dev_select(d, (uint8_t)(0xE0 | ((lba >> 24) & 0x0F)));
+    }
+    outb(c->io + ATA_REG_FEATURES, features);
+    outb(c->io + ATA_REG_SECCOUNT0, (uint8_t)count); /* 0 = 256 */
+    outb(c->io + ATA_REG_LBA0, (uint8_t)lba);
+    outb(c->io + ATA_REG_LBA1, (uint8_t)(lba >> 8));
+    outb(c->io + ATA_REG_LBA2, (uint8_t)(lba >> 16));
+    c->irq_done = 0;
+    outb(c->io + ATA_REG_COMMAND, cmd);
+    TRACE(TR_ATA_CMD, d - devs, cmd, lba, count);
+    return 0;
+}
+
+static int dev_error(ata_dev_t *d, int status)
+{
+    uint8_t err = inb(d->ch->io + ATA_REG_ERROR);
+    TRACE(TR_ATA_ERROR, d - devs, status, err, 0);
+    serial("[ATA] ata%d: error status=0x%x err=0x%x\n", (int)(d - devs), status & 0xFF, err);
+    return status < 0 ? -2 : -3;
+}
+
+/* after a write: empty the drive's write cache, unless switched off */
+static int dev_flush(ata_dev_t *d)
+{
+    if (g_skip_cache_flush)
+        return 0;
+    dev_issue(d, d->lba48 ? ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH, 0, 0, 0, 0);
+    int status = chan_wait_irq(d->ch);
+    if (status < 0 || (status & ATA_SR_ERR)) {
+        dev_error(d, status);
+        return -1;
+    }
+    return 0;
+}
+
+/* non-data command, polled (probe and reset) */
+static int dev_cmd_nodata(ata_dev_t *d, uint8_t cmd, uint8_t features, uint32_t count)
+{
+    if (dev_issue(d, cmd, features, 0, count, 0) != 0)
+        return -1;
+    int status = chan_wait_bsy_clear(d->ch);
+    return (status < 0 || (status & ATA_SR_ERR)) ? -1 : 0;
+}
+
+/* one command of at most ATA_MAX_SECTORS, channel claimed */
+static int dev_rw_one(ata_dev_t *d, int write, uint64_t lba, uint32_t count, uint8_t *buf)
+{
+    ata_chan_t *c = d->ch;
+    int ext = (lba + count > 0x0FFFFFFF);
+    uint8_t cmd;
+    if (d->multiple > 1)
+        cmd = write ? (ext ? ATA_CMD_WRITE_MULT_EXT : ATA_CMD_WRITE_MULTIPLE)
+                    : (ext ? ATA_CMD_READ_MULT_EXT : ATA_CMD_READ_MULTIPLE);
+    else
+        cmd = write ? (ext ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_WRITE_PIO)
+                    : (ext ? ATA_CMD_READ_PIO_EXT : ATA_CMD_READ_PIO);
+    if (dev_issue(d, cmd, 0, lba, count, ext) != 0)
+        return dev_error(d, -1);
+
+    /* reads: an interrupt announces every DRQ block; writes: the first
+       block goes out as soon as DRQ is up, then each interrupt asks for
+       the next one, and a last one reports completion */
+    int status = write ? chan_wait_drq(c) : chan_wait_irq(c);
+    while (count) {
+        uint32_t n = count < d->multiple ? count : d->multiple;
+        if (status < 0 || (status & (ATA_SR_ERR | ATA_SR_DF)) || !(status & ATA_SR_DRQ))
+            return dev_error(d, status);
+        c->irq_done = 0;
+        if (write)
+            outsw(c->io + ATA_REG_DATA, buf, n * 256);
+        else
+            insw(c->io + ATA_REG_DATA, buf, n * 256);
+        buf += n * 512;
+        count -= n;
+        if (count || write)
+            status = chan_wait_irq(c);
+    }
+    if (write) {
+        if (status < 0 || (status & (ATA_SR_ERR | ATA_SR_DF)))
+            return dev_error(d, status);
+        if (dev_flush(d) != 0)
+            return -3;
+    } else {
+        status = chan_altstatus(c);
+        if (status & (ATA_SR_ERR | ATA_SR_DF))
+            return dev_error(d, status);
+    }
+    TRACE(TR_ATA_DONE, d - devs, status, 0, 0);
+    return 0;
+}
+
+/* ---- bus-master DMA ---- */
+
+static void chan_reset(ata_chan_t *c);
+
+/* PRD table for segs, one entry per page piece (so no entry crosses
+   64 KB); number of entries, -1 for an odd address or a full table */
+static int chan_build_prdt(ata_chan_t *c, const block_seg_t *segs, int nsegs)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < nsegs; i++) {
+        uintptr_t v = (uintptr_t)segs[i].buf;
+        uint32_t left = segs[i].count * 512;
+        if (v & 1)
+            return -1;
+        while (left) {
+            uint32_t piece = PAGE_SIZE - (v & (PAGE_SIZE - 1));
+            if (piece > left) piece = left;
+            if (n >= ATA_PRD_MAX)
+                return -1;
+            c->prdt[n].phys = vmm_dma_phys((void*)v);
+            c->prdt[n].bytes = (uint16_t)piece;
+            c->prdt[n].flags = 0;
+            n++;
+            v += piece;
+            left -= piece;
+        }
+    }
+    if (!n)
+        return -1;
+    c->prdt[n - 1].flags = PRD_EOT;
+    return (int)n;
+}
+
+/* Start a DMA command on a claimed channel: PRD table, ATA command, then
+   the engine. done == NULL: the caller waits and reads c->dma_status.
+   -1 if the buffers cannot be described to the controller (use PIO). */
+static int chan_dma_start(ata_dev_t *d, int write, uint64_t lba,
+                          const block_seg_t *segs, int nsegs, block_done_fn done, void *ctx)
+{
+    ata_chan_t *c = d->ch;
+    uint32_t count = 0;
+    for (int i = 0; i < nsegs; i++) count += segs[i].count;
+    /* past 256 sectors only the EXT commands can count; the PRD table
+       bounds the rest (2 MB of pages) */
+    int ext = (lba + count > 0x0FFFFFFF) || count > ATA_MAX_SECTORS;
+    if (count == 0 || (ext && !d->lba48) || chan_build_prdt(c, segs, nsegs) < 0)
+        return -1;
+
+    uint8_t dir = write ? 0 : BM_CMD_READ;
+    outb(c->bmide + BM_REG_CMD, 0);
+    outl(c->bmide + BM_REG_PRDT, vmm_dma_phys(c->prdt));
+    outb(c->bmide + BM_REG_CMD, dir);
+    outb(c->bmide + BM_REG_STATUS,
+         (inb(c->bmide + BM_REG_STATUS) & BM_ST_DRV_DMA) | BM_ST_ERR | BM_ST_IRQ);
+
+    c->dma_done = done;
+    c->dma_ctx = ctx;
+    c->dma_dev = d;
+    c->dma_status = 0;
+    c->dma_start_ms = timer_uptime_ms();
+    uint8_t cmd = write ? (ext ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA)
+                        : (ext ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+    if (dev_issue(d, cmd, 0, lba, count, ext) != 0)
+        return dev_error(d, -1);
+    /* the drive cannot finish before the engine runs */
+    __atomic_store_n(&c->dma_active, 1, __ATOMIC_RELEASE);
+    outb(c->bmide + BM_REG_CMD, dir | BM_CMD_START);
+    return 0;
+}
+
+/* Stop the engine and collect the result. Exactly one caller (IRQ, poll
+   or the sync waiter) gets here per command; an async command releases
+   the channel and runs its callback. */
+static void chan_dma_finish(ata_chan_t *c, int timed_out)
+{
+    if (!__atomic_exchange_n(&c->dma_active, 0, __ATOMIC_ACQ_REL))
+        return;
+    uint8_t bm = inb(c->bmide + BM_REG_STATUS);
+    outb(c->bmide + BM_REG_CMD, 0);
+    uint8_t status = inb(c->io + ATA_REG_STATUS); /* acks INTRQ */
+    outb(c->bmide + BM_REG_STATUS, (bm & BM_ST_DRV_DMA) | BM_ST_ERR | BM_ST_IRQ);
+    c->irq_status = status;
+
+    ata_dev_t *d = c->dma_dev;
+    int r = 0;
+    if (timed_out || (bm & BM_ST_ERR) || (status & (ATA_SR_BSY | ATA_SR_ERR | ATA_SR_DF))) {
+        r = dev_error(d, timed_out ? -1 : status);
+        if (timed_out || (status & ATA_SR_BSY))
+            chan_reset(c);
+    } else {
+        TRACE(TR_ATA_DONE, d - devs, status, 0, 0);
     }
-    return status;
+
+    block_done_fn done = c->dma_done;
+    if (!done) {
+        c->dma_status = r;
+        return;
+    }
+    void *ctx = c->dma_ctx;
+    c->dma_done = 0;
+    chan_release(c);
+    done(r, ctx);
 }
 
-/* simple hex dumper for debug */
-static void ata_dump_hex(const uint8_t* buf, int count)
+/* completion without the interrupt handler: the controller latched
+   INTRQ, or the command ran out of time */
+static void chan_dma_poll(ata_chan_t *c)
 {
-    const char hex[] = "0123456789ABCDEF";
-    char out[4];
+    if (!__atomic_load_n(&c->dma_active, __ATOMIC_ACQUIRE))
+        return;
+    if (inb(c->bmide + BM_REG_STATUS) & BM_ST_IRQ)
+        chan_dma_finish(c, 0);
+    else if (timer_uptime_ms() - c->dma_start_ms > ATA_TIMEOUT_MS)
+        chan_dma_finish(c, 1);
+}
 
-    for (int i = 0; i < count; i++) {
-        uint8_t b = buf[i];
-        out[0] = hex[b >> 4];
-        out[1] = hex[b & 0xF];
-        out[2] = ' ';
-        out[3] = 0;
-        terminal_writestring(out);
+/* synchronous DMA, channel claimed; 1 if this buffer needs PIO */
+static int dev_dma_rw(ata_dev_t *d, int write, uint64_t lba, uint32_t count, uint8_t *buf)
+{
+    ata_chan_t *c = d->ch;
+    block_seg_t seg = { buf, count };
+    int r = chan_dma_start(d, write, lba, &seg, 1, 0, 0);
+    if (r == -1)
+        return 1;
+    if (r != 0)
+        return r;
+    if (c->irq_ok && irqs_enabled() && chan_wait_irq(c) < 0)
+        chan_dma_finish(c, 1);
+    while (__atomic_load_n(&c->dma_active, __ATOMIC_ACQUIRE))
+        chan_dma_poll(c);
+    if (c->dma_status != 0)
+        return c->dma_status;
+    return (write && dev_flush(d) != 0) ? -3 : 0;
+}
 
-        if ((i + 1) % 16 == 0)
-            terminal_writestring("\n");
+/* range and MBR checks shared by the sync and async paths */
+static int dev_check(ata_dev_t *d, int write, uint64_t lba, uint32_t count)
+{
+    if (!d->present)
+        return -1;
+    if (lba + count > d->sectors || (!d->lba48 && lba + count > 0x0FFFFFFF))
+        return -2;
+    if (write && lba == 0 && count && !g_allow_mbr_write)
+        return -100;
+    return 0;
+}
+
+static int dev_rw(ata_dev_t *d, int write, uint64_t lba, uint32_t count, uint8_t *buf)
+{
+    if (!buf)
+        return -1;
+    int r = dev_check(d, write, lba, count);
+    if (r != 0)
+        return r;
+
+    chan_claim(d->ch);
+    while (count && r == 0) {
+        uint32_t n = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        r = d->dma && !d->pio ? dev_dma_rw(d, write, lba, n, buf) : 1;
+        if (r == 1)
+            r = dev_rw_one(d, write, lba, n, buf);
+        lba += n;
+        buf += n * 512;
+        count -= n;
     }
+    chan_release(d->ch);
+    return r;
+}
+
+/* ---- block device ---- */
+
+static int ata_block_read(block_device_t *bd, uint64_t lba, uint32_t count, void *buf)
+{
+    return dev_rw((ata_dev_t*)bd->priv, 0, lba, count, (uint8_t*)buf);
+}
+
+static int ata_block_write(block_device_t *bd, uint64_t lba, uint32_t count, const void *buf)
+{
+    return dev_rw((ata_dev_t*)bd->priv, 1, lba, count, (uint8_t*)buf);
+}
+
+/* async path, driven by io_sched: one DMA command per call, the channel
+   stays claimed until the completion interrupt */
+static int ata_block_submit(block_device_t *bd, int write, uint64_t lba,
+                            const block_seg_t *segs, int nsegs, block_done_fn done, void *ctx)
+{
+    ata_dev_t *d = (ata_dev_t*)bd->priv;
+    uint32_t count = 0;
+    for (int i = 0; i < nsegs; i++) count += segs[i].count;
+    int r = dev_check(d, write, lba, count);
+    if (r != 0)
+        return r;
+    if (__atomic_test_and_set(&d->ch->claimed, __ATOMIC_ACQUIRE))
+        return BLOCK_EBUSY;
+    r = chan_dma_start(d, write, lba, segs, nsegs, done, ctx);
+    if (r != 0)
+        chan_release(d->ch);
+    return r;
+}
+
+static void ata_block_poll(block_device_t *bd)
+{
+    chan_dma_poll(((ata_dev_t*)bd->priv)->ch);
 }
 
 /* wrapper to expose MBR write control */
@@ -109,87 +628,149 @@ void ata_set_skip_cache_flush(int enabled)
     g_skip_cache_flush = enabled ? 1 : 0;
 }
 
-static void ata_soft_reset(void)
+int ata_set_pio(block_device_t *bd, int enabled)
 {
-    /* SRST bit in device control */
-    outb(ATA_PRIMARY_CTRL + ATA_CTRL_DEVICECTL, 0x04);
-    ata_io_wait();
-    outb(ATA_PRIMARY_CTRL + ATA_CTRL_DEVICECTL, 0x00);
-    ata_io_wait();
+    ata_dev_t *d = 0;
+    for (int i = 0; i < ATA_MAX_DEVICES; i++)
+        if (devs[i].present && &devs[i].bd == bd) d = &devs[i];
+    if (!d)
+        return -1;
+    d->pio = enabled ? 1 : 0;
+    /* io_sched reads submit per dispatch: without it, requests go through
+       read/write from io_sched_poll(); a DMA command already in flight
+       still completes on its interrupt */
+    bd->submit = d->dma && !d->pio ? ata_block_submit : 0;
+    return 0;
 }
 
-/* Convenience wrapper */
-int ata_read_sector(uint32_t lba, uint8_t* buffer)
+/* SET MULTIPLE MODE to the drive's maximum (IDENTIFY word 47) */
+static void dev_set_multiple(ata_dev_t *d, const uint16_t *id)
 {
-    return ata_pio_read28(lba, buffer);
+    uint16_t max = id[47] & 0xFF;
+    d->multiple = 1;
+    if (max >= 2 && dev_cmd_nodata(d, ATA_CMD_SET_MULTIPLE, 0, max) == 0)
+        d->multiple = max;
 }
 
-int ata_read_sector_retry(uint32_t lba, uint8_t* buffer, int retries)
+/* Fastest DMA mode the drive offers (IDENTIFY words 49, 53, 63, 88, 93),
+   switched on with SET FEATURES. Controller timings stay as the firmware
+   programmed them. */
+static void dev_set_dma(ata_dev_t *d, const uint16_t *id)
 {
-    if (retries < 1) retries = 1;
-    for (int i = 0; i < retries; i++) {
-        int r = ata_read_sector(lba, buffer);
-        if (r == 0) return 0;
-        terminal_writestring("[ATA] read retry\n");
-        ata_soft_reset();
+    d->dma = 0;
+    d->xfer_mode = 0;
+    if (!d->ch->bmide || !(id[49] & (1 << 8)))
+        return;
+    if (id[53] & (1 << 2)) {
+        /* above UDMA2 needs an 80-conductor cable */
+        uint16_t udma = id[88] & ((id[93] & (1 << 13)) ? 0x3F : 0x07);
+        for (int m = 5; m >= 0 && !d->xfer_mode; m--)
+            if (udma & (1 << m)) d->xfer_mode = (uint8_t)(0x40 | m);
     }
-    return -1;
+    for (int m = 2; m >= 0 && !d->xfer_mode; m--)
+        if (id[63] & (1 << m)) d->xfer_mode = (uint8_t)(0x20 | m);
+    if (!d->xfer_mode ||
+        dev_cmd_nodata(d, ATA_CMD_SET_FEATURES, ATA_FEAT_XFER_MODE, d->xfer_mode) != 0)
+        return;
+    d->dma = 1;
+    uint16_t bm = d->ch->bmide;
+    outb(bm + BM_REG_STATUS, (inb(bm + BM_REG_STATUS) & BM_ST_DRV_DMA) | (0x20 << d->slave));
 }
 
-/* IDENTIFY DEVICE implementation */
-int ata_identify(uint16_t* buffer)
+/* SRST on a claimed channel, then the drive settings again */
+static void chan_reset(ata_chan_t *c)
 {
-    if (!buffer)
-        return -4;
+    /* SRST bit in device control */
+    outb(c->ctrl + ATA_CTRL_DEVICECTL, ATA_DC_SRST | ATA_DC_NIEN);
+    chan_io_wait(c);
+    outb(c->ctrl + ATA_CTRL_DEVICECTL, ATA_DC_NIEN);
+    chan_io_wait(c);
+    chan_wait_bsy_clear(c);
+
+    for (int i = 0; i < ATA_MAX_DEVICES; i++) {
+        ata_dev_t *d = &devs[i];
+        if (!d->present || d->ch != c)
+            continue;
+        if (d->multiple > 1 && dev_cmd_nodata(d, ATA_CMD_SET_MULTIPLE, 0, d->multiple) != 0)
+            d->multiple = 1;
+        if (d->dma && dev_cmd_nodata(d, ATA_CMD_SET_FEATURES, ATA_FEAT_XFER_MODE, d->xfer_mode) != 0)
+            d->dma = 0;
+    }
+    /* DMA completion needs INTRQ even when the PIC never delivers it */
+    if (c->irq_ok || c->bmide) {
+        (void)inb(c->io + ATA_REG_STATUS);
+        outb(c->ctrl + ATA_CTRL_DEVICECTL, 0);
+    }
+}
+
+static void ata_soft_reset(void)
+{
+    chan_claim(&chans[0]);
+    chan_reset(&chans[0]);
+    chan_release(&chans[0]);
+}
+
+/* IDENTIFY one drive (polled); 0 and 256 words in buffer on success */
+static int dev_identify(ata_dev_t *d, uint16_t *buffer)
+{
+    ata_chan_t *c = d->ch;
 
-    ata_select_master();
+    dev_select(d, 0xA0);
 
     /* clear registers per spec */
-    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT0, 0);
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, 0);
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, 0);
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, 0);
+    outb(c->io + ATA_REG_SECCOUNT0, 0);
+    outb(c->io + ATA_REG_LBA0, 0);
+    outb(c->io + ATA_REG_LBA1, 0);
+    outb(c->io + ATA_REG_LBA2, 0);
 
-    ata_io_wait();
+    chan_io_wait(c);
 
     /* send IDENTIFY */
-    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    c->irq_done = 0;
+    outb(c->io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
 
     /* read status */
-    uint8_t status = ata_read_status();
-    if (status == 0)
+    uint8_t status = inb(c->io + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF)
         return -1; /* no device */
 
-    /* wait BSY clear */
-    for (int i = 0; i < 100000; i++) {
-        if (!(status & ATA_SR_BSY)) break;
-        status = ata_read_status();
-    }
-    if (status & ATA_SR_BSY)
+    int st = chan_wait_bsy_clear(c);
+    if (st < 0)
         return -5;
 
+    /* ATAPI / SATA signatures: not a disk this driver handles */
+    uint8_t sig1 = inb(c->io + ATA_REG_LBA1), sig2 = inb(c->io + ATA_REG_LBA2);
+    if (sig1 != 0 || sig2 != 0)
+        return -1;
+
     /* check for error */
-    if (status & ATA_SR_ERR)
+    if (st & ATA_SR_ERR)
         return -2;
 
-    /* wait DRQ set */
-    for (int i = 0; i < 100000; i++) {
-        if (status & ATA_SR_DRQ) break;
-        status = ata_read_status();
-        if (status & ATA_SR_ERR)
-            return -3;
-    }
-    if (!(status & ATA_SR_DRQ))
-        return -6;
+    st = chan_wait_drq(c);
+    if (st < 0 || !(st & ATA_SR_DRQ))
+        return (st >= 0 && (st & ATA_SR_ERR)) ? -3 : -6;
 
     /* read 256 words (512 bytes) */
-    for (int i = 0; i < 256; ++i) {
-        buffer[i] = inw(ATA_PRIMARY_IO + ATA_REG_DATA);
-    }
-
+    insw(c->io + ATA_REG_DATA, buffer, 256);
+    (void)inb(c->io + ATA_REG_STATUS);
     return 0;
 }
 
+/* IDENTIFY DEVICE implementation */
+int ata_identify(uint16_t* buffer)
+{
+    if (!buffer)
+        return -4;
+    ata_dev_t d = { 0 };
+    d.ch = &chans[0];
+    d.multiple = 1;
+    chan_claim(&chans[0]);
+    int r = dev_identify(&d, buffer);
+    chan_release(&chans[0]);
+    return r;
+}
+
 /* decode identify: model string + LBA28 sectors if present */
 int ata_decode_identify(const uint16_t* id_buf, char* model, size_t model_len, uint32_t* lba28_sectors)
 {
@@ -222,6 +803,8 @@ int ata_decode_identify(const uint16_t* id_buf, char* model, size_t model_len, u
     return 0;
 }
 
+/* ---- legacy single-sector API (primary master) ---- */
+
 /* read single sector using LBA28 PIO */
 int ata_pio_read28(uint32_t lba, uint8_t* buffer)
 {
@@ -231,52 +814,25 @@ int ata_pio_read28(uint32_t lba, uint8_t* buffer)
     if (lba & 0xF0000000) /* LBA must be 28-bit */
         return -2;
 
-    ata_select_master();
-
-    /* set sector count = 1 */
-    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT0, 1);
-
-    /* set LBA low/mid/high */
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, (uint8_t)(lba & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, (uint8_t)((lba >> 8) & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, (uint8_t)((lba >> 16) & 0xFF));
-
-    /* select drive and high 4 bits of LBA (0xE0 = 1110 0000 -> LBA mode + master) */
-    uint8_t head = 0xE0 | (uint8_t)((lba >> 24) & 0x0F);
-    outb(ATA_PRIMARY_IO + ATA_REG_HDDEVSEL, head);
-    ata_io_wait();
-
-    /* issue read command */
-    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_READ_PIO);
-
-    /* wait for BSY clear */
-    uint8_t status = ata_wait_bsy_clear();
-
-    /* check error */
-    if (status & ATA_SR_ERR)
-        return -3;
+    return dev_rw(&devs[0], 0, lba, 1, buffer);
+}
 
-    /* wait DRQ */
-    for (int i = 0; i < 100000; i++) {
-        if (status & ATA_SR_DRQ) break;
-        status = ata_read_status();
-        if (status & ATA_SR_ERR)
-            return -4;
-    }
-    if (!(status & ATA_SR_DRQ))
-        return -5;
+/* Convenience wrapper */
+int ata_read_sector(uint32_t lba, uint8_t* buffer)
+{
+    return ata_pio_read28(lba, buffer);
+}
 
-    /* read 256 words (512 bytes) */
-    for (int i = 0; i < 256; ++i) {
-        uint16_t w = inw(ATA_PRIMARY_IO + ATA_REG_DATA);
-        /* write little-endian into buffer */
-        buffer[i * 2 + 0] = (uint8_t)(w & 0xFF);
-        buffer[i * 2 + 1] = (uint8_t)(w >> 8);
+int ata_read_sector_retry(uint32_t lba, uint8_t* buffer, int retries)
+{
+    if (retries < 1) retries = 1;
+    for (int i = 0; i < retries; i++) {
+        int r = ata_read_sector(lba, buffer);
+        if (r == 0) return 0;
+        terminal_writestring("[ATA] read retry\n");
+        ata_soft_reset();
     }
-
-    /* final status check (optional) */
-    ata_io_wait();
-    return 0;
+    return -1;
 }
 
 /* write single sector using LBA28 PIO */
@@ -288,61 +844,7 @@ int ata_write_sector(uint32_t lba, const uint8_t* buffer)
     if (lba & 0xF0000000)
         return -2;
 
-    /* protecție MBR */
-    if (lba == 0 && !g_allow_mbr_write)
-        return -100;
-
-    ata_select_master();
-
-    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT0, 1);
-
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, (uint8_t)(lba & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, (uint8_t)((lba >> 8) & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, (uint8_t)((lba >> 16) & 0xFF));
-
-    outb(ATA_PRIMARY_IO + ATA_REG_HDDEVSEL,
-         0xE0 | ((lba >> 24) & 0x0F));
-
-    ata_io_wait();
-
-    /* issue write command */
-    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_WRITE_PIO);
-
-    uint8_t status = ata_wait_bsy_clear();
-    if (status & ATA_SR_ERR) {
-        terminal_writestring("[ATA] write: ERR after BSY clear\n");
-        return -3;
-    }
-
-    for (int i = 0; i < 100000; i++) {
-        if (status & ATA_SR_DRQ) break;
-        status = ata_read_status();
-        if (status & ATA_SR_ERR) {
-            terminal_writestring("[ATA] write: ERR waiting DRQ\n");
-            return -4;
-        }
-    }
-    if (!(status & ATA_SR_DRQ)) {
-        terminal_writestring("[ATA] write: DRQ timeout\n");
-        return -5;
-    }
-
-    /* write 256 words */
-    for (int i = 0; i < 256; i++) {
-        uint16_t w =
-            ((uint16_t)buffer[i * 2 + 1] << 8) |
-             (uint16_t)buffer[i * 2 + 0];
-
-        outw(ATA_PRIMARY_IO + ATA_REG_DATA, w);
-    }
-
-    /* flush cache */
-    if (!g_skip_cache_flush) {
-        outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
-        ata_wait_bsy_clear();
-    }
-
-    return 0;
+    return dev_rw(&devs[0], 1, lba, 1, (uint8_t*)buffer);
 }
 
 int ata_write_sector_retry(uint32_t lba, const uint8_t* buffer, int retries)
@@ -357,27 +859,119 @@ int ata_write_sector_retry(uint32_t lba, const uint8_t* buffer, int retries)
     return -1;
 }
 
-/* init + test (reads sector 0 and dumps first 128 bytes) */
-void ata_init(void)
-{
-    terminal_writestring("[ATA] init\n");
+/* ---- init ---- */
 
-    static uint8_t sector[512];
+/* probe one drive; registers it as ata<i> when it is an ATA disk */
+static int dev_probe(int i)
+{
+    static uint16_t id[256];
+    ata_dev_t *d = &devs[i];
+    d->ch = &chans[i / 2];
+    d->slave = (uint8_t)(i & 1);
+    d->present = 0;
+    d->multiple = 1;
+    d->pio = 0;
+
+    if (dev_identify(d, id) != 0)
+        return 0;
+
+    uint32_t lba28 = 0;
+    char model[41];
+    ata_decode_identify(id, model, sizeof(model), &lba28);
+    d->lba48 = (id[83] & (1 << 10)) ? 1 : 0;
+    d->sectors = lba28;
+    if (d->lba48) {
+        d->sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                     ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    }
+    if (d->sectors == 0)
+        return 0;
+    dev_set_multiple(d, id);
+    dev_set_dma(d, id);
+    d->present = 1;
+
+    block_device_t *bd = &d->bd;
+    bd->name[0] = 'a'; bd->name[1] = 't'; bd->name[2] = 'a';
+    bd->name[3] = (char)('0' + i); bd->name[4] = 0;
+    bd->sector_count = d->sectors;
+    bd->sector_size = 512;
+    bd->read = ata_block_read;
+    bd->write = ata_block_write;
+    /* without DMA, io_sched serves it synchronously from io_sched_poll() */
+    bd->submit = d->dma ? ata_block_submit : 0;
+    bd->poll = d->dma ? ata_block_poll : 0;
+    bd->priv = d;
+    block_register(bd);
+
+    serial("[ATA] ata%d: %s, %llu sectors, LBA48 %s, %u sectors/block, %s\n", i, model,
+           (unsigned long long)d->sectors, d->lba48 ? "yes" : "no", d->multiple,
+           !d->dma ? "PIO" : (d->xfer_mode & 0x40) ? "UDMA" : "MWDMA");
+    return 1;
+}
 
-    if (ata_read_sector(0, sector) != 0) {
-        terminal_writestring("[ATA] read sector 0 FAILED\n");
+/* PCI IDE controller: bus-master registers for the channels it runs in
+   compatibility mode (the ports above), 8 bytes each from BAR4 */
+static void bmide_probe(void)
+{
+    uint8_t bus, dev, func;
+    if (!pci_find_device_by_subclass(0x01, 0x01, &bus, &dev, &func))
+        return;
+    uint8_t prog_if = pci_read_prog_if(bus, dev, func);
+    uint32_t bar4 = pci_read_bar32(bus, dev, func, 4);
+    if (!(prog_if & 0x80) || !(bar4 & 1) || !(bar4 & ~3u)) {
+        serial("[ATA] IDE controller without bus mastering, PIO only\n");
         return;
     }
+    pci_enable_busmaster(bus, dev, func);
+
+    for (int ch = 0; ch < 2; ch++) {
+        if (prog_if & (ch ? 0x04 : 0x01))
+            continue; /* native mode: not at the legacy ports */
+        uint32_t phys = (uint32_t)(uintptr_t)pmm_alloc_frames(1, 0);
+        if (!phys)
+            break;
+        if (vmm_virt_to_phys((void*)(uintptr_t)phys) != phys) {
+            pmm_free_frames(phys, 1);
+            break;
+        }
+        chans[ch].prdt = (ata_prd_t*)(uintptr_t)phys;
+        chans[ch].bmide = (uint16_t)((bar4 & ~3u) + ch * 8);
+    }
+    serial("[ATA] bus-master IDE at %u:%u.%u, io 0x%x\n", bus, dev, func, bar4 & ~3u);
+}
 
-    terminal_writestring("[ATA] sector 0 read OK\n");
-
-    ata_dump_hex(sector, 128);
+int ata_init(void)
+{
+    terminal_writestring("[ATA] init\n");
+    int found = 0;
+
+    bmide_probe();
+
+    for (int ch = 0; ch < 2; ch++) {
+        ata_chan_t *c = &chans[ch];
+        /* floating bus: no controller behind this channel */
+        if (inb(c->io + ATA_REG_STATUS) == 0xFF)
+            continue;
+        /* probe with the drive's interrupt line masked */
+        outb(c->ctrl + ATA_CTRL_DEVICECTL, ATA_DC_NIEN);
+        int n = dev_probe(ch * 2) + dev_probe(ch * 2 + 1);
+        if (!n)
+            continue;
+        found += n;
+
+        irq_install_handler(c->irq, ch ? ata_irq_secondary : ata_irq_primary);
+        if (!apic_is_active()) {
+            /* PIC: unmask the line on the slave and the cascade on the master */
+            outb(0xA1, inb(0xA1) & ~(1 << (c->irq - 8)));
+            outb(0x21, inb(0x21) & ~(1 << 2));
+        }
+        c->irq_ok = 1;
+        (void)inb(c->io + ATA_REG_STATUS);
+        outb(c->ctrl + ATA_CTRL_DEVICECTL, 0);
+    }
 
-    /* semnătura MBR */
-    if (sector[510] == 0x55 && sector[511] == 0xAA)
-        terminal_writestring("\n[ATA] MBR signature OK (55 AA)\n");
-    else
-        terminal_writestring("\n[ATA] MBR signature MISSING\n");
+    terminal_printf("[ATA] %d disk(s) registered\n", found);
+    return found;
 }
 
 #ifdef __cplusplus
@@ -7,10 +7,22 @@
 extern "C" {
 #endif
 
-/* Inițializare driver ATA (detectare dispozitiv, setare mod PIO etc.) */
-void ata_init(void);
+/* Driver ATA (IDE) PIO: ambele canale (0x1F0/IRQ14, 0x170/IRQ15), master
+ * și slave. Discurile găsite se înregistrează ca block_device_t
+ * "ata0".."ata3" (primary master, primary slave, secondary master,
+ * secondary slave). Transferurile folosesc READ/WRITE MULTIPLE (mai multe
+ * sectoare per întrerupere), rep insw/outsw, LBA48 când discul îl are, iar
+ * terminarea vine pe IRQ: cine așteaptă doarme (task) sau face hlt.
+ * Dacă există un controller IDE PCI cu bus mastering (BAR4) și discul
+ * știe DMA, transferurile merg prin DMA (tabel PRD per canal), iar
+ * block_device_t primește submit/poll asincron, ca la AHCI.
+ * return: numărul de discuri înregistrate */
+#define ATA_MAX_DEVICES 4
+#define ATA_MAX_SECTORS 256   /* sectoare per comandă */
 
-/* IDENTIFY DEVICE
+int ata_init(void);
+
+/* IDENTIFY DEVICE (primary master)
  * buffer: pointer la 256 de cuvinte uint16_t (512 bytes)
  * return:
  *   0  : succes
@@ -28,6 +40,8 @@ int ata_identify(uint16_t* buffer);
  */
 int ata_decode_identify(const uint16_t* id_buf, char* model, size_t model_len, uint32_t* lba28_sectors);
 
+/* Funcțiile de sector de mai jos lucrează pe primary master ("ata0") */
+
 /* Citire PIO low-level (LBA28) - 1 sector (512 bytes) */
 int ata_pio_read28(uint32_t lba, uint8_t* buffer);
 
@@ -52,6 +66,11 @@ void ata_set_allow_mbr_write(int enabled);
 /* Skip cache flush after write (debug/installer) */
 void ata_set_skip_cache_flush(int enabled);
 
+/* Force PIO on one ATA disk even if it has bus-master DMA (blkbench pio).
+ * return: 0, or -1 if bd is not an ATA disk */
+struct block_device;
+int ata_set_pio(struct block_device *bd, int enabled);
+
 /* Write with retry + soft reset (returns 0 on success) */
 int ata_write_sector_retry(uint32_t lba, const uint8_t* buffer, int retries);
 
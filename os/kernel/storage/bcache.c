@@ -0,0 +1,752 @@
+/* kernel/storage/bcache.c
+   Buffer cache under the filesystems (FAT via disk_*(), ChrysFS, partition scan).
+   - one 512-byte sector per buffer, hash chains on (device, lba)
+   - every buffer sits on one LRU list (head = most recently used);
+     unused buffers are kept at the tail so they are recycled first
+   - writes only dirty the buffer; bcache_flush() writes dirty sectors back
+     sorted and merged into multi-sector requests
+   - device I/O runs without bc_lock: the buffer is marked BC_BUSY and
+     anyone else who needs it waits for the flag to drop
+   - sequential streams are detected per device: reads prefetch a window
+     ahead of the reader and writes are pushed out behind the writer, both
+     asynchronously through the I/O scheduler (storage/io_sched.h); the window
+     starts at BCACHE_RA_MIN and doubles with every batch the stream uses
+*/
+
+#include "bcache.h"
+#include "io_sched.h"
+#include "../mem/kmalloc.h"
+#include "../string.h"
+#include "../sync/spinlock.h"
+#include "../time/timer.h"
+#include "../debug/trace.h"
+
+extern void serial(const char *fmt, ...);
+
+#define BC_SECTOR 512
+
+#define BC_VALID 0x1
+#define BC_DIRTY 0x2
+#define BC_BUSY  0x4
+#define BC_RA    0x8   /* filled by read-ahead, not read yet */
+
+/* requests this large go straight to the device: streaming a big file
+   through the cache would only push out the FAT and directory sectors */
+#define BCACHE_BYPASS_SECTORS 128
+/* dirty buffers written back per flush round (size of the bounce buffer) */
+#define BCACHE_FLUSH_BATCH 64
+
+/* read-ahead / write-behind */
+#define BCACHE_STREAMS     8     /* sequential streams tracked at once */
+#define BCACHE_RA_MIN      16    /* first window, in sectors */
+#define BCACHE_RA_MAX      128   /* largest window = largest async request (64 KB) */
+#define BCACHE_ASYNC_SLOTS 4     /* async requests in flight */
+
+typedef struct bcache_buf {
+    block_device_t *dev;
+    uint64_t lba;
+    uint8_t *data;
+    uint32_t flags;
+    struct bcache_buf *hnext;
+    struct bcache_buf *lru_prev;
+    struct bcache_buf *lru_next;
+} bcache_buf_t;
+
+typedef struct {
+    block_device_t *dev;
+    int write;
+    uint64_t last;        /* start of the stream's last request */
+    uint64_t next;        /* first sector after it */
+    uint64_t async_next;  /* reads: first sector not prefetched yet;
+                             writes: first sector not written behind yet */
+    uint32_t window;      /* 0 until the stream has gone sequential */
+    uint32_t stamp;       /* the least recently used stream is replaced */
+} bc_stream_t;
+
+typedef struct {
+    volatile int busy;
+    int write;
+    block_device_t *dev;
+    uint64_t lba;
+    uint32_t count;
+    uint8_t *bounce;      /* BCACHE_RA_MAX sectors, the DMA target/source */
+    bcache_buf_t *b[BCACHE_RA_MAX];
+} bc_async_t;
+
+static bcache_buf_t *bufs = 0;
+static uint8_t *data_pool = 0;
+static bcache_buf_t **hash = 0;
+static uint32_t hash_mask = 0;
+static bcache_buf_t *lru_head = 0;
+static bcache_buf_t *lru_tail = 0;
+static uint8_t *flush_bounce = 0;
+static volatile int flushing = 0;
+static uint32_t dirty_since_ms = 0;   /* when st.dirty last went 0 -> 1 */
+
+static bc_stream_t streams[BCACHE_STREAMS];
+static uint32_t stream_clock = 0;
+static bc_async_t aio[BCACHE_ASYNC_SLOTS];
+
+static bcache_stats_t st;
+static spinlock_t bc_lock = SPINLOCK_INIT("bcache");
+
+/* ---- hash / LRU (bc_lock held) ---- */
+
+static inline uint32_t hash_idx(block_device_t *dev, uint64_t lba) {
+    uint32_t h = (uint32_t)lba * 2654435761u;
+    h ^= (uint32_t)(uintptr_t)dev >> 4;
+    h ^= (uint32_t)(lba >> 32);
+    return h & hash_mask;
+}
+
+static bcache_buf_t *lookup(block_device_t *dev, uint64_t lba) {
+    for (bcache_buf_t *b = hash[hash_idx(dev, lba)]; b; b = b->hnext) {
+        if (b->dev == dev && b->lba == lba) return b;
+    }
+    return 0;
+}
+
+static void hash_insert(bcache_buf_t *b) {
+    uint32_t h = hash_idx(b->dev, b->lba);
+    b->hnext = hash[h];
+    hash[h] = b;
+}
+
+static void hash_remove(bcache_buf_t *b) {
+    bcache_buf_t **pp = &hash[hash_idx(b->dev, b->lba)];
+    while (*pp && *pp != b) pp = &(*pp)->hnext;
+    if (*pp) *pp = b->hnext;
+    b->hnext = 0;
+}
+
+static void lru_unlink(bcache_buf_t *b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+    else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else lru_tail = b->lru_prev;
+    b->lru_prev = b->lru_next = 0;
+}
+
+static void lru_touch(bcache_buf_t *b) {
+    if (lru_head == b) return;
+    lru_unlink(b);
+    b->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = b;
+    lru_head = b;
+    if (!lru_tail) lru_tail = b;
+}
+
+static void lru_to_tail(bcache_buf_t *b) {
+    if (lru_tail == b) return;
+    lru_unlink(b);
+    b->lru_prev = lru_tail;
+    if (lru_tail) lru_tail->lru_next = b;
+    lru_tail = b;
+    if (!lru_head) lru_head = b;
+}
+
+static void mark_dirty(bcache_buf_t *b) {
+    if (b->flags & BC_DIRTY) return;
+    b->flags |= BC_DIRTY;
+    if (st.dirty++ == 0) dirty_since_ms = timer_uptime_ms();
+}
+
+static void mark_clean(bcache_buf_t *b) {
+    if (!(b->flags & BC_DIRTY)) return;
+    b->flags &= ~BC_DIRTY;
+    st.dirty--;
+}
+
+/* unused again: out of the hash, to the LRU tail */
+static void drop_buf(bcache_buf_t *b) {
+    hash_remove(b);
+    b->flags = 0;
+    b->dev = 0;
+    st.used--;
+    lru_to_tail(b);
+}
+
+/* wait for a BC_BUSY buffer with the lock dropped; polling io_sched
+   finishes async requests without an IRQ and runs those of PIO devices */
+static void wait_busy(uint32_t *fl) {
+    spin_unlock_irqrestore(&bc_lock, *fl);
+    io_sched_poll();
+    *fl = spin_lock_irqsave(&bc_lock);
+}
+
+/* Take the least recently used idle buffer out of the hash. A dirty one is
+   written back first, with the lock dropped, so callers must look their
+   sector up again afterwards. NULL if nothing can be recycled. */
+static bcache_buf_t *take_victim(uint32_t *fl) {
+    for (;;) {
+        bcache_buf_t *b = lru_tail;
+        while (b && (b->flags & BC_BUSY)) b = b->lru_prev;
+        if (!b) return 0;
+
+        if (b->flags & BC_DIRTY) {
+            b->flags |= BC_BUSY;
+            spin_unlock_irqrestore(&bc_lock, *fl);
+            int r = b->dev->write(b->dev, b->lba, 1, b->data);
+            *fl = spin_lock_irqsave(&bc_lock);
+            b->flags &= ~BC_BUSY;
+            if (r != 0) {
+                serial("[BCACHE] write-back of %s lba %llu failed (%d)\n",
+                       b->dev->name, (unsigned long long)b->lba, r);
+                lru_touch(b);
+                return 0;
+            }
+            mark_clean(b);
+            st.writebacks++;
+            continue; /* the list may have changed meanwhile */
+        }
+
+        if (b->flags & BC_VALID) {
+            hash_remove(b);
+            st.evictions++;
+            st.used--;
+        }
+        b->flags = 0;
+        b->dev = 0;
+        return b;
+    }
+}
+
+/* Get the buffer for (dev, lba), recycling one if it is not cached.
+   Returned idle (not BC_BUSY); *fresh says it holds no data yet. */
+static bcache_buf_t *get_buf(block_device_t *dev, uint64_t lba, int *fresh, uint32_t *fl) {
+    for (;;) {
+        bcache_buf_t *b = lookup(dev, lba);
+        if (b) {
+            if (b->flags & BC_BUSY) { wait_busy(fl); continue; }
+            *fresh = 0;
+            return b;
+        }
+        bcache_buf_t *v = take_victim(fl);
+        if (!v) return 0;
+        if (lookup(dev, lba)) { lru_to_tail(v); continue; }
+        v->dev = dev;
+        v->lba = lba;
+        v->flags = BC_VALID;
+        hash_insert(v);
+        st.used++;
+        *fresh = 1;
+        return v;
+    }
+}
+
+/* ---- sequential streams, read-ahead, write-behind (bc_lock held) ---- */
+
+/* Account a request to its stream: one that continues or overlaps the
+   previous request of the same kind, else the least recently used slot
+   starts a new stream. Returns the stream once it is sequential. */
+static bc_stream_t *stream_update(block_device_t *dev, int write, uint64_t lba, uint32_t count) {
+    bc_stream_t *s = 0;
+    for (int i = 0; i < BCACHE_STREAMS && !s; i++) {
+        bc_stream_t *c = &streams[i];
+        if (c->dev == dev && c->write == write && lba >= c->last && lba <= c->next) s = c;
+    }
+    if (!s) {
+        s = &streams[0];
+        for (int i = 1; i < BCACHE_STREAMS; i++) {
+            if (streams[i].stamp < s->stamp) s = &streams[i];
+        }
+        s->dev = dev;
+        s->write = write;
+        s->next = lba;
+        s->async_next = write ? lba : lba + count;
+        s->window = 0;
+    } else if (lba + count > s->next && !s->window) {
+        s->window = BCACHE_RA_MIN;
+    }
+    s->last = lba;
+    if (lba + count > s->next) s->next = lba + count;
+    s->stamp = ++stream_clock;
+    return s->window ? s : 0;
+}
+
+static void stream_grow(bc_stream_t *s) {
+    s->window *= 2;
+    if (s->window > BCACHE_RA_MAX) s->window = BCACHE_RA_MAX;
+}
+
+static bc_async_t *aio_get(void) {
+    for (int i = 0; i < BCACHE_ASYNC_SLOTS; i++) {
+        if (!aio[i].busy && aio[i].bounce) return &aio[i];
+    }
+    return 0;
+}
+
+/* A clean idle buffer for read-ahead, without writing anything back; data
+   prefetched earlier and not read yet is left alone. */
+static bcache_buf_t *take_clean_victim(void) {
+    int budget = BCACHE_RA_MAX * 2;
+    for (bcache_buf_t *b = lru_tail; b && budget-- > 0; b = b->lru_prev) {
+        if (b->flags & (BC_BUSY | BC_DIRTY | BC_RA)) continue;
+        if (b->flags & BC_VALID) {
+            hash_remove(b);
+            st.evictions++;
+            st.used--;
+        }
+        b->flags = 0;
+        b->dev = 0;
+        return b;
+    }
+    return 0;
+}
+
+static void aio_finish(bc_async_t *a, int status) {
+    for (uint32_t i = 0; i < a->count; i++) {
+        bcache_buf_t *b = a->b[i];
+        b->flags &= ~BC_BUSY;
+        if (a->write) {
+            if (status == 0) {
+                mark_clean(b);
+                st.writebacks++;
+            }
+        } else if (status == 0) {
+            memcpy(b->data, a->bounce + i * BC_SECTOR, BC_SECTOR);
+        } else {
+            drop_buf(b);
+        }
+    }
+    a->busy = 0;
+}
+
+static void aio_done(int status, void *ctx) {
+    bc_async_t *a = (bc_async_t*)ctx;
+    if (status != 0) {
+        serial("[BCACHE] async %s of %s lba %llu (+%u) failed (%d)\n", a->write ? "write" : "read",
+               a->dev->name, (unsigned long long)a->lba, a->count, status);
+    }
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    aio_finish(a, status);
+    spin_unlock_irqrestore(&bc_lock, fl);
+}
+
+/* queue a prepared slot in io_sched; its buffers are already BC_BUSY */
+static void aio_submit(bc_async_t *a, uint32_t *fl) {
+    a->busy = 1;
+    spin_unlock_irqrestore(&bc_lock, *fl);
+    int r = io_sched_submit_dev(a->dev, a->write ? IO_OP_WRITE : IO_OP_READ, a->lba,
+                                a->count, a->bounce, aio_done, a);
+    *fl = spin_lock_irqsave(&bc_lock);
+    if (r != 0) aio_finish(a, r); /* queue full: nothing was started */
+}
+
+/* wait for async requests (writes only, or all) of dev (NULL: any);
+   returns whether there were any */
+static int aio_wait(block_device_t *dev, int writes_only, uint32_t *fl) {
+    int waited = 0;
+    for (;;) {
+        bc_async_t *p = 0;
+        for (int i = 0; i < BCACHE_ASYNC_SLOTS && !p; i++) {
+            bc_async_t *a = &aio[i];
+            if (a->busy && (!writes_only || a->write) && (!dev || a->dev == dev)) p = a;
+        }
+        if (!p) return waited;
+        waited = 1;
+        spin_unlock_irqrestore(&bc_lock, *fl);
+        io_sched_poll();
+        *fl = spin_lock_irqsave(&bc_lock);
+    }
+}
+
+/* Keep at least half a window prefetched ahead of the reader: the next
+   run of uncached sectors goes into clean buffers marked BC_BUSY, which a
+   reader that gets there first simply waits on. */
+static void read_ahead(bc_stream_t *s, uint32_t *fl) {
+    block_device_t *dev = s->dev;
+    if (s->async_next < s->next) s->async_next = s->next;
+    if (s->async_next > s->next + s->window / 2) return;
+
+    uint64_t end = s->next + s->window;
+    if (end > dev->sector_count) end = dev->sector_count;
+    while (s->async_next < end && lookup(dev, s->async_next)) s->async_next++;
+    if (s->async_next >= end) return;
+
+    bc_async_t *a = aio_get();
+    if (!a) return;
+    a->dev = dev;
+    a->write = 0;
+    a->lba = s->async_next;
+    a->count = 0;
+    while (a->lba + a->count < end && a->count < BCACHE_RA_MAX && !lookup(dev, a->lba + a->count)) {
+        bcache_buf_t *b = take_clean_victim();
+        if (!b) break;
+        b->dev = dev;
+        b->lba = a->lba + a->count;
+        b->flags = BC_VALID | BC_BUSY | BC_RA;
+        hash_insert(b);
+        lru_touch(b);
+        st.used++;
+        a->b[a->count++] = b;
+    }
+    if (!a->count) return;
+    s->async_next = a->lba + a->count;
+    st.readahead += a->count;
+    TRACE(TR_BC_READAHEAD, a->lba, a->count, s->window, 0);
+    stream_grow(s);
+    aio_submit(a, fl);
+}
+
+/* Once a window's worth of sequential dirty sectors sits behind the
+   writer, start writing them back while the writer carries on. */
+static void write_behind(bc_stream_t *s, uint32_t *fl) {
+    block_device_t *dev = s->dev;
+    if (s->next - s->async_next < s->window) return;
+
+    bc_async_t *a = aio_get();
+    if (!a) return;
+    a->dev = dev;
+    a->write = 1;
+    a->count = 0;
+    while (s->async_next < s->next && a->count < BCACHE_RA_MAX) {
+        bcache_buf_t *b = lookup(dev, s->async_next);
+        if (!b || (b->flags & (BC_DIRTY | BC_BUSY)) != BC_DIRTY) {
+            if (a->count) break;
+            s->async_next++; /* not ours to write (clean, gone or in flight) */
+            continue;
+        }
+        if (!a->count) a->lba = s->async_next;
+        b->flags |= BC_BUSY;
+        memcpy(a->bounce + a->count * BC_SECTOR, b->data, BC_SECTOR);
+        a->b[a->count++] = b;
+        s->async_next++;
+    }
+    if (!a->count) return;
+    st.writebehind += a->count;
+    TRACE(TR_BC_WRITEBEHIND, a->lba, a->count, s->window, 0);
+    stream_grow(s);
+    aio_submit(a, fl);
+}
+
+/* ---- public API ---- */
+
+int bcache_enabled(void) {
+    return bufs != 0;
+}
+
+int bcache_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buf) {
+    if (!dev || !dev->read) return -1;
+    if (!bufs || dev->sector_size != BC_SECTOR) return dev->read(dev, lba, count, buf);
+    uint8_t *out = (uint8_t*)buf;
+
+    if (count >= BCACHE_BYPASS_SECTORS) {
+        int r = bcache_read_direct(dev, lba, count, buf);
+        if (r == 0) {
+            uint32_t fl = spin_lock_irqsave(&bc_lock);
+            st.bypass++;
+            spin_unlock_irqrestore(&bc_lock, fl);
+        }
+        return r;
+    }
+
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    uint32_t i = 0;
+    while (i < count) {
+        bcache_buf_t *b = lookup(dev, lba + i);
+        if (b) {
+            if (b->flags & BC_BUSY) { wait_busy(&fl); continue; }
+            memcpy(out + i * BC_SECTOR, b->data, BC_SECTOR);
+            lru_touch(b);
+            st.hits++;
+            if (b->flags & BC_RA) {
+                b->flags &= ~BC_RA;
+                st.ra_hits++;
+            }
+            i++;
+            continue;
+        }
+
+        /* miss: one device read for the whole run of uncached sectors,
+           straight into the caller's buffer, then copy into the cache */
+        uint32_t n = 1;
+        while (i + n < count && !lookup(dev, lba + i + n)) n++;
+        st.misses += n;
+        TRACE(TR_BC_MISS, lba + i, n, 0, 0);
+        spin_unlock_irqrestore(&bc_lock, fl);
+        int r = dev->read(dev, lba + i, n, out + i * BC_SECTOR);
+        fl = spin_lock_irqsave(&bc_lock);
+        if (r != 0) {
+            spin_unlock_irqrestore(&bc_lock, fl);
+            return r;
+        }
+        for (uint32_t k = 0; k < n; k++) {
+            uint8_t *src = out + (i + k) * BC_SECTOR;
+            int fresh;
+            bcache_buf_t *c = get_buf(dev, lba + i + k, &fresh, &fl);
+            if (!c) break;
+            if (fresh) memcpy(c->data, src, BC_SECTOR);
+            else if (c->flags & BC_DIRTY) memcpy(src, c->data, BC_SECTOR); /* written meanwhile */
+            lru_touch(c);
+        }
+        i += n;
+    }
+    bc_stream_t *s = stream_update(dev, 0, lba, count);
+    if (s) read_ahead(s, &fl);
+    spin_unlock_irqrestore(&bc_lock, fl);
+    return 0;
+}
+
+int bcache_read_direct(block_device_t *dev, uint64_t lba, uint32_t count, void *buf) {
+    if (!dev || !dev->read) return -1;
+    if (!bufs || dev->sector_size != BC_SECTOR) return dev->read(dev, lba, count, buf);
+    uint8_t *out = (uint8_t*)buf;
+
+    int r = dev->read(dev, lba, count, buf);
+    if (r != 0) return r;
+    /* dirty cached sectors (write-behind in flight included) are newer
+       than what the disk returned */
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    if (st.dirty) {
+        for (uint32_t i = 0; i < count; i++) {
+            bcache_buf_t *b = lookup(dev, lba + i);
+            if (b && (b->flags & BC_DIRTY)) memcpy(out + i * BC_SECTOR, b->data, BC_SECTOR);
+        }
+    }
+    spin_unlock_irqrestore(&bc_lock, fl);
+    return 0;
+}
+
+int bcache_write(block_device_t *dev, uint64_t lba, uint32_t count, const void *buf) {
+    if (!dev || !dev->write) return -1;
+    if (!bufs || dev->sector_size != BC_SECTOR) return dev->write(dev, lba, count, buf);
+    const uint8_t *in = (const uint8_t*)buf;
+
+    if (count >= BCACHE_BYPASS_SECTORS) {
+        /* a write-behind landing after this request would undo it */
+        uint32_t fl = spin_lock_irqsave(&bc_lock);
+        aio_wait(dev, 1, &fl);
+        spin_unlock_irqrestore(&bc_lock, fl);
+        int r = dev->write(dev, lba, count, buf);
+        /* keep cached copies in step with the disk */
+        fl = spin_lock_irqsave(&bc_lock);
+        st.bypass++;
+        for (uint32_t i = 0; r == 0 && i < count; ) {
+            bcache_buf_t *b = lookup(dev, lba + i);
+            if (b && (b->flags & BC_BUSY)) { wait_busy(&fl); continue; }
+            if (b) {
+                memcpy(b->data, in + i * BC_SECTOR, BC_SECTOR);
+                mark_clean(b);
+            }
+            i++;
+        }
+        spin_unlock_irqrestore(&bc_lock, fl);
+        return r;
+    }
+
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        int fresh;
+        bcache_buf_t *b = get_buf(dev, lba + i, &fresh, &fl);
+        if (!b) {
+            /* nothing recyclable: this sector goes straight to the disk */
+            spin_unlock_irqrestore(&bc_lock, fl);
+            int r = dev->write(dev, lba + i, 1, in + i * BC_SECTOR);
+            if (r != 0) return r;
+            fl = spin_lock_irqsave(&bc_lock);
+            continue;
+        }
+        memcpy(b->data, in + i * BC_SECTOR, BC_SECTOR);
+        b->flags &= ~BC_RA;
+        mark_dirty(b);
+        lru_touch(b);
+    }
+    bc_stream_t *s = stream_update(dev, 1, lba, count);
+    if (s) write_behind(s, &fl);
+    int too_dirty = st.dirty > st.nblocks / 2;
+    spin_unlock_irqrestore(&bc_lock, fl);
+
+    /* keep at least half of the cache clean (and cheap to recycle) */
+    if (too_dirty) return bcache_flush(dev);
+    return 0;
+}
+
+static void sort_batch(bcache_buf_t **v, int n) {
+    for (int i = 1; i < n; i++) {
+        bcache_buf_t *x = v[i];
+        int j = i - 1;
+        while (j >= 0 && (v[j]->dev > x->dev || (v[j]->dev == x->dev && v[j]->lba > x->lba))) {
+            v[j + 1] = v[j];
+            j--;
+        }
+        v[j + 1] = x;
+    }
+}
+
+int bcache_flush(block_device_t *dev) {
+    if (!bufs) return 0;
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    if (flushing) {
+        spin_unlock_irqrestore(&bc_lock, fl);
+        return 0;
+    }
+    flushing = 1;
+
+    int rc = 0;
+    bcache_buf_t *batch[BCACHE_FLUSH_BATCH];
+    while (rc == 0) {
+        int n = 0;
+        for (bcache_buf_t *b = lru_head; b && n < BCACHE_FLUSH_BATCH; b = b->lru_next) {
+            if ((b->flags & (BC_DIRTY | BC_BUSY)) == BC_DIRTY && (!dev || b->dev == dev))
+                batch[n++] = b;
+        }
+        if (n == 0) {
+            /* write-behind still in flight is not on the disk yet either;
+               a failed one leaves its sectors dirty for the next round */
+            if (!aio_wait(dev, 1, &fl)) break;
+            continue;
+        }
+        sort_batch(batch, n);
+        for (int i = 0; i < n; i++) batch[i]->flags |= BC_BUSY;
+        spin_unlock_irqrestore(&bc_lock, fl);
+
+        /* merge consecutive sectors into one request through the bounce buffer */
+        int done = 0;
+        while (done < n) {
+            int run = 1;
+            memcpy(flush_bounce, batch[done]->data, BC_SECTOR);
+            while (done + run < n && batch[done + run]->dev == batch[done]->dev &&
+                   batch[done + run]->lba == batch[done]->lba + (uint64_t)run) {
+                memcpy(flush_bounce + run * BC_SECTOR, batch[done + run]->data, BC_SECTOR);
+                run++;
+            }
+            int r = batch[done]->dev->write(batch[done]->dev, batch[done]->lba, (uint32_t)run, flush_bounce);
+            if (r != 0) {
+                serial("[BCACHE] flush of %s lba %llu (+%d) failed (%d)\n", batch[done]->dev->name,
+                       (unsigned long long)batch[done]->lba, run, r);
+                rc = r;
+                break;
+            }
+            done += run;
+        }
+
+        fl = spin_lock_irqsave(&bc_lock);
+        for (int i = 0; i < n; i++) {
+            batch[i]->flags &= ~BC_BUSY;
+            if (i < done) {
+                mark_clean(batch[i]);
+                st.writebacks++;
+            }
+        }
+        TRACE(TR_BC_FLUSH, done, rc, 0, 0);
+    }
+    if (st.dirty) dirty_since_ms = timer_uptime_ms();
+    flushing = 0;
+    spin_unlock_irqrestore(&bc_lock, fl);
+    return rc;
+}
+
+void bcache_invalidate(block_device_t *dev) {
+    if (!bufs) return;
+    bcache_flush(dev);
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    for (uint32_t i = 0; i < st.nblocks; i++) {
+        bcache_buf_t *b = &bufs[i];
+        if (!(b->flags & BC_VALID) || (b->flags & BC_BUSY) || b->dev != dev) continue;
+        if (b->flags & BC_DIRTY) continue; /* flush failed: keep the data */
+        drop_buf(b);
+    }
+    spin_unlock_irqrestore(&bc_lock, fl);
+}
+
+void bcache_periodic(void) {
+    if (!bufs || !st.dirty || flushing) return;
+    if (timer_uptime_ms() - dirty_since_ms < BCACHE_FLUSH_MS) return;
+    bcache_flush(0);
+}
+
+static void bcache_free(void) {
+    if (bufs) kfree(bufs);
+    if (data_pool) kfree(data_pool);
+    if (hash) kfree(hash);
+    if (flush_bounce) kfree(flush_bounce);
+    for (int i = 0; i < BCACHE_ASYNC_SLOTS; i++) {
+        if (aio[i].bounce) kfree(aio[i].bounce);
+        aio[i].bounce = 0;
+    }
+    bufs = 0;
+    data_pool = 0;
+    hash = 0;
+    flush_bounce = 0;
+    lru_head = lru_tail = 0;
+}
+
+int bcache_init(uint32_t nblocks) {
+    if (bufs) {
+        bcache_flush(0);
+        uint32_t fl = spin_lock_irqsave(&bc_lock);
+        aio_wait(0, 0, &fl);
+        bcache_free();
+        spin_unlock_irqrestore(&bc_lock, fl);
+    }
+    memset(&st, 0, sizeof(st));
+    memset(streams, 0, sizeof(streams));
+    if (nblocks == 0) {
+        serial("[BCACHE] disabled\n");
+        return 0;
+    }
+    if (nblocks < 16) nblocks = 16;
+
+    uint32_t nbuckets = 1;
+    while (nbuckets < nblocks) nbuckets <<= 1;
+
+    bcache_buf_t *nb = (bcache_buf_t*)kmalloc(nblocks * sizeof(bcache_buf_t));
+    uint8_t *pool = (uint8_t*)kmalloc(nblocks * BC_SECTOR);
+    bcache_buf_t **ht = (bcache_buf_t**)kmalloc(nbuckets * sizeof(bcache_buf_t*));
+    uint8_t *bounce = (uint8_t*)kmalloc(BCACHE_FLUSH_BATCH * BC_SECTOR);
+    if (!nb || !pool || !ht || !bounce) {
+        if (nb) kfree(nb);
+        if (pool) kfree(pool);
+        if (ht) kfree(ht);
+        if (bounce) kfree(bounce);
+        serial("[BCACHE] out of memory for %u blocks, cache disabled\n", nblocks);
+        return -1;
+    }
+
+    memset(nb, 0, nblocks * sizeof(bcache_buf_t));
+    memset(ht, 0, nbuckets * sizeof(bcache_buf_t*));
+
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    data_pool = pool;
+    hash = ht;
+    hash_mask = nbuckets - 1;
+    flush_bounce = bounce;
+    lru_head = lru_tail = 0;
+    for (uint32_t i = 0; i < nblocks; i++) {
+        nb[i].data = pool + i * BC_SECTOR;
+        nb[i].lru_prev = lru_tail;
+        if (lru_tail) lru_tail->lru_next = &nb[i];
+        else lru_head = &nb[i];
+        lru_tail = &nb[i];
+    }
+    st.nblocks = nblocks;
+    bufs = nb;
+    spin_unlock_irqrestore(&bc_lock, fl);
+
+    /* without these bounce buffers the cache just runs synchronously */
+    for (int i = 0; i < BCACHE_ASYNC_SLOTS; i++) {
+        uint8_t *ab = (uint8_t*)kmalloc(BCACHE_RA_MAX * BC_SECTOR);
+        if (!ab) break;
+        fl = spin_lock_irqsave(&bc_lock);
+        aio[i].bounce = ab;
+        spin_unlock_irqrestore(&bc_lock, fl);
+    }
+
+    serial("[BCACHE] %u blocks (%u KB), %u hash buckets\n", nblocks, nblocks / 2, nbuckets);
+    return 0;
+}
+
+void bcache_get_stats(bcache_stats_t *out) {
+    if (!out) return;
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    *out = st;
+    spin_unlock_irqrestore(&bc_lock, fl);
+}
+
+void bcache_reset_stats(void) {
+    uint32_t fl = spin_lock_irqsave(&bc_lock);
+    st.hits = st.misses = st.evictions = st.writebacks = st.bypass = 0;
+    st.readahead = st.ra_hits = st.writebehind = 0;
+    spin_unlock_irqrestore(&bc_lock, fl);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include "block.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kernel/storage/bcache.h
+   Buffer cache for block_device_t: one sector per buffer, hashed on
+   (device, lba), LRU replacement, write-back with dirty tracking.
+   Reached through block_read()/block_write() (storage/block.h). */
+
+#define BCACHE_DEFAULT_BLOCKS 2048   /* 1 MB of 512-byte sectors */
+#define BCACHE_FLUSH_MS       2000   /* bcache_periodic(): dirty data age limit */
+
+typedef struct {
+    uint32_t nblocks;
+    uint32_t used;
+    uint32_t dirty;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t writebacks;     /* sectors written to the device from the cache */
+    uint32_t bypass;         /* large requests that went straight to the device */
+    uint32_t readahead;      /* sectors prefetched for sequential readers */
+    uint32_t ra_hits;        /* prefetched sectors that were then read */
+    uint32_t writebehind;    /* sectors written back early behind sequential writers */
+} bcache_stats_t;
+
+/* (re)size the cache; dirty data is flushed first. 0 on success */
+int bcache_init(uint32_t nblocks);
+int bcache_enabled(void);
+
+int bcache_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buf);
+int bcache_write(block_device_t *dev, uint64_t lba, uint32_t count, const void *buf);
+/* straight from the device into buf, without filling the cache; dirty
+   cached sectors are copied over what the disk returned */
+int bcache_read_direct(block_device_t *dev, uint64_t lba, uint32_t count, void *buf);
+
+/* write dirty sectors back (dev == NULL: every device); 0 on success */
+int bcache_flush(block_device_t *dev);
+/* drop every cached sector of dev (after flushing it) */
+void bcache_invalidate(block_device_t *dev);
+/* main loops: flush once the oldest dirty data is BCACHE_FLUSH_MS old */
+void bcache_periodic(void);
+
+void bcache_get_stats(bcache_stats_t *out);
+void bcache_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,5 @@
 #include "block.h"
+#include "bcache.h"
 #include "../string.h"
 
 extern void serial(const char *fmt, ...);
@@ -29,4 +30,21 @@ block_device_t* block_get(const char* name) {
         }
     }
     return 0;
-}
\ No newline at end of file
+}
+
+int block_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buf) {
+    return bcache_read(dev, lba, count, buf);
+}
+
+int block_write(block_device_t *dev, uint64_t lba, uint32_t count, const void *buf) {
+    return bcache_write(dev, lba, count, buf);
+}
+
+int block_read_direct(block_device_t *dev, uint64_t lba, uint32_t count, void *buf) {
+    if ((uintptr_t)buf & 0xFFF) return -1;
+    return bcache_read_direct(dev, lba, count, buf);
+}
+
+int block_sync(block_device_t *dev) {
+    return bcache_flush(dev);
+}
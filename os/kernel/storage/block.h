@@ -5,12 +5,31 @@
 extern "C" {
 #endif
 
+typedef void (*block_done_fn)(int status, void *ctx);
+
+/* one piece of a scatter-gather request: count sectors at buf */
+typedef struct {
+    void *buf;
+    uint32_t count;
+} block_seg_t;
+
+#define BLOCK_EBUSY (-2)   /* submit: device queue full, retry after a completion */
+
 typedef struct block_device {
     char name[32];
     uint64_t sector_count;
     uint32_t sector_size;
     int (*read)(struct block_device *dev, uint64_t lba, uint32_t count, void *buf);
     int (*write)(struct block_device *dev, uint64_t lba, uint32_t count, const void *buf);
+    /* optional asynchronous driver path, driven by the I/O scheduler
+       (storage/io_sched.h): submit starts one command covering segs back to
+       back from lba and returns at once (0, BLOCK_EBUSY, or <0 on error);
+       done() runs on completion, possibly from an IRQ. poll reaps finished
+       commands when no interrupt does. Without submit, io_sched issues the
+       queued requests through read/write. */
+    int (*submit)(struct block_device *dev, int write, uint64_t lba,
+                  const block_seg_t *segs, int nsegs, block_done_fn done, void *ctx);
+    void (*poll)(struct block_device *dev);
     void *priv; // Driver private data
 } block_device_t;
 
@@ -18,6 +37,18 @@ void block_init(void);
 int block_register(block_device_t *dev);
 block_device_t* block_get(const char* name);
 
+/* I/O through the buffer cache (storage/bcache.h); filesystems use these
+   instead of dev->read/dev->write so cached and on-disk data stay coherent */
+int block_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buf);
+int block_write(block_device_t *dev, uint64_t lba, uint32_t count, const void *buf);
+int block_sync(block_device_t *dev); /* NULL: every device */
+
+/* Zero-copy read into a page-aligned buffer (page cache pages, or user
+   buffers mapped in the kernel page directory): a DMA driver transfers
+   straight into buf, one PRDT entry per page, and the cache only patches
+   in dirty sectors. -1 if buf is not page-aligned. */
+int block_read_direct(block_device_t *dev, uint64_t lba, uint32_t count, void *buf);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -1,66 +1,287 @@
+/* kernel/storage/io_sched.c
+   Block I/O scheduler, one queue per block_device_t.
+   - pending requests are kept sorted by LBA and dispatched C-LOOK style
+     (ascending from the last position, then wrap around); a request that
+     has waited IO_SCHED_DEADLINE_MS goes first
+   - adjacent requests of the same direction are merged into one
+     scatter-gather command (dev->submit), up to IO_SCHED_MERGE_SECTORS
+   - devices with dev->submit keep up to IO_SCHED_DEPTH commands in flight;
+     each completion (AHCI IRQ) dispatches the next one right away
+   - devices without it (PIO) are served synchronously from io_sched_poll()
+   Callbacks always run without io_lock, so they may submit again.
+*/
 #include "io_sched.h"
-#include "ahci/ahci.h"
+#include "../sync/spinlock.h"
+#include "../time/timer.h"
+#include "../debug/trace.h"
 
-#define MAX_IO_REQUESTS 64
+#define MAX_IO_REQUESTS        128
+#define IO_SCHED_MAX_DEVS      16
+#define IO_SCHED_DEPTH         8     /* commands in flight per device; the rest sort and merge */
+#define IO_SCHED_MERGE_SECTORS 256   /* largest merged command (128 KB) */
+#define IO_SCHED_MAX_SEGS      8
+#define IO_SCHED_DEADLINE_MS   500
 
-typedef struct {
-    int active;
-    int port;
+typedef struct io_request {
+    struct io_request *next;    /* device queue (sorted) or free list */
+    struct io_request *chain;   /* requests merged behind this one */
+    block_device_t *dev;
     io_op_t op;
     uint64_t lba;
     uint32_t count;
     void *buf;
     io_callback_t cb;
     void *ctx;
+    uint32_t queued_ms;
+    int status;                 /* dispatch error, for the failed list */
 } io_request_t;
 
-static io_request_t queue[MAX_IO_REQUESTS];
-static int head = 0;
-static int tail = 0;
+typedef struct {
+    block_device_t *dev;
+    io_request_t *queue;
+    uint64_t pos;               /* elevator position: sector after the last command */
+    uint32_t inflight;
+} io_devq_t;
+
+static io_request_t pool[MAX_IO_REQUESTS];
+static io_request_t *free_list = NULL;
+static io_devq_t devqs[IO_SCHED_MAX_DEVS];
+static int ndevqs = 0;
+/* submit may come from IRQ context or another CPU */
+static spinlock_t io_lock = SPINLOCK_INIT("io_sched");
 
 void io_sched_init(void) {
-    for (int i = 0; i < MAX_IO_REQUESTS; i++) {
-        queue[i].active = 0;
+    uint32_t flags = spin_lock_irqsave(&io_lock);
+    free_list = NULL;
+    for (int i = MAX_IO_REQUESTS - 1; i >= 0; i--) {
+        pool[i].next = free_list;
+        free_list = &pool[i];
     }
+    ndevqs = 0;
+    spin_unlock_irqrestore(&io_lock, flags);
 }
 
-int io_sched_submit(int port, io_op_t op, uint64_t lba, uint32_t count, void *buf, io_callback_t cb, void *ctx) {
-    int next = (head + 1) % MAX_IO_REQUESTS;
-    if (next == tail) return -1; // Queue full
-
-    io_request_t *req = &queue[head];
-    req->port = port;
-    req->op = op;
-    req->lba = lba;
-    req->count = count;
-    req->buf = buf;
-    req->cb = cb;
-    req->ctx = ctx;
-    req->active = 1;
-
-    head = next;
+/* ---- queues (io_lock held) ---- */
+
+static io_devq_t *devq_get(block_device_t *dev) {
+    for (int i = 0; i < ndevqs; i++) {
+        if (devqs[i].dev == dev) return &devqs[i];
+    }
+    if (ndevqs >= IO_SCHED_MAX_DEVS) return NULL;
+    io_devq_t *q = &devqs[ndevqs++];
+    q->dev = dev;
+    q->queue = NULL;
+    q->pos = 0;
+    q->inflight = 0;
+    return q;
+}
+
+/* after any request with the same LBA: equal requests keep their order */
+static void queue_insert(io_devq_t *q, io_request_t *r) {
+    io_request_t **pp = &q->queue;
+    while (*pp && (*pp)->lba <= r->lba) pp = &(*pp)->next;
+    r->next = *pp;
+    *pp = r;
+}
+
+static void req_free(io_request_t *r) {
+    r->next = free_list;
+    free_list = r;
+}
+
+/* Take the next command off the queue: the expired request if there is one,
+   else the first at or after the elevator position; then pull in the
+   requests that continue it, if the device can take scatter-gather. */
+static io_request_t *pick(io_devq_t *q) {
+    uint32_t now = timer_uptime_ms();
+    io_request_t **pp = &q->queue;
+    io_request_t **oldest = &q->queue;
+    for (io_request_t **it = &q->queue; *it; it = &(*it)->next) {
+        if (now - (*it)->queued_ms > now - (*oldest)->queued_ms) oldest = it;
+    }
+    if (now - (*oldest)->queued_ms >= IO_SCHED_DEADLINE_MS) {
+        pp = oldest;
+    } else {
+        while (*pp && (*pp)->lba < q->pos) pp = &(*pp)->next;
+        if (!*pp) pp = &q->queue; /* end of the sweep: wrap */
+    }
+
+    io_request_t *r = *pp;
+    *pp = r->next;
+    r->chain = NULL;
+
+    uint32_t total = r->count;
+    int nsegs = 1;
+    io_request_t *tail = r;
+    while (q->dev->submit && *pp && nsegs < IO_SCHED_MAX_SEGS) {
+        io_request_t *x = *pp;
+        if (x->op != r->op || x->lba != r->lba + total ||
+            total + x->count > IO_SCHED_MERGE_SECTORS) break;
+        *pp = x->next;
+        x->chain = NULL;
+        tail->chain = x;
+        tail = x;
+        total += x->count;
+        nsegs++;
+    }
+    q->pos = r->lba + total;
+    return r;
+}
+
+static void io_done(int status, void *ctx);
+
+/* Fill the device's free command slots. Requests the driver refused with
+   an error are returned (linked through next) for the caller to complete
+   once io_lock is dropped. */
+static io_request_t *dispatch(io_devq_t *q) {
+    io_request_t *failed = NULL;
+    while (q->queue && q->inflight < IO_SCHED_DEPTH) {
+        uint64_t pos = q->pos;
+        io_request_t *r = pick(q);
+        block_seg_t segs[IO_SCHED_MAX_SEGS];
+        int n = 0;
+        uint32_t total = 0;
+        for (io_request_t *x = r; x; x = x->chain) {
+            segs[n].buf = x->buf;
+            segs[n].count = x->count;
+            total += x->count;
+            n++;
+        }
+        TRACE(TR_IOS_DISPATCH, r->op, r->lba, total, n);
+        int rc = q->dev->submit(q->dev, r->op == IO_OP_WRITE, r->lba, segs, n, io_done, r);
+        if (rc == BLOCK_EBUSY) {
+            /* driver full (sync users hold slots): retry on a completion or poll */
+            for (io_request_t *x = r, *nx; x; x = nx) {
+                nx = x->chain;
+                queue_insert(q, x);
+            }
+            q->pos = pos;
+            break;
+        }
+        if (rc < 0) {
+            r->status = rc;
+            r->next = failed;
+            failed = r;
+            continue;
+        }
+        q->inflight++;
+    }
+    return failed;
+}
+
+/* run the callbacks of a command (unlocked), then recycle its requests */
+static void finish(io_request_t *r, int status) {
+    TRACE(TR_IOS_DONE, r->op, r->lba, r->count, status);
+    for (io_request_t *x = r; x; x = x->chain) {
+        if (x->cb) x->cb(status, x->ctx);
+    }
+    uint32_t flags = spin_lock_irqsave(&io_lock);
+    for (io_request_t *x = r, *nx; x; x = nx) {
+        nx = x->chain;
+        req_free(x);
+    }
+    spin_unlock_irqrestore(&io_lock, flags);
+}
+
+static void finish_failed(io_request_t *failed) {
+    while (failed) {
+        io_request_t *nx = failed->next;
+        finish(failed, failed->status);
+        failed = nx;
+    }
+}
+
+/* driver completion: may run in IRQ context */
+static void io_done(int status, void *ctx) {
+    io_request_t *r = (io_request_t*)ctx;
+    block_device_t *dev = r->dev;
+    finish(r, status);
+
+    uint32_t flags = spin_lock_irqsave(&io_lock);
+    io_devq_t *q = devq_get(dev);
+    io_request_t *failed = NULL;
+    if (q) {
+        q->inflight--;
+        failed = dispatch(q);
+    }
+    spin_unlock_irqrestore(&io_lock, flags);
+    finish_failed(failed);
+}
+
+/* ---- public API ---- */
+
+int io_sched_submit_dev(block_device_t *dev, io_op_t op, uint64_t lba, uint32_t count,
+                        void *buf, io_callback_t cb, void *ctx) {
+    if (!dev || count == 0) return -1;
+    uint32_t flags = spin_lock_irqsave(&io_lock);
+    io_devq_t *q = devq_get(dev);
+    io_request_t *r = free_list;
+    if (!q || !r) { // Queue full
+        spin_unlock_irqrestore(&io_lock, flags);
+        return -1;
+    }
+    free_list = r->next;
+
+    r->dev = dev;
+    r->op = op;
+    r->lba = lba;
+    r->count = count;
+    r->buf = buf;
+    r->cb = cb;
+    r->ctx = ctx;
+    r->chain = NULL;
+    r->status = 0;
+    r->queued_ms = timer_uptime_ms();
+    queue_insert(q, r);
+    TRACE(TR_IOS_QUEUE, op, lba, count, q->inflight);
+
+    io_request_t *failed = NULL;
+    if (dev->submit) failed = dispatch(q);
+    spin_unlock_irqrestore(&io_lock, flags);
+    finish_failed(failed);
     return 0;
 }
 
+int io_sched_submit(int port, io_op_t op, uint64_t lba, uint32_t count, void *buf, io_callback_t cb, void *ctx) {
+    char name[6] = { 'a', 'h', 'c', 'i', '0', 0 };
+    if (port < 0 || port > 9) return -1;
+    name[4] = (char)('0' + port);
+    return io_sched_submit_dev(block_get(name), op, lba, count, buf, cb, ctx);
+}
+
+/* Reap finished commands where no IRQ did, push queued requests into the
+   slots that freed up, and run the queues of synchronous devices. */
 void io_sched_poll(void) {
-    if (head == tail) return; // Empty
-
-    io_request_t *req = &queue[tail];
-    if (req->active) {
-        int status = -1;
-        // Dispatch to driver (AHCI)
-        // Nota: Deocamdată AHCI e sincron, deci asta va bloca scurt timp.
-        // Pe viitor, ahci_read_lba ar trebui să returneze imediat și să seteze un flag.
-        if (req->op == IO_OP_READ) {
-            status = ahci_read_lba(req->port, req->lba, req->count, req->buf);
-        } else {
-            status = ahci_write_lba(req->port, req->lba, req->count, req->buf);
+    for (int i = 0; i < ndevqs; i++) {
+        io_devq_t *q = &devqs[i];
+        block_device_t *dev = q->dev;
+        if (dev->submit) {
+            if (dev->poll) dev->poll(dev);
+            uint32_t flags = spin_lock_irqsave(&io_lock);
+            io_request_t *failed = dispatch(q);
+            spin_unlock_irqrestore(&io_lock, flags);
+            finish_failed(failed);
+            continue;
         }
 
-        if (req->cb) {
-            req->cb(status, req->ctx);
+        /* no async path: one request at a time, in elevator order */
+        for (;;) {
+            uint32_t flags = spin_lock_irqsave(&io_lock);
+            if (!q->queue || q->inflight) {
+                spin_unlock_irqrestore(&io_lock, flags);
+                break;
+            }
+            io_request_t *r = pick(q);
+            q->inflight++;
+            spin_unlock_irqrestore(&io_lock, flags);
+            TRACE(TR_IOS_DISPATCH, r->op, r->lba, r->count, 1);
+
+            int rc = r->op == IO_OP_WRITE ? dev->write(dev, r->lba, r->count, r->buf)
+                                          : dev->read(dev, r->lba, r->count, r->buf);
+            flags = spin_lock_irqsave(&io_lock);
+            q->inflight--;
+            spin_unlock_irqrestore(&io_lock, flags);
+            finish(r, rc);
         }
-        req->active = 0;
     }
-    tail = (tail + 1) % MAX_IO_REQUESTS;
-}
\ No newline at end of file
+}
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "block.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,10 +16,19 @@ typedef enum {
 
 typedef void (*io_callback_t)(int status, void *ctx);
 
-/* Adaugă o cerere în coadă (non-blocking) */
+/* Adaugă o cerere în coada dispozitivului (non-blocking): 0 = acceptată,
+   -1 = nu mai sunt cereri libere. Callback-ul rulează la terminare, din
+   IRQ sau din io_sched_poll(). Cererile aflate simultan în coadă pot fi
+   reordonate: nu pune în coadă citiri și scrieri care se suprapun. */
+int io_sched_submit_dev(block_device_t *dev, io_op_t op, uint64_t lba, uint32_t count,
+                        void *buf, io_callback_t cb, void *ctx);
+
+/* Același lucru pentru portul AHCI `port` (dispozitivul "ahci<port>") */
 int io_sched_submit(int port, io_op_t op, uint64_t lba, uint32_t count, void *buf, io_callback_t cb, void *ctx);
 
-/* Procesează coada (trebuie apelat în main loop sau timer interrupt) */
+/* Procesează cozile (main loop sau cine așteaptă o cerere): culege
+   comenzile terminate fără IRQ, trimite ce a rămas în coadă și servește
+   sincron dispozitivele fără dev->submit (PIO). */
 void io_sched_poll(void);
 
 /* Inițializează scheduler-ul */
@@ -28,4 +38,4 @@ void io_sched_init(void);
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
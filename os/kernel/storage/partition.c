@@ -1,5 +1,6 @@
 #include "partition.h"
 #include "ahci/ahci.h"
+#include "block.h"
 #include "../string.h"
 
 /* MBR Structures */
@@ -48,8 +49,17 @@ typedef struct {
 static uint8_t sector_buf[512];
 static uint8_t gpt_entry_buf[512];
 
+/* AHCI port -> its block device (named like in ahci_init), so the scan
+   goes through the buffer cache like the filesystems that follow it */
+static block_device_t *port_dev(int port) {
+    char name[6] = { 'a', 'h', 'c', 'i', (char)('0' + port), 0 };
+    return block_get(name);
+}
+
 int partition_scan(int port, partition_info_t *out_parts, int max_parts) {
-    if (ahci_read_lba(port, 0, 1, sector_buf) != 0) return -1;
+    block_device_t *dev = port_dev(port);
+    if (!dev) return -1;
+    if (block_read(dev, 0, 1, sector_buf) != 0) return -1;
 
     mbr_t *mbr = (mbr_t*)sector_buf;
     if (mbr->signature != 0xAA55) {
@@ -62,7 +72,7 @@ int partition_scan(int port, partition_info_t *out_parts, int max_parts) {
         serial("[PART] GPT Protective MBR detected. Parsing GPT...\n");
         
         /* Read GPT Header at LBA 1 */
-        if (ahci_read_lba(port, 1, 1, sector_buf) != 0) return -1;
+        if (block_read(dev, 1, 1, sector_buf) != 0) return -1;
         gpt_header_t *gpt = (gpt_header_t*)sector_buf;
 
         if (gpt->signature != 0x5452415020494645ULL) { /* "EFI PART" */
@@ -81,7 +91,7 @@ int partition_scan(int port, partition_info_t *out_parts, int max_parts) {
 
         for (uint32_t i = 0; i < num_entries && count < max_parts; i++) {
             if (i % entries_per_sector == 0) {
-                if (ahci_read_lba(port, entry_lba + (i / entries_per_sector), 1, gpt_entry_buf) != 0) break;
+                if (block_read(dev, entry_lba + (i / entries_per_sector), 1, gpt_entry_buf) != 0) break;
             }
             
             gpt_entry_t *e = (gpt_entry_t*)(gpt_entry_buf + (i % entries_per_sector) * entry_size);
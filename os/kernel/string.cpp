@@ -89,13 +89,81 @@ char* strstr(const char* haystack, const char* needle)
     return NULL;
 }
 
-/* ---------- memory ops ---------- */
+/* ---------- memory ops ----------
+   Size-dispatched:
+   - n <= MEM_SMALL_MAX           : word/byte loops (no setup cost)
+   - n <  MEM_NT_THRESHOLD        : rep movsd / rep stosd
+   - n >= MEM_NT_THRESHOLD + SSE2 : movnti non-temporal stores, so framebuffer-sized
+                                    blocks do not flush the whole cache
+   movnti only uses general purpose registers, so no FPU/XMM state has to be
+   saved around it (the kernel does not manage SSE context).
+*/
+
+#define MEM_SMALL_MAX    64u
+#define MEM_NT_THRESHOLD (256u * 1024u)
+
+static int mem_nt_ok = 0; /* set by string_init_cpu() when CPUID reports SSE2 */
+
+static inline void copy_small(unsigned char* d, const unsigned char* s, size_t n)
+{
+    while (n >= 4) {
+        *(uint32_t*)d = *(const uint32_t*)s;
+        d += 4; s += 4; n -= 4;
+    }
+    while (n--) *d++ = *s++;
+}
+
+static inline void copy_rep(unsigned char* d, const unsigned char* s, size_t n)
+{
+    /* align the destination so rep movsd runs on whole words */
+    size_t head = (size_t)(-(uintptr_t)d) & 3u;
+    if (head > n) head = n;
+    n -= head;
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(head) :: "memory");
+    size_t dw = n >> 2;
+    asm volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(dw) :: "memory");
+    size_t tail = n & 3u;
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(tail) :: "memory");
+}
+
+static void copy_nt(unsigned char* d, const unsigned char* s, size_t n)
+{
+    /* align the destination to 16 so write-combining buffers fill whole lines */
+    size_t head = (size_t)(-(uintptr_t)d) & 15u;
+    copy_rep(d, s, head);
+    d += head; s += head; n -= head;
+
+    size_t blocks = n >> 4;
+    if (blocks) {
+        asm volatile(
+            "1:\n\t"
+            "movl   (%[s]), %%eax\n\t"
+            "movl  4(%[s]), %%edx\n\t"
+            "movnti %%eax,   (%[d])\n\t"
+            "movnti %%edx,  4(%[d])\n\t"
+            "movl  8(%[s]), %%eax\n\t"
+            "movl 12(%[s]), %%edx\n\t"
+            "movnti %%eax,  8(%[d])\n\t"
+            "movnti %%edx, 12(%[d])\n\t"
+            "addl $16, %[s]\n\t"
+            "addl $16, %[d]\n\t"
+            "decl %[n]\n\t"
+            "jnz 1b\n\t"
+            "sfence"
+            : [d] "+r"(d), [s] "+r"(s), [n] "+r"(blocks)
+            :
+            : "eax", "edx", "memory", "cc");
+    }
+    copy_rep(d, s, n & 15u);
+}
 
 void* memcpy(void* dest, const void* src, size_t n)
 {
     unsigned char* d = (unsigned char*)dest;
     const unsigned char* s = (const unsigned char*)src;
-    for (size_t i = 0; i < n; ++i) d[i] = s[i];
+    if (n <= MEM_SMALL_MAX) copy_small(d, s, n);
+    else if (n >= MEM_NT_THRESHOLD && mem_nt_ok) copy_nt(d, s, n);
+    else copy_rep(d, s, n);
     return dest;
 }
 
@@ -103,19 +171,85 @@ void* memmove(void* dest, const void* src, size_t n)
 {
     unsigned char* d = (unsigned char*)dest;
     const unsigned char* s = (const unsigned char*)src;
-    if (d < s) {
-        for (size_t i = 0; i < n; ++i) d[i] = s[i];
-    } else if (d > s) {
-        for (size_t i = n; i > 0; --i) d[i-1] = s[i-1];
+    if (d == s || n == 0) return dest;
+
+    if (d < s || d >= s + n) {
+        /* forward copy is safe: reads always stay ahead of writes */
+        if (n >= MEM_NT_THRESHOLD && mem_nt_ok && d >= s + n) copy_nt(d, s, n);
+        else if (n <= MEM_SMALL_MAX && d + 4 <= s) copy_small(d, s, n);
+        else if (n <= MEM_SMALL_MAX) { for (size_t i = 0; i < n; ++i) d[i] = s[i]; }
+        else copy_rep(d, s, n);
+        return dest;
+    }
+
+    /* overlapping with dest above src: copy backwards, a dword at a time.
+       No std/rep movsl: DF=1 must never be visible to an interrupt. */
+    unsigned char* de = d + n;
+    const unsigned char* se = s + n;
+    size_t tail = n & 3u;
+    while (tail--) *--de = *--se;
+    for (size_t dw = n >> 2; dw; --dw) {
+        de -= 4; se -= 4;
+        uint32_t v;
+        __builtin_memcpy(&v, se, 4);
+        __builtin_memcpy(de, &v, 4);
     }
     return dest;
 }
 
+static inline void set_small(unsigned char* p, uint32_t pattern, size_t n)
+{
+    while (n >= 4) {
+        *(uint32_t*)p = pattern;
+        p += 4; n -= 4;
+    }
+    while (n--) *p++ = (unsigned char)pattern;
+}
+
+static inline void set_rep(unsigned char* p, uint32_t pattern, size_t n)
+{
+    size_t head = (size_t)(-(uintptr_t)p) & 3u;
+    if (head > n) head = n;
+    n -= head;
+    asm volatile("rep stosb" : "+D"(p), "+c"(head) : "a"(pattern) : "memory");
+    size_t dw = n >> 2;
+    asm volatile("rep stosl" : "+D"(p), "+c"(dw) : "a"(pattern) : "memory");
+    size_t tail = n & 3u;
+    asm volatile("rep stosb" : "+D"(p), "+c"(tail) : "a"(pattern) : "memory");
+}
+
+static void set_nt(unsigned char* p, uint32_t pattern, size_t n)
+{
+    size_t head = (size_t)(-(uintptr_t)p) & 15u;
+    set_rep(p, pattern, head);
+    p += head; n -= head;
+
+    size_t blocks = n >> 4;
+    if (blocks) {
+        asm volatile(
+            "1:\n\t"
+            "movnti %[v],   (%[p])\n\t"
+            "movnti %[v],  4(%[p])\n\t"
+            "movnti %[v],  8(%[p])\n\t"
+            "movnti %[v], 12(%[p])\n\t"
+            "addl $16, %[p]\n\t"
+            "decl %[n]\n\t"
+            "jnz 1b\n\t"
+            "sfence"
+            : [p] "+r"(p), [n] "+r"(blocks)
+            : [v] "r"(pattern)
+            : "memory", "cc");
+    }
+    set_rep(p, pattern, n & 15u);
+}
+
 void* memset(void* s, int c, size_t n)
 {
     unsigned char* p = (unsigned char*)s;
-    unsigned char uc = (unsigned char)c;
-    for (size_t i = 0; i < n; ++i) p[i] = uc;
+    uint32_t pattern = (uint32_t)(unsigned char)c * 0x01010101u;
+    if (n <= MEM_SMALL_MAX) set_small(p, pattern, n);
+    else if (n >= MEM_NT_THRESHOLD && mem_nt_ok) set_nt(p, pattern, n);
+    else set_rep(p, pattern, n);
     return s;
 }
 
@@ -123,12 +257,91 @@ int memcmp(const void* s1, const void* s2, size_t n)
 {
     const unsigned char* a = (const unsigned char*)s1;
     const unsigned char* b = (const unsigned char*)s2;
+    /* skip equal words, then locate the differing byte */
+    while (n >= 4 && *(const uint32_t*)a == *(const uint32_t*)b) {
+        a += 4; b += 4; n -= 4;
+    }
     for (size_t i = 0; i < n; ++i) {
         if (a[i] != b[i]) return a[i] - b[i];
     }
     return 0;
 }
 
+/* ---------- mem* fast path setup ---------- */
+
+extern "C" void string_init_cpu(void)
+{
+    uint32_t a, b, c, d;
+    asm volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0), "c"(0));
+    if (a < 1) return;
+    asm volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1), "c"(0));
+    mem_nt_ok = (d >> 26) & 1; /* SSE2 -> movnti */
+}
+
+extern "C" int string_nt_enabled(void)
+{
+    return mem_nt_ok;
+}
+
+static int selftest_one(unsigned char* src, unsigned char* dst, size_t n, size_t off)
+{
+    for (size_t i = 0; i < n + 32; ++i) { src[i] = (unsigned char)(i * 7 + 3); dst[i] = 0xEE; }
+
+    memcpy(dst + off, src + 1, n);
+    if (off > 0 && dst[off - 1] != 0xEE) return -1;
+    if (dst[off + n] != 0xEE) return -1;
+    if (memcmp(dst + off, src + 1, n) != 0) return -1;
+    for (size_t i = 0; i < n; ++i) if (dst[off + i] != src[1 + i]) return -1;
+
+    memset(dst + off, 0x5A, n);
+    if (dst[off + n] != 0xEE) return -1;
+    for (size_t i = 0; i < n; ++i) if (dst[off + i] != 0x5A) return -1;
+
+    /* overlapping moves in both directions */
+    memmove(src + 3, src, n);
+    for (size_t i = 0; i < n; ++i) if (src[3 + i] != (unsigned char)(i * 7 + 3)) return -1;
+    for (size_t i = 0; i < n + 3; ++i) src[i] = (unsigned char)(i * 7 + 3);
+    memmove(src, src + 3, n);
+    for (size_t i = 0; i < n; ++i) if (src[i] != (unsigned char)((i + 3) * 7 + 3)) return -1;
+
+    if (n && memcmp(src, src + 1, n) == 0) return -1;
+    return 0;
+}
+
+/* Boot-time check of every size class; falls back to rep paths if the
+   non-temporal path misbehaves. Returns 0 on success. */
+extern "C" int string_selftest(void)
+{
+    static const size_t sizes[] = { 0, 1, 3, 4, 15, 63, 64, 65, 255, 1000, 4097,
+                                    MEM_NT_THRESHOLD - 1, MEM_NT_THRESHOLD + 13 };
+    size_t cap = MEM_NT_THRESHOLD + 64;
+    unsigned char* src = (unsigned char*)kmalloc(cap);
+    unsigned char* dst = (unsigned char*)kmalloc(cap);
+    if (!src || !dst) {
+        if (src) kfree(src);
+        if (dst) kfree(dst);
+        return -1;
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; ++i) {
+        for (size_t off = 0; off < 4 && rc == 0; ++off) {
+            rc = selftest_one(src, dst, sizes[i], off);
+        }
+    }
+    if (rc != 0 && mem_nt_ok) {
+        mem_nt_ok = 0;
+        rc = -2; /* non-temporal path disabled, rep paths still verified below */
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            if (selftest_one(src, dst, sizes[i], 1) != 0) { rc = -1; break; }
+        }
+    }
+
+    kfree(src);
+    kfree(dst);
+    return rc;
+}
+
 /* ---------- small integer->string helpers (useful for debug) ---------- */
 
 char* itoa_dec(char* out, int32_t v)
@@ -20,12 +20,17 @@ char* strrchr(const char* s, int c);
 char* strstr(const char* haystack, const char* needle);
 char* strdup(const char* s);
 
-/* Memory helpers (byte-oriented) */
+/* Memory helpers (size-dispatched: word loops / rep movs / movnti) */
 void* memcpy(void* dest, const void* src, size_t n);
 void* memmove(void* dest, const void* src, size_t n);
 void* memset(void* s, int c, size_t n);
 int memcmp(const void* s1, const void* s2, size_t n);
 
+/* mem* fast path setup: CPUID probe, boot self-test (0 = ok), NT path state */
+void string_init_cpu(void);
+int string_selftest(void);
+int string_nt_enabled(void);
+
 /* Small convenience conversions */
 char* itoa_dec(char* out, int32_t v); /* decimal, returns out */
 char* utoa_hex(char* out, uint32_t v); /* hex (lowercase), returns out */
@@ -34,9 +34,9 @@ int vmm_map_pages(void* page_dir, uint32_t vaddr, void* phys, uint32_t size, uin
 }
 
 /* PMM stub - allocation fails */
-void* pmm_alloc_frames(uint32_t pages) __attribute__((weak));
-void* pmm_alloc_frames(uint32_t pages) {
-    (void)pages;
+void* pmm_alloc_frames(uint32_t pages, uint32_t align) __attribute__((weak));
+void* pmm_alloc_frames(uint32_t pages, uint32_t align) {
+    (void)pages; (void)align;
     terminal_printf("[stub pmm] pmm_alloc_frames(%u) not implemented\n", pages);
     return NULL;
 }
@@ -0,0 +1,248 @@
+/* kernel/sync/spinlock.c
+   Ticket spinlocks (FIFO: each CPU takes a ticket and waits for its turn),
+   IRQ-safe wrappers and writer-preferring reader-writer locks.
+   SYNC_DEBUG builds keep per-lock statistics on a registry list.
+*/
+
+#include "spinlock.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SYNC_DEBUG
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* registry of locks that have been used at least once */
+static spinlock_t* lock_list = NULL;
+static volatile int registry_lock = 0;
+
+static void dbg_register(spinlock_t* lock) {
+    uint32_t fl = irq_save();
+    while (__atomic_test_and_set(&registry_lock, __ATOMIC_ACQUIRE)) {
+        while (registry_lock) asm volatile("pause");
+    }
+    /* spin_init may run again on a lock that is already listed */
+    for (spinlock_t* l = lock_list; l && !lock->registered; l = l->dbg_next) {
+        if (l == lock) lock->registered = 1;
+    }
+    if (!lock->registered) {
+        if (!lock->name) lock->name = "?";
+        lock->dbg_next = lock_list;
+        lock_list = lock;
+        lock->registered = 1;
+    }
+    __atomic_clear(&registry_lock, __ATOMIC_RELEASE);
+    irq_restore(fl);
+}
+
+static void dbg_acquired(spinlock_t* lock, uint32_t spins) {
+    if (!lock->registered) dbg_register(lock);
+    lock->acquires++;
+    if (spins) {
+        lock->contended++;
+        lock->spins += spins;
+    }
+    lock->t_acquired = rdtsc();
+}
+
+static void dbg_release(spinlock_t* lock) {
+    uint64_t held = rdtsc() - lock->t_acquired;
+    if (held > lock->max_hold) lock->max_hold = held;
+}
+#endif
+
+void spin_init(spinlock_t* lock, const char* name) {
+    lock->next = 0;
+    lock->owner = 0;
+#ifdef SYNC_DEBUG
+    lock->name = name;
+    lock->acquires = lock->contended = lock->spins = 0;
+    lock->max_hold = lock->t_acquired = 0;
+    lock->registered = 0;
+    lock->dbg_next = NULL;
+    dbg_register(lock);
+#else
+    (void)name;
+#endif
+}
+
+void spin_lock(spinlock_t* lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint32_t spins = 0;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        asm volatile("pause");
+        spins++;
+    }
+#ifdef SYNC_DEBUG
+    dbg_acquired(lock, spins);
+#else
+    (void)spins;
+#endif
+}
+
+int spin_trylock(spinlock_t* lock) {
+    uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+    uint16_t expected = owner;
+    /* free when no ticket is outstanding: next == owner */
+    if (!__atomic_compare_exchange_n(&lock->next, &expected, (uint16_t)(owner + 1), 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+#ifdef SYNC_DEBUG
+    dbg_acquired(lock, 0);
+#endif
+    return 1;
+}
+
+void spin_unlock(spinlock_t* lock) {
+#ifdef SYNC_DEBUG
+    dbg_release(lock);
+#endif
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+int spin_is_locked(spinlock_t* lock) {
+    return __atomic_load_n(&lock->owner, __ATOMIC_RELAXED) !=
+           __atomic_load_n(&lock->next, __ATOMIC_RELAXED);
+}
+
+uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+/* ---------- reader-writer locks ----------
+   Readers back off while a writer waits, so writers cannot starve. */
+
+void rwlock_init(rwlock_t* lock, const char* name) {
+    lock->count = 0;
+    lock->writers_waiting = 0;
+#ifdef SYNC_DEBUG
+    spin_init(&lock->stats, name);
+#else
+    (void)name;
+#endif
+}
+
+void read_lock(rwlock_t* lock) {
+    uint32_t spins = 0;
+    for (;;) {
+        int32_t c = __atomic_load_n(&lock->count, __ATOMIC_RELAXED);
+        if (c >= 0 && !lock->writers_waiting &&
+            __atomic_compare_exchange_n(&lock->count, &c, c + 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        asm volatile("pause");
+        spins++;
+    }
+#ifdef SYNC_DEBUG
+    if (!lock->stats.registered) dbg_register(&lock->stats);
+    __atomic_fetch_add(&lock->stats.acquires, 1, __ATOMIC_RELAXED);
+    if (spins) {
+        __atomic_fetch_add(&lock->stats.contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&lock->stats.spins, spins, __ATOMIC_RELAXED);
+    }
+#else
+    (void)spins;
+#endif
+}
+
+void read_unlock(rwlock_t* lock) {
+    __atomic_fetch_sub(&lock->count, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock_t* lock) {
+    uint32_t spins = 0;
+    __atomic_fetch_add(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+    for (;;) {
+        int32_t c = 0;
+        if (__atomic_compare_exchange_n(&lock->count, &c, -1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        asm volatile("pause");
+        spins++;
+    }
+    __atomic_fetch_sub(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+#ifdef SYNC_DEBUG
+    dbg_acquired(&lock->stats, spins);
+#else
+    (void)spins;
+#endif
+}
+
+void write_unlock(rwlock_t* lock) {
+#ifdef SYNC_DEBUG
+    dbg_release(&lock->stats);
+#endif
+    __atomic_store_n(&lock->count, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t read_lock_irqsave(rwlock_t* lock) {
+    uint32_t flags = irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+void read_unlock_irqrestore(rwlock_t* lock, uint32_t flags) {
+    read_unlock(lock);
+    irq_restore(flags);
+}
+
+uint32_t write_lock_irqsave(rwlock_t* lock) {
+    uint32_t flags = irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+void write_unlock_irqrestore(rwlock_t* lock, uint32_t flags) {
+    write_unlock(lock);
+    irq_restore(flags);
+}
+
+/* ---------- statistics ---------- */
+
+int sync_debug_enabled(void) {
+#ifdef SYNC_DEBUG
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int sync_get_stats(int idx, lock_stats_t* out) {
+#ifdef SYNC_DEBUG
+    spinlock_t* l = lock_list;
+    while (l && idx-- > 0) l = l->dbg_next;
+    if (!l || !out) return -1;
+    out->name = l->name;
+    out->acquires = l->acquires;
+    out->contended = l->contended;
+    out->spins = l->spins;
+    out->max_hold = l->max_hold;
+    return 0;
+#else
+    (void)idx;
+    (void)out;
+    return -1;
+#endif
+}
+
+void sync_reset_stats(void) {
+#ifdef SYNC_DEBUG
+    for (spinlock_t* l = lock_list; l; l = l->dbg_next) {
+        l->acquires = l->contended = l->spins = 0;
+        l->max_hold = 0;
+    }
+#endif
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kernel/sync/spinlock.h
+   Ticket spinlocks, IRQ-safe variants and reader-writer locks.
+   - spin_lock / spin_unlock         : between CPUs, interrupts untouched
+   - spin_lock_irqsave / _irqrestore : state shared with IRQ handlers
+   - read_lock / write_lock          : many readers or one writer (writers first)
+   Build with -DSYNC_DEBUG to record per-lock acquires, contended acquires,
+   spin iterations and the longest hold time (TSC cycles); see `locks`.
+*/
+
+typedef struct spinlock {
+    volatile uint16_t next;   /* next ticket to hand out */
+    volatile uint16_t owner;  /* ticket being served */
+#ifdef SYNC_DEBUG
+    const char* name;
+    uint32_t acquires;
+    uint32_t contended;       /* acquires that had to wait */
+    uint32_t spins;           /* total wait iterations */
+    uint64_t max_hold;        /* longest hold, TSC cycles */
+    uint64_t t_acquired;
+    int registered;
+    struct spinlock* dbg_next;
+#endif
+} spinlock_t;
+
+typedef struct {
+    volatile int32_t count;   /* >0: readers, -1: writer, 0: free */
+    volatile uint32_t writers_waiting;
+#ifdef SYNC_DEBUG
+    spinlock_t stats;         /* only its counters are used */
+#endif
+} rwlock_t;
+
+#ifdef SYNC_DEBUG
+#define SPINLOCK_INIT(n) { 0, 0, (n), 0, 0, 0, 0, 0, 0, 0 }
+#define RWLOCK_INIT(n) { 0, 0, SPINLOCK_INIT(n) }
+#else
+#define SPINLOCK_INIT(n) { 0, 0 }
+#define RWLOCK_INIT(n) { 0, 0 }
+#endif
+
+/* Interrupt flag helpers: save EFLAGS and cli / restore EFLAGS
+   (SYNC_HOST: no-ops, for host-side builds such as tools/bench) */
+#ifdef SYNC_HOST
+static inline uint32_t irq_save(void) { return 0; }
+static inline void irq_restore(uint32_t flags) { (void)flags; }
+#else
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    asm volatile("pushl %0\n\tpopfl" :: "r"(flags) : "memory", "cc");
+}
+#endif
+
+void spin_init(spinlock_t* lock, const char* name);
+void spin_lock(spinlock_t* lock);
+int spin_trylock(spinlock_t* lock); /* 1 if acquired */
+void spin_unlock(spinlock_t* lock);
+int spin_is_locked(spinlock_t* lock);
+
+uint32_t spin_lock_irqsave(spinlock_t* lock);
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags);
+
+void rwlock_init(rwlock_t* lock, const char* name);
+void read_lock(rwlock_t* lock);
+void read_unlock(rwlock_t* lock);
+void write_lock(rwlock_t* lock);
+void write_unlock(rwlock_t* lock);
+uint32_t read_lock_irqsave(rwlock_t* lock);
+void read_unlock_irqrestore(rwlock_t* lock, uint32_t flags);
+uint32_t write_lock_irqsave(rwlock_t* lock);
+void write_unlock_irqrestore(rwlock_t* lock, uint32_t flags);
+
+/* Debug statistics (SYNC_DEBUG builds; otherwise sync_debug_enabled() == 0) */
+typedef struct {
+    const char* name;
+    uint32_t acquires;
+    uint32_t contended;
+    uint32_t spins;
+    uint64_t max_hold;
+} lock_stats_t;
+
+int sync_debug_enabled(void);
+int sync_get_stats(int idx, lock_stats_t* out); /* 0 ok, -1 past the end */
+void sync_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
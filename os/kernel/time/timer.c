@@ -1,20 +1,49 @@
 // kernel/time/timer.c
 #include "timer.h"
 #include "../drivers/pit.h"
+#include "../drivers/serial.h"
 #include "../interrupts/irq.h"
 #include "../interrupts/isr.h"
 #include "../arch/i386/io.h"
+#include "../arch/i386/idt.h"
+#include "../hardware/hpet.h"
+#include "../hardware/lapic.h"
+#include "../hardware/apic.h"
+#include "../smp/smp.h"
+#include "../sync/spinlock.h"
+#include "../sched/pcb.h"
+#include "../sched/scheduler.h"
 #include <stdint.h>
+#include <stddef.h>
 
 /* tick counter (updated from IRQ) */
 static volatile uint64_t ticks = 0;
 static uint32_t tick_hz = 100;
 
+/* One-shot deadlines: binary min-heap on deadline_ns.
+ * With APIC + HPET the BSP's LAPIC timer is programmed for the earliest
+ * deadline and the PIT is stopped (tickless); otherwise the heap is checked
+ * on every PIT tick. */
+#define KTIMER_MAX 64
+/* longest one-shot programmed at once; the ISR re-arms for later deadlines */
+#define ONESHOT_MAX_NS 1000000000ull
+
+static ktimer_t* theap[KTIMER_MAX];
+static volatile int theap_count = 0;
+static spinlock_t timer_lock = SPINLOCK_INIT("timer");
+
+static volatile int tickless = 0;
+static uint32_t lapic_tpms = 0;      /* LAPIC ticks per ms (divide-by-16) */
+static uint32_t bsp_apic_id = 0;
+static uint64_t ns_base = 0;         /* timer_now_ns() when the PIT was stopped */
+static uint64_t hpet_base = 0;       /* hpet_time_ns() at the same moment */
+
 /* IRQ0 handler */
 static void timer_irq_handler(registers_t* regs)
 {
     (void)regs;
     ticks++;
+    if (theap_count) timer_run_expired();
 }
 
 void timer_init(uint32_t frequency)
@@ -34,9 +63,19 @@ void timer_init(uint32_t frequency)
     outb(0x40, (uint8_t)((divisor >> 8) & 0xFF)); // High byte
 }
 
+/* monotonic ns: PIT ticks, or HPET once tickless (continuous across the switch) */
+uint64_t timer_now_ns(void)
+{
+    if (tickless) return ns_base + (hpet_time_ns() - hpet_base);
+    uint64_t t;
+    do { t = ticks; } while (t != ticks); /* 64-bit read vs. IRQ0 */
+    return t * (1000000000u / tick_hz);
+}
 
 uint64_t timer_ticks(void)
 {
+    if (tickless) return timer_now_ns() / (1000000000u / tick_hz);
+
     uint64_t ret;
     asm volatile("cli");
     ret = ticks;
@@ -46,25 +85,273 @@ uint64_t timer_ticks(void)
 
 uint32_t timer_uptime_seconds(void)
 {
+    if (tickless) return (uint32_t)(timer_now_ns() / 1000000000u);
     if (tick_hz == 0) return 0;
     return (uint32_t)ticks / tick_hz;
 }
 
 uint32_t timer_uptime_ms(void)
 {
+    if (tickless) return (uint32_t)(timer_now_ns() / 1000000u);
     if (tick_hz == 0) return 0;
     return ((uint32_t)ticks * 1000) / tick_hz;
 }
+
+/* ---- deadline heap (timer_lock held) ---- */
+
+static void heap_place(int i, ktimer_t* t)
+{
+    theap[i] = t;
+    t->heap_idx = i;
+}
+
+static void heap_sift_up(int i)
+{
+    ktimer_t* t = theap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (theap[parent]->deadline_ns <= t->deadline_ns) break;
+        heap_place(i, theap[parent]);
+        i = parent;
+    }
+    heap_place(i, t);
+}
+
+static void heap_sift_down(int i)
+{
+    ktimer_t* t = theap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= theap_count) break;
+        if (child + 1 < theap_count &&
+            theap[child + 1]->deadline_ns < theap[child]->deadline_ns) child++;
+        if (theap[child]->deadline_ns >= t->deadline_ns) break;
+        heap_place(i, theap[child]);
+        i = child;
+    }
+    heap_place(i, t);
+}
+
+static void heap_remove(ktimer_t* t)
+{
+    int i = t->heap_idx;
+    t->heap_idx = -1;
+    ktimer_t* last = theap[--theap_count];
+    if (i == theap_count) return;
+    heap_place(i, last);
+    heap_sift_up(i);
+    heap_sift_down(last->heap_idx);
+}
+
+static inline int on_bsp(void)
+{
+    return lapic_get_id() == bsp_apic_id;
+}
+
+/* point the BSP's LAPIC one-shot at the earliest deadline */
+static void deadline_program(void)
+{
+    if (theap_count == 0) {
+        lapic_timer_oneshot(SMP_DEADLINE_VECTOR, 0);
+        return;
+    }
+    uint64_t now = timer_now_ns();
+    uint64_t when = theap[0]->deadline_ns;
+    uint64_t delta = when > now ? when - now : 0;
+    if (delta > ONESHOT_MAX_NS) delta = ONESHOT_MAX_NS;
+    uint32_t count = (uint32_t)((delta * lapic_tpms) / 1000000u);
+    lapic_timer_oneshot(SMP_DEADLINE_VECTOR, count ? count : 1);
+}
+
+void ktimer_init(ktimer_t* t, void (*fn)(void* arg), void* arg)
+{
+    t->deadline_ns = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->heap_idx = -1;
+}
+
+int ktimer_arm(ktimer_t* t, uint64_t deadline_ns)
+{
+    uint32_t fl = spin_lock_irqsave(&timer_lock);
+    if (t->heap_idx >= 0) heap_remove(t);
+    if (theap_count >= KTIMER_MAX) {
+        spin_unlock_irqrestore(&timer_lock, fl);
+        return -1;
+    }
+    t->deadline_ns = deadline_ns;
+    heap_place(theap_count++, t);
+    heap_sift_up(t->heap_idx);
+
+    int earliest = t->heap_idx == 0;
+    if (tickless && earliest && on_bsp()) deadline_program();
+    spin_unlock_irqrestore(&timer_lock, fl);
+
+    /* an AP cannot reach the BSP's LAPIC timer: let the BSP re-arm it */
+    if (tickless && earliest && !on_bsp())
+        lapic_send_ipi((uint8_t)bsp_apic_id, LAPIC_IPI_FIXED, SMP_DEADLINE_VECTOR);
+    return 0;
+}
+
+int ktimer_cancel(ktimer_t* t)
+{
+    uint32_t fl = spin_lock_irqsave(&timer_lock);
+    int armed = t->heap_idx >= 0;
+    if (armed) {
+        int was_first = t->heap_idx == 0;
+        heap_remove(t);
+        if (tickless && was_first && on_bsp()) deadline_program();
+    }
+    spin_unlock_irqrestore(&timer_lock, fl);
+    return armed;
+}
+
+/* Run every due callback outside the lock (callbacks may re-arm timers),
+ * then re-program the one-shot for what is left. */
+void timer_run_expired(void)
+{
+    uint64_t now = timer_now_ns();
+    for (;;) {
+        uint32_t fl = spin_lock_irqsave(&timer_lock);
+        if (theap_count == 0 || theap[0]->deadline_ns > now) {
+            if (tickless && on_bsp()) deadline_program();
+            spin_unlock_irqrestore(&timer_lock, fl);
+            return;
+        }
+        ktimer_t* t = theap[0];
+        heap_remove(t);
+        void (*fn)(void*) = t->fn;
+        void* arg = t->arg;
+        spin_unlock_irqrestore(&timer_lock, fl);
+        if (fn) fn(arg);
+    }
+}
+
+/* LAPIC deadline vector (BSP timer + re-arm IPI from APs) */
+void timer_deadline_handler(void);
+
+__attribute__((naked)) void timer_deadline_isr(void) {
+    asm volatile(
+        "pushal\n\t"
+        "cld\n\t"
+        "call timer_deadline_handler\n\t"
+        "popal\n\t"
+        "iretl\n\t"
+    );
+}
+
+void timer_deadline_handler(void)
+{
+    lapic_eoi();
+    timer_run_expired();
+}
+
+void timer_hires_init(void)
+{
+    if (!apic_is_active() || !hpet_is_active()) {
+        serial_printf("[TIMER] no APIC/HPET: deadlines run on PIT ticks\n");
+        return;
+    }
+    lapic_tpms = lapic_timer_calibrate();
+    if (!lapic_tpms) {
+        serial_printf("[TIMER] LAPIC timer not calibrated: deadlines run on PIT ticks\n");
+        return;
+    }
+    bsp_apic_id = lapic_get_id();
+    idt_set_gate(SMP_DEADLINE_VECTOR, (uint32_t)timer_deadline_isr, 0x08, 0x8E);
+
+    uint32_t fl = spin_lock_irqsave(&timer_lock);
+    ns_base = timer_now_ns();
+    hpet_base = hpet_time_ns();
+    tickless = 1;
+    // PIT devine redundant: mode 0 cu numărătoare maximă = o singură întrerupere, apoi tace
+    outb(0x43, 0x30);
+    outb(0x40, 0xFF);
+    outb(0x40, 0xFF);
+    deadline_program();
+    spin_unlock_irqrestore(&timer_lock, fl);
+
+    serial_printf("[TIMER] tickless: LAPIC one-shot deadlines (%u ticks/ms)\n", lapic_tpms);
+}
+
+/* ---- sleeping ---- */
+
+typedef struct {
+    volatile int done;
+    int tid;
+} sleeper_t;
+
+static void sleep_wake(void* arg)
+{
+    sleeper_t* s = (sleeper_t*)arg;
+    s->done = 1;
+    if (s->tid >= 0) scheduler_wake(s->tid, 0);
+}
+
+static inline int irqs_enabled(void)
+{
+    uint32_t fl;
+    asm volatile("pushfl\n\tpopl %0" : "=r"(fl));
+    return (fl & 0x200) != 0;
+}
+
+static void sleep_until(uint64_t deadline)
+{
+    if (!irqs_enabled()) {
+        /* nothing can wake us: poll HPET (PIT ticks would never advance) */
+        if (hpet_is_active()) {
+            uint64_t end = hpet_time_ns() + (deadline - timer_now_ns());
+            while (hpet_time_ns() < end) asm volatile("pause");
+        }
+        return;
+    }
+
+    pcb_t* cur = pcb_get_current();
+    sleeper_t s = { 0, cur ? (int)cur->tid : -1 };
+    ktimer_t t;
+    ktimer_init(&t, sleep_wake, &s);
+    if (ktimer_arm(&t, deadline) != 0) {
+        /* heap full: fall back to waiting for the clock */
+        while (timer_now_ns() < deadline) asm volatile("pause");
+        return;
+    }
+
+    /* scheduled task: block until the timer wakes us, the CPU runs others */
+    while (cur && !s.done) {
+        if (scheduler_block_until(&s.done) != 0) break;
+    }
+    if (s.done) return;
+
+    /* kernel_main / idle context: halt until the deadline interrupt */
+    s.tid = -1;
+    asm volatile("cli");
+    while (!s.done) asm volatile("sti\n\thlt\n\tcli");
+    asm volatile("sti");
+}
+
 void sleep(uint32_t ms)
 {
     if (tick_hz == 0) return;
+    sleep_until(timer_now_ns() + (uint64_t)ms * 1000000u);
+}
+
+void sleep_us(uint32_t us)
+{
+    if (tick_hz == 0) return;
+    sleep_until(timer_now_ns() + (uint64_t)us * 1000u);
+}
 
-    uint32_t wait_ticks = (ms * tick_hz) / 1000;
-    if (wait_ticks == 0) wait_ticks = 1;
+/* ---- idle ---- */
 
-    uint64_t start = timer_ticks();
+static void idle_wakeup(void* arg) { (void)arg; }
+static ktimer_t idle_timer = { 0, idle_wakeup, NULL, -1 };
 
-    while ((timer_ticks() - start) < wait_ticks) {
-        asm volatile("pause");
-    }
+/* Halt until the next interrupt. Tickless, nothing else wakes the CPU
+ * periodically, so max_ms bounds the nap for loops that poll devices. */
+void timer_idle(uint32_t max_ms)
+{
+    asm volatile("cli");
+    if (tickless && max_ms)
+        ktimer_arm(&idle_timer, timer_now_ns() + (uint64_t)max_ms * 1000000u);
+    asm volatile("sti\n\thlt"); /* sti shadow: no wake-up is lost before hlt */
 }
@@ -14,8 +14,32 @@ uint64_t timer_ticks(void);
 uint32_t timer_uptime_seconds(void);
 uint32_t timer_uptime_ms(void);
 
-/* sleep using PIT ticks */
+/* monotonic clock in ns (PIT ticks, HPET once tickless) */
+uint64_t timer_now_ns(void);
+
+/* One-shot kernel timers. fn runs in interrupt context once
+ * timer_now_ns() >= deadline_ns; the ktimer_t must stay valid while armed. */
+typedef struct ktimer {
+    uint64_t deadline_ns;
+    void (*fn)(void* arg);
+    void* arg;
+    int heap_idx;           /* -1 when not armed */
+} ktimer_t;
+
+void ktimer_init(ktimer_t* t, void (*fn)(void* arg), void* arg);
+int ktimer_arm(ktimer_t* t, uint64_t deadline_ns); /* re-arms; -1 if full */
+int ktimer_cancel(ktimer_t* t);                    /* 1 if it was armed */
+void timer_run_expired(void);
+
+/* after apic_init/hpet_init: LAPIC one-shot deadlines, PIT stopped */
+void timer_hires_init(void);
+
+/* sleep: blocks the calling task (other tasks run); halts outside tasks */
 void sleep(uint32_t ms);
+void sleep_us(uint32_t us);
+
+/* main loops: hlt until the next interrupt, at most max_ms (0 = no bound) */
+void timer_idle(uint32_t max_ms);
 
 #ifdef __cplusplus
 }
@@ -1,6 +1,7 @@
 #include "bmp.h"
-#include "../../cmds/fat.h" /* Pentru fat32_read_file */
-#include "../../mem/kmalloc.h"
+#include "../../fs/vfs/vfs.h"
+#include "../../fs/vfs/pcache.h"
+#include <stddef.h>
 
 /* Structuri BMP (packed) */
 typedef struct {
@@ -26,30 +27,39 @@ typedef struct {
 } __attribute__((packed)) BITMAPINFOHEADER;
 
 extern void serial(const char *fmt, ...);
-extern int fat32_read_file_offset(const char *path, void *buf, uint32_t size,
-                                  uint32_t offset);
-extern int fat32_read_file(const char *path, void *buf, uint32_t max_size);
 
 int fly_load_bmp_to_surface(surface_t *surf, const char *path) {
   if (!surf || !path)
     return -1;
 
-  /* 1. Alocăm un buffer temporar pentru a citi header-ul și a afla dimensiunea
-   */
-  /* Citim primii 54 bytes (FileHeader + InfoHeader standard) */
-  uint8_t header_buf[54];
-  if (fat32_read_file(path, header_buf, 54) < 54) {
+  /* 1. Mapăm fișierul din page cache: rândurile se citesc direct din
+   * paginile partajate, fără buffer propriu, iar o a doua încărcare a
+   * aceleiași imagini nu mai ajunge la disc */
+  vnode_t *node = vfs_resolve(path);
+  uint32_t mapSize = 0;
+  const uint8_t *map =
+      node ? (const uint8_t *)vfs_mmap(node, 0, 0, &mapSize) : NULL;
+  vnode_put(node);
+  if (!map) {
+    serial("[BMP] Error: Could not open %s\n", path);
+    return -1;
+  }
+
+  /* Primii 54 bytes (FileHeader + InfoHeader standard) */
+  if (mapSize < 54) {
     serial("[BMP] Error: Could not read BMP header for %s\n", path);
+    vfs_munmap((void *)map);
     return -1;
   }
 
-  BITMAPFILEHEADER *fileHeader = (BITMAPFILEHEADER *)header_buf;
-  BITMAPINFOHEADER *infoHeader =
-      (BITMAPINFOHEADER *)(header_buf + sizeof(BITMAPFILEHEADER));
+  const BITMAPFILEHEADER *fileHeader = (const BITMAPFILEHEADER *)map;
+  const BITMAPINFOHEADER *infoHeader =
+      (const BITMAPINFOHEADER *)(map + sizeof(BITMAPFILEHEADER));
 
   if (fileHeader->bfType != 0x4D42) { /* 'BM' */
     serial("[BMP] Error: Not a valid BMP file (Magic: %x)\n",
            fileHeader->bfType);
+    vfs_munmap((void *)map);
     return -1;
   }
 
@@ -64,31 +74,24 @@ int fly_load_bmp_to_surface(surface_t *surf, const char *path) {
 
   if (bpp != 24 && bpp != 32) {
     serial("[BMP] Error: Only 24 and 32 bpp BMPs are supported.\n");
+    vfs_munmap((void *)map);
     return -1;
   }
 
-  /* 2. Citim secvențial rând cu rând pentru a economisi memorie */
   /* Padding la 4 bytes per rând */
   int rowSize = ((width * bpp + 31) / 32) * 4;
-
-  uint8_t *rowBuffer = (uint8_t *)kmalloc(rowSize);
-  if (!rowBuffer) {
-    serial("[BMP] Error: Out of memory for row buffer.\n");
-    return -1;
-  }
+  int absHeight = (height > 0) ? height : -height;
 
   /* Iterăm prin rândurile imaginii (în fișier) */
   /* BMP stochează de obicei bottom-up. Rândul 0 din fișier este rândul de jos
    * al imaginii. */
-  int absHeight = (height > 0) ? height : -height;
-
   for (int i = 0; i < absHeight; i++) {
-    /* Citim rândul i din fișier */
     uint32_t filePos = dataOffset + i * rowSize;
-    if (fat32_read_file_offset(path, rowBuffer, rowSize, filePos) != rowSize) {
-      serial("[BMP] Error reading row %d\n", i);
+    if (filePos + rowSize > mapSize) {
+      serial("[BMP] Error reading rows %d..%d\n", i, absHeight - 1);
       break;
     }
+    const uint8_t *rowBuffer = map + filePos;
 
     /* Calculăm poziția pe ecran */
     /* Dacă height > 0 (bottom-up), rândul 0 din fișier este ultimul rând de pe
@@ -102,7 +105,7 @@ int fly_load_bmp_to_surface(surface_t *surf, const char *path) {
       if (x >= (int)surf->width)
         break;
 
-      uint8_t *px = rowBuffer + (x * (bpp / 8));
+      const uint8_t *px = rowBuffer + (x * (bpp / 8));
       uint32_t color = 0;
 
       if (bpp == 24) {
@@ -127,7 +130,7 @@ int fly_load_bmp_to_surface(surface_t *surf, const char *path) {
     }
   }
 
-  kfree(rowBuffer);
+  vfs_munmap((void *)map);
   return 0;
 }
 
@@ -135,8 +138,13 @@ surface_t *fly_load_bmp(const char *path) {
   if (!path)
     return NULL;
 
+  /* antetul vine din page cache; fly_load_bmp_to_surface() mapează apoi
+   * aceleași pagini */
   uint8_t header_buf[54];
-  if (fat32_read_file(path, header_buf, 54) < 54) {
+  vnode_t *node = vfs_resolve(path);
+  int got = node ? vfs_read(node, 0, header_buf, 54) : -1;
+  vnode_put(node);
+  if (got < 54) {
     return NULL;
   }
 
@@ -0,0 +1,137 @@
+#!/bin/sh
+# tools/bench/blkbench.sh
+# Host side of the in-guest `blkbench` command. Boots chrysalis.iso in QEMU
+# with a scratch disk on the chosen controller, types blkbench command lines
+# into the shell through the QEMU monitor (sendkey) and keeps the BLKBENCH
+# result lines the kernel logs on serial, so numbers can be compared across
+# driver changes (ATA PIO / bus-master IDE / AHCI, cache on/off). On ide the
+# default runs include PIO ones (blkbench's pio option), so PIO and
+# bus-master DMA are measured on the same disk.
+#
+# Run from os/ after `make iso`:
+#   ../tools/bench/blkbench.sh [ide|ahci] ["blkbench args"]...
+#   make blk-bench BLKBENCH_CTRL=ahci
+# Each quoted argument is one run; the device name is added in front.
+# Environment: QEMU, ISO, DISK (scratch image, created if missing),
+#              BOOT_WAIT (seconds before typing), RUN_WAIT (seconds per run)
+# Needs socat. The scratch disk is overwritten by the write workloads (from
+# blkbench's default offset=1m on; sector 0 is never written).
+
+set -u
+
+CTRL=${1:-ide}
+[ $# -gt 0 ] && shift
+
+QEMU=${QEMU:-qemu-system-i386}
+ISO=${ISO:-chrysalis.iso}
+DISK=${DISK:-blkbench.img}
+BOOT_WAIT=${BOOT_WAIT:-25}
+RUN_WAIT=${RUN_WAIT:-300}
+
+case "$CTRL" in
+ide)
+    DEV=ata0
+    DRIVE="-drive file=$DISK,format=raw,if=ide"
+    ;;
+ahci)
+    DEV=ahci0
+    DRIVE="-drive file=$DISK,format=raw,if=none,id=disk0 -device ahci,id=ahci -device ide-hd,drive=disk0,bus=ahci.0"
+    ;;
+*)
+    echo "usage: $0 [ide|ahci] [\"blkbench args\"]..." >&2
+    exit 1
+    ;;
+esac
+
+if [ $# -eq 0 ]; then
+    set -- "rw=all bs=4k iodepth=1 size=64m force" \
+           "rw=randread bs=4k iodepth=8 size=64m" \
+           "rw=read bs=128k iodepth=4 size=64m" \
+           "rw=randread bs=4k iodepth=1 size=64m cache=on"
+    [ "$CTRL" = ide ] && set -- "$@" \
+           "rw=randread bs=4k iodepth=1 size=64m pio" \
+           "rw=read bs=128k iodepth=4 size=64m pio"
+fi
+
+command -v socat >/dev/null 2>&1 || { echo "blkbench.sh: socat is required" >&2; exit 1; }
+[ -f "$ISO" ] || { echo "blkbench.sh: $ISO not found (make iso)" >&2; exit 1; }
+[ -f "$DISK" ] || dd if=/dev/zero of="$DISK" bs=1M count=1024 status=none
+
+STAMP=$(date +%Y%m%d-%H%M%S)
+mkdir -p logs
+LOG=logs/blkbench-$CTRL-$STAMP.serial.log
+OUT=logs/blkbench-$CTRL-$STAMP.txt
+MON=$(mktemp -u /tmp/blkbench-mon.XXXXXX)
+
+monitor() {
+    printf '%s\n' "$1" | socat - "UNIX-CONNECT:$MON" >/dev/null
+}
+
+key() {
+    case "$1" in
+    [a-z0-9]) echo "$1" ;;
+    ' ') echo spc ;;
+    '=') echo equal ;;
+    '-') echo minus ;;
+    '.') echo dot ;;
+    ',') echo comma ;;
+    '/') echo slash ;;
+    *) echo "blkbench.sh: cannot type '$1'" >&2; return 1 ;;
+    esac
+}
+
+type_line() {
+    rest=$1
+    while [ -n "$rest" ]; do
+        c=$(printf '%s' "$rest" | cut -c1)
+        rest=$(printf '%s' "$rest" | cut -c2-)
+        k=$(key "$c") || return 1
+        monitor "sendkey $k"
+    done
+    monitor "sendkey ret"
+}
+
+results() {
+    grep -c '^BLKBENCH' "$LOG" 2>/dev/null || true
+}
+
+# shellcheck disable=SC2086
+"$QEMU" -m 512 -smp 2 -boot order=d -cdrom "$ISO" $DRIVE \
+    -serial "file:$LOG" -monitor "unix:$MON,server,nowait" -display none &
+QPID=$!
+trap 'kill $QPID 2>/dev/null; rm -f "$MON"' EXIT INT TERM
+
+echo "blkbench.sh: $CTRL ($DEV), booting, serial log in $LOG"
+sleep "$BOOT_WAIT"
+
+for args in "$@"; do
+    case "$args" in
+    *rw=all*) want=4 ;;
+    *) want=1 ;;
+    esac
+    have=$(results)
+    echo "blkbench.sh: blkbench $DEV $args"
+    type_line "blkbench $DEV $args" || exit 1
+    waited=0
+    while [ "$(results)" -lt $((have + want)) ] && [ $waited -lt "$RUN_WAIT" ]; do
+        sleep 1
+        waited=$((waited + 1))
+    done
+    [ $waited -ge "$RUN_WAIT" ] && echo "blkbench.sh: no result after ${RUN_WAIT}s" >&2
+done
+
+monitor "quit" 2>/dev/null
+
+grep '^BLKBENCH' "$LOG" | tr -d '\r' > "$OUT"
+awk -v ctrl="$CTRL" '
+    BEGIN {
+        printf "%-5s %-6s %-9s %7s %3s %-5s %-4s %8s %8s %8s %8s %8s\n", "ctrl", "dev", "rw",
+               "bs", "qd", "cache", "pio", "iops", "MB/s", "p50 us", "p99 us", "max us"
+    }
+    {
+        for (i = 2; i <= NF; i++) { split($i, kv, "="); f[kv[1]] = kv[2] }
+        printf "%-5s %-6s %-9s %7s %3s %-5s %-4s %8s %8.1f %8s %8s %8s\n", ctrl, f["dev"], f["rw"],
+               f["bs"], f["qd"], f["cache"], f["pio"], f["iops"], f["kbps"] / 1024, f["p50"],
+               f["p99"], f["max"]
+    }' "$OUT"
+echo "blkbench.sh: results in $OUT"
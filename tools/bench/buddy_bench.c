@@ -0,0 +1,104 @@
+/* tools/bench/buddy_bench.c
+   Host-side stress benchmark for kernel/mem/buddy.c.
+   Build & run (from os/):  make buddy-bench
+   or by hand:
+     cc -O2 -I../os/kernel/mem buddy_bench.c ../os/kernel/mem/buddy.c -o buddy_bench
+   Usage: buddy_bench [ops] [region_mb] [live_blocks]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "buddy.h"
+
+/* buddy.c references the linker heap bounds; the bench binds its own region */
+uint8_t __heap_start;
+uint8_t __heap_end;
+
+#define PAGE_SIZE 4096u
+
+typedef struct {
+    void* ptr;
+    int order;
+} slot_t;
+
+static uint32_t rng_state = 0x12345678u;
+static uint32_t rng(void) {
+    /* xorshift32: deterministic across hosts */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* mostly single pages, a tail of larger blocks */
+static int pick_order(void) {
+    uint32_t r = rng() % 100;
+    if (r < 60) return 0;
+    if (r < 80) return 1;
+    if (r < 90) return 2;
+    if (r < 96) return 3 + (int)(rng() % 3);
+    return 6 + (int)(rng() % 4);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report(const char* tag) {
+    buddy_stats_t st;
+    buddy_get_stats(&st);
+    printf("%-8s free %6u / %6u pages, largest order %2d, fragmentation %3u%%\n",
+           tag, st.free_pages, st.total_pages, st.largest_order, st.frag_percent);
+}
+
+int main(int argc, char** argv) {
+    unsigned long ops = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000ul;
+    unsigned region_mb = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 64u;
+    unsigned live = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 0) : 4096u;
+
+    uint32_t pages = (uint32_t)(((uint64_t)region_mb << 20) / PAGE_SIZE);
+    void* region = aligned_alloc(PAGE_SIZE, (size_t)pages * PAGE_SIZE);
+    slot_t* slots = calloc(live, sizeof(slot_t));
+    if (!region || !slots) {
+        fprintf(stderr, "out of host memory\n");
+        return 1;
+    }
+
+    buddy_init_region(region, pages);
+    report("init");
+
+    unsigned long allocs = 0, frees = 0, failures = 0;
+    double t0 = now_sec();
+    for (unsigned long i = 0; i < ops; ++i) {
+        slot_t* s = &slots[rng() % live];
+        if (s->ptr) {
+            buddy_free_page(s->ptr, s->order);
+            s->ptr = NULL;
+            frees++;
+        } else {
+            s->order = pick_order();
+            s->ptr = buddy_alloc_page(s->order);
+            if (s->ptr) allocs++;
+            else failures++;
+        }
+    }
+    double dt = now_sec() - t0;
+    report("steady");
+
+    for (unsigned i = 0; i < live; ++i) {
+        if (slots[i].ptr) buddy_free_page(slots[i].ptr, slots[i].order);
+    }
+    report("drained");
+
+    printf("%lu ops in %.3f s: %.2f M ops/s (%lu allocs, %lu frees, %lu failed)\n",
+           ops, dt, (double)ops / dt / 1e6, allocs, frees, failures);
+
+    free(slots);
+    free(region);
+    return 0;
+}